@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#define DEVICE "/dev/ioctl_example"
+
+#define MY_IOCTL_MAGIC 'M'
+#define UPLOAD_PINNED _IOWR(MY_IOCTL_MAGIC, 3, struct upload_desc)
+#define UPLOAD_COPY   _IOWR(MY_IOCTL_MAGIC, 4, struct upload_desc)
+
+#define MIN_SIZE (4u << 10)
+#define MAX_SIZE (64u << 20)
+
+struct upload_desc {
+    uint64_t addr;
+    uint64_t len;
+    uint32_t crc;
+    uint32_t pad;
+};
+
+/*
+ * Usage: ./bench_upload [total_MiB]
+ * Uploads total_MiB (default 1024) at each size from 4 KiB to 64 MiB, once
+ * through UPLOAD_COPY (chunked copy_from_user) and once through
+ * UPLOAD_PINNED (pinned pages, read in place), and prints GB/s for both.
+ * The two CRCs the kernel returns must match.
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double run(int fd, unsigned long cmd, char *buf, size_t size, uint64_t total,
+                  uint32_t *crc)
+{
+    struct upload_desc desc = { .addr = (uintptr_t)buf, .len = size };
+    uint64_t done = 0, t0 = now_ns();
+
+    do {
+        if (ioctl(fd, cmd, &desc)) {
+            perror("ioctl");
+            exit(EXIT_FAILURE);
+        }
+        done += size;
+    } while (done < total);
+    *crc = desc.crc;
+    return (double)done / (now_ns() - t0);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t total = (argc > 1 ? strtoull(argv[1], NULL, 0) : 1024) << 20;
+    uint32_t crc_copy, crc_pinned;
+    double copy, pinned;
+    char *buf;
+    size_t size, i;
+    int fd;
+
+    fd = open(DEVICE, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    buf = malloc(MAX_SIZE);
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < MAX_SIZE; i++)      // also faults every page in before timing
+        buf[i] = rand();
+
+    printf("%10s %10s %10s %8s   (GB/s)\n", "size", "copy", "pinned", "speedup");
+    for (size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+        copy = run(fd, UPLOAD_COPY, buf, size, total, &crc_copy);
+        pinned = run(fd, UPLOAD_PINNED, buf, size, total, &crc_pinned);
+        printf("%9zuK %10.2f %10.2f %7.2fx%s\n", size >> 10, copy, pinned, pinned / copy,
+               crc_copy == crc_pinned ? "" : "   CRC MISMATCH");
+        if (crc_copy != crc_pinned)
+            return 1;
+    }
+
+    free(buf);
+    close(fd);
+    return 0;
+}
@@ -3,6 +3,12 @@
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 #include <linux/ioctl.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/scatterlist.h>
+#include <linux/crc32.h>
+#include "../../common/devstats.h"
 
 #define DEVICE_NAME "ioctl_example"
 #define MY_IOCTL_MAGIC 'M'
@@ -16,16 +22,144 @@
 
 //This IOCTL command means user-space will pass a struct mystruct to the kernel driver.
 #define GREETER    _IOW(MY_IOCTL_MAGIC, 2, struct mystruct) 
+
+//These two take a struct upload_desc: a user buffer that the kernel consumes in full.
+//UPLOAD_PINNED reads it in place through pinned pages, UPLOAD_COPY copies it in chunks.
+#define UPLOAD_PINNED _IOWR(MY_IOCTL_MAGIC, 3, struct upload_desc)
+#define UPLOAD_COPY   _IOWR(MY_IOCTL_MAGIC, 4, struct upload_desc)
+
+#define UPLOAD_MAX   (256u << 20)   // longest buffer one call may pin
+#define COPY_CHUNK   (64u << 10)    // bounce buffer of UPLOAD_COPY
 int32_t answer = 42;  // Global variable for reading/writing
 
+// Per-CPU counters of every ioctl, mapped by /dev/devstats/ioctl_example
+static const char *const stat_channels[] = { "ioctl" };
+static struct devstats stats;
+
 //below is the structure which i want to pass from user space to kernel space
 struct mystruct {
     int repeat;
     char name[32];
 };
 
+//Descriptor of a bulk upload. The kernel fills in crc (crc32 of the buffer)
+//to show it has seen every byte.
+struct upload_desc {
+    __u64 addr;
+    __u64 len;
+    __u32 crc;
+    __u32 pad;
+};
+
+// -------- bulk upload --------
+/*
+upload_pinned
+-------------
+Pins the user pages, describes them with a scatterlist and reads the data
+where it lies. No byte is copied into the kernel, so the only cost per page
+is the pin itself; at megabyte sizes that is far cheaper than copy_from_user
+moving every byte through the cache a second time.
+*/
+static int upload_pinned(u64 addr, u64 len, u32 *crc)
+{
+    unsigned long first = addr & PAGE_MASK;
+    int nr_pages = (PAGE_ALIGN(addr + len) - first) >> PAGE_SHIFT;
+    struct sg_mapping_iter miter;
+    struct sg_table sgt;
+    struct page **pages;
+    int pinned = 0, n, ret;
+
+    pages = kvmalloc_array(nr_pages, sizeof(*pages), GFP_KERNEL);
+    if (!pages)
+        return -ENOMEM;
+
+    // Read-only pin: the device never writes into the caller's buffer
+    while (pinned < nr_pages) {
+        n = pin_user_pages_fast(first + ((unsigned long)pinned << PAGE_SHIFT),
+                                nr_pages - pinned, 0, pages + pinned);
+        if (n <= 0) {
+            ret = n ? n : -EFAULT;
+            goto out_unpin;
+        }
+        pinned += n;
+    }
+
+    ret = sg_alloc_table_from_pages(&sgt, pages, nr_pages, offset_in_page(addr),
+                                    len, GFP_KERNEL);
+    if (ret)
+        goto out_unpin;
+
+    *crc = ~0u;
+    sg_miter_start(&miter, sgt.sgl, sgt.orig_nents, SG_MITER_FROM_SG);
+    while (sg_miter_next(&miter)) {
+        *crc = crc32_le(*crc, miter.addr, miter.length);
+        cond_resched();
+    }
+    sg_miter_stop(&miter);
+    *crc = ~*crc;
+
+    sg_free_table(&sgt);
+out_unpin:
+    unpin_user_pages(pages, pinned);
+    kvfree(pages);
+    return ret;
+}
+
+// The classic path for comparison: copy_from_user into a bounce buffer, chunk by chunk
+static int upload_copy(u64 addr, u64 len, u32 *crc)
+{
+    void __user *src = u64_to_user_ptr(addr);
+    size_t n;
+    void *buf;
+    int ret = 0;
+
+    buf = kmalloc(COPY_CHUNK, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    *crc = ~0u;
+    while (len) {
+        n = min_t(u64, len, COPY_CHUNK);
+        if (copy_from_user(buf, src, n)) {
+            ret = -EFAULT;
+            break;
+        }
+        *crc = crc32_le(*crc, buf, n);
+        src += n;
+        len -= n;
+        cond_resched();
+    }
+    *crc = ~*crc;
+
+    kfree(buf);
+    return ret;
+}
+
+static long do_upload(unsigned int cmd, unsigned long arg, size_t *moved)
+{
+    struct upload_desc desc;
+    int ret;
+
+    if (copy_from_user(&desc, (void __user *)arg, sizeof(desc)))
+        return -EFAULT;
+    if (!desc.len || desc.len > UPLOAD_MAX || desc.addr + desc.len < desc.addr)
+        return -EINVAL;
+
+    if (cmd == UPLOAD_PINNED)
+        ret = upload_pinned(desc.addr, desc.len, &desc.crc);
+    else
+        ret = upload_copy(desc.addr, desc.len, &desc.crc);
+    if (ret)
+        return ret;
+
+    *moved = desc.len;
+    if (copy_to_user((void __user *)arg, &desc, sizeof(desc)))
+        return -EFAULT;
+    return 0;
+}
+
 // -------- ioctl handler --------
-static long my_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+static long my_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg, size_t *moved) {
     struct mystruct test;
 
     switch (cmd) {
@@ -62,12 +196,28 @@ static long my_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
         printk(KERN_INFO "ioctl_example: %d greets to %s\n", test.repeat, test.name);
         break;
 
+    // Bulk uploads log nothing: they run millions of times in the benchmark
+    case UPLOAD_PINNED:
+    case UPLOAD_COPY:
+        return do_upload(cmd, arg, moved);
+
     default:
         return -EINVAL;
     }
     return 0;
 }
 
+// Timed wrapper: the payload size of a successful command counts as bytes,
+// for an upload that is the length of the whole user buffer
+static long my_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    u64 t0 = ktime_get_ns();
+    size_t moved = _IOC_SIZE(cmd);
+    long ret = my_do_ioctl(file, cmd, arg, &moved);
+
+    devstats_end(&stats, 0, t0, ret ? ret : moved);
+    return ret;
+}
+
 // -------- File ops --------
 static int my_open(struct inode *inode, struct file *file) {
     printk(KERN_INFO "ioctl_example: device opened\n");
@@ -88,6 +238,11 @@ static struct file_operations fops = {
 
 static int major;
 static int __init ioctl_init(void) {
+    int ret = devstats_register(&stats, DEVICE_NAME, stat_channels, ARRAY_SIZE(stat_channels));
+
+    if (ret)
+        return ret;
+
     //in the function register_chrdev, we are registering our device with the kernel
     //0 means we want the kernel to allocate a major number dynamically     if we pass a specific major number, the kernel will try to use that number and 
     // best practice is to pass 0 and let the kernel allocate a free major number for us.
@@ -95,6 +250,7 @@ static int __init ioctl_init(void) {
     major = register_chrdev(0, DEVICE_NAME, &fops);
     if (major < 0) {
         printk(KERN_ERR "ioctl_example: failed to register device\n");
+        devstats_unregister(&stats);
         return major;
     }
     printk(KERN_INFO "ioctl_example: module loaded, major = %d\n", major);
@@ -103,6 +259,7 @@ static int __init ioctl_init(void) {
 }
 static void __exit ioctl_exit(void) {
     unregister_chrdev(major, DEVICE_NAME);
+    devstats_unregister(&stats);
     printk(KERN_INFO "ioctl_example: module unloaded\n");
 }
 
@@ -0,0 +1,153 @@
+// KUnit suites of ioctl_example's commands and bulk uploads (see ../../common/ktest.h)
+#include "ioctl_example.c"
+#include "../../common/ktest.h"
+
+#define TEST_UPLOAD (3 * PAGE_SIZE + 100)
+
+// ioctls counted on the stats page, all CPUs
+static u64 ioctl_ops(void)
+{
+    u64 ops = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        ops += devstats_slot(&stats, cpu)->ops;
+    return ops;
+}
+
+static void ioctl_value_test(struct kunit *test)
+{
+    int32_t __user *uval = ktest_user_buf(test, sizeof(int32_t));
+    u64 ops = ioctl_ops();
+    int32_t v = -1234;
+
+    KUNIT_ASSERT_EQ(test, put_user(v, uval), 0);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, WR_VALUE, (unsigned long)uval), 0);
+    KUNIT_EXPECT_EQ(test, answer, -1234);
+
+    answer = 77;
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, RD_VALUE, (unsigned long)uval), 0);
+    KUNIT_ASSERT_EQ(test, get_user(v, uval), 0);
+    KUNIT_EXPECT_EQ(test, v, 77);
+    KUNIT_EXPECT_EQ(test, ioctl_ops(), ops + 2);
+    answer = 42;
+}
+
+static void ioctl_greeter_test(struct kunit *test)
+{
+    struct mystruct __user *us = ktest_user_buf(test, sizeof(*us));
+    struct mystruct s = { .repeat = 3, .name = "kunit" };
+
+    KUNIT_ASSERT_EQ(test, copy_to_user(us, &s, sizeof(s)), 0);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, GREETER, (unsigned long)us), 0);
+}
+
+static void ioctl_bad_test(struct kunit *test)
+{
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, _IO(MY_IOCTL_MAGIC, 9), 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, WR_VALUE, 0), -EFAULT);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, RD_VALUE, 0), -EFAULT);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, GREETER, 0), -EFAULT);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, UPLOAD_COPY, 0), -EFAULT);
+}
+
+// Both upload paths see every byte of an unaligned buffer, and agree
+static void ioctl_upload_test(struct kunit *test)
+{
+    struct upload_desc __user *udesc = ktest_user_buf(test, sizeof(*udesc));
+    u8 __user *ubuf = ktest_user_buf(test, TEST_UPLOAD + PAGE_SIZE);
+    unsigned int cmds[] = { UPLOAD_PINNED, UPLOAD_COPY };
+    struct upload_desc desc;
+    u8 *data;
+    u32 want;
+    int i;
+
+    data = kunit_kmalloc(test, TEST_UPLOAD, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, data);
+    for (i = 0; i < TEST_UPLOAD; i++)
+        data[i] = i * 31 + 7;
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf + 13, data, TEST_UPLOAD), 0);
+    want = ~crc32_le(~0u, data, TEST_UPLOAD);
+
+    for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+        desc = (struct upload_desc){ .addr = (unsigned long)(ubuf + 13), .len = TEST_UPLOAD };
+        KUNIT_ASSERT_EQ(test, copy_to_user(udesc, &desc, sizeof(desc)), 0);
+        KUNIT_ASSERT_EQ(test, my_ioctl(NULL, cmds[i], (unsigned long)udesc), 0);
+        KUNIT_ASSERT_EQ(test, copy_from_user(&desc, udesc, sizeof(desc)), 0);
+        KUNIT_EXPECT_EQ_MSG(test, desc.crc, want, "cmd %d", i);
+    }
+}
+
+static void ioctl_upload_bad_test(struct kunit *test)
+{
+    struct upload_desc __user *udesc = ktest_user_buf(test, sizeof(*udesc));
+    struct upload_desc bad[] = {
+        { .addr = 4096, .len = 0 },
+        { .addr = 4096, .len = UPLOAD_MAX + 1 },
+        { .addr = -4096ULL, .len = 8192 },      // wraps
+        { .addr = 4096, .len = 4096 },          // not mapped
+    };
+    long want[] = { -EINVAL, -EINVAL, -EINVAL, -EFAULT };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(bad); i++) {
+        KUNIT_ASSERT_EQ(test, copy_to_user(udesc, &bad[i], sizeof(bad[i])), 0);
+        KUNIT_EXPECT_EQ_MSG(test, my_ioctl(NULL, UPLOAD_COPY, (unsigned long)udesc), want[i],
+                            "copy, case %d", i);
+        KUNIT_EXPECT_EQ_MSG(test, my_ioctl(NULL, UPLOAD_PINNED, (unsigned long)udesc), want[i],
+                            "pinned, case %d", i);
+    }
+}
+
+static struct kunit_case ioctl_cases[] = {
+    KUNIT_CASE(ioctl_value_test),
+    KUNIT_CASE(ioctl_greeter_test),
+    KUNIT_CASE(ioctl_bad_test),
+    KUNIT_CASE(ioctl_upload_test),
+    KUNIT_CASE(ioctl_upload_bad_test),
+    {}
+};
+
+static struct kunit_suite ioctl_suite = {
+    .name = "ioctl_example",
+    .test_cases = ioctl_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+// RD_VALUE logs a line per call, so this mostly times printk into the log buffer
+static void ioctl_value_bench(struct kunit *test)
+{
+    int32_t __user *uval = ktest_user_buf(test, sizeof(int32_t));
+
+    ktest_bench(test, "RD_VALUE", my_ioctl(NULL, RD_VALUE, (unsigned long)uval));
+}
+
+// 1 MiB per call: the size where pinning is meant to win
+static void ioctl_upload_bench(struct kunit *test)
+{
+    struct upload_desc __user *udesc = ktest_user_buf(test, sizeof(*udesc));
+    u8 __user *ubuf = ktest_user_buf(test, SZ_1M);
+    struct upload_desc desc = { .addr = (unsigned long)ubuf, .len = SZ_1M };
+
+    // Fault the buffer in first, or the first round times page faults
+    KUNIT_ASSERT_EQ(test, clear_user(ubuf, SZ_1M), 0);
+    KUNIT_ASSERT_EQ(test, copy_to_user(udesc, &desc, sizeof(desc)), 0);
+    ktest_bench_n(test, "UPLOAD_PINNED 1M", bench_iters >> 10,
+                  my_ioctl(NULL, UPLOAD_PINNED, (unsigned long)udesc));
+    ktest_bench_n(test, "UPLOAD_COPY 1M", bench_iters >> 10,
+                  my_ioctl(NULL, UPLOAD_COPY, (unsigned long)udesc));
+}
+
+static struct kunit_case ioctl_bench_cases[] = {
+    KUNIT_CASE_SLOW(ioctl_value_bench),
+    KUNIT_CASE_SLOW(ioctl_upload_bench),
+    {}
+};
+
+static struct kunit_suite ioctl_bench_suite = {
+    .name = "ioctl_example_bench",
+    .test_cases = ioctl_bench_cases,
+};
+
+kunit_test_suites(&ioctl_suite, &ioctl_bench_suite);
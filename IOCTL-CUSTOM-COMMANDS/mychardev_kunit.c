@@ -0,0 +1,59 @@
+// KUnit suites of mychardev's ioctl commands (see ../common/ktest.h)
+#include "mychardev.c"
+#include "../common/ktest.h"
+
+// The commands take no argument and never look at the file
+static void mychardev_ioctl_test(struct kunit *test)
+{
+    counter = 0;
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, IOCTL_CMD_INCREMENT, 0), 0);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, IOCTL_CMD_INCREMENT, 0), 0);
+    KUNIT_EXPECT_EQ(test, counter, 2);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, IOCTL_CMD_DECREMENT, 0), 0);
+    KUNIT_EXPECT_EQ(test, counter, 1);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, IOCTL_CMD_DECREMENT, 0), 0);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, IOCTL_CMD_DECREMENT, 0), 0);
+    KUNIT_EXPECT_EQ(test, counter, -1);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, IOCTL_CMD_RESET, 0), 0);
+    KUNIT_EXPECT_EQ(test, counter, 0);
+}
+
+static void mychardev_unknown_test(struct kunit *test)
+{
+    counter = 5;
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, _IO(MY_IOCTL_MAGIC, 3), 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, my_ioctl(NULL, _IO('X', 0), 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, counter, 5);
+}
+
+static struct kunit_case mychardev_cases[] = {
+    KUNIT_CASE(mychardev_ioctl_test),
+    KUNIT_CASE(mychardev_unknown_test),
+    {}
+};
+
+static struct kunit_suite mychardev_suite = {
+    .name = "mychardev",
+    .test_cases = mychardev_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+// Every command logs a line, so this mostly times printk into the log buffer
+static void mychardev_ioctl_bench(struct kunit *test)
+{
+    ktest_bench(test, "increment", my_ioctl(NULL, IOCTL_CMD_INCREMENT, 0));
+    ktest_bench(test, "unknown", my_ioctl(NULL, _IO('X', 0), 0));
+}
+
+static struct kunit_case mychardev_bench_cases[] = {
+    KUNIT_CASE_SLOW(mychardev_ioctl_bench),
+    {}
+};
+
+static struct kunit_suite mychardev_bench_suite = {
+    .name = "mychardev_bench",
+    .test_cases = mychardev_bench_cases,
+};
+
+kunit_test_suites(&mychardev_suite, &mychardev_bench_suite);
@@ -3,6 +3,20 @@
 #include <linux/kthread.h>   // for kthread functions
 #include <linux/sched.h>     // for task_struct
 #include <linux/delay.h>     // for msleep()
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/cpumask.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/llist.h>
+#include <linux/kfifo.h>
+#include <linux/log2.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/perf_event.h>
+#include <linux/math64.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Tutorial Example");
@@ -15,12 +29,16 @@ The kthread_create function creates a thread but does not start it immediately.
 To start the thread, we need to call wake_up_process on the returned task_struct pointer.
 The kthread_run function combines these two steps: it creates and starts the thread in one call
 Global variables for threads
-*/ 
+*/
 static struct task_struct *kthread1;
 static struct task_struct *kthread2;
 static int t1 = 1;
 static int t2 = 2;
 
+static bool demo = true;
+module_param(demo, bool, 0444);
+MODULE_PARM_DESC(demo, "Start the two logging threads of the example (default on; off for quiet benchmarks)");
+
 // Function executed by each thread
 static int thread_function(void *thread_number)
 {
@@ -36,33 +54,846 @@ static int thread_function(void *thread_number)
     return 0;
 }
 
+/* ---------- queue benchmark ---------- */
+/*
+The same thread API drives a benchmark of the queues a driver hot path
+might use. N producer and M consumer kthreads are created with
+kthread_create(), bound to chosen CPUs with kthread_bind() and then
+woken together - the first way above, because a thread can only be
+bound before it first runs. Producers push timestamped messages through
+one of the interchangeable queues below; consumers pop them until every
+producer is done and the queue is empty.
+
+Everything is driven from /sys/kernel/debug/kfret/:
+  queue       the implementation to use; reading lists them all
+  producers   N (1..64)                consumers   M (1..64)
+  messages    messages per producer    capacity    queue slots, power of two
+  cpus        CPU list the threads are bound to, round robin:
+              producers first, then consumers (default: all online)
+  run         write anything: runs one benchmark, returns when it ends
+  results     the last run: throughput, latency percentiles, cache misses
+
+A full queue makes a producer retry, an empty one makes a consumer retry;
+both spin, yielding now and then, so what is measured is the queue and
+not the scheduler.
+*/
+#define KFRET_MAX_THREADS   64          // of each kind
+#define HIST_SUB_BITS       4           // 16 linear steps per power of two: ~6% resolution
+#define HIST_BUCKETS        ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+struct kfret_msg {
+    u64 t_ns;           // when the producer started pushing it
+    u32 producer;
+    u32 seq;
+};
+
+// List-based queues move nodes; each producer owns a pool of them
+struct kfret_node {
+    struct list_head list;
+    struct llist_node ll;   // llist queue, and the owner's free list
+    struct kfret_thread *owner;
+    struct kfret_msg m;
+};
+
+struct kfret_thread {
+    struct task_struct *task;
+    int cpu;
+    bool producer;
+    u32 id;
+    u64 ops;                    // messages pushed / popped
+    u64 retries;                // pushes that found the queue full / pops that found it empty
+    u64 end_ns;
+    s64 cache_misses;           // -1: no perf counter
+    struct llist_head free;     // producer: nodes given back by consumers
+    struct llist_node *cache;   // producer: free nodes taken in one go
+    struct llist_node *batch;   // llist consumer: nodes taken in one go, oldest first
+    struct kfret_node *nodes;
+    u64 hist_op[HIST_BUCKETS];  // push or pop duration
+    u64 hist_lat[HIST_BUCKETS]; // consumer: push start to pop end
+} ____cacheline_aligned;
+
+struct kfret_queue {
+    const char *name;
+    bool single_consumer;
+    bool nodes;                 // needs producer node pools
+    int  (*init)(unsigned int capacity);
+    void (*destroy)(void);
+    bool (*push)(struct kfret_thread *t, const struct kfret_msg *m);   // false: full
+    bool (*pop)(struct kfret_thread *t, struct kfret_msg *m);          // false: empty
+};
+
+/* node pools */
+static struct kfret_node *node_get(struct kfret_thread *t)
+{
+    struct kfret_node *n;
+
+    if (!t->cache)
+        t->cache = llist_del_all(&t->free);
+    if (!t->cache)
+        return NULL;    // every node is in flight: the queue is full for us
+    n = llist_entry(t->cache, struct kfret_node, ll);
+    t->cache = t->cache->next;
+    return n;
+}
+
+static void node_put(struct kfret_node *n)
+{
+    llist_add(&n->ll, &n->owner->free);
+}
+
+/* spinlock + list_head */
+static LIST_HEAD(lq_head);
+static DEFINE_SPINLOCK(lq_lock);
+
+static int lq_init(unsigned int capacity)
+{
+    INIT_LIST_HEAD(&lq_head);
+    return 0;
+}
+
+static void lq_destroy(void)
+{
+}
+
+static bool lq_push(struct kfret_thread *t, const struct kfret_msg *m)
+{
+    struct kfret_node *n = node_get(t);
+
+    if (!n)
+        return false;
+    n->m = *m;
+    spin_lock(&lq_lock);
+    list_add_tail(&n->list, &lq_head);
+    spin_unlock(&lq_lock);
+    return true;
+}
+
+static bool lq_pop(struct kfret_thread *t, struct kfret_msg *m)
+{
+    struct kfret_node *n;
+
+    spin_lock(&lq_lock);
+    n = list_first_entry_or_null(&lq_head, struct kfret_node, list);
+    if (n)
+        list_del(&n->list);
+    spin_unlock(&lq_lock);
+    if (!n)
+        return false;
+    *m = n->m;
+    node_put(n);
+    return true;
+}
+
+/* kfifo, one lock per side */
+static DECLARE_KFIFO_PTR(kq, struct kfret_msg);
+static DEFINE_SPINLOCK(kq_in_lock);
+static DEFINE_SPINLOCK(kq_out_lock);
+
+static int kq_init(unsigned int capacity)
+{
+    return kfifo_alloc(&kq, capacity, GFP_KERNEL);
+}
+
+static void kq_destroy(void)
+{
+    kfifo_free(&kq);
+}
+
+static bool kq_push(struct kfret_thread *t, const struct kfret_msg *m)
+{
+    return kfifo_in_spinlocked(&kq, m, 1, &kq_in_lock);
+}
+
+static bool kq_pop(struct kfret_thread *t, struct kfret_msg *m)
+{
+    return kfifo_out_spinlocked(&kq, m, 1, &kq_out_lock);
+}
+
+/* llist: lock-free multi-producer, single consumer */
+static LLIST_HEAD(llq);
+
+static int llq_init(unsigned int capacity)
+{
+    init_llist_head(&llq);
+    return 0;
+}
+
+static void llq_destroy(void)
+{
+}
+
+static bool llq_push(struct kfret_thread *t, const struct kfret_msg *m)
+{
+    struct kfret_node *n = node_get(t);
+
+    if (!n)
+        return false;
+    n->m = *m;
+    llist_add(&n->ll, &llq);
+    return true;
+}
+
+// llist_del_all() takes the whole stack at once; reversed it is in push order
+static bool llq_pop(struct kfret_thread *t, struct kfret_msg *m)
+{
+    struct kfret_node *n;
+
+    if (!t->batch)
+        t->batch = llist_reverse_order(llist_del_all(&llq));
+    if (!t->batch)
+        return false;
+    n = llist_entry(t->batch, struct kfret_node, ll);
+    t->batch = t->batch->next;  // before node_put() reuses ll
+    *m = n->m;
+    node_put(n);
+    return true;
+}
+
+/*
+Bounded lock-free MPMC ring (D. Vyukov's design). Each cell carries a
+sequence number telling whose turn it is: pos when it is free for the
+push that claims position pos, pos + 1 once that push has filled it,
+pos + capacity when the pop has emptied it for the next lap. A side
+claims a position by cmpxchg on its own index only, so producers and
+consumers never write the same word. Both indexes and every cell sit on
+their own cacheline, so the only sharing is the one the algorithm needs.
+*/
+struct ring_cell {
+    atomic_long_t seq;
+    struct kfret_msg m;
+} ____cacheline_aligned;
+
+static struct {
+    atomic_long_t enq ____cacheline_aligned;
+    atomic_long_t deq ____cacheline_aligned;
+    struct ring_cell *cells ____cacheline_aligned;
+    unsigned long mask;
+} ring;
+
+static int ring_init(unsigned int capacity)
+{
+    unsigned long i;
+
+    ring.cells = kvcalloc(capacity, sizeof(*ring.cells), GFP_KERNEL);
+    if (!ring.cells)
+        return -ENOMEM;
+    for (i = 0; i < capacity; i++)
+        atomic_long_set(&ring.cells[i].seq, i);
+    ring.mask = capacity - 1;
+    atomic_long_set(&ring.enq, 0);
+    atomic_long_set(&ring.deq, 0);
+    return 0;
+}
+
+static void ring_destroy(void)
+{
+    kvfree(ring.cells);
+}
+
+static bool ring_push(struct kfret_thread *t, const struct kfret_msg *m)
+{
+    long pos = atomic_long_read(&ring.enq), dif;
+    struct ring_cell *c;
+
+    for (;;) {
+        c = &ring.cells[pos & ring.mask];
+        dif = atomic_long_read_acquire(&c->seq) - pos;
+        if (!dif) {
+            if (atomic_long_try_cmpxchg_relaxed(&ring.enq, &pos, pos + 1))
+                break;      // pos is ours; on failure pos was reloaded
+        } else if (dif < 0) {
+            return false;   // the cell still holds last lap's message: full
+        } else {
+            pos = atomic_long_read(&ring.enq);
+        }
+    }
+    c->m = *m;
+    atomic_long_set_release(&c->seq, pos + 1);
+    return true;
+}
+
+static bool ring_pop(struct kfret_thread *t, struct kfret_msg *m)
+{
+    long pos = atomic_long_read(&ring.deq), dif;
+    struct ring_cell *c;
+
+    for (;;) {
+        c = &ring.cells[pos & ring.mask];
+        dif = atomic_long_read_acquire(&c->seq) - (pos + 1);
+        if (!dif) {
+            if (atomic_long_try_cmpxchg_relaxed(&ring.deq, &pos, pos + 1))
+                break;
+        } else if (dif < 0) {
+            return false;   // not filled yet: empty
+        } else {
+            pos = atomic_long_read(&ring.deq);
+        }
+    }
+    *m = c->m;
+    atomic_long_set_release(&c->seq, pos + ring.mask + 1);
+    return true;
+}
+
+static const struct kfret_queue kfret_queues[] = {
+    { "spinlock", false, true,  lq_init,   lq_destroy,   lq_push,   lq_pop },
+    { "kfifo",    false, false, kq_init,   kq_destroy,   kq_push,   kq_pop },
+    { "llist",    true,  true,  llq_init,  llq_destroy,  llq_push,  llq_pop },
+    { "ring",     false, false, ring_init, ring_destroy, ring_push, ring_pop },
+};
+
+/* histograms: log-linear, like HdrHistogram with 4 bits of precision */
+static unsigned int hist_index(u64 v)
+{
+    unsigned int msb;
+
+    if (v < (1 << HIST_SUB_BITS))
+        return v;
+    msb = fls64(v) - 1;
+    return (msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS |
+           ((v >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+// Lowest value that falls into bucket i
+static u64 hist_value(unsigned int i)
+{
+    unsigned int e = i >> HIST_SUB_BITS;
+
+    if (!e)
+        return i;
+    return (u64)((1 << HIST_SUB_BITS) | (i & ((1 << HIST_SUB_BITS) - 1))) << (e - 1);
+}
+
+static u64 hist_pct(const u64 *hist, u64 total, unsigned int permille)
+{
+    u64 want = div_u64(total * permille + 999, 1000), seen = 0;
+    unsigned int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= want && seen)
+            return hist_value(i);
+    }
+    return 0;
+}
+
+/* perf counters, where the kernel and the CPU have them */
+#ifdef CONFIG_PERF_EVENTS
+static struct perf_event *kfret_perf_start(void)
+{
+    struct perf_event_attr attr = {
+        .type       = PERF_TYPE_HARDWARE,
+        .config     = PERF_COUNT_HW_CACHE_MISSES,
+        .size       = sizeof(attr),
+        .exclude_hv = 1,
+    };
+    struct perf_event *ev = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+
+    return IS_ERR(ev) ? NULL : ev;
+}
+
+// Scaled up if the PMU was shared and the counter only ran part of the time
+static s64 kfret_perf_stop(struct perf_event *ev)
+{
+    u64 enabled, running, count;
+
+    if (!ev)
+        return -1;
+    count = perf_event_read_value(ev, &enabled, &running);
+    perf_event_release_kernel(ev);
+    if (running && running < enabled)
+        count = mul_u64_u64_div_u64(count, enabled, running);
+    return running ? count : -1;
+}
+#else
+static struct perf_event *kfret_perf_start(void) { return NULL; }
+static s64 kfret_perf_stop(struct perf_event *ev) { return -1; }
+#endif
+
+/* settings and the last run */
+static char kfret_queue_name[16] = "ring";
+static u32 kfret_producers = 1;
+static u32 kfret_consumers = 1;
+static u64 kfret_messages = 1000000;
+static u32 kfret_capacity = 4096;
+static cpumask_var_t kfret_cpus;
+
+static DEFINE_MUTEX(kfret_lock);            // settings, runs and results
+static const struct kfret_queue *kfret_q;
+static u64 kfret_run_messages;              // settings of the current / last run
+static u32 kfret_run_producers;
+static struct kfret_thread *kfret_threads;  // of the last run, for results
+static unsigned int kfret_nr_threads;
+static u64 kfret_start_ns;
+static bool kfret_go;
+static DECLARE_WAIT_QUEUE_HEAD(kfret_start_wq);
+static atomic_t kfret_producers_left;
+static atomic_t kfret_running;
+static DECLARE_WAIT_QUEUE_HEAD(kfret_done_wq);
+
+// Threads wait here after creation, so they all start together
+static void kfret_wait_start(void)
+{
+    wait_event(kfret_start_wq, READ_ONCE(kfret_go) || kthread_should_stop());
+}
+
+static void kfret_backoff(u64 *retries)
+{
+    if (!(++*retries & 63))
+        cond_resched();     // let a thread sharing this CPU make progress
+    else
+        cpu_relax();
+}
+
+// Reports t done, then stays alive until kthread_stop() collects it
+static void kfret_finish(struct kfret_thread *t, struct perf_event *ev)
+{
+    t->end_ns = ktime_get_ns();
+    t->cache_misses = kfret_perf_stop(ev);
+    if (t->producer) {
+        smp_mb__before_atomic();    // our last push is visible before the count drops
+        atomic_dec(&kfret_producers_left);
+    }
+    if (atomic_dec_and_test(&kfret_running))
+        wake_up(&kfret_done_wq);
+
+    set_current_state(TASK_INTERRUPTIBLE);
+    while (!kthread_should_stop()) {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
+}
+
+static int kfret_producer(void *arg)
+{
+    struct kfret_thread *t = arg;
+    struct perf_event *ev = kfret_perf_start();
+    struct kfret_msg m = { .producer = t->id };
+    u64 t0, t1;
+
+    kfret_wait_start();
+    while (t->ops < kfret_run_messages && !kthread_should_stop()) {
+        m.seq = t->ops;
+        m.t_ns = t0 = ktime_get_ns();
+        if (!kfret_q->push(t, &m)) {
+            kfret_backoff(&t->retries);
+            continue;
+        }
+        t1 = ktime_get_ns();
+        t->hist_op[hist_index(t1 - t0)]++;
+        t->ops++;
+    }
+    kfret_finish(t, ev);
+    return 0;
+}
+
+static int kfret_consumer(void *arg)
+{
+    struct kfret_thread *t = arg;
+    struct perf_event *ev = kfret_perf_start();
+    struct kfret_msg m;
+    bool last;
+    u64 t0, t1;
+
+    kfret_wait_start();
+    while (!kthread_should_stop()) {
+        // Read before the pop: if the producers were already done, empty means finished
+        last = !atomic_read_acquire(&kfret_producers_left);
+        t0 = ktime_get_ns();
+        if (kfret_q->pop(t, &m)) {
+            t1 = ktime_get_ns();
+            t->hist_op[hist_index(t1 - t0)]++;
+            t->hist_lat[hist_index(t1 - m.t_ns)]++;
+            t->ops++;
+            continue;
+        }
+        if (last)
+            break;
+        kfret_backoff(&t->retries);
+    }
+    kfret_finish(t, ev);
+    return 0;
+}
+
+static int kfret_pools_alloc(struct kfret_thread *threads, unsigned int nr_prod)
+{
+    unsigned int per = max(kfret_capacity / nr_prod, 1u), i, j;
+
+    for (i = 0; i < nr_prod; i++) {
+        struct kfret_thread *t = &threads[i];
+
+        t->nodes = kvcalloc(per, sizeof(*t->nodes), GFP_KERNEL);
+        if (!t->nodes)
+            return -ENOMEM;
+        init_llist_head(&t->free);
+        for (j = 0; j < per; j++) {
+            t->nodes[j].owner = t;
+            llist_add(&t->nodes[j].ll, &t->free);
+        }
+    }
+    return 0;
+}
+
+static void kfret_threads_free(void)
+{
+    unsigned int i;
+
+    for (i = 0; kfret_threads && i < kfret_nr_threads; i++)
+        kvfree(kfret_threads[i].nodes);
+    kvfree(kfret_threads);
+    kfret_threads = NULL;
+    kfret_nr_threads = 0;
+}
+
+// One benchmark run with the current settings; kfret_lock held
+static int kfret_run(void)
+{
+    unsigned int nr = kfret_producers + kfret_consumers, i;
+    const struct kfret_queue *q = NULL;
+    struct kfret_thread *threads;
+    cpumask_var_t cpus;
+    int cpu = -1, ret;
+
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++)
+        if (!strcmp(kfret_queues[i].name, kfret_queue_name))
+            q = &kfret_queues[i];
+    if (!q || !kfret_producers || !kfret_consumers || !kfret_messages ||
+        kfret_producers > KFRET_MAX_THREADS || kfret_consumers > KFRET_MAX_THREADS ||
+        !is_power_of_2(kfret_capacity) || kfret_messages > U32_MAX)
+        return -EINVAL;
+    if (q->single_consumer && kfret_consumers != 1)
+        return -EINVAL;     // llist_del_all() has to have a single caller
+
+    if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+        return -ENOMEM;
+    cpumask_and(cpus, kfret_cpus, cpu_online_mask);
+    if (cpumask_empty(cpus)) {
+        ret = -EINVAL;
+        goto out_mask;
+    }
+
+    kfret_threads_free();
+    threads = kvcalloc(nr, sizeof(*threads), GFP_KERNEL);
+    if (!threads) {
+        ret = -ENOMEM;
+        goto out_mask;
+    }
+    kfret_threads = threads;
+    kfret_nr_threads = nr;
+    if (q->nodes) {
+        ret = kfret_pools_alloc(threads, kfret_producers);
+        if (ret)
+            goto out_mask;
+    }
+    ret = q->init(kfret_capacity);
+    if (ret)
+        goto out_mask;
+    kfret_q = q;
+    kfret_run_messages = kfret_messages;
+    kfret_run_producers = kfret_producers;
+
+    WRITE_ONCE(kfret_go, false);
+    atomic_set(&kfret_producers_left, kfret_producers);
+    atomic_set(&kfret_running, nr);
+
+    // Created and bound first, woken only once every thread exists
+    for (i = 0; i < nr; i++) {
+        struct kfret_thread *t = &threads[i];
+
+        t->producer = i < kfret_producers;
+        t->id = t->producer ? i : i - kfret_producers;
+        cpu = cpumask_next(cpu, cpus);
+        if (cpu >= nr_cpu_ids)
+            cpu = cpumask_first(cpus);
+        t->cpu = cpu;
+        t->task = kthread_create(t->producer ? kfret_producer : kfret_consumer, t,
+                                 "kfret_%c%u", t->producer ? 'p' : 'c', t->id);
+        if (IS_ERR(t->task)) {
+            ret = PTR_ERR(t->task);
+            t->task = NULL;
+            // Never woken: kthread_stop() makes them exit without running
+            while (i--)
+                kthread_stop(threads[i].task);
+            goto out_queue;
+        }
+        kthread_bind(t->task, cpu);
+    }
+    for (i = 0; i < nr; i++)
+        wake_up_process(threads[i].task);
+
+    kfret_start_ns = ktime_get_ns();
+    WRITE_ONCE(kfret_go, true);
+    wake_up_all(&kfret_start_wq);
+
+    // A kill stops the run early; the results then cover what was done
+    if (wait_event_killable(kfret_done_wq, !atomic_read(&kfret_running)))
+        pr_info("kfret: run interrupted\n");
+    for (i = 0; i < nr; i++)
+        kthread_stop(threads[i].task);
+    ret = 0;
+
+out_queue:
+    q->destroy();
+out_mask:
+    free_cpumask_var(cpus);
+    if (ret)
+        kfret_threads_free();
+    return ret;
+}
+
+/* ---------- debugfs ---------- */
+static struct dentry *kfret_debugfs;
+
+static void kfret_show_hist(struct seq_file *m, const char *name, const u64 *hist)
+{
+    u64 total = 0;
+    unsigned int i, max = 0;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        total += hist[i];
+        if (hist[i])
+            max = i;
+    }
+    seq_printf(m, "%-12s %10llu %10llu %10llu %10llu %10llu\n", name,
+               hist_pct(hist, total, 500), hist_pct(hist, total, 900),
+               hist_pct(hist, total, 990), hist_pct(hist, total, 999),
+               total ? hist_value(max) : 0);
+}
+
+static int kfret_results_show(struct seq_file *m, void *v)
+{
+    u64 *push, *pop, *lat, msgs = 0, retries[2] = { 0 }, end = 0;
+    s64 misses = 0;
+    unsigned int i, j;
+
+    mutex_lock(&kfret_lock);
+    if (!kfret_threads) {
+        seq_puts(m, "no run yet: echo 1 > run\n");
+        goto out;
+    }
+    push = kvcalloc(3 * HIST_BUCKETS, sizeof(u64), GFP_KERNEL);
+    if (!push)
+        goto out;
+    pop = push + HIST_BUCKETS;
+    lat = pop + HIST_BUCKETS;
+
+    for (i = 0; i < kfret_nr_threads; i++) {
+        const struct kfret_thread *t = &kfret_threads[i];
+
+        for (j = 0; j < HIST_BUCKETS; j++) {
+            (t->producer ? push : pop)[j] += t->hist_op[j];
+            lat[j] += t->hist_lat[j];
+        }
+        if (!t->producer)
+            msgs += t->ops;
+        retries[!t->producer] += t->retries;
+        end = max(end, t->end_ns);
+        if (misses >= 0)
+            misses = t->cache_misses < 0 ? -1 : misses + t->cache_misses;
+    }
+    end = end > kfret_start_ns ? end - kfret_start_ns : 1;
+
+    seq_printf(m, "queue:        %s\n", kfret_q->name);
+    seq_printf(m, "threads:      %u producers, %u consumers\n",
+               kfret_run_producers, kfret_nr_threads - kfret_run_producers);
+    seq_printf(m, "messages:     %llu in %llu us\n", msgs, div_u64(end, 1000));
+    seq_printf(m, "throughput:   %llu msgs/s\n", div64_u64(msgs * NSEC_PER_SEC, end));
+    seq_printf(m, "full_retries: %llu\nempty_retries: %llu\n", retries[0], retries[1]);
+    if (misses >= 0)
+        seq_printf(m, "cache_misses: %lld (%llu.%02llu per message)\n", misses,
+                   msgs ? div64_u64(misses, msgs) : 0,
+                   msgs ? div64_u64(misses * 100, msgs) % 100 : 0);
+    else
+        seq_puts(m, "cache_misses: n/a (no perf counter)\n");
+
+    seq_printf(m, "\n%-12s %10s %10s %10s %10s %10s\n", "ns", "p50", "p90", "p99", "p99.9", "max");
+    kfret_show_hist(m, "push", push);
+    kfret_show_hist(m, "pop", pop);
+    kfret_show_hist(m, "latency", lat);
+
+    seq_printf(m, "\n%-10s %4s %12s %12s %14s\n", "thread", "cpu", "messages", "retries", "cache_misses");
+    for (i = 0; i < kfret_nr_threads; i++) {
+        const struct kfret_thread *t = &kfret_threads[i];
+
+        seq_printf(m, "%s%-9u %4d %12llu %12llu %14lld\n", t->producer ? "p" : "c", t->id,
+                   t->cpu, t->ops, t->retries, t->cache_misses);
+    }
+    kvfree(push);
+out:
+    mutex_unlock(&kfret_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(kfret_results);
+
+static int kfret_run_write(void *data, u64 val)
+{
+    int ret;
+
+    mutex_lock(&kfret_lock);
+    ret = kfret_run();
+    mutex_unlock(&kfret_lock);
+    return ret;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(kfret_run_fops, NULL, kfret_run_write, "%llu\n");
+
+// Lists the queues with the selected one in brackets, like a sysfs scheduler file
+static int kfret_queue_show(struct seq_file *m, void *v)
+{
+    unsigned int i;
+
+    mutex_lock(&kfret_lock);
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++) {
+        bool cur = !strcmp(kfret_queues[i].name, kfret_queue_name);
+
+        seq_printf(m, "%s%s%s ", cur ? "[" : "", kfret_queues[i].name, cur ? "]" : "");
+    }
+    mutex_unlock(&kfret_lock);
+    seq_putc(m, '\n');
+    return 0;
+}
+
+static int kfret_queue_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, kfret_queue_show, NULL);
+}
+
+static ssize_t kfret_queue_write(struct file *file, const char __user *ubuf,
+                                 size_t len, loff_t *ppos)
+{
+    char buf[16];
+    unsigned int i;
+
+    if (len >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, len))
+        return -EFAULT;
+    buf[len] = '\0';
+
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++) {
+        if (sysfs_streq(buf, kfret_queues[i].name)) {
+            mutex_lock(&kfret_lock);
+            strscpy(kfret_queue_name, kfret_queues[i].name, sizeof(kfret_queue_name));
+            mutex_unlock(&kfret_lock);
+            return len;
+        }
+    }
+    return -EINVAL;
+}
+
+static const struct file_operations kfret_queue_fops = {
+    .owner   = THIS_MODULE,
+    .open    = kfret_queue_open,
+    .read    = seq_read,
+    .write   = kfret_queue_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+static int kfret_cpus_show(struct seq_file *m, void *v)
+{
+    mutex_lock(&kfret_lock);
+    seq_printf(m, "%*pbl\n", cpumask_pr_args(kfret_cpus));
+    mutex_unlock(&kfret_lock);
+    return 0;
+}
+
+static int kfret_cpus_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, kfret_cpus_show, NULL);
+}
+
+static ssize_t kfret_cpus_write(struct file *file, const char __user *ubuf,
+                                size_t len, loff_t *ppos)
+{
+    cpumask_var_t mask;
+    char buf[256];
+    int ret;
+
+    if (len >= sizeof(buf))
+        return -EINVAL;
+    if (copy_from_user(buf, ubuf, len))
+        return -EFAULT;
+    buf[len] = '\0';
+    if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+        return -ENOMEM;
+
+    ret = cpulist_parse(strim(buf), mask);
+    if (!ret && !cpumask_intersects(mask, cpu_online_mask))
+        ret = -EINVAL;
+    if (!ret) {
+        mutex_lock(&kfret_lock);
+        cpumask_copy(kfret_cpus, mask);
+        mutex_unlock(&kfret_lock);
+    }
+    free_cpumask_var(mask);
+    return ret ? ret : len;
+}
+
+static const struct file_operations kfret_cpus_fops = {
+    .owner   = THIS_MODULE,
+    .open    = kfret_cpus_open,
+    .read    = seq_read,
+    .write   = kfret_cpus_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+// kfret_run() copies the numbers it needs, so writing them during a run affects the next one
+static void kfret_debugfs_init(void)
+{
+    kfret_debugfs = debugfs_create_dir("kfret", NULL);
+    debugfs_create_file("queue", 0644, kfret_debugfs, NULL, &kfret_queue_fops);
+    debugfs_create_u32("producers", 0644, kfret_debugfs, &kfret_producers);
+    debugfs_create_u32("consumers", 0644, kfret_debugfs, &kfret_consumers);
+    debugfs_create_u64("messages", 0644, kfret_debugfs, &kfret_messages);
+    debugfs_create_u32("capacity", 0644, kfret_debugfs, &kfret_capacity);
+    debugfs_create_file("cpus", 0644, kfret_debugfs, NULL, &kfret_cpus_fops);
+    debugfs_create_file_unsafe("run", 0200, kfret_debugfs, NULL, &kfret_run_fops);
+    debugfs_create_file("results", 0444, kfret_debugfs, NULL, &kfret_results_fops);
+}
+
 // Module init
 static int __init kfret_init(void)
 {
     pr_info("Loading kfret module\n");
 
+    if (!alloc_cpumask_var(&kfret_cpus, GFP_KERNEL))
+        return -ENOMEM;
+    cpumask_copy(kfret_cpus, cpu_online_mask);
+    kfret_debugfs_init();
+
+    if (!demo)
+        return 0;
+
     // First way: kthread_create + wake_up_process
     kthread1 = kthread_create(thread_function, &t1, "kthread1");
-    if (kthread1) {
+    if (!IS_ERR(kthread1)) {
         wake_up_process(kthread1);
         pr_info("kthread1 created and running with kthread create plus wakeup in 2 steps\n");
     } else {
         pr_err("kthread1 could not be created\n");
-        return -1;
+        kthread1 = NULL;
+        goto err;
     }
 
     // Second way: kthread_run (create + run in one step)
     kthread2 = kthread_run(thread_function, &t2, "kthread2");
-    if (kthread2) {
-        pr_info("kthread2 created and running\ in one step \n");
+    if (!IS_ERR(kthread2)) {
+        pr_info("kthread2 created and running in one step\n");
     } else {
         pr_err("kthread2 could not be created\n");
+        kthread2 = NULL;
         kthread_stop(kthread1); // cleanup thread1
-        return -1;
+        goto err;
     }
 
     pr_info("Both threads are running now\n");
     return 0;
+
+err:
+    debugfs_remove_recursive(kfret_debugfs);
+    free_cpumask_var(kfret_cpus);
+    return -1;
 }
 
 // Module exit
@@ -73,6 +904,11 @@ static void __exit kfret_exit(void)
     if (kthread2)
         kthread_stop(kthread2);
 
+    // Removing the files waits for a run in progress to return
+    debugfs_remove_recursive(kfret_debugfs);
+    kfret_threads_free();
+    free_cpumask_var(kfret_cpus);
+
     pr_info("Stopped both threads, exiting module\n");
 }
 
@@ -0,0 +1,234 @@
+// KUnit suites of the kfret queues, histograms and runs (see ../common/ktest.h)
+#include "kfret.c"
+#include "../common/ktest.h"
+
+#define TEST_CAPACITY   8
+
+/*
+One producer and one consumer thread record, driven from the test thread
+itself: the queues only look at the record of the side that calls them.
+The capacity is small so the tests reach full and wrap around.
+*/
+struct queue_fixture {
+    struct kfret_thread *threads;   // [0] producer, [1] consumer
+};
+
+static void queue_fixture_free(void *arg)
+{
+    struct kfret_thread *threads = arg;
+
+    kvfree(threads[0].nodes);
+    kvfree(threads);
+}
+
+static struct kfret_thread *queue_open(struct kunit *test, const struct kfret_queue *q)
+{
+    struct kfret_thread *threads = kvcalloc(2, sizeof(*threads), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, threads);
+    KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, queue_fixture_free, threads), 0);
+    threads[0].producer = true;
+    kfret_capacity = TEST_CAPACITY;
+    if (q->nodes)
+        KUNIT_ASSERT_EQ(test, kfret_pools_alloc(threads, 1), 0);
+    KUNIT_ASSERT_EQ(test, q->init(TEST_CAPACITY), 0);
+    return threads;
+}
+
+// Every queue holds exactly its capacity and hands messages back in order
+static void queue_fifo_test(struct kunit *test)
+{
+    struct kfret_thread *t;
+    struct kfret_msg m;
+    unsigned int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++) {
+        const struct kfret_queue *q = &kfret_queues[i];
+
+        t = queue_open(test, q);
+        for (j = 0; j < TEST_CAPACITY; j++) {
+            m = (struct kfret_msg){ .producer = 0, .seq = j };
+            KUNIT_EXPECT_TRUE_MSG(test, q->push(&t[0], &m), "%s push %u", q->name, j);
+        }
+        KUNIT_EXPECT_FALSE_MSG(test, q->push(&t[0], &m), "%s: not full", q->name);
+
+        for (j = 0; j < TEST_CAPACITY; j++) {
+            KUNIT_ASSERT_TRUE_MSG(test, q->pop(&t[1], &m), "%s pop %u", q->name, j);
+            KUNIT_EXPECT_EQ_MSG(test, m.seq, j, "%s", q->name);
+        }
+        KUNIT_EXPECT_FALSE_MSG(test, q->pop(&t[1], &m), "%s: not empty", q->name);
+        q->destroy();
+    }
+}
+
+// Several laps of a queue kept half full: indexes, sequence numbers and node pools wrap
+static void queue_wrap_test(struct kunit *test)
+{
+    struct kfret_thread *t;
+    struct kfret_msg m;
+    unsigned int i, in, out;
+
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++) {
+        const struct kfret_queue *q = &kfret_queues[i];
+
+        t = queue_open(test, q);
+        for (in = out = 0; out < 10 * TEST_CAPACITY; ) {
+            if (in - out < TEST_CAPACITY / 2) {
+                m = (struct kfret_msg){ .seq = in };
+                KUNIT_ASSERT_TRUE_MSG(test, q->push(&t[0], &m), "%s push %u", q->name, in);
+                in++;
+                continue;
+            }
+            KUNIT_ASSERT_TRUE_MSG(test, q->pop(&t[1], &m), "%s pop %u", q->name, out);
+            KUNIT_EXPECT_EQ_MSG(test, m.seq, out, "%s", q->name);
+            out++;
+        }
+        q->destroy();
+    }
+}
+
+static void hist_test(struct kunit *test)
+{
+    u64 *hist, v;
+    unsigned int i;
+
+    // Exact below 16, then within one sub-bucket (1/16) of the value
+    for (v = 0; v < 16; v++)
+        KUNIT_EXPECT_EQ(test, hist_value(hist_index(v)), v);
+    for (v = 16; v < 1ULL << 40; v = v * 3 / 2 + 1) {
+        i = hist_index(v);
+        KUNIT_ASSERT_LT(test, i, HIST_BUCKETS);
+        KUNIT_EXPECT_LE(test, hist_value(i), v);
+        KUNIT_EXPECT_GT(test, hist_value(i + 1), v);
+        KUNIT_EXPECT_LE(test, v - hist_value(i), v / 16);
+    }
+    KUNIT_EXPECT_LT(test, hist_index(U64_MAX), HIST_BUCKETS);
+
+    hist = kunit_kcalloc(test, HIST_BUCKETS, sizeof(*hist), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, hist);
+    hist[hist_index(10)] = 900;
+    hist[hist_index(1000)] = 99;
+    hist[hist_index(100000)] = 1;
+    KUNIT_EXPECT_EQ(test, hist_pct(hist, 1000, 500), 10);
+    KUNIT_EXPECT_EQ(test, hist_pct(hist, 1000, 900), 10);
+    KUNIT_EXPECT_EQ(test, hist_pct(hist, 1000, 990), hist_value(hist_index(1000)));
+    KUNIT_EXPECT_EQ(test, hist_pct(hist, 1000, 999), hist_value(hist_index(1000)));
+    KUNIT_EXPECT_EQ(test, hist_pct(hist, 1000, 1000), hist_value(hist_index(100000)));
+    KUNIT_EXPECT_EQ(test, hist_pct(hist, 0, 500), 0);
+}
+
+// Settings the tests change; put back when each test ends
+static int run_init(struct kunit *test)
+{
+    mutex_lock(&kfret_lock);
+    kfret_capacity = 64;
+    kfret_messages = 20000;
+    kfret_producers = 2;
+    kfret_consumers = 2;
+    mutex_unlock(&kfret_lock);
+    return 0;
+}
+
+static void run_exit(struct kunit *test)
+{
+    mutex_lock(&kfret_lock);
+    strscpy(kfret_queue_name, "ring", sizeof(kfret_queue_name));
+    kfret_capacity = 4096;
+    kfret_messages = 1000000;
+    kfret_producers = 1;
+    kfret_consumers = 1;
+    mutex_unlock(&kfret_lock);
+}
+
+// Whole runs with real threads: every message pushed is popped once
+static void run_test(struct kunit *test)
+{
+    u64 pushed, popped;
+    unsigned int i, j;
+    int ret;
+
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++) {
+        const struct kfret_queue *q = &kfret_queues[i];
+
+        mutex_lock(&kfret_lock);
+        strscpy(kfret_queue_name, q->name, sizeof(kfret_queue_name));
+        kfret_consumers = q->single_consumer ? 1 : 2;
+        ret = kfret_run();
+        pushed = popped = 0;
+        for (j = 0; !ret && j < kfret_nr_threads; j++) {
+            if (kfret_threads[j].producer)
+                pushed += kfret_threads[j].ops;
+            else
+                popped += kfret_threads[j].ops;
+        }
+        mutex_unlock(&kfret_lock);
+
+        KUNIT_ASSERT_EQ_MSG(test, ret, 0, "%s", q->name);
+        KUNIT_EXPECT_EQ_MSG(test, pushed, 2 * 20000, "%s", q->name);
+        KUNIT_EXPECT_EQ_MSG(test, popped, 2 * 20000, "%s", q->name);
+    }
+}
+
+static void run_invalid_test(struct kunit *test)
+{
+    mutex_lock(&kfret_lock);
+    strscpy(kfret_queue_name, "llist", sizeof(kfret_queue_name));
+    KUNIT_EXPECT_EQ(test, kfret_run(), -EINVAL);    // two consumers
+    strscpy(kfret_queue_name, "ring", sizeof(kfret_queue_name));
+    kfret_capacity = 1000;
+    KUNIT_EXPECT_EQ(test, kfret_run(), -EINVAL);
+    kfret_capacity = 64;
+    kfret_producers = KFRET_MAX_THREADS + 1;
+    KUNIT_EXPECT_EQ(test, kfret_run(), -EINVAL);
+    kfret_producers = 2;
+    strscpy(kfret_queue_name, "none", sizeof(kfret_queue_name));
+    KUNIT_EXPECT_EQ(test, kfret_run(), -EINVAL);
+    mutex_unlock(&kfret_lock);
+}
+
+static struct kunit_case kfret_cases[] = {
+    KUNIT_CASE(queue_fifo_test),
+    KUNIT_CASE(queue_wrap_test),
+    KUNIT_CASE(hist_test),
+    KUNIT_CASE(run_test),
+    KUNIT_CASE(run_invalid_test),
+    {}
+};
+
+static struct kunit_suite kfret_suite = {
+    .name = "kfret",
+    .init = run_init,
+    .exit = run_exit,
+    .test_cases = kfret_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+// A push and a pop on one CPU with nobody else around: the floor of each queue
+static void queue_pair_bench(struct kunit *test)
+{
+    struct kfret_msg m = {};
+    struct kfret_thread *t;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(kfret_queues); i++) {
+        const struct kfret_queue *q = &kfret_queues[i];
+
+        t = queue_open(test, q);
+        ktest_bench(test, q->name, q->push(&t[0], &m); q->pop(&t[1], &m));
+        q->destroy();
+    }
+}
+
+static struct kunit_case kfret_bench_cases[] = {
+    KUNIT_CASE_SLOW(queue_pair_bench),
+    {}
+};
+
+static struct kunit_suite kfret_bench_suite = {
+    .name = "kfret_bench",
+    .exit = run_exit,
+    .test_cases = kfret_bench_cases,
+};
+
+kunit_test_suites(&kfret_suite, &kfret_bench_suite);
@@ -7,6 +7,20 @@
 #include <linux/gpio.h>
 #include <linux/poll.h>
 #include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/pm_qos.h>
+#include <linux/hrtimer.h>
+#include <linux/irq_work.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/sched/signal.h>
+#include <linux/kfifo.h>
+#include <linux/rcupdate.h>
+#include "../common/devstats.h"
+#include "irqpoll_ioctl.h"
 
 #define GPIO_BUTTON 17        // Example: GPIO17 on Raspberry Pi
 #define DEVICE_NAME "irqpoll"
@@ -37,60 +51,794 @@ that are waiting for events on the device.
 static int irq_ready = 0;
 static wait_queue_head_t waitqueue;
 
+/*
+Every open file is a consumer with its own event queue and wait queue.
+The handler builds one record per interrupt (struct irqpoll_event) and
+offers it to every consumer through that consumer's filter program; only
+the consumers the record is delivered to are woken. poll() reports POLLIN
+while the consumer's queue holds records, read() returns them.
+irq_ready still records that an interrupt has happened.
+*/
+#define CLIENT_QUEUE_LEN 64         // records per consumer, a power of two
+
+// Both guarded by emit_lock: replayed events may arrive on another CPU than the IRQ.
+// A plain spinlock: consumers are woken under it, and wake_up() takes one itself.
+static u32 irq_seq;
+static u64 last_edge_ns;
+static DEFINE_SPINLOCK(emit_lock);
+
+/*
+Per-CPU counters of interrupts and poll calls, mapped by /dev/devstats/irqpoll.
+The handler counts from hard-irq context; devstats_add() is safe there.
+The wakeup channel times each delivered event from the interrupt to the
+poll() that reports it, i.e. how long the woken consumer took to run. Its
+average shows what a latency QoS bound buys (see below).
+*/
+enum { STAT_IRQ, STAT_POLL, STAT_WAKEUP, STAT_SAMPLE };
+static const char *const stat_channels[] = { "irq", "poll", "wakeup", "sample" };
+static struct devstats stats;
+
+/*
+CPU latency QoS
+Waking a consumer from a deep C-state costs the exit latency of that state.
+While at least one consumer has a latency budget, the driver holds one
+cpu_latency_qos request for the tightest budget, which keeps CPUs out of
+states slower to leave than that. The request is dropped when the last such
+consumer closes, so the power cost is only paid while someone listens.
+A consumer's budget is set with IRQPOLL_SET_LATENCY; qos_latency_us gives
+every opener a default one.
+*/
+static int qos_latency_us = -1;
+module_param(qos_latency_us, int, 0644);
+MODULE_PARM_DESC(qos_latency_us, "Default latency budget of every opener in us, -1 = none (applies to later opens)");
+
+struct irqpoll_prog;
+
+struct irqpoll_client {
+    struct list_head node;              // in clients, walked by the handler under RCU
+    struct rcu_head rcu;
+    int budget_us;                      // -1 = no budget
+    int seen;                           // deliveries already timed by the wakeup channel
+    atomic_t delivered;
+    u64 last_ns;                        // time of the last delivered event
+    u32 folded;                         // events aggregated since the last delivery
+    struct irqpoll_prog __rcu *prog;    // NULL: every event is delivered
+    struct irqpoll_filter_stats fstats;
+    wait_queue_head_t wait;
+    struct mutex read_lock;             // one reader at a time: the queue, or rpos and lost
+    DECLARE_KFIFO(events, struct irqpoll_event, CLIENT_QUEUE_LEN);
+    u64 rpos;                           // sampling mode: next ring word read() returns
+    u64 lost;                           // sampling mode: words overwritten before read()
+};
+
+// Writers hold clients_lock; the interrupt handler only reads, under RCU
+static LIST_HEAD(clients);
+static DEFINE_MUTEX(clients_lock);
+static struct pm_qos_request qos_req;
+static int qos_bound_us = -1;
+
+// Applies the tightest budget of all consumers; clients_lock held
+static void irqpoll_update_qos(void)
+{
+    struct irqpoll_client *c;
+    int bound = -1;
+
+    list_for_each_entry(c, &clients, node)
+        if (c->budget_us >= 0 && (bound < 0 || c->budget_us < bound))
+            bound = c->budget_us;
+
+    if (bound == qos_bound_us)
+        return;
+    if (bound < 0)
+        cpu_latency_qos_remove_request(&qos_req);
+    else if (qos_bound_us < 0)
+        cpu_latency_qos_add_request(&qos_req, bound);
+    else
+        cpu_latency_qos_update_request(&qos_req, bound);
+
+    printk(KERN_INFO "gpio_irq_poll: CPU latency bound %d us\n", bound);
+    qos_bound_us = bound;
+}
+
+/* ---------- sampling mode ---------- */
+
+/*
+For lines too fast or too bouncy for an interrupt per edge, sample_hz > 0
+replaces the interrupt with a periodic hrtimer. Every tick reads each line
+in sample_gpios and appends one bit per line to a bitstream packed into
+64-bit words (layout in irqpoll_ioctl.h). The cost is fixed by the rate and
+the line count, however busy the lines are.
+
+The words go into a ring that the timer overwrites and never waits for.
+Each open file reads from its own position; readers and poll() are woken
+once every WAKE_WORDS words rather than once per tick.
+The tick stays a hard timer so the samples keep their timing even on
+PREEMPT_RT. A hard timer must not wake sleepers there, so the wakeup is
+handed to an irq_work, which PREEMPT_RT runs in a thread.
+*/
+#define SAMPLE_MAX_HZ   1000000
+#define WAKE_WORDS      64          // 512 bytes of samples
+#define MAX_LATE_TICKS  4096        // bound the catch-up work of one late tick
+
+static unsigned int sample_hz;
+module_param(sample_hz, uint, 0444);
+MODULE_PARM_DESC(sample_hz, "Sample the lines at this rate instead of taking interrupts, 0 = interrupt mode (default)");
+
+static int sample_gpios[IRQPOLL_MAX_LINES] = { GPIO_BUTTON };
+static int nr_sample_gpios = 1;
+module_param_array(sample_gpios, int, &nr_sample_gpios, 0444);
+MODULE_PARM_DESC(sample_gpios, "GPIO lines to sample, in bit order (default 17)");
+
+static unsigned int ring_kb = 1024;
+module_param(ring_kb, uint, 0444);
+MODULE_PARM_DESC(ring_kb, "Sample ring size in KiB, rounded up to a power of two (default 1024)");
+
+static struct irqpoll_ring *ring;  // vmalloc_user(): header page, then the words
+static u64 *ring_words;
+static struct hrtimer sample_timer;
+static struct irq_work sample_wake; // wakes readers outside the hard timer
+static ktime_t sample_period;
+static u64 sample_cur;             // the word being filled
+static unsigned int sample_bits;   // bits already in sample_cur
+static int sample_requested;       // lines requested so far, for unwinding
+
+// Appends nr bits; a full word is stored, then published in ring->head
+static void sample_push(u64 sample, unsigned int nr)
+{
+    u64 head;
+
+    sample_cur |= sample << sample_bits;
+    sample_bits += nr;
+    if (sample_bits < 64)
+        return;
+
+    head = ring->head;
+    ring_words[head & (ring->nr_words - 1)] = sample_cur;
+    smp_store_release(&ring->head, head + 1);
+    if ((head + 1) % WAKE_WORDS == 0)
+        irq_work_queue(&sample_wake);
+
+    // The bits of this sample that did not fit start the next word
+    sample_bits -= 64;
+    sample_cur = sample_bits ? sample >> (nr - sample_bits) : 0;
+}
+
+static void sample_wake_fn(struct irq_work *work)
+{
+    wake_up(&waitqueue);
+}
+
+static enum hrtimer_restart sample_tick(struct hrtimer *timer)
+{
+    u64 t0 = ktime_get_ns(), sample = 0, ticks;
+    unsigned int i, nr = ring->nr_lines;
+
+    for (i = 0; i < nr; i++)
+        sample |= (u64)!!gpio_get_value(sample_gpios[i]) << i;
+
+    // A late timer owes several ticks; repeating the sample keeps the stream in time
+    ticks = hrtimer_forward_now(timer, sample_period);
+    if (ticks > 1)
+        ring->late_ticks += ticks - 1;
+    ticks = min_t(u64, ticks, MAX_LATE_TICKS);
+    while (ticks--)
+        sample_push(sample, nr);
+
+    devstats_end(&stats, STAT_SAMPLE, t0, 0);
+    return HRTIMER_RESTART;
+}
+
+static int __init sample_init(void)
+{
+    unsigned long words;
+    ktime_t start;
+    int i, ret;
+
+    if (sample_hz > SAMPLE_MAX_HZ || nr_sample_gpios < 1 || !ring_kb)
+        return -EINVAL;
+
+    words = roundup_pow_of_two((unsigned long)ring_kb * 1024 / sizeof(u64));
+    ring = vmalloc_user(PAGE_SIZE + words * sizeof(u64));
+    if (!ring)
+        return -ENOMEM;
+    ring_words = (void *)ring + PAGE_SIZE;
+    ring->magic = IRQPOLL_RING_MAGIC;
+    ring->nr_lines = nr_sample_gpios;
+    ring->rate_hz = sample_hz;
+    ring->nr_words = words;
+    ring->data_offset = PAGE_SIZE;
+
+    for (i = 0; i < nr_sample_gpios; i++) {
+        ring->lines[i] = sample_gpios[i];
+        ret = gpio_is_valid(sample_gpios[i]) ?
+              gpio_request(sample_gpios[i], "irqpoll-sample") : -ENODEV;
+        if (ret) {
+            printk(KERN_ERR "gpio_irq_poll: Cannot use GPIO %d for sampling\n", sample_gpios[i]);
+            goto err_free;
+        }
+        sample_requested++;
+        // The timer reads the lines in hard irq context: expanders on a slow bus cannot
+        if (gpio_cansleep(sample_gpios[i])) {
+            printk(KERN_ERR "gpio_irq_poll: GPIO %d can sleep, it cannot be sampled\n", sample_gpios[i]);
+            ret = -EINVAL;
+            goto err_free;
+        }
+        gpio_direction_input(sample_gpios[i]);
+    }
+
+    // Absolute start, so start_ns is exactly the time of tick 0
+    sample_period = ns_to_ktime(div_u64(NSEC_PER_SEC, sample_hz));
+    start = ktime_add(ktime_get(), sample_period);
+    ring->start_ns = ktime_to_ns(start);
+    init_irq_work(&sample_wake, sample_wake_fn);
+    hrtimer_init(&sample_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_HARD);
+    sample_timer.function = sample_tick;
+    hrtimer_start(&sample_timer, start, HRTIMER_MODE_ABS_HARD);
+
+    printk(KERN_INFO "gpio_irq_poll: Sampling %d line(s) at %u Hz, ring %lu KiB\n",
+           nr_sample_gpios, sample_hz, words * sizeof(u64) / 1024);
+    return 0;
+
+err_free:
+    while (sample_requested)
+        gpio_free(sample_gpios[--sample_requested]);
+    vfree(ring);
+    ring = NULL;
+    return ret;
+}
+
+static void sample_exit(void)
+{
+    hrtimer_cancel(&sample_timer);
+    irq_work_sync(&sample_wake);    // a wakeup queued by the last tick
+    while (sample_requested)
+        gpio_free(sample_gpios[--sample_requested]);
+    vfree(ring);
+}
+
+/*
+Copies whole words from the file's position. If the timer has lapped the
+reader, the overwritten words are skipped and counted in c->lost
+(IRQPOLL_GET_LOST).
+*/
+static ssize_t sample_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+{
+    struct irqpoll_client *c = file->private_data;
+    u64 mask = ring->nr_words - 1, head, n, first;
+    size_t words = len / sizeof(u64);
+    ssize_t ret;
+
+    if (!words)
+        return -EINVAL;
+
+    // rpos and lost belong to the file, which several threads may read at once
+    if (mutex_lock_interruptible(&c->read_lock))
+        return -ERESTARTSYS;
+    if (file->f_flags & O_NONBLOCK) {
+        if (smp_load_acquire(&ring->head) == c->rpos) {
+            ret = -EAGAIN;
+            goto out;
+        }
+    } else if (wait_event_interruptible(waitqueue, smp_load_acquire(&ring->head) != c->rpos)) {
+        ret = -ERESTARTSYS;
+        goto out;
+    }
+
+retry:
+    head = smp_load_acquire(&ring->head);
+    if (head - c->rpos > ring->nr_words) {
+        c->lost += head - ring->nr_words - c->rpos;
+        c->rpos = head - ring->nr_words;
+    }
+    n = min_t(u64, head - c->rpos, words);
+
+    // At most two pieces: up to the end of the ring, then from its start
+    first = min(n, ring->nr_words - (c->rpos & mask));
+    if (copy_to_user(buf, &ring_words[c->rpos & mask], first * sizeof(u64)) ||
+        copy_to_user(buf + first * sizeof(u64), ring_words, (n - first) * sizeof(u64))) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    // Words the timer overwrote during the copy are not trustworthy; read again
+    if (smp_load_acquire(&ring->head) - c->rpos > ring->nr_words)
+        goto retry;
+
+    c->rpos += n;
+    *offset += n * sizeof(u64);
+    ret = n * sizeof(u64);
+out:
+    mutex_unlock(&c->read_lock);
+    return ret;
+}
+
+// Maps the ring header and words read-only
+static int sample_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (!sample_hz)
+        return -ENODEV;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+}
+
+static ssize_t event_read(struct file *file, char __user *buf, size_t len);
+
+static ssize_t my_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+{
+    if (!sample_hz)
+        return event_read(file, buf, len);
+    return sample_read(file, buf, len, offset);
+}
+
+/* ---------- event filter programs ---------- */
+
+/*
+A consumer that only wants a few of the events attaches a filter program
+(IRQPOLL_SET_FILTER, instruction set in irqpoll_ioctl.h). It runs in the
+interrupt handler on each record, so an event nobody wants costs a few
+instructions instead of a wakeup, a context switch and a read().
+Programs are checked once, at attach time, so the handler can run them
+without any checks: every opcode, field and memory slot is valid, and
+forward-only jumps bound the run to len instructions.
+*/
+struct irqpoll_prog {
+    struct rcu_head rcu;
+    u32 mem[IRQPOLL_FILTER_MEM];        // kept across events; only the handler writes it
+    unsigned int len;
+    struct irqpoll_insn insns[];
+};
+
+static int irqpoll_check_prog(const struct irqpoll_insn *insns, unsigned int len)
+{
+    const struct irqpoll_insn *in;
+    unsigned int pc;
+
+    for (pc = 0; pc < len; pc++) {
+        in = &insns[pc];
+        if (in->pad)
+            return -EINVAL;
+        switch (in->op) {
+        case IRQPOLL_OP_LD:
+            if (in->k >= IRQPOLL_F_MAX)
+                return -EINVAL;
+            break;
+        case IRQPOLL_OP_LDM:
+        case IRQPOLL_OP_STM:
+            if (in->k >= IRQPOLL_FILTER_MEM)
+                return -EINVAL;
+            break;
+        case IRQPOLL_OP_MOD:
+            if (!in->k)
+                return -EINVAL;
+            break;
+        case IRQPOLL_OP_JEQ:
+        case IRQPOLL_OP_JGT:
+        case IRQPOLL_OP_JGE:
+            if (pc + 1 + max(in->jt, in->jf) >= len)
+                return -EINVAL;
+            break;
+        case IRQPOLL_OP_RET:
+            if (in->k > IRQPOLL_AGGREGATE)
+                return -EINVAL;
+            break;
+        case IRQPOLL_OP_LDI:
+        case IRQPOLL_OP_ADD:
+        case IRQPOLL_OP_SUB:
+        case IRQPOLL_OP_AND:
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+    // Straight-line code must not run off the end
+    return insns[len - 1].op == IRQPOLL_OP_RET ? 0 : -EINVAL;
+}
+
+static u32 irqpoll_run_prog(struct irqpoll_prog *prog, const struct irqpoll_event *ev, u32 folded)
+{
+    const struct irqpoll_insn *in;
+    unsigned int pc = 0;
+    u32 a = 0, cond;
+
+    for (;;) {
+        in = &prog->insns[pc++];
+        switch (in->op) {
+        case IRQPOLL_OP_LD:
+            switch (in->k) {
+            case IRQPOLL_F_LEVEL:    a = ev->level; break;
+            case IRQPOLL_F_WIDTH_US: a = min_t(u64, div_u64(ev->width_ns, 1000), U32_MAX); break;
+            case IRQPOLL_F_SEQ:      a = ev->seq; break;
+            default:                 a = folded; break;
+            }
+            break;
+        case IRQPOLL_OP_LDI: a = in->k; break;
+        case IRQPOLL_OP_LDM: a = prog->mem[in->k]; break;
+        case IRQPOLL_OP_STM: prog->mem[in->k] = a; break;
+        case IRQPOLL_OP_ADD: a += in->k; break;
+        case IRQPOLL_OP_SUB: a -= in->k; break;
+        case IRQPOLL_OP_AND: a &= in->k; break;
+        case IRQPOLL_OP_MOD: a %= in->k; break;
+        case IRQPOLL_OP_RET: return in->k;
+        default:
+            if (in->op == IRQPOLL_OP_JEQ)
+                cond = a == in->k;
+            else if (in->op == IRQPOLL_OP_JGT)
+                cond = a > in->k;
+            else
+                cond = a >= in->k;
+            pc += cond ? in->jt : in->jf;
+            break;
+        }
+    }
+}
+
+// Attaches a copy of the user's program, or detaches with len == 0
+static int irqpoll_set_filter(struct irqpoll_client *c, const struct irqpoll_filter __user *arg)
+{
+    struct irqpoll_prog *prog = NULL, *old;
+    struct irqpoll_filter f;
+    int ret;
+
+    if (sample_hz)
+        return -EOPNOTSUPP;     // the sampler has no events to filter
+    if (copy_from_user(&f, arg, sizeof(f)))
+        return -EFAULT;
+    if (f.len > IRQPOLL_FILTER_MAX_INSNS)
+        return -E2BIG;
+
+    if (f.len) {
+        prog = kzalloc(struct_size(prog, insns, f.len), GFP_KERNEL);
+        if (!prog)
+            return -ENOMEM;
+        prog->len = f.len;
+        if (copy_from_user(prog->insns, u64_to_user_ptr(f.insns),
+                           f.len * sizeof(struct irqpoll_insn))) {
+            kfree(prog);
+            return -EFAULT;
+        }
+        ret = irqpoll_check_prog(prog->insns, prog->len);
+        if (ret) {
+            kfree(prog);
+            return ret;
+        }
+    }
+
+    mutex_lock(&clients_lock);
+    old = rcu_replace_pointer(c->prog, prog, lockdep_is_held(&clients_lock));
+    mutex_unlock(&clients_lock);
+    if (old)
+        kfree_rcu(old, rcu);
+    return 0;
+}
+
+/* ---------- interrupt mode ---------- */
+
+/*
+Replay
+IRQPOLL_INJECT queues recorded edges (see irqcap.h and irqreplay.c) with
+the CLOCK_MONOTONIC time each one is due. An hrtimer emits them at that
+time through irqpoll_emit(), the same path as a real interrupt, so
+filters, queues, wakeups and statistics see a production load shape.
+It is not a hard timer: it wakes consumers, which PREEMPT_RT only allows
+from its soft timer context (elsewhere it expires in hard irq anyway).
+With replay_only=1 no GPIO or IRQ is requested at all and replayed
+events are the only ones; otherwise the two are interleaved.
+*/
+static bool replay_only;
+module_param(replay_only, bool, 0444);
+MODULE_PARM_DESC(replay_only, "Take events only from IRQPOLL_INJECT; request no GPIO or IRQ (no hardware needed)");
+
+#define INJECT_CHUNK    64          // events copied in per step of an IRQPOLL_INJECT
+#define INJECT_BURST    256         // most events one timer tick emits when behind
+
+static DEFINE_KFIFO(inject_fifo, struct irqpoll_replay_ev, IRQPOLL_INJECT_QUEUE);
+static DEFINE_SPINLOCK(inject_lock);       // the fifo, inject_armed, inject_last_due
+static DEFINE_MUTEX(inject_mutex);         // one injecting caller at a time
+static DECLARE_WAIT_QUEUE_HEAD(inject_wait);
+static struct hrtimer inject_timer;
+static bool inject_armed;                  // timer queued or running with events left
+static u64 inject_last_due;
+
+// Runs c's filter on ev and queues the record if it is delivered; irq context
+static void irqpoll_offer(struct irqpoll_client *c, const struct irqpoll_event *ev)
+{
+    struct irqpoll_prog *prog = rcu_dereference(c->prog);
+    struct irqpoll_event rec;
+    u32 verdict = prog ? irqpoll_run_prog(prog, ev, c->folded) : IRQPOLL_DELIVER;
+
+    switch (verdict) {
+    case IRQPOLL_DROP:
+        c->fstats.dropped++;
+        return;
+    case IRQPOLL_AGGREGATE:
+        c->folded++;
+        c->fstats.aggregated++;
+        return;
+    }
+
+    rec = *ev;
+    rec.folded = c->folded;
+    c->folded = 0;
+    c->fstats.delivered++;
+    if (!kfifo_put(&c->events, rec))
+        c->fstats.overflow++;   // queue full: this record is lost
+    WRITE_ONCE(c->last_ns, ev->time_ns);
+    atomic_inc(&c->delivered);
+    wake_up(&c->wait);  // wake this consumer in poll() or read()
+}
+
+// One edge at time_ns: builds its record and offers it to every consumer; irq context
+static void irqpoll_emit(u64 time_ns, u8 level)
+{
+    struct irqpoll_event ev = {
+        .time_ns = time_ns,
+        .level   = level,
+    };
+    struct irqpoll_client *c;
+    unsigned long flags;
+
+    spin_lock_irqsave(&emit_lock, flags);
+    ev.width_ns = time_ns > last_edge_ns ? time_ns - last_edge_ns : 0;
+    ev.seq = irq_seq++;
+    irq_ready = 1;
+    last_edge_ns = time_ns;
+
+    rcu_read_lock();
+    list_for_each_entry_rcu(c, &clients, node)
+        irqpoll_offer(c, &ev);
+    rcu_read_unlock();
+    spin_unlock_irqrestore(&emit_lock, flags);
+}
+
 static irq_handler_t gpio_irq_poll_handler(unsigned int irq, void *dev_id,
                                            struct pt_regs *regs)
 {
-    printk(KERN_INFO "gpio_irq_poll: Button interrupt detected!\n");
-    irq_ready = 1;
-    wake_up(&waitqueue);  // wake processes in poll()
+    u64 t0 = ktime_get_ns();
+
+    printk_ratelimited(KERN_INFO "gpio_irq_poll: Button interrupt detected!\n");
+    irqpoll_emit(t0, !!gpio_get_value(GPIO_BUTTON));
+
+    devstats_end(&stats, STAT_IRQ, t0, 0);
     return (irq_handler_t)IRQ_HANDLED;
 }
 
+/*
+Emits every queued event that is due, stamped with its due time rather
+than the (slightly later) time the timer ran, so widths replay exactly.
+A tick that finds too many overdue events emits INJECT_BURST of them and
+runs again at once.
+*/
+static enum hrtimer_restart inject_tick(struct hrtimer *timer)
+{
+    u64 now = ktime_get_ns();
+    struct irqpoll_replay_ev ev;
+    unsigned int n = 0;
+    bool more;
+
+    spin_lock(&inject_lock);
+    while ((more = kfifo_peek(&inject_fifo, &ev)) && ev.due_ns <= now && n < INJECT_BURST) {
+        kfifo_skip(&inject_fifo);
+        irqpoll_emit(ev.due_ns, !!ev.level);
+        n++;
+    }
+    if (more)
+        hrtimer_set_expires(timer, ns_to_ktime(max(ev.due_ns, now)));
+    else
+        inject_armed = false;   // the next IRQPOLL_INJECT starts the timer again
+    spin_unlock(&inject_lock);
+
+    wake_up(&inject_wait);
+    return more ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+static long irqpoll_inject(struct file *file, struct irqpoll_inject __user *arg)
+{
+    struct irqpoll_replay_ev __user *src;
+    struct irqpoll_replay_ev *buf;
+    struct irqpoll_inject req;
+    unsigned int done = 0, n, i;
+    long ret = 0;
+
+    if (sample_hz)
+        return -EINVAL;     // sampling mode has no event pipeline
+    if (copy_from_user(&req, arg, sizeof(req)))
+        return -EFAULT;
+    src = u64_to_user_ptr(req.events);
+
+    buf = kmalloc_array(INJECT_CHUNK, sizeof(*buf), GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    // The fifo has a single producer; the timer only ever takes from it
+    mutex_lock(&inject_mutex);
+    while (done < req.nr) {
+        n = min_t(unsigned int, req.nr - done, INJECT_CHUNK);
+        if (file->f_flags & O_NONBLOCK) {
+            n = min_t(unsigned int, n, kfifo_avail(&inject_fifo));
+            if (!n) {
+                ret = -EAGAIN;
+                break;
+            }
+        } else if (wait_event_interruptible(inject_wait, kfifo_avail(&inject_fifo) >= n)) {
+            ret = -ERESTARTSYS;
+            break;
+        }
+        if (copy_from_user(buf, src + done, n * sizeof(*buf))) {
+            ret = -EFAULT;
+            break;
+        }
+
+        spin_lock_irq(&inject_lock);
+        for (i = 0; i < n; i++) {
+            buf[i].due_ns = max(buf[i].due_ns, inject_last_due);
+            inject_last_due = buf[i].due_ns;
+            kfifo_put(&inject_fifo, buf[i]);
+        }
+        // Not armed means the fifo was empty, so buf[0] is now its head
+        if (!inject_armed) {
+            inject_armed = true;
+            hrtimer_start(&inject_timer, ns_to_ktime(buf[0].due_ns), HRTIMER_MODE_ABS);
+        }
+        spin_unlock_irq(&inject_lock);
+        done += n;
+    }
+    mutex_unlock(&inject_mutex);
+    kfree(buf);
+
+    // Whatever was queued stays queued; report it rather than the error
+    if (!done)
+        return ret;
+    req.nr = done;
+    return copy_to_user(arg, &req, sizeof(req)) ? -EFAULT : 0;
+}
+
+// Interrupt mode read(): whole records from the file's queue
+static ssize_t event_read(struct file *file, char __user *buf, size_t len)
+{
+    struct irqpoll_client *c = file->private_data;
+    unsigned int copied;
+    int ret;
+
+    if (len < sizeof(struct irqpoll_event))
+        return -EINVAL;
+
+    if (file->f_flags & O_NONBLOCK) {
+        if (kfifo_is_empty(&c->events))
+            return -EAGAIN;
+    } else if (wait_event_interruptible(c->wait, !kfifo_is_empty(&c->events))) {
+        return -ERESTARTSYS;
+    }
+
+    mutex_lock(&c->read_lock);
+    ret = kfifo_to_user(&c->events, buf, len, &copied);
+    mutex_unlock(&c->read_lock);
+    return ret ? ret : copied;
+}
+
 static unsigned int my_poll(struct file *file, poll_table *wait)
 {
-    poll_wait(file, &waitqueue, wait);
+    struct irqpoll_client *c = file->private_data;
+    u64 t0 = ktime_get_ns();
+    unsigned int mask = 0;
+    int events;
 
-    if (irq_ready == 1) {
+    if (sample_hz) {
+        poll_wait(file, &waitqueue, wait);
+        mask = smp_load_acquire(&ring->head) != c->rpos ? POLLIN : 0;
+        devstats_end(&stats, STAT_POLL, t0, 0);
+        return mask;
+    }
+
+    poll_wait(file, &c->wait, wait);
+
+    if (!kfifo_is_empty(&c->events)) {
         irq_ready = 0;
-        return POLLIN;   // Data ready
+        mask = POLLIN;   // Data ready
+    }
+
+    // The first poll() after a batch of deliveries times the wakeup
+    events = atomic_read(&c->delivered);
+    if (c->seen != events) {
+        c->seen = events;
+        devstats_add(&stats, STAT_WAKEUP, 0, false, t0 - READ_ONCE(c->last_ns));
     }
+    devstats_end(&stats, STAT_POLL, t0, 0);
+    return mask;
+}
+
+static int my_open(struct inode *inode, struct file *file)
+{
+    struct irqpoll_client *c = kzalloc(sizeof(*c), GFP_KERNEL);
+
+    if (!c)
+        return -ENOMEM;
+    c->budget_us = READ_ONCE(qos_latency_us);
+    init_waitqueue_head(&c->wait);
+    mutex_init(&c->read_lock);
+    INIT_KFIFO(c->events);
+    if (sample_hz)
+        c->rpos = smp_load_acquire(&ring->head);   // capture starts now
+    file->private_data = c;
+
+    mutex_lock(&clients_lock);
+    list_add_rcu(&c->node, &clients);
+    irqpoll_update_qos();
+    mutex_unlock(&clients_lock);
     return 0;
 }
 
-static struct file_operations fops = {
-    .owner = THIS_MODULE,
-    .poll  = my_poll,
-};
+// The handler may still be looking at c: free it after a grace period
+static void irqpoll_client_free(struct rcu_head *head)
+{
+    struct irqpoll_client *c = container_of(head, struct irqpoll_client, rcu);
 
-static int __init ModuleInit(void)
+    kfree(rcu_dereference_protected(c->prog, 1));
+    kfree(c);
+}
+
+static int my_release(struct inode *inode, struct file *file)
 {
-    int result;
+    struct irqpoll_client *c = file->private_data;
 
-    printk(KERN_INFO "gpio_irq_poll: Initializing module...\n");
+    mutex_lock(&clients_lock);
+    list_del_rcu(&c->node);
+    irqpoll_update_qos();
+    mutex_unlock(&clients_lock);
+    call_rcu(&c->rcu, irqpoll_client_free);
+    return 0;
+}
 
-    /*
- * When this module is loaded, the kernel first runs the ModuleInit() function.
- *
- * Inside ModuleInit():
- *  - Sets up a waitqueue.
- *  - Validates and requests control of GPIO pin 17.
- *  - Configures GPIO 17 as input.
- *  - Exports it for visibility in sysfs.
- *
- * Why waitqueue?
- *  - Processes calling poll() may need to sleep until an event occurs.
- *  - The waitqueue provides the mechanism for the kernel to block
- *    those processes efficiently and wake them later.
- *
- * Implementation detail:
- *  - A waitqueue is set up by declaring a wait_queue_head_t, e.g.:
- *        DECLARE_WAIT_QUEUE_HEAD(my_queue);
- *    or:
- *        init_waitqueue_head(&my_queue);
- *  - This object acts as the anchor point for all sleeping processes.
- */
+static long my_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct irqpoll_client *c = file->private_data;
+    int budget;
+    u64 lost;
 
-    init_waitqueue_head(&waitqueue);
+    switch (cmd) {
+    case IRQPOLL_SET_LATENCY:
+        if (copy_from_user(&budget, (int __user *)arg, sizeof(budget)))
+            return -EFAULT;
+        mutex_lock(&clients_lock);
+        c->budget_us = budget < 0 ? -1 : budget;
+        irqpoll_update_qos();
+        mutex_unlock(&clients_lock);
+        return 0;
+    case IRQPOLL_GET_LATENCY:
+        mutex_lock(&clients_lock);
+        budget = qos_bound_us;
+        mutex_unlock(&clients_lock);
+        return copy_to_user((int __user *)arg, &budget, sizeof(budget)) ? -EFAULT : 0;
+    case IRQPOLL_GET_LOST:
+        mutex_lock(&c->read_lock);
+        lost = c->lost;
+        mutex_unlock(&c->read_lock);
+        return copy_to_user((u64 __user *)arg, &lost, sizeof(lost)) ? -EFAULT : 0;
+    case IRQPOLL_SET_FILTER:
+        return irqpoll_set_filter(c, (const struct irqpoll_filter __user *)arg);
+    case IRQPOLL_GET_FILTER_STATS:
+        return copy_to_user((void __user *)arg, &c->fstats, sizeof(c->fstats)) ? -EFAULT : 0;
+    case IRQPOLL_INJECT:
+        return irqpoll_inject(file, (struct irqpoll_inject __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+static struct file_operations fops = {
+    .owner          = THIS_MODULE,
+    .open           = my_open,
+    .release        = my_release,
+    .poll           = my_poll,
+    .read           = my_read,
+    .mmap           = sample_mmap,
+    .unlocked_ioctl = my_ioctl,
+};
+
+static int __init irq_mode_init(void)
+{
+    int result;
 
     /*  
  * Validate that GPIO_BUTTON (GPIO 17) is a valid GPIO number supported 
@@ -133,14 +881,76 @@ static int __init ModuleInit(void)
         gpio_free(GPIO_BUTTON);
         return result;
     }
+    return 0;
+}
+
+// Releases whatever produces events: the sampling timer, or the replay timer and the IRQ
+static void irqpoll_stop_source(void)
+{
+    if (sample_hz) {
+        sample_exit();
+        return;
+    }
+    hrtimer_cancel(&inject_timer);
+    if (!replay_only) {
+        free_irq(irq_number, NULL);
+        gpio_unexport(GPIO_BUTTON);
+        gpio_free(GPIO_BUTTON);
+    }
+}
+
+static int __init ModuleInit(void)
+{
+    int result;
+
+    printk(KERN_INFO "gpio_irq_poll: Initializing module...\n");
+
+    /*
+ * When this module is loaded, the kernel first runs the ModuleInit() function.
+ *
+ * Inside ModuleInit():
+ *  - Sets up a waitqueue.
+ *  - Validates and requests control of GPIO pin 17.
+ *  - Configures GPIO 17 as input.
+ *  - Exports it for visibility in sysfs.
+ *
+ * Why waitqueue?
+ *  - Processes calling poll() may need to sleep until an event occurs.
+ *  - The waitqueue provides the mechanism for the kernel to block
+ *    those processes efficiently and wake them later.
+ *
+ * Implementation detail:
+ *  - A waitqueue is set up by declaring a wait_queue_head_t, e.g.:
+ *        DECLARE_WAIT_QUEUE_HEAD(my_queue);
+ *    or:
+ *        init_waitqueue_head(&my_queue);
+ *  - This object acts as the anchor point for all sleeping processes.
+ */
+
+    init_waitqueue_head(&waitqueue);
+
+    result = devstats_register(&stats, DEVICE_NAME, stat_channels, ARRAY_SIZE(stat_channels));
+    if (result)
+        return result;
+
+    hrtimer_init(&inject_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    inject_timer.function = inject_tick;
+
+    if (sample_hz)
+        result = sample_init();
+    else
+        result = replay_only ? 0 : irq_mode_init();
+    if (result) {
+        devstats_unregister(&stats);
+        return result;
+    }
 
     // Register character device
     result = register_chrdev(DEVICE_MAJOR, DEVICE_NAME, &fops);
     if (result < 0) {
         printk(KERN_ERR "gpio_irq_poll: Failed to register device\n");
-        free_irq(irq_number, NULL);
-        gpio_unexport(GPIO_BUTTON);
-        gpio_free(GPIO_BUTTON);
+        irqpoll_stop_source();
+        devstats_unregister(&stats);
         return result;
     }
 
@@ -151,10 +961,10 @@ static int __init ModuleInit(void)
 
 static void __exit ModuleExit(void)
 {
-    free_irq(irq_number, NULL);
-    gpio_unexport(GPIO_BUTTON);
-    gpio_free(GPIO_BUTTON);
     unregister_chrdev(DEVICE_MAJOR, DEVICE_NAME);
+    irqpoll_stop_source();
+    devstats_unregister(&stats);
+    rcu_barrier();  // irqpoll_client_free() callbacks of the last closes
 
     printk(KERN_INFO "gpio_irq_poll: Module unloaded\n");
 }
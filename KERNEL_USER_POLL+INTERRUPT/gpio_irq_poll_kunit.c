@@ -0,0 +1,381 @@
+// KUnit suites of irqpoll: filters, queues, poll, replay and latency budgets (see ../common/ktest.h)
+#include "gpio_irq_poll.c"
+#include "../common/ktest.h"
+
+/*
+Load with replay_only=1 (kunit/run-qemu.sh does): no GPIO is needed, and
+the only events are the ones the tests emit. The tests open consumers of
+their own and call irqpoll_emit() as the interrupt handler would.
+*/
+static struct irqpoll_insn width_prog[] = {
+    { .op = IRQPOLL_OP_LD, .k = IRQPOLL_F_WIDTH_US },
+    { .op = IRQPOLL_OP_JGT, .jt = 0, .jf = 1, .k = 500 },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DELIVER },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DROP },
+};
+
+static struct irqpoll_insn every_4_prog[] = {
+    { .op = IRQPOLL_OP_LDM, .k = 0 },
+    { .op = IRQPOLL_OP_ADD, .k = 1 },
+    { .op = IRQPOLL_OP_MOD, .k = 4 },
+    { .op = IRQPOLL_OP_STM, .k = 0 },
+    { .op = IRQPOLL_OP_JEQ, .jt = 0, .jf = 1, .k = 0 },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DELIVER },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_AGGREGATE },
+};
+
+static void client_close(void *file)
+{
+    my_release(NULL, file);
+}
+
+// A consumer as an open() of /dev/irqpoll would make it, closed when the test ends
+static struct file *client_open(struct kunit *test, unsigned int f_flags)
+{
+    struct file *file;
+
+    if (sample_hz)
+        kunit_skip(test, "interrupt mode only");
+    file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    file->f_flags = f_flags;
+    KUNIT_ASSERT_EQ(test, my_open(NULL, file), 0);
+    KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, client_close, file), 0);
+    return file;
+}
+
+// Attaches a filter through the ioctl, from user memory like a real caller
+static long client_filter(struct kunit *test, struct file *file,
+                          const struct irqpoll_insn *insns, unsigned int len)
+{
+    struct irqpoll_filter __user *uf;
+    struct irqpoll_filter f;
+
+    uf = ktest_user_buf(test, sizeof(f) + len * sizeof(*insns));
+    f = (struct irqpoll_filter){ .len = len, .insns = (unsigned long)(uf + 1) };
+    KUNIT_ASSERT_EQ(test, copy_to_user(uf, &f, sizeof(f)), 0);
+    KUNIT_ASSERT_EQ(test, copy_to_user(uf + 1, insns, len * sizeof(*insns)), 0);
+    return my_ioctl(file, IRQPOLL_SET_FILTER, (unsigned long)uf);
+}
+
+// Edges width_us apart, continuing from the last one emitted
+static void emit_widths(const unsigned int *width_us, unsigned int nr)
+{
+    u64 t = READ_ONCE(last_edge_ns);
+    unsigned int i;
+
+    for (i = 0; i < nr; i++) {
+        t += width_us[i] * NSEC_PER_USEC;
+        irqpoll_emit(t, i & 1);
+    }
+}
+
+static void client_set_latency(struct kunit *test, struct file *file, int budget_us)
+{
+    int __user *ubudget = ktest_user_buf(test, sizeof(int));
+
+    KUNIT_ASSERT_EQ(test, put_user(budget_us, ubudget), 0);
+    KUNIT_ASSERT_EQ(test, my_ioctl(file, IRQPOLL_SET_LATENCY, (unsigned long)ubudget), 0);
+}
+
+static int bound_us(struct kunit *test, struct file *file)
+{
+    int __user *ubound = ktest_user_buf(test, sizeof(int));
+    int bound;
+
+    KUNIT_ASSERT_EQ(test, my_ioctl(file, IRQPOLL_GET_LATENCY, (unsigned long)ubound), 0);
+    KUNIT_ASSERT_EQ(test, get_user(bound, ubound), 0);
+    return bound;
+}
+
+static struct irqpoll_filter_stats client_stats(struct file *file)
+{
+    return ((struct irqpoll_client *)file->private_data)->fstats;
+}
+
+/* ---------- filter programs ---------- */
+
+static void prog_check_test(struct kunit *test)
+{
+    struct irqpoll_insn bad[][2] = {
+        { { .op = IRQPOLL_OP_MAX }, { .op = IRQPOLL_OP_RET } },
+        { { .op = IRQPOLL_OP_LD, .k = IRQPOLL_F_MAX }, { .op = IRQPOLL_OP_RET } },
+        { { .op = IRQPOLL_OP_LDM, .k = IRQPOLL_FILTER_MEM }, { .op = IRQPOLL_OP_RET } },
+        { { .op = IRQPOLL_OP_MOD, .k = 0 }, { .op = IRQPOLL_OP_RET } },
+        { { .op = IRQPOLL_OP_JEQ, .jt = 1 }, { .op = IRQPOLL_OP_RET } },  // jumps off the end
+        { { .op = IRQPOLL_OP_LDI, .pad = 1 }, { .op = IRQPOLL_OP_RET } },
+        { { .op = IRQPOLL_OP_RET }, { .op = IRQPOLL_OP_LDI } },           // runs off the end
+        { { .op = IRQPOLL_OP_LDI }, { .op = IRQPOLL_OP_RET, .k = IRQPOLL_AGGREGATE + 1 } },
+    };
+    int i;
+
+    KUNIT_EXPECT_EQ(test, irqpoll_check_prog(width_prog, ARRAY_SIZE(width_prog)), 0);
+    KUNIT_EXPECT_EQ(test, irqpoll_check_prog(every_4_prog, ARRAY_SIZE(every_4_prog)), 0);
+    for (i = 0; i < ARRAY_SIZE(bad); i++)
+        KUNIT_EXPECT_EQ_MSG(test, irqpoll_check_prog(bad[i], 2), -EINVAL, "program %d", i);
+}
+
+static void prog_run_test(struct kunit *test)
+{
+    struct irqpoll_prog *prog;
+    struct irqpoll_event ev = {};
+    int i;
+
+    prog = kunit_kzalloc(test, struct_size(prog, insns, ARRAY_SIZE(every_4_prog)), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, prog);
+    memcpy(prog->insns, width_prog, sizeof(width_prog));
+    prog->len = ARRAY_SIZE(width_prog);
+    ev.width_ns = 500 * NSEC_PER_USEC;
+    KUNIT_EXPECT_EQ(test, irqpoll_run_prog(prog, &ev, 0), IRQPOLL_DROP);
+    ev.width_ns += NSEC_PER_USEC;
+    KUNIT_EXPECT_EQ(test, irqpoll_run_prog(prog, &ev, 0), IRQPOLL_DELIVER);
+    ev.width_ns = U64_MAX;      // saturates instead of wrapping to a short width
+    KUNIT_EXPECT_EQ(test, irqpoll_run_prog(prog, &ev, 0), IRQPOLL_DELIVER);
+
+    // Memory keeps its value from one event to the next
+    memcpy(prog->insns, every_4_prog, sizeof(every_4_prog));
+    prog->len = ARRAY_SIZE(every_4_prog);
+    for (i = 1; i <= 12; i++)
+        KUNIT_EXPECT_EQ_MSG(test, irqpoll_run_prog(prog, &ev, 0),
+                            i % 4 ? IRQPOLL_AGGREGATE : IRQPOLL_DELIVER, "event %d", i);
+}
+
+/* ---------- event path ---------- */
+
+// Records reach every consumer, in order, with consecutive sequence numbers and widths
+static void emit_read_test(struct kunit *test)
+{
+    static const unsigned int widths[] = { 100, 2000, 30, 700 };
+    struct file *a = client_open(test, O_NONBLOCK);
+    struct file *b = client_open(test, O_NONBLOCK);
+    struct irqpoll_event __user *ubuf = ktest_user_buf(test, 8 * sizeof(struct irqpoll_event));
+    struct irqpoll_event ev[4];
+    int i;
+
+    KUNIT_EXPECT_EQ(test, my_poll(a, NULL), 0);
+    KUNIT_EXPECT_EQ(test, event_read(a, (char __user *)ubuf, 8 * sizeof(ev[0])), -EAGAIN);
+    KUNIT_EXPECT_EQ(test, event_read(a, (char __user *)ubuf, sizeof(ev[0]) - 1), -EINVAL);
+
+    emit_widths(widths, ARRAY_SIZE(widths));
+    KUNIT_EXPECT_EQ(test, my_poll(a, NULL), POLLIN);
+    KUNIT_EXPECT_EQ(test, my_poll(a, NULL), POLLIN);    // until the queue is read
+
+    KUNIT_ASSERT_EQ(test, event_read(a, (char __user *)ubuf, 8 * sizeof(ev[0])),
+                    (ssize_t)sizeof(ev));
+    KUNIT_ASSERT_EQ(test, copy_from_user(ev, ubuf, sizeof(ev)), 0);
+    for (i = 0; i < ARRAY_SIZE(ev); i++) {
+        KUNIT_EXPECT_EQ(test, ev[i].width_ns, widths[i] * NSEC_PER_USEC);
+        KUNIT_EXPECT_EQ(test, ev[i].level, i & 1);
+        KUNIT_EXPECT_EQ(test, ev[i].folded, 0);
+        if (i)
+            KUNIT_EXPECT_EQ(test, ev[i].seq, ev[i - 1].seq + 1);
+    }
+    KUNIT_EXPECT_EQ(test, event_read(a, (char __user *)ubuf, 8 * sizeof(ev[0])), -EAGAIN);
+    KUNIT_EXPECT_EQ(test, my_poll(a, NULL), 0);
+
+    // b was not read: it still holds its own copy
+    KUNIT_EXPECT_EQ(test, event_read(b, (char __user *)ubuf, 8 * sizeof(ev[0])),
+                    (ssize_t)sizeof(ev));
+}
+
+static void filter_test(struct kunit *test)
+{
+    static const unsigned int widths[] = { 100, 2000, 30, 700, 1, 1, 1, 1 };
+    struct file *w = client_open(test, O_NONBLOCK);
+    struct file *n = client_open(test, O_NONBLOCK);
+    struct irqpoll_event __user *ubuf = ktest_user_buf(test, 8 * sizeof(struct irqpoll_event));
+    struct irqpoll_filter_stats st;
+    struct irqpoll_event ev[2];
+
+    KUNIT_ASSERT_EQ(test, client_filter(test, w, width_prog, ARRAY_SIZE(width_prog)), 0);
+    KUNIT_ASSERT_EQ(test, client_filter(test, n, every_4_prog, ARRAY_SIZE(every_4_prog)), 0);
+    emit_widths(widths, ARRAY_SIZE(widths));
+
+    st = client_stats(w);
+    KUNIT_EXPECT_EQ(test, st.delivered, 2);
+    KUNIT_EXPECT_EQ(test, st.dropped, 6);
+    KUNIT_ASSERT_EQ(test, event_read(w, (char __user *)ubuf, 8 * sizeof(ev[0])),
+                    (ssize_t)sizeof(ev));
+    KUNIT_ASSERT_EQ(test, copy_from_user(ev, ubuf, sizeof(ev)), 0);
+    KUNIT_EXPECT_EQ(test, ev[0].width_ns, 2000 * NSEC_PER_USEC);
+    KUNIT_EXPECT_EQ(test, ev[1].width_ns, 700 * NSEC_PER_USEC);
+
+    // Every fourth event, carrying the three before it
+    st = client_stats(n);
+    KUNIT_EXPECT_EQ(test, st.delivered, 2);
+    KUNIT_EXPECT_EQ(test, st.aggregated, 6);
+    KUNIT_ASSERT_EQ(test, event_read(n, (char __user *)ubuf, 8 * sizeof(ev[0])),
+                    (ssize_t)sizeof(ev));
+    KUNIT_ASSERT_EQ(test, copy_from_user(ev, ubuf, sizeof(ev)), 0);
+    KUNIT_EXPECT_EQ(test, ev[0].folded, 3);
+    KUNIT_EXPECT_EQ(test, ev[1].folded, 3);
+    KUNIT_EXPECT_EQ(test, ev[1].seq, ev[0].seq + 4);
+
+    // Detached again, everything is delivered
+    KUNIT_ASSERT_EQ(test, client_filter(test, w, NULL, 0), 0);
+    emit_widths(widths, 1);
+    KUNIT_EXPECT_EQ(test, client_stats(w).delivered, 3);
+}
+
+// Refused before the instructions are even copied in
+static void filter_bad_test(struct kunit *test)
+{
+    struct irqpoll_filter __user *uf = ktest_user_buf(test, sizeof(*uf));
+    struct file *f = client_open(test, O_NONBLOCK);
+    struct irqpoll_filter big = { .len = IRQPOLL_FILTER_MAX_INSNS + 1 };
+    struct irqpoll_filter unmapped = { .len = 1, .insns = 16 };
+
+    KUNIT_ASSERT_EQ(test, copy_to_user(uf, &big, sizeof(big)), 0);
+    KUNIT_EXPECT_EQ(test, my_ioctl(f, IRQPOLL_SET_FILTER, (unsigned long)uf), -E2BIG);
+    KUNIT_ASSERT_EQ(test, copy_to_user(uf, &unmapped, sizeof(unmapped)), 0);
+    KUNIT_EXPECT_EQ(test, my_ioctl(f, IRQPOLL_SET_FILTER, (unsigned long)uf), -EFAULT);
+    KUNIT_EXPECT_EQ(test, client_filter(test, f, width_prog, 2), -EINVAL);
+}
+
+// A full queue loses records but still counts and reports the deliveries
+static void overflow_test(struct kunit *test)
+{
+    static const unsigned int width[] = { 10 };
+    struct file *f = client_open(test, O_NONBLOCK);
+    int i;
+
+    for (i = 0; i < CLIENT_QUEUE_LEN + 3; i++)
+        emit_widths(width, 1);
+    KUNIT_EXPECT_EQ(test, client_stats(f).delivered, CLIENT_QUEUE_LEN + 3);
+    KUNIT_EXPECT_EQ(test, client_stats(f).overflow, 3);
+    KUNIT_EXPECT_EQ(test, my_poll(f, NULL), POLLIN);
+}
+
+// Replayed events come out at their due time, stamped with it, through the same path
+static void inject_test(struct kunit *test)
+{
+    struct file *f = client_open(test, 0);
+    struct irqpoll_inject __user *ureq;
+    struct irqpoll_replay_ev __user *uev;
+    struct irqpoll_replay_ev rev[3];
+    struct irqpoll_event __user *ubuf;
+    struct irqpoll_event ev[3];
+    struct irqpoll_inject req;
+    u64 t0 = ktime_get_ns() + 5 * NSEC_PER_MSEC;
+    ssize_t got = 0, n;
+    int i;
+
+    ureq = ktest_user_buf(test, sizeof(req) + sizeof(rev));
+    uev = (struct irqpoll_replay_ev __user *)(ureq + 1);
+    ubuf = ktest_user_buf(test, sizeof(ev));
+    for (i = 0; i < ARRAY_SIZE(rev); i++)
+        rev[i] = (struct irqpoll_replay_ev){ .due_ns = t0 + i * NSEC_PER_MSEC, .level = i & 1 };
+    rev[2].due_ns = t0;     // out of order: moved up to its predecessor
+    req = (struct irqpoll_inject){ .events = (unsigned long)uev, .nr = ARRAY_SIZE(rev) };
+    KUNIT_ASSERT_EQ(test, copy_to_user(uev, rev, sizeof(rev)), 0);
+    KUNIT_ASSERT_EQ(test, copy_to_user(ureq, &req, sizeof(req)), 0);
+
+    KUNIT_ASSERT_EQ(test, my_ioctl(f, IRQPOLL_INJECT, (unsigned long)ureq), 0);
+    KUNIT_ASSERT_EQ(test, copy_from_user(&req, ureq, sizeof(req)), 0);
+    KUNIT_EXPECT_EQ(test, req.nr, ARRAY_SIZE(rev));
+
+    // Blocking reads: each returns once the timer has emitted something
+    while (got < sizeof(ev)) {
+        n = event_read(f, (char __user *)ubuf + got, sizeof(ev) - got);
+        KUNIT_ASSERT_GT(test, n, 0);
+        got += n;
+    }
+    KUNIT_EXPECT_GE(test, ktime_get_ns(), t0 + NSEC_PER_MSEC);
+    KUNIT_ASSERT_EQ(test, copy_from_user(ev, ubuf, sizeof(ev)), 0);
+    KUNIT_EXPECT_EQ(test, ev[0].time_ns, t0);
+    KUNIT_EXPECT_EQ(test, ev[1].time_ns, t0 + NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, ev[2].time_ns, t0 + NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, ev[1].width_ns, NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, ev[2].width_ns, 0);
+    KUNIT_EXPECT_EQ(test, ev[1].level, 1);
+}
+
+// The driver holds the tightest budget of its consumers, and none once they are gone
+static void latency_test(struct kunit *test)
+{
+    struct file *a, *b;
+
+    if (qos_latency_us >= 0)
+        kunit_skip(test, "needs qos_latency_us=-1");
+    a = client_open(test, 0);
+    b = client_open(test, 0);
+    KUNIT_EXPECT_EQ(test, bound_us(test, a), -1);
+    client_set_latency(test, a, 200);
+    client_set_latency(test, b, 50);
+    KUNIT_EXPECT_EQ(test, bound_us(test, a), 50);
+    client_set_latency(test, b, -7);
+    KUNIT_EXPECT_EQ(test, bound_us(test, a), 200);
+
+    my_release(NULL, a);
+    KUNIT_EXPECT_EQ(test, bound_us(test, b), -1);
+    KUNIT_EXPECT_EQ(test, my_open(NULL, a), 0);     // closed again at the end
+
+    KUNIT_EXPECT_EQ(test, my_ioctl(a, IRQPOLL_SET_LATENCY, 0), -EFAULT);
+    KUNIT_EXPECT_EQ(test, my_ioctl(a, _IO(IRQPOLL_IOCTL_MAGIC, 9), 0), -ENOTTY);
+}
+
+static struct kunit_case irqpoll_cases[] = {
+    KUNIT_CASE(prog_check_test),
+    KUNIT_CASE(prog_run_test),
+    KUNIT_CASE(emit_read_test),
+    KUNIT_CASE(filter_test),
+    KUNIT_CASE(filter_bad_test),
+    KUNIT_CASE(overflow_test),
+    KUNIT_CASE(inject_test),
+    KUNIT_CASE(latency_test),
+    {}
+};
+
+static struct kunit_suite irqpoll_suite = {
+    .name = "irqpoll",
+    .test_cases = irqpoll_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+/*
+What one interrupt costs in the handler, by the number of consumers and
+what their filters do with it. Nobody reads, so queues overflow after the
+first records; kfifo_put() failing costs the same as succeeding.
+*/
+static void emit_bench(struct kunit *test)
+{
+    struct file *f[8];
+    u64 t = READ_ONCE(last_edge_ns);
+    int i;
+
+    f[0] = client_open(test, O_NONBLOCK);
+    ktest_bench(test, "1 consumer", irqpoll_emit(t += 1000, 0));
+
+    KUNIT_ASSERT_EQ(test, client_filter(test, f[0], width_prog, ARRAY_SIZE(width_prog)), 0);
+    ktest_bench(test, "1 consumer, dropped", irqpoll_emit(t += 1000, 0));
+
+    for (i = 1; i < ARRAY_SIZE(f); i++) {
+        f[i] = client_open(test, O_NONBLOCK);
+        KUNIT_ASSERT_EQ(test, client_filter(test, f[i], width_prog, ARRAY_SIZE(width_prog)), 0);
+    }
+    ktest_bench(test, "8 consumers, dropped", irqpoll_emit(t += 1000, 0));
+    for (i = 0; i < ARRAY_SIZE(f); i++)
+        KUNIT_ASSERT_EQ(test, client_filter(test, f[i], NULL, 0), 0);
+    ktest_bench(test, "8 consumers", irqpoll_emit(t += 1000, 0));
+}
+
+static void poll_bench(struct kunit *test)
+{
+    struct file *f = client_open(test, O_NONBLOCK);
+
+    ktest_bench(test, "idle", my_poll(f, NULL));
+}
+
+static struct kunit_case irqpoll_bench_cases[] = {
+    KUNIT_CASE_SLOW(emit_bench),
+    KUNIT_CASE_SLOW(poll_bench),
+    {}
+};
+
+static struct kunit_suite irqpoll_bench_suite = {
+    .name = "irqpoll_bench",
+    .test_cases = irqpoll_bench_cases,
+};
+
+kunit_test_suites(&irqpoll_suite, &irqpoll_bench_suite);
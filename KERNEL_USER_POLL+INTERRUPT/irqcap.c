@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdint.h>
+#include "irqcap.h"
+
+#define DEVICE_PATH "/dev/irqpoll"
+
+/*
+ * Usage: ./irqcap <out.irqcap> [seconds] [quantum_ns]
+ *        ./irqcap -t [events] [quantum_ns]
+ * Records every event of /dev/irqpoll (interrupt mode) into a capture file
+ * (format in irqcap.h) until the time is up (default: until Ctrl-C).
+ * quantum_ns is the timestamp resolution kept, default 1000; a coarser
+ * quantum turns more of a jittery signal into runs. Events the capture was
+ * too slow for show up as sequence gaps and are replayed as missing.
+ *
+ * -t needs no device: it encodes a synthetic stream (default 100000
+ * events) into a temporary file, decodes it back, seeks into it, and
+ * checks every event against the original.
+ */
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+/*
+The synthetic stream starts like a capture of the first edge after load
+(width == time) and mixes steady runs, jitter, bounces (same level twice)
+and lost events, over several blocks. Edges are at least 500 us apart.
+*/
+#define SELF_TEST_START 5000001600ULL
+
+static void self_test_event(uint64_t i, struct irqpoll_event *ev, uint64_t *time, uint32_t *seq)
+{
+    uint64_t step = 500000 + (i / 1000 % 4) * 250000;
+
+    if (i % 1000 >= 700)
+        step += (i * 7919) % 3001;      // jitter
+    memset(ev, 0, sizeof(*ev));
+    *time += i ? step : 0;
+    ev->width_ns = i ? step : *time;
+    *seq += 1 + (i % 5003 == 17 ? i % 7 + 1 : 0);
+    ev->time_ns = *time;
+    ev->seq = *seq;
+    ev->level = (i + i / 3001) & 1;
+}
+
+// Decoded times are within half a quantum; seq and level are exact
+static int self_test_match(const struct irqpoll_event *got, const struct irqpoll_event *want,
+                           uint64_t i, uint64_t q)
+{
+    if (got->seq == want->seq && got->level == want->level &&
+        got->time_ns + q / 2 >= want->time_ns && got->time_ns <= want->time_ns + q / 2)
+        return 0;
+    fprintf(stderr, "event %llu: got seq %u level %u time %llu, want seq %u level %u time %llu\n",
+            (unsigned long long)i, got->seq, got->level, (unsigned long long)got->time_ns,
+            want->seq, want->level, (unsigned long long)want->time_ns);
+    return -1;
+}
+
+static int self_test(uint64_t nr, uint32_t quantum)
+{
+    char path[] = "/tmp/irqcap-XXXXXX";
+    struct irqpoll_event ev, want, *seek_want = NULL;
+    struct irqcap_writer w;
+    struct irqcap_reader r;
+    uint64_t time = SELF_TEST_START, i;
+    uint32_t seq = 0;
+    int fd, ret = -1, k;
+
+    if (!nr || !quantum || quantum >= 250000) {
+        fprintf(stderr, "The self test needs events > 0 and 0 < quantum_ns < 250000\n");
+        return -1;
+    }
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return -1;
+    }
+    close(fd);
+    if (irqcap_create(&w, path, quantum)) {
+        perror(path);
+        goto out;
+    }
+    for (i = 0; i < nr; i++) {
+        self_test_event(i, &ev, &time, &seq);
+        if (irqcap_add(&w, &ev)) {
+            fprintf(stderr, "Out of memory\n");
+            irqcap_close(&w);
+            goto out;
+        }
+    }
+    if (irqcap_close(&w) || irqcap_open(&r, path)) {
+        perror(path);
+        goto out;
+    }
+
+    // Decode everything, keeping eight events to seek to afterwards
+    seek_want = calloc(8, sizeof(*seek_want));
+    if (!seek_want)
+        goto out_reader;
+    time = SELF_TEST_START;
+    seq = 0;
+    for (i = 0; (k = irqcap_next(&r, &ev)) > 0 && i < nr; i++) {
+        self_test_event(i, &want, &time, &seq);
+        if (self_test_match(&ev, &want, i, quantum))
+            goto out_reader;
+        for (k = 0; k < 8; k++)
+            if (i == nr * k / 8)
+                seek_want[k] = want;
+    }
+    if (k < 0 || i != nr) {
+        fprintf(stderr, "decoded %llu of %llu events\n", (unsigned long long)i, (unsigned long long)nr);
+        goto out_reader;
+    }
+
+    // Half a quantum early still comes after the previous event, which is 500 us back
+    for (k = 0; k < 8 && nr; k++) {
+        if (irqcap_seek(&r, seek_want[k].time_ns - quantum / 2) <= 0 ||
+            irqcap_next(&r, &ev) <= 0) {
+            fprintf(stderr, "seek to seq %u failed\n", seek_want[k].seq);
+            goto out_reader;
+        }
+        if (self_test_match(&ev, &seek_want[k], seek_want[k].seq, quantum))
+            goto out_reader;
+    }
+    printf("%llu events in %u blocks, quantum %u ns: round trip ok\n",
+           (unsigned long long)nr, r.hdr.nr_blocks, quantum);
+    ret = 0;
+out_reader:
+    free(seek_want);
+    irqcap_free(&r);
+out:
+    unlink(path);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    struct irqpoll_event ev[64];
+    struct irqcap_writer w;
+    struct sigaction sa;
+    uint64_t lost = 0;
+    uint32_t quantum;
+    ssize_t n, i;
+    long size;
+    int fd;
+
+    if (argc > 1 && !strcmp(argv[1], "-t"))
+        return self_test(argc > 2 ? strtoull(argv[2], NULL, 0) : 100000,
+                         argc > 3 ? atoi(argv[3]) : 1000) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <out.irqcap> [seconds] [quantum_ns]\n"
+                        "       %s -t [events] [quantum_ns]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    quantum = argc > 3 ? atoi(argv[3]) : 1000;
+
+    fd = open(DEVICE_PATH, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+    if (irqcap_create(&w, argv[1], quantum)) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // No SA_RESTART: the signal has to interrupt the blocking read()
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGALRM, &sa, NULL);
+    if (argc > 2)
+        alarm(atoi(argv[2]));
+
+    while (!stop) {
+        n = read(fd, ev, sizeof(ev));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            break;
+        }
+        for (i = 0; i < n / (ssize_t)sizeof(ev[0]); i++) {
+            if (w.hdr.nr_events)
+                lost += (uint32_t)(ev[i].seq - w.seq - 1);
+            if (irqcap_add(&w, &ev[i])) {
+                fprintf(stderr, "Out of memory\n");
+                stop = 1;
+                break;
+            }
+        }
+    }
+    close(fd);
+
+    size = w.offset + (long)w.hdr.nr_blocks * sizeof(struct irqcap_index);
+    if (irqcap_close(&w)) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    printf("%llu events (%llu lost) over %.3f s in %ld bytes, %.2f bytes/event\n",
+           (unsigned long long)w.hdr.nr_events, (unsigned long long)lost,
+           (w.hdr.end_ns - w.hdr.start_ns) / 1e9, size,
+           w.hdr.nr_events ? (double)size / w.hdr.nr_events : 0.0);
+    return EXIT_SUCCESS;
+}
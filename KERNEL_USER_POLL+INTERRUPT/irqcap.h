@@ -0,0 +1,339 @@
+#ifndef IRQCAP_H
+#define IRQCAP_H
+
+/*
+ * Capture file of an irqpoll event stream, written by irqcap and read by
+ * irqreplay.
+ *
+ *   struct irqcap_header                  at 0
+ *   blocks of encoded events              from sizeof(struct irqcap_header)
+ *   struct irqcap_index[nr_blocks]        at index_offset
+ *
+ * Timestamps are kept in units of quantum_ns. Every event is a delta from
+ * the previous one; the level normally flips at each edge and seq grows by
+ * one. The stream is a list of tokens, each standing for a run of events
+ * with the same delta:
+ *
+ *   varint  run << 2 | IRQCAP_SEQ_GAP | IRQCAP_SAME_LEVEL
+ *   varint  delta, in quanta
+ *   varint  gap                           only with IRQCAP_SEQ_GAP
+ *
+ * IRQCAP_SAME_LEVEL: the level does not flip (an edge was missed or
+ * bounced). IRQCAP_SEQ_GAP: seq skips gap numbers before the first event
+ * of the run, i.e. events the capture lost. A regular signal (PWM, a
+ * steady bus) collapses into one token per block.
+ *
+ * A block holds block_events events and starts with a fresh token. Its
+ * index entry keeps the state before its first event, so decoding can
+ * start at any block: seeking a long capture reads the index and one
+ * block, not the whole file. Varints are unsigned LEB128.
+ *
+ * A capture that was not closed properly has nr_blocks == 0; irqreplay
+ * refuses it.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "irqpoll_ioctl.h"
+
+#define IRQCAP_MAGIC        "IRQCAP1"
+#define IRQCAP_BLOCK_EVENTS 4096
+#define IRQCAP_SAME_LEVEL   1
+#define IRQCAP_SEQ_GAP      2
+
+struct irqcap_header {
+    char     magic[8];
+    uint32_t quantum_ns;        // timestamp resolution
+    uint32_t block_events;
+    uint64_t nr_events;
+    uint64_t start_ns;          // CLOCK_MONOTONIC time of the first event
+    uint64_t end_ns;            // ... and of the last one
+    uint64_t index_offset;
+    uint32_t nr_blocks;
+    uint32_t pad;
+};
+
+// State just before the first event of a block
+struct irqcap_index {
+    uint64_t offset;            // file offset of the block's first token
+    uint64_t time_ns;           // time of the previous event
+    uint32_t seq;               // seq of the previous event
+    uint8_t  level;             // level after the previous event
+    uint8_t  pad[3];
+};
+
+/* ---------- writer ---------- */
+
+struct irqcap_writer {
+    FILE *f;
+    struct irqcap_header hdr;
+    struct irqcap_index *index;
+    uint64_t offset;            // bytes written so far
+    uint64_t time;              // reconstructed time of the last event
+    uint32_t seq;
+    uint8_t  level;
+    uint32_t in_block;          // events of the current block
+    // the run being collected
+    uint64_t run, delta, gap;
+    unsigned int flags;
+};
+
+static inline void irqcap_put_varint(struct irqcap_writer *w, uint64_t v)
+{
+    do {
+        fputc((v & 0x7f) | (v > 0x7f ? 0x80 : 0), w->f);
+        w->offset++;
+        v >>= 7;
+    } while (v);
+}
+
+static inline void irqcap_flush_run(struct irqcap_writer *w)
+{
+    if (!w->run)
+        return;
+    irqcap_put_varint(w, w->run << 2 | w->flags);
+    irqcap_put_varint(w, w->delta);
+    if (w->flags & IRQCAP_SEQ_GAP)
+        irqcap_put_varint(w, w->gap);
+    w->run = 0;
+}
+
+static inline int irqcap_create(struct irqcap_writer *w, const char *path, uint32_t quantum_ns)
+{
+    memset(w, 0, sizeof(*w));
+    w->f = fopen(path, "wb");
+    if (!w->f)
+        return -1;
+    memcpy(w->hdr.magic, IRQCAP_MAGIC, sizeof(w->hdr.magic));
+    w->hdr.quantum_ns = quantum_ns ? quantum_ns : 1;
+    w->hdr.block_events = IRQCAP_BLOCK_EVENTS;
+    // Placeholder; the real header is written by irqcap_close()
+    fwrite(&w->hdr, sizeof(w->hdr), 1, w->f);
+    w->offset = sizeof(w->hdr);
+    return 0;
+}
+
+static inline int irqcap_add(struct irqcap_writer *w, const struct irqpoll_event *ev)
+{
+    uint64_t q = w->hdr.quantum_ns, delta, gap;
+    unsigned int flags;
+
+    if (!w->hdr.nr_events) {
+        /*
+         * The state "before" event 0, made up from its width and level.
+         * The first edge after load has width == time, so the rounded
+         * width is clamped to keep that state at or after time 0.
+         */
+        uint64_t width = (ev->width_ns + q / 2) / q * q;
+
+        if (width > ev->time_ns - ev->time_ns % q)
+            width = ev->time_ns - ev->time_ns % q;
+        w->hdr.start_ns = ev->time_ns;
+        w->time = ev->time_ns - width;
+        w->seq = ev->seq - 1;
+        w->level = !ev->level;
+    }
+
+    // Rounded against the reconstructed time, so errors never add up
+    delta = ev->time_ns > w->time ? (ev->time_ns - w->time + q / 2) / q : 0;
+    gap = (uint32_t)(ev->seq - w->seq - 1);
+    flags = (ev->level == w->level ? IRQCAP_SAME_LEVEL : 0) | (gap ? IRQCAP_SEQ_GAP : 0);
+
+    if (w->in_block == w->hdr.block_events || !w->hdr.nr_events) {
+        struct irqcap_index *idx;
+
+        irqcap_flush_run(w);
+        if (!(w->hdr.nr_blocks & 1023)) {
+            idx = realloc(w->index, (w->hdr.nr_blocks + 1024) * sizeof(*idx));
+            if (!idx)
+                return -1;
+            w->index = idx;
+        }
+        idx = &w->index[w->hdr.nr_blocks++];
+        memset(idx, 0, sizeof(*idx));
+        idx->offset = w->offset;
+        idx->time_ns = w->time;
+        idx->seq = w->seq;
+        idx->level = w->level;
+        w->in_block = 0;
+    }
+
+    // A gap starts a token of its own; otherwise extend the run while nothing changes
+    if (w->run && (gap || delta != w->delta || flags != w->flags))
+        irqcap_flush_run(w);
+    if (!w->run) {
+        w->delta = delta;
+        w->flags = flags;
+        w->gap = gap;
+    }
+    w->run++;
+    if (gap)
+        irqcap_flush_run(w);
+
+    w->time += delta * q;
+    w->seq = ev->seq;
+    w->level = ev->level;
+    w->in_block++;
+    w->hdr.nr_events++;
+    w->hdr.end_ns = w->time;
+    return 0;
+}
+
+static inline int irqcap_close(struct irqcap_writer *w)
+{
+    int ret;
+
+    irqcap_flush_run(w);
+    w->hdr.index_offset = w->offset;
+    fwrite(w->index, sizeof(*w->index), w->hdr.nr_blocks, w->f);
+    rewind(w->f);
+    fwrite(&w->hdr, sizeof(w->hdr), 1, w->f);
+    ret = ferror(w->f) ? -1 : 0;
+    if (fclose(w->f))
+        ret = -1;
+    free(w->index);
+    return ret;
+}
+
+/* ---------- reader ---------- */
+
+struct irqcap_reader {
+    FILE *f;
+    struct irqcap_header hdr;
+    struct irqcap_index *index;
+    uint64_t next;              // number of the next event
+    uint64_t time;
+    uint32_t seq;
+    uint8_t  level;
+    uint64_t run, delta;        // events left in the current token
+    unsigned int flags;
+};
+
+static inline int irqcap_get_varint(struct irqcap_reader *r, uint64_t *v)
+{
+    unsigned int shift = 0;
+    int c;
+
+    *v = 0;
+    do {
+        c = fgetc(r->f);
+        if (c == EOF || shift > 63)
+            return -1;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 0;
+}
+
+// Positions r just before the first event of block b
+static inline int irqcap_seek_block(struct irqcap_reader *r, uint32_t b)
+{
+    const struct irqcap_index *idx = &r->index[b];
+
+    if (fseek(r->f, idx->offset, SEEK_SET))
+        return -1;
+    r->next = (uint64_t)b * r->hdr.block_events;
+    r->time = idx->time_ns;
+    r->seq = idx->seq;
+    r->level = idx->level;
+    r->run = 0;
+    return 0;
+}
+
+static inline int irqcap_open(struct irqcap_reader *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+    r->f = fopen(path, "rb");
+    if (!r->f)
+        return -1;
+    if (fread(&r->hdr, sizeof(r->hdr), 1, r->f) != 1 ||
+        memcmp(r->hdr.magic, IRQCAP_MAGIC, sizeof(r->hdr.magic)) ||
+        !r->hdr.nr_blocks || !r->hdr.block_events || !r->hdr.quantum_ns)
+        goto bad;
+    r->index = calloc(r->hdr.nr_blocks, sizeof(*r->index));
+    if (!r->index || fseek(r->f, r->hdr.index_offset, SEEK_SET) ||
+        fread(r->index, sizeof(*r->index), r->hdr.nr_blocks, r->f) != r->hdr.nr_blocks ||
+        irqcap_seek_block(r, 0))
+        goto bad;
+    return 0;
+bad:
+    fclose(r->f);
+    free(r->index);
+    return -1;
+}
+
+// Decodes the next event into ev; returns 1, 0 at the end, -1 on a damaged file
+static inline int irqcap_next(struct irqcap_reader *r, struct irqpoll_event *ev)
+{
+    uint64_t v, gap = 0;
+
+    if (r->next >= r->hdr.nr_events)
+        return 0;
+    if (!r->run) {
+        if (irqcap_get_varint(r, &v) || irqcap_get_varint(r, &r->delta))
+            return -1;
+        r->run = v >> 2;
+        r->flags = v & 3;
+        if ((r->flags & IRQCAP_SEQ_GAP) && irqcap_get_varint(r, &gap))
+            return -1;
+        if (!r->run)
+            return -1;
+    }
+
+    memset(ev, 0, sizeof(*ev));
+    ev->width_ns = r->delta * r->hdr.quantum_ns;
+    ev->time_ns = r->time + ev->width_ns;
+    ev->seq = r->seq + 1 + (uint32_t)gap;
+    ev->level = r->flags & IRQCAP_SAME_LEVEL ? r->level : !r->level;
+
+    r->time = ev->time_ns;
+    r->seq = ev->seq;
+    r->level = ev->level;
+    r->run--;
+    r->next++;
+    return 1;
+}
+
+// Positions r at the first event at or after time_ns, reading one block at most
+static inline int irqcap_seek(struct irqcap_reader *r, uint64_t time_ns)
+{
+    uint32_t lo = 0, hi = r->hdr.nr_blocks - 1, mid;
+    struct irqpoll_event ev;
+    long pos;
+    int ret;
+
+    // Last block whose state before it lies before time_ns
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (r->index[mid].time_ns < time_ns)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    if (irqcap_seek_block(r, lo))
+        return -1;
+
+    for (;;) {
+        struct irqcap_reader save = *r;
+
+        pos = ftell(r->f);
+        ret = irqcap_next(r, &ev);
+        if (ret <= 0)
+            return ret;
+        if (ev.time_ns >= time_ns) {
+            // Step back so the next irqcap_next() returns ev again
+            *r = save;
+            return fseek(r->f, pos, SEEK_SET) ? -1 : 1;
+        }
+    }
+}
+
+static inline void irqcap_free(struct irqcap_reader *r)
+{
+    fclose(r->f);
+    free(r->index);
+}
+
+#endif
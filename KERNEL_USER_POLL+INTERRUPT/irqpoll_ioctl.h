@@ -0,0 +1,185 @@
+#ifndef IRQPOLL_IOCTL_H
+#define IRQPOLL_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define IRQPOLL_IOCTL_MAGIC 'q'
+
+/*
+ * Wakeup latency budget of this open file, in microseconds. While any open
+ * file has a budget, the driver holds a CPU latency QoS request for the
+ * tightest one, so CPUs avoid idle states that take longer to leave.
+ * A negative budget withdraws it again.
+ */
+#define IRQPOLL_SET_LATENCY _IOW(IRQPOLL_IOCTL_MAGIC, 0, __s32)
+
+// The bound currently requested from the PM QoS core, -1 if none
+#define IRQPOLL_GET_LATENCY _IOR(IRQPOLL_IOCTL_MAGIC, 1, __s32)
+
+// Sampling mode: 64-bit words this file's read() skipped because the ring overran them
+#define IRQPOLL_GET_LOST    _IOR(IRQPOLL_IOCTL_MAGIC, 2, __u64)
+
+/*
+ * Interrupt mode: read() returns one record per event delivered to this
+ * file. Events the file's filter aggregated are counted in the next
+ * delivered record.
+ */
+struct irqpoll_event {
+    __u64 time_ns;          // CLOCK_MONOTONIC time of the interrupt
+    __u64 width_ns;         // how long the line held its previous level
+    __u32 seq;              // interrupts since load; consecutive
+    __u32 folded;           // events aggregated into this one
+    __u8  level;            // line level after the edge
+    __u8  pad[7];
+};
+
+/*
+ * Event filter programs
+ *
+ * Each open file can attach a small program that runs, in the interrupt
+ * handler, on every event before it is queued for that file. It returns
+ * one of three verdicts:
+ *
+ *   IRQPOLL_DELIVER     queue the record and wake the file
+ *   IRQPOLL_DROP        forget the event; no wakeup
+ *   IRQPOLL_AGGREGATE   count it into the next delivered record; no wakeup
+ *
+ * The machine has a 32-bit accumulator A and IRQPOLL_FILTER_MEM words of
+ * memory M[] that keep their values from one event to the next (zeroed at
+ * attach). Jumps go forward only: jt / jf instructions are skipped. The
+ * program is checked when it is attached: known opcodes, zero pad, fields
+ * and memory slots in range, no division by zero, jumps inside the
+ * program, and a RET as the last instruction. It therefore always ends, after at
+ * most len instructions.
+ *
+ * Example: deliver only edges whose previous level lasted over 500 us
+ * (use designated initializers: pad sits before k)
+ *
+ *     { .op = IRQPOLL_OP_LD, .k = IRQPOLL_F_WIDTH_US },
+ *     { .op = IRQPOLL_OP_JGT, .jt = 0, .jf = 1, .k = 500 },
+ *     { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DELIVER },
+ *     { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DROP },
+ */
+enum {
+    IRQPOLL_OP_LD,          // A = field k
+    IRQPOLL_OP_LDI,         // A = k
+    IRQPOLL_OP_LDM,         // A = M[k]
+    IRQPOLL_OP_STM,         // M[k] = A
+    IRQPOLL_OP_ADD,         // A += k
+    IRQPOLL_OP_SUB,         // A -= k
+    IRQPOLL_OP_AND,         // A &= k
+    IRQPOLL_OP_MOD,         // A %= k, k != 0
+    IRQPOLL_OP_JEQ,         // skip jt if A == k, else jf
+    IRQPOLL_OP_JGT,         // skip jt if A > k, else jf
+    IRQPOLL_OP_JGE,         // skip jt if A >= k, else jf
+    IRQPOLL_OP_RET,         // verdict k
+    IRQPOLL_OP_MAX,
+};
+
+enum {
+    IRQPOLL_F_LEVEL,        // 0 or 1
+    IRQPOLL_F_WIDTH_US,     // width_ns / 1000, saturated
+    IRQPOLL_F_SEQ,
+    IRQPOLL_F_FOLDED,       // events aggregated since the last delivery
+    IRQPOLL_F_MAX,
+};
+
+enum {
+    IRQPOLL_DELIVER,
+    IRQPOLL_DROP,
+    IRQPOLL_AGGREGATE,
+};
+
+#define IRQPOLL_FILTER_MAX_INSNS  64
+#define IRQPOLL_FILTER_MEM        4
+
+struct irqpoll_insn {
+    __u8  op;
+    __u8  jt;
+    __u8  jf;
+    __u8  pad;
+    __u32 k;
+};
+
+struct irqpoll_filter {
+    __u32 len;              // instructions; 0 detaches the filter
+    __u32 pad;
+    __u64 insns;            // user pointer to struct irqpoll_insn[len]
+};
+
+#define IRQPOLL_SET_FILTER  _IOW(IRQPOLL_IOCTL_MAGIC, 3, struct irqpoll_filter)
+
+// What this file's filter decided so far, and records lost to a full queue
+struct irqpoll_filter_stats {
+    __u64 delivered;
+    __u64 dropped;
+    __u64 aggregated;
+    __u64 overflow;
+};
+
+#define IRQPOLL_GET_FILTER_STATS _IOR(IRQPOLL_IOCTL_MAGIC, 4, struct irqpoll_filter_stats)
+
+/*
+ * Replay (interrupt mode)
+ *
+ * Queues recorded edges to be emitted as if the line had produced them:
+ * each goes through the interrupt path (sequence number, filters, queues,
+ * wakeups) at CLOCK_MONOTONIC time due_ns, and its record carries due_ns
+ * as time_ns. Due times are expected in order; one earlier than its
+ * predecessor is moved up to it. The queue holds IRQPOLL_INJECT_QUEUE
+ * events: a blocking call waits for room, a non-blocking one queues what
+ * fits. On return nr is the number queued.
+ */
+#define IRQPOLL_INJECT_QUEUE 4096
+
+struct irqpoll_replay_ev {
+    __u64 due_ns;
+    __u8  level;
+    __u8  pad[7];
+};
+
+struct irqpoll_inject {
+    __u64 events;           // user pointer to struct irqpoll_replay_ev[nr]
+    __u32 nr;               // in: events offered; out: events queued
+    __u32 pad;
+};
+
+#define IRQPOLL_INJECT      _IOWR(IRQPOLL_IOCTL_MAGIC, 5, struct irqpoll_inject)
+
+/*
+ * Sampling mode (module parameter sample_hz > 0)
+ *
+ * A periodic hrtimer reads nr_lines GPIO lines every tick and appends one
+ * bit per line to a bitstream: bit n of the stream (bit n % 64 of word
+ * n / 64) is line n % nr_lines at tick n / nr_lines. Tick t was taken at
+ * start_ns + t * 1e9 / rate_hz.
+ *
+ * The words go into a ring that the sampler overwrites and never waits
+ * for. read() returns whole words from the file's own position. mmap()
+ * maps this header page, then the ring at data_offset:
+ *
+ *     word w (w < head) is at ring[w & (nr_words - 1)], valid while
+ *     head - w <= nr_words
+ *
+ * The kernel stores a word before publishing it in head (release order),
+ * so a reader loads head with acquire order, copies words, then loads
+ * head again to discard the words that may have been overwritten meanwhile.
+ */
+#define IRQPOLL_RING_MAGIC   0x51524950    /* "PIRQ" */
+#define IRQPOLL_MAX_LINES    64
+
+struct irqpoll_ring {
+    __u32 magic;
+    __u32 nr_lines;
+    __u32 rate_hz;
+    __u32 pad;
+    __u64 nr_words;         // ring capacity, a power of two
+    __u64 data_offset;      // bytes from the start of the mapping
+    __u64 start_ns;         // CLOCK_MONOTONIC time of tick 0
+    __u64 head;             // words written so far
+    __u64 late_ticks;       // ticks the timer ran late for; their bits repeat the next sample
+    __s32 lines[IRQPOLL_MAX_LINES];  // GPIO number of each line, in bit order
+};
+
+#endif
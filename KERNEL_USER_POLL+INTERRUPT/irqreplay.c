@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "irqcap.h"
+
+#define DEVICE_PATH "/dev/irqpoll"
+#define BATCH       256             // events per IRQPOLL_INJECT
+
+/*
+ * Usage: ./irqreplay <capture.irqcap> [speed] [from_s]
+ *        ./irqreplay -l <capture.irqcap> [from_s]
+ * Replays a capture written by irqcap into the driver's event pipeline
+ * (IRQPOLL_INJECT), at the recorded pace or speed times faster (default 1,
+ * fractions slow it down), starting from_s seconds into the capture.
+ * Consumers of /dev/irqpoll see the events as if the line produced them;
+ * load the module with replay_only=1 to run without the hardware.
+ * -l lists the decoded events instead.
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int list(struct irqcap_reader *r)
+{
+    struct irqpoll_event ev;
+    int ret;
+
+    while ((ret = irqcap_next(r, &ev)) > 0)
+        printf("%10u %16.6f %12.1f %d\n", ev.seq,
+               (ev.time_ns - r->hdr.start_ns) / 1e3, ev.width_ns / 1e3, ev.level);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    struct irqpoll_replay_ev batch[BATCH];
+    struct irqpoll_inject req;
+    struct irqpoll_event ev;
+    struct irqcap_reader r;
+    uint64_t first = 0, base = 0, last_due = 0, sent = 0, late = 0;
+    int listing = argc > 1 && !strcmp(argv[1], "-l");
+    double speed = 1.0, from = 0.0;
+    unsigned int n = 0;
+    int fd = -1, ret;
+
+    if (argc < 2 + listing) {
+        fprintf(stderr, "Usage: %s <capture.irqcap> [speed] [from_s]\n"
+                        "       %s -l <capture.irqcap> [from_s]\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!listing && argc > 2)
+        speed = atof(argv[2]);
+    if (argc > 3)
+        from = atof(argv[3]);
+    if (speed <= 0) {
+        fprintf(stderr, "speed must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (irqcap_open(&r, argv[1 + listing])) {
+        fprintf(stderr, "%s: not a complete capture\n", argv[1 + listing]);
+        return EXIT_FAILURE;
+    }
+    printf("%llu events over %.3f s, %u blocks, quantum %u ns\n",
+           (unsigned long long)r.hdr.nr_events, (r.hdr.end_ns - r.hdr.start_ns) / 1e9,
+           r.hdr.nr_blocks, r.hdr.quantum_ns);
+
+    // Through the index: decodes one block, not everything before from_s
+    if (from > 0 && irqcap_seek(&r, r.hdr.start_ns + (uint64_t)(from * 1e9)) < 0) {
+        fprintf(stderr, "Damaged capture\n");
+        return EXIT_FAILURE;
+    }
+
+    if (listing) {
+        ret = list(&r);
+        irqcap_free(&r);
+        return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    fd = open(DEVICE_PATH, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    for (;;) {
+        ret = irqcap_next(&r, &ev);
+        if (ret > 0) {
+            if (!base) {
+                first = ev.time_ns;
+                base = now_ns() + 10000000;     // 10 ms to fill the queue ahead
+            }
+            batch[n].due_ns = base + (uint64_t)((ev.time_ns - first) / speed);
+            batch[n].level = ev.level;
+            last_due = batch[n].due_ns;
+            n++;
+        }
+        if (n == BATCH || (ret <= 0 && n)) {
+            // Blocks while the kernel queue is full, which paces this loop
+            req.events = (uintptr_t)batch;
+            req.nr = n;
+            if (ioctl(fd, IRQPOLL_INJECT, &req) < 0) {
+                perror("IRQPOLL_INJECT");
+                break;
+            }
+            if (now_ns() > batch[0].due_ns)
+                late++;
+            sent += req.nr;
+            n = 0;
+        }
+        if (ret <= 0)
+            break;
+    }
+    if (ret < 0)
+        fprintf(stderr, "Damaged capture, stopped early\n");
+
+    // Stay until the last event is due, so the replay can be timed from outside
+    if (sent) {
+        uint64_t t = now_ns();
+
+        if (last_due > t)
+            usleep((last_due - t) / 1000);
+    }
+    printf("replayed %llu events in %.3f s at %.2fx; %llu batches queued too late\n",
+           (unsigned long long)sent, base ? (now_ns() - base) / 1e9 : 0.0, speed,
+           (unsigned long long)late);
+    close(fd);
+    irqcap_free(&r);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "irqpoll_ioctl.h"
+
+#define DEVICE_PATH "/dev/irqpoll"
+
+/*
+ * Usage: ./sample_dump <seconds> [out.bin]
+ * Needs the module loaded with sample_hz > 0. Follows the sample ring
+ * through mmap() for the given time, optionally saves the raw 64-bit words
+ * to out.bin, and prints per line: ticks, high time and edge count.
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    const struct irqpoll_ring *ring;
+    const uint64_t *words;
+    uint64_t ticks[IRQPOLL_MAX_LINES] = { 0 }, high[IRQPOLL_MAX_LINES] = { 0 };
+    uint64_t edges[IRQPOLL_MAX_LINES] = { 0 };
+    uint64_t pos, head, end, lost = 0, w;
+    int last[IRQPOLL_MAX_LINES];
+    struct pollfd pfd;
+    unsigned int nr, i, b, line;
+    size_t len;
+    FILE *out = NULL;
+    int fd, v;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <seconds> [out.bin]\n", argv[0]);
+        return 1;
+    }
+    fd = open(DEVICE_PATH, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    // Map the header first to learn the ring size, then everything
+    ring = mmap(NULL, 4096, PROT_READ, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED || ring->magic != IRQPOLL_RING_MAGIC) {
+        fprintf(stderr, "Not in sampling mode (load with sample_hz=...)\n");
+        return 1;
+    }
+    len = ring->data_offset + ring->nr_words * sizeof(uint64_t);
+    munmap((void *)ring, 4096);
+    ring = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    words = (const uint64_t *)((const char *)ring + ring->data_offset);
+    nr = ring->nr_lines;
+    memset(last, -1, sizeof(last));
+
+    if (argc > 2 && !(out = fopen(argv[2], "wb"))) {
+        perror(argv[2]);
+        return 1;
+    }
+    printf("%u line(s) at %u Hz, ring of %llu words\n", nr, ring->rate_hz,
+           (unsigned long long)ring->nr_words);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pos = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    end = now_ns() + strtoull(argv[1], NULL, 0) * 1000000000ull;
+
+    while (now_ns() < end) {
+        poll(&pfd, 1, 100);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head - pos > ring->nr_words) {
+            lost += head - ring->nr_words - pos;
+            pos = head - ring->nr_words;
+        }
+        for (; pos < head; pos++) {
+            w = words[pos & (ring->nr_words - 1)];
+            // The word is only valid if the sampler has not lapped it meanwhile
+            if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - pos > ring->nr_words)
+                break;
+            if (out)
+                fwrite(&w, sizeof(w), 1, out);
+            // Stream bit n is line n % nr at tick n / nr
+            for (b = 0; b < 64; b++) {
+                line = (pos * 64 + b) % nr;
+                v = (w >> b) & 1;
+                ticks[line]++;
+                high[line] += v;
+                if (last[line] >= 0 && v != last[line])
+                    edges[line]++;
+                last[line] = v;
+            }
+        }
+    }
+
+    printf("%6s %6s %14s %8s %10s\n", "line", "gpio", "ticks", "high%", "edges");
+    for (i = 0; i < nr; i++)
+        printf("%6u %6d %14llu %7.2f%% %10llu\n", i, ring->lines[i],
+               (unsigned long long)ticks[i],
+               ticks[i] ? 100.0 * high[i] / ticks[i] : 0.0,
+               (unsigned long long)edges[i]);
+    printf("lost %llu words, %llu late ticks\n", (unsigned long long)lost,
+           (unsigned long long)ring->late_ticks);
+
+    if (out)
+        fclose(out);
+    munmap((void *)ring, len);
+    close(fd);
+    return 0;
+}
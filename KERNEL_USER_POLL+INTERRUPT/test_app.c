@@ -5,22 +5,93 @@
 #include <poll.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include "irqpoll_ioctl.h"
 
 #define DEVICE_PATH "/dev/irqpoll"
 
-int main(void)
+/*
+ * Usage: ./test_app [-w min_width_us] [-n every_n] [budget_us]
+ * With budget_us, the app declares that wakeup latency budget; the driver
+ * keeps a CPU latency QoS request for it until the app exits.
+ * -w attaches a filter that delivers only edges whose previous level lasted
+ * longer than min_width_us; -n one that delivers every n-th event and
+ * aggregates the others into it.
+ */
+
+// deliver if width > k, else drop
+static struct irqpoll_insn width_prog[] = {
+    { .op = IRQPOLL_OP_LD, .k = IRQPOLL_F_WIDTH_US },
+    { .op = IRQPOLL_OP_JGT, .jt = 0, .jf = 1, .k = 0 },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DELIVER },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DROP },
+};
+
+// M[0] counts events; deliver when it reaches n, else aggregate
+static struct irqpoll_insn every_n_prog[] = {
+    { .op = IRQPOLL_OP_LDM, .k = 0 },
+    { .op = IRQPOLL_OP_ADD, .k = 1 },
+    { .op = IRQPOLL_OP_MOD, .k = 0 },
+    { .op = IRQPOLL_OP_STM, .k = 0 },
+    { .op = IRQPOLL_OP_JEQ, .jt = 0, .jf = 1, .k = 0 },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_DELIVER },
+    { .op = IRQPOLL_OP_RET, .k = IRQPOLL_AGGREGATE },
+};
+
+int main(int argc, char *argv[])
 {
     int fd;
     struct pollfd pfd;
-    int ret;
+    int ret, opt;
+    int32_t budget, bound;
+    struct irqpoll_filter filter = { 0 };
+    struct irqpoll_event ev[16];
+    ssize_t n, i;
+
+    while ((opt = getopt(argc, argv, "w:n:")) != -1) {
+        switch (opt) {
+        case 'w':
+            width_prog[1].k = atoi(optarg);
+            filter.len = sizeof(width_prog) / sizeof(width_prog[0]);
+            filter.insns = (uintptr_t)width_prog;
+            break;
+        case 'n':
+            every_n_prog[2].k = atoi(optarg);
+            filter.len = sizeof(every_n_prog) / sizeof(every_n_prog[0]);
+            filter.insns = (uintptr_t)every_n_prog;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-w min_width_us] [-n every_n] [budget_us]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
     // Open the device file created by the kernel module
-    fd = open(DEVICE_PATH, O_RDONLY);
+    // Non-blocking, so the record queue can be drained after each wakeup
+    fd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
     if (fd < 0) {
         perror("Failed to open device");
         return EXIT_FAILURE;
     }
 
+    if (filter.len && ioctl(fd, IRQPOLL_SET_FILTER, &filter) < 0) {
+        perror("IRQPOLL_SET_FILTER");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    if (optind < argc) {
+        budget = atoi(argv[optind]);
+        if (ioctl(fd, IRQPOLL_SET_LATENCY, &budget) < 0) {
+            perror("IRQPOLL_SET_LATENCY");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+    }
+    if (ioctl(fd, IRQPOLL_GET_LATENCY, &bound) == 0)
+        printf("CPU latency bound in force: %d us\n", bound);
+
     pfd.fd = fd;
     pfd.events = POLLIN;   // We are only interested in "data ready" events
 
@@ -36,6 +107,10 @@ int main(void)
 
         if (pfd.revents & POLLIN) {
             printf("Button event detected!\n");
+            while ((n = read(fd, ev, sizeof(ev))) > 0)
+                for (i = 0; i < n / (ssize_t)sizeof(ev[0]); i++)
+                    printf("  #%u level %u after %.1f us, %u aggregated\n", ev[i].seq, ev[i].level,
+                           ev[i].width_ns / 1000.0, ev[i].folded);
         }
     }
 
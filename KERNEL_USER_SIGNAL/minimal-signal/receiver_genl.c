@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include "sigdev_genl.h"
+
+/*
+ * Usage: ./receiver_genl [rcvbuf_KiB] [delay_us]
+ * Subscribes to the sigdev "events" group and prints, once per second,
+ * messages and events received, events per message, and losses: ENOBUFS
+ * overruns of this socket, sequence gaps, and the kernel's drop count.
+ * rcvbuf_KiB sizes the socket buffer (SO_RCVBUFFORCE as root); delay_us
+ * sleeps after every message to play a slow subscriber.
+ */
+
+#define BUF_SIZE 65536
+
+#define NLA_DATA(na)  ((void *)((char *)(na) + NLA_HDRLEN))
+#define NLA_LEN(na)   ((na)->nla_len - NLA_HDRLEN)
+#define GENL_ATTRS(nlh) \
+    ((struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN))
+#define GENL_ATTRLEN(nlh) ((int)(nlh)->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN))
+
+#define nla_for_each(na, head, len) \
+    for (na = (head); (len) >= (int)sizeof(*na) && na->nla_len >= sizeof(*na) && \
+         na->nla_len <= (len); \
+         (len) -= NLA_ALIGN(na->nla_len), na = (struct nlattr *)((char *)na + NLA_ALIGN(na->nla_len)))
+
+static char buf[BUF_SIZE];
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Asks the controller for the family id and the id of its "events" group
+static int resolve_family(int fd, int *family, int *group)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct genlmsghdr genl;
+        char attrs[64];
+    } req = { 0 };
+    struct nlattr *na, *grp, *ga;
+    struct nlmsghdr *nlh;
+    int len, glen, alen;
+
+    req.nlh.nlmsg_type = GENL_ID_CTRL;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST;
+    req.genl.cmd = CTRL_CMD_GETFAMILY;
+    req.genl.version = 1;
+    na = (struct nlattr *)req.attrs;
+    na->nla_type = CTRL_ATTR_FAMILY_NAME;
+    na->nla_len = NLA_HDRLEN + sizeof(SIGDEV_GENL_NAME);
+    memcpy(NLA_DATA(na), SIGDEV_GENL_NAME, sizeof(SIGDEV_GENL_NAME));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(na->nla_len);
+
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0)
+        return -1;
+    len = recv(fd, buf, sizeof(buf), 0);
+    nlh = (struct nlmsghdr *)buf;
+    if (len < 0 || !NLMSG_OK(nlh, len) || nlh->nlmsg_type == NLMSG_ERROR) {
+        errno = ENOENT;     // module not loaded
+        return -1;
+    }
+
+    *family = *group = -1;
+    len = GENL_ATTRLEN(nlh);
+    nla_for_each(na, GENL_ATTRS(nlh), len) {
+        if (na->nla_type == CTRL_ATTR_FAMILY_ID)
+            *family = *(uint16_t *)NLA_DATA(na);
+        if ((na->nla_type & NLA_TYPE_MASK) != CTRL_ATTR_MCAST_GROUPS)
+            continue;
+        glen = NLA_LEN(na);
+        nla_for_each(grp, (struct nlattr *)NLA_DATA(na), glen) {
+            const char *name = NULL;
+            int id = -1;
+
+            alen = NLA_LEN(grp);
+            nla_for_each(ga, (struct nlattr *)NLA_DATA(grp), alen) {
+                if (ga->nla_type == CTRL_ATTR_MCAST_GRP_NAME)
+                    name = NLA_DATA(ga);
+                if (ga->nla_type == CTRL_ATTR_MCAST_GRP_ID)
+                    id = *(uint32_t *)NLA_DATA(ga);
+            }
+            if (name && !strcmp(name, SIGDEV_GENL_MCGRP))
+                *group = id;
+        }
+    }
+    return *family < 0 || *group < 0 ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int rcvbuf = (argc > 1 ? atoi(argv[1]) : 0) * 1024;
+    int delay_us = argc > 2 ? atoi(argv[2]) : 0;
+    uint64_t msgs = 0, events = 0, gaps = 0, overruns = 0, dropped = 0;
+    uint64_t next_seq = 0;
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    struct nlmsghdr *nlh;
+    struct nlattr *na;
+    struct sigdev_event ev;
+    int fd, family, group, len, alen;
+    socklen_t optlen = sizeof(rcvbuf);
+    double last = now_s(), t;
+    int started = 0;
+
+    fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        perror("User: netlink socket");
+        return 1;
+    }
+    if (resolve_family(fd, &family, &group)) {
+        perror("User: sigdev family not found");
+        return 1;
+    }
+
+    // FORCE may exceed net.core.rmem_max but needs CAP_NET_ADMIN
+    if (rcvbuf && setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)))
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &optlen);
+
+    if (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group))) {
+        perror("User: join group");
+        return 1;
+    }
+    printf("User: family %d, group %d, receive buffer %d KiB\n", family, group, rcvbuf / 1024);
+
+    for (;;) {
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            // The socket buffer overflowed: at least one message is gone
+            if (errno == ENOBUFS) {
+                overruns++;
+                continue;
+            }
+            perror("User: recv");
+            return 1;
+        }
+
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type != family)
+                continue;
+            msgs++;
+            alen = GENL_ATTRLEN(nlh);
+            nla_for_each(na, GENL_ATTRS(nlh), alen) {
+                if (na->nla_type == SIGDEV_A_DROPPED)
+                    memcpy(&dropped, NLA_DATA(na), sizeof(dropped));
+                if (na->nla_type != SIGDEV_A_EVENT || NLA_LEN(na) != sizeof(ev))
+                    continue;
+                memcpy(&ev, NLA_DATA(na), sizeof(ev));
+                if (started && ev.seq != next_seq)
+                    gaps += ev.seq - next_seq;
+                started = 1;
+                next_seq = ev.seq + 1;
+                events++;
+            }
+            if (delay_us)
+                usleep(delay_us);
+        }
+
+        t = now_s();
+        if (t - last >= 1.0) {
+            printf("User: %8.0f msg/s %10.0f events/s %6.1f events/msg | lost %llu (overruns %llu) kernel drops %llu\n",
+                   msgs / (t - last), events / (t - last), msgs ? (double)events / msgs : 0.0,
+                   (unsigned long long)gaps, (unsigned long long)overruns,
+                   (unsigned long long)dropped);
+            msgs = events = 0;
+            last = t;
+        }
+    }
+}
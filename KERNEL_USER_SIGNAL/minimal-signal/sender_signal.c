@@ -9,6 +9,11 @@
 #include <linux/signal.h>         // for kernel_siginfo
 #include <linux/kdev_t.h>
 #include <linux/cdev.h>
+#include <linux/kfifo.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <net/genetlink.h>
+#include "sigdev_genl.h"
 
 #define DEVICE_NAME "sigdev"
 #define CLASS_NAME "sigclass"
@@ -21,6 +26,32 @@ static struct device *sig_device;
 // ioctl command number
 #define IOCTL_SET_PID _IOW('a', 'a', int32_t *)
 
+#define EVENT_VALUE      1234
+#define EVENT_FIFO_SIZE  1024      // events queued for netlink, a power of two
+
+/*
+The work handler raises `burst` events every `period_ms`. The registered
+process gets one signal per period, as before; every event also goes to the
+sigdev generic netlink group (see sigdev_genl.h). Both are writable, so they
+are clamped when read: a period of at least 1 ms, and no larger burst than
+the queue holds.
+*/
+static unsigned int period_ms = 5000;
+module_param(period_ms, uint, 0644);
+MODULE_PARM_DESC(period_ms, "Time between event bursts in ms, at least 1 (default 5000)");
+
+static unsigned int burst = 1;
+module_param(burst, uint, 0644);
+MODULE_PARM_DESC(burst, "Events raised per period, at most 1024 (default 1)");
+
+static unsigned int batch = 64;
+module_param(batch, uint, 0644);
+MODULE_PARM_DESC(batch, "Most events packed into one netlink message (default 64)");
+
+static unsigned int flush_us = 1000;
+module_param(flush_us, uint, 0644);
+MODULE_PARM_DESC(flush_us, "Longest an event waits for its batch to fill, in us (default 1000)");
+
 // ioctl handler
 static long sigdev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
@@ -43,7 +74,7 @@ static void send_signal_to_user(void)
     struct task_struct *task;
 
     if (pid <= 0) {
-        printk(KERN_INFO "Kernel: No PID registered yet. Will retry...\n");
+        printk_ratelimited(KERN_INFO "Kernel: No PID registered yet. Will retry...\n");
         return;
     }
 
@@ -55,9 +86,9 @@ static void send_signal_to_user(void)
         memset(&info, 0, sizeof(struct kernel_siginfo));
         info.si_signo = SIGUSR1;
         info.si_code  = SI_QUEUE;
-        info.si_int   = 1234;
+        info.si_int   = EVENT_VALUE;
 
-        printk(KERN_INFO "Kernel: Sending SIGUSR1 to PID %d\n", pid);
+        printk_ratelimited(KERN_INFO "Kernel: Sending SIGUSR1 to PID %d\n", pid);
         send_sig_info(SIGUSR1, &info, task);
     } else {
         printk(KERN_WARNING "Kernel: PID %d not found\n", pid);
@@ -65,19 +96,188 @@ static void send_signal_to_user(void)
     rcu_read_unlock();
 }
 
+/* ---------- generic netlink event channel ---------- */
+
+/*
+Events are queued in a fifo and published in batches: the flush work packs
+as many as fit into one message (up to `batch`), so a burst costs a few
+messages instead of one per event. It runs as soon as a batch is full, or
+flush_us after the first event of a partial one.
+
+Each subscriber socket has its own receive buffer. A slow subscriber that
+lets it fill loses messages (recv() reports ENOBUFS and the sequence numbers
+jump) without holding back the kernel or the other subscribers; SO_RCVBUF
+sets how large a burst it can absorb. Events are only lost here, before
+multicast, when the fifo overflows; SIGDEV_A_DROPPED counts those.
+*/
+static DECLARE_KFIFO(ev_fifo, struct sigdev_event, EVENT_FIFO_SIZE);
+static DEFINE_SPINLOCK(ev_lock);
+static u64 ev_seq, ev_dropped, ev_msgs;
+static struct delayed_work flush_work;
+
+static const struct nla_policy sigdev_genl_policy[SIGDEV_A_MAX + 1] = {
+    [SIGDEV_A_EVENT]   = NLA_POLICY_EXACT_LEN(sizeof(struct sigdev_event)),
+    [SIGDEV_A_DROPPED] = { .type = NLA_U64 },
+    [SIGDEV_A_SEQ]     = { .type = NLA_U64 },
+    [SIGDEV_A_MSGS]    = { .type = NLA_U64 },
+};
+
+static const struct genl_multicast_group sigdev_genl_mcgrps[] = {
+    { .name = SIGDEV_GENL_MCGRP },
+};
+
+static int sigdev_genl_get_stats(struct sk_buff *skb, struct genl_info *info);
+
+static const struct genl_small_ops sigdev_genl_ops[] = {
+    {
+        .cmd  = SIGDEV_CMD_GET_STATS,
+        .doit = sigdev_genl_get_stats,
+    },
+};
+
+static struct genl_family sigdev_genl_family __ro_after_init = {
+    .name          = SIGDEV_GENL_NAME,
+    .version       = SIGDEV_GENL_VERSION,
+    .maxattr       = SIGDEV_A_MAX,
+    .policy        = sigdev_genl_policy,
+    .module        = THIS_MODULE,
+    .small_ops     = sigdev_genl_ops,
+    .n_small_ops   = ARRAY_SIZE(sigdev_genl_ops),
+    .resv_start_op = __SIGDEV_CMD_MAX,
+    .mcgrps        = sigdev_genl_mcgrps,
+    .n_mcgrps      = ARRAY_SIZE(sigdev_genl_mcgrps),
+};
+
+static int sigdev_genl_get_stats(struct sk_buff *skb, struct genl_info *info)
+{
+    struct sk_buff *msg;
+    unsigned long flags;
+    u64 seq, dropped, msgs;
+    void *hdr;
+
+    msg = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+    if (!msg)
+        return -ENOMEM;
+
+    spin_lock_irqsave(&ev_lock, flags);
+    seq = ev_seq;
+    dropped = ev_dropped;
+    msgs = ev_msgs;
+    spin_unlock_irqrestore(&ev_lock, flags);
+
+    hdr = genlmsg_put_reply(msg, info, &sigdev_genl_family, 0, SIGDEV_CMD_GET_STATS);
+    if (!hdr ||
+        nla_put_u64_64bit(msg, SIGDEV_A_SEQ, seq, SIGDEV_A_PAD) ||
+        nla_put_u64_64bit(msg, SIGDEV_A_DROPPED, dropped, SIGDEV_A_PAD) ||
+        nla_put_u64_64bit(msg, SIGDEV_A_MSGS, msgs, SIGDEV_A_PAD)) {
+        nlmsg_free(msg);
+        return -EMSGSIZE;
+    }
+    genlmsg_end(msg, hdr);
+    return genlmsg_reply(msg, info);
+}
+
+// Queues one event for the group; safe from any context
+static void sigdev_publish(s32 value)
+{
+    struct sigdev_event ev = { .time_ns = ktime_get_ns(), .value = value };
+    unsigned long flags;
+    unsigned int queued;
+
+    spin_lock_irqsave(&ev_lock, flags);
+    ev.seq = ev_seq++;
+    // Nobody listening: the sequence still advances, nothing is queued
+    if (!genl_has_listeners(&sigdev_genl_family, &init_net, 0)) {
+        spin_unlock_irqrestore(&ev_lock, flags);
+        return;
+    }
+    if (!kfifo_put(&ev_fifo, ev))
+        ev_dropped++;
+    queued = kfifo_len(&ev_fifo);
+    spin_unlock_irqrestore(&ev_lock, flags);
+
+    if (queued >= READ_ONCE(batch))
+        mod_delayed_work(system_wq, &flush_work, 0);
+    else
+        schedule_delayed_work(&flush_work, usecs_to_jiffies(READ_ONCE(flush_us)));
+}
+
+static void flush_handler(struct work_struct *work)
+{
+    unsigned int n, max = clamp_val(READ_ONCE(batch), 1, EVENT_FIFO_SIZE);
+    struct sigdev_event ev;
+    struct sk_buff *skb;
+    bool empty = false;
+    void *hdr;
+
+    while (!empty) {
+        skb = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+        if (!skb)
+            break;      // events stay queued for the next flush
+        hdr = genlmsg_put(skb, 0, 0, &sigdev_genl_family, 0, SIGDEV_CMD_EVENTS);
+        if (!hdr || nla_put_u64_64bit(skb, SIGDEV_A_DROPPED, READ_ONCE(ev_dropped), SIGDEV_A_PAD)) {
+            nlmsg_free(skb);
+            break;
+        }
+
+        for (n = 0; n < max; n++) {
+            // Check for room first, so an event is never taken out and then lost
+            if (skb_tailroom(skb) < nla_total_size(sizeof(ev)))
+                break;
+            if (!kfifo_out_spinlocked(&ev_fifo, &ev, 1, &ev_lock)) {
+                empty = true;
+                break;
+            }
+            nla_put(skb, SIGDEV_A_EVENT, sizeof(ev), &ev);
+        }
+        if (!n) {
+            nlmsg_free(skb);
+            break;
+        }
+
+        genlmsg_end(skb, hdr);
+        // -ESRCH only means the last subscriber just left
+        genlmsg_multicast(&sigdev_genl_family, skb, 0, 0, GFP_KERNEL);
+        spin_lock_irq(&ev_lock);
+        ev_msgs++;
+        spin_unlock_irq(&ev_lock);
+        cond_resched();
+    }
+}
+
 static struct delayed_work my_work;
 
-// Workqueue handler (repeats every 5 seconds)
+static unsigned long work_period(void)
+{
+    return msecs_to_jiffies(max(READ_ONCE(period_ms), 1U));
+}
+
+// Workqueue handler (repeats every period_ms)
 static void work_handler(struct work_struct *work)
 {
+    unsigned int i, n = min(READ_ONCE(burst), (unsigned int)EVENT_FIFO_SIZE);
+
     send_signal_to_user();
-    schedule_delayed_work(&my_work, 5 * HZ); // reschedule
+    for (i = 0; i < n; i++)
+        sigdev_publish(EVENT_VALUE);
+    schedule_delayed_work(&my_work, work_period()); // reschedule
 }
 
 static int __init sigdev_init(void)
 {
+    int ret;
+
+    INIT_KFIFO(ev_fifo);
+    INIT_DELAYED_WORK(&flush_work, flush_handler);
+    ret = genl_register_family(&sigdev_genl_family);
+    if (ret) {
+        printk(KERN_ALERT "Kernel: Failed to register generic netlink family\n");
+        return ret;
+    }
+
     major = register_chrdev(0, DEVICE_NAME, &fops);  // 0 → let kernel pick a free major
     if (major < 0) {
+        genl_unregister_family(&sigdev_genl_family);
         printk(KERN_ALERT "Kernel: Failed to register device\n");
         return major;
     }
@@ -85,6 +285,7 @@ static int __init sigdev_init(void)
     sig_class = class_create(DEVICE_NAME);   
     if (IS_ERR(sig_class)) {
         unregister_chrdev(major, DEVICE_NAME);
+        genl_unregister_family(&sigdev_genl_family);
         printk(KERN_ALERT "Kernel: Failed to create class\n");
         return PTR_ERR(sig_class);
     }
@@ -93,6 +294,7 @@ static int __init sigdev_init(void)
     if (IS_ERR(sig_device)) {
         class_destroy(sig_class);
         unregister_chrdev(major, DEVICE_NAME);
+        genl_unregister_family(&sigdev_genl_family);
         printk(KERN_ALERT "Kernel: Failed to create device\n");
         return PTR_ERR(sig_device);
     }
@@ -101,7 +303,7 @@ static int __init sigdev_init(void)
 
     // Schedule first work
     INIT_DELAYED_WORK(&my_work, work_handler);
-    schedule_delayed_work(&my_work, 5 * HZ);
+    schedule_delayed_work(&my_work, work_period());
 
     return 0;
 }
@@ -109,6 +311,8 @@ static int __init sigdev_init(void)
 static void __exit sigdev_exit(void)
 {
     cancel_delayed_work_sync(&my_work);
+    cancel_delayed_work_sync(&flush_work);
+    genl_unregister_family(&sigdev_genl_family);
     device_destroy(sig_class, MKDEV(major, 0));
     class_destroy(sig_class);
     unregister_chrdev(major, DEVICE_NAME);
@@ -121,4 +325,4 @@ module_exit(sigdev_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Muhammad Ali Hussnain");
 MODULE_DESCRIPTION("Kernel module to send signals to user-space process periodically");
-MODULE_VERSION("1.0");
+MODULE_VERSION("1.1");
@@ -0,0 +1,130 @@
+// KUnit suites of sigdev: PID registration, signals and the netlink batches (see ../../common/ktest.h)
+#include "sender_signal.c"
+#include "../../common/ktest.h"
+
+static int saved_pid;
+static unsigned int saved_batch;
+
+static int sigdev_test_init(struct kunit *test)
+{
+    saved_pid = pid;
+    saved_batch = batch;
+    return 0;
+}
+
+static void sigdev_test_exit(struct kunit *test)
+{
+    pid = saved_pid;
+    batch = saved_batch;
+    flush_signals(current);
+    disallow_signal(SIGUSR1);
+}
+
+static void sigdev_ioctl_test(struct kunit *test)
+{
+    int32_t __user *upid = ktest_user_buf(test, sizeof(int32_t));
+
+    KUNIT_ASSERT_EQ(test, put_user(4321, upid), 0);
+    KUNIT_EXPECT_EQ(test, sigdev_ioctl(NULL, IOCTL_SET_PID, (unsigned long)upid), 0);
+    KUNIT_EXPECT_EQ(test, pid, 4321);
+    KUNIT_EXPECT_EQ(test, sigdev_ioctl(NULL, IOCTL_SET_PID, 0), -EFAULT);
+}
+
+// The test thread registers itself; a kthread has to opt in to a signal first
+static void sigdev_signal_test(struct kunit *test)
+{
+    allow_signal(SIGUSR1);
+    pid = task_pid_vnr(current);
+    send_signal_to_user();
+    KUNIT_ASSERT_TRUE(test, signal_pending(current));
+    KUNIT_EXPECT_EQ(test, kernel_dequeue_signal(), SIGUSR1);
+
+    // Nobody registered, or gone: nothing is sent
+    pid = -1;
+    send_signal_to_user();
+    KUNIT_EXPECT_FALSE(test, signal_pending(current));
+}
+
+// Without a subscriber the sequence advances and nothing is queued
+static void sigdev_publish_test(struct kunit *test)
+{
+    u64 seq = ev_seq;
+
+    if (genl_has_listeners(&sigdev_genl_family, &init_net, 0))
+        kunit_skip(test, "a subscriber is listening");
+    sigdev_publish(1);
+    sigdev_publish(2);
+    KUNIT_EXPECT_EQ(test, ev_seq, seq + 2);
+    KUNIT_EXPECT_TRUE(test, kfifo_is_empty(&ev_fifo));
+}
+
+// One flush packs the queued events into messages of at most batch events each
+static void sigdev_flush_test(struct kunit *test)
+{
+    struct sigdev_event ev = { .value = EVENT_VALUE };
+    u64 msgs = ev_msgs;
+    int i;
+
+    batch = 16;
+    for (i = 0; i < 150; i++)
+        KUNIT_ASSERT_TRUE(test, kfifo_in_spinlocked(&ev_fifo, &ev, 1, &ev_lock));
+    flush_handler(NULL);
+    KUNIT_EXPECT_TRUE(test, kfifo_is_empty(&ev_fifo));
+    KUNIT_EXPECT_EQ(test, ev_msgs, msgs + DIV_ROUND_UP(150, 16));
+
+    // Nothing queued: no message
+    flush_handler(NULL);
+    KUNIT_EXPECT_EQ(test, ev_msgs, msgs + DIV_ROUND_UP(150, 16));
+}
+
+static struct kunit_case sigdev_cases[] = {
+    KUNIT_CASE(sigdev_ioctl_test),
+    KUNIT_CASE(sigdev_signal_test),
+    KUNIT_CASE(sigdev_publish_test),
+    KUNIT_CASE(sigdev_flush_test),
+    {}
+};
+
+static struct kunit_suite sigdev_suite = {
+    .name = "sigdev",
+    .init = sigdev_test_init,
+    .exit = sigdev_test_exit,
+    .test_cases = sigdev_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+static void sigdev_signal_bench(struct kunit *test)
+{
+    allow_signal(SIGUSR1);
+    pid = task_pid_vnr(current);
+    ktest_bench(test, "send + dequeue", send_signal_to_user(); kernel_dequeue_signal());
+}
+
+// 64 events per round: queueing them, then packing and multicasting one message
+static void sigdev_flush_bench(struct kunit *test)
+{
+    struct sigdev_event ev = { .value = EVENT_VALUE };
+    int i;
+
+    batch = 64;
+    ktest_bench_n(test, "64 events", bench_iters >> 6,
+                  for (i = 0; i < 64; i++)
+                      kfifo_in_spinlocked(&ev_fifo, &ev, 1, &ev_lock);
+                  flush_handler(NULL));
+}
+
+static struct kunit_case sigdev_bench_cases[] = {
+    KUNIT_CASE_SLOW(sigdev_signal_bench),
+    KUNIT_CASE_SLOW(sigdev_flush_bench),
+    {}
+};
+
+static struct kunit_suite sigdev_bench_suite = {
+    .name = "sigdev_bench",
+    .init = sigdev_test_init,
+    .exit = sigdev_test_exit,
+    .test_cases = sigdev_bench_cases,
+};
+
+kunit_test_suites(&sigdev_suite, &sigdev_bench_suite);
@@ -0,0 +1,43 @@
+#ifndef SIGDEV_GENL_H
+#define SIGDEV_GENL_H
+
+#include <linux/types.h>
+
+/*
+ * Generic netlink interface of sigdev, shared with user space.
+ *
+ * Every event the module raises is published to the "events" multicast
+ * group of the "sigdev" family. One SIGDEV_CMD_EVENTS message carries
+ * SIGDEV_A_DROPPED followed by one or more SIGDEV_A_EVENT attributes, in
+ * sequence order.
+ */
+#define SIGDEV_GENL_NAME     "sigdev"
+#define SIGDEV_GENL_VERSION  1
+#define SIGDEV_GENL_MCGRP    "events"
+
+enum {
+    SIGDEV_CMD_UNSPEC,
+    SIGDEV_CMD_EVENTS,      // kernel -> group: a batch of events
+    SIGDEV_CMD_GET_STATS,   // request -> reply: SEQ, DROPPED, MSGS
+    __SIGDEV_CMD_MAX,
+};
+
+enum {
+    SIGDEV_A_UNSPEC,
+    SIGDEV_A_PAD,
+    SIGDEV_A_EVENT,         // struct sigdev_event
+    SIGDEV_A_DROPPED,       // u64: events lost in the kernel queue so far
+    SIGDEV_A_SEQ,           // u64: events raised so far
+    SIGDEV_A_MSGS,          // u64: messages published so far
+    __SIGDEV_A_MAX,
+};
+#define SIGDEV_A_MAX (__SIGDEV_A_MAX - 1)
+
+struct sigdev_event {
+    __u64 seq;              // consecutive; a gap means lost events
+    __u64 time_ns;          // ktime_get_ns() when raised
+    __s32 value;            // the same value the signal carries in si_int
+    __u32 pad;
+};
+
+#endif
@@ -11,6 +11,19 @@
  * 1. SPI device initialization
  * 2. Register read/write (CHIP_ID, CONFIG, CTRL_MEAS)
  * 3. Reading raw pressure and temperature data
+ * 4. Continuous sampling into a ring buffer, streamed through /dev/bmp280
+ * 5. An IIO device with pressure/temperature channels and a triggered buffer
+ * 6. Calibrated readings from the trim registers (0x88-0x9F), read once at load
+ * 7. Batched register access: several operations per spi_message, submitted
+ *    asynchronously with spi_async and completed through callbacks
+ * 8. Sensor arrays: a proper spi_driver with probe/remove. Every sensor has
+ *    its own state, sampler thread and IIO device, and all of them feed
+ *    the one /dev/bmp280 stream
+ * 9. A regmap with a register cache for configuration registers, and
+ *    cache statistics in debugfs
+ * 10. Forced mode: one conversion per request, completion detected by
+ *    polling the STATUS register; oversampling and IIR filter set at runtime
+ * 11. Optional SPI clock tuning at probe, reported in sysfs
  *
  * All register addresses and operation values use macros.
  */
@@ -18,13 +31,41 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
+#include <linux/delay.h>
 #include <linux/spi/spi.h>
 #include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/device.h>
+#include <linux/kthread.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/of.h>
+#include <linux/mod_devicetable.h>
+#include <linux/idr.h>
+#include <linux/regmap.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/atomic.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/sysfs.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+#include "bmp280.h"
+#include "bmp280_comp.h"
 
 /* ---------- Driver Definitions ---------- */
 #define DRIVER_NAME        "spi_bmp280"
-#define BMP280_BUS_NUM     0       // SPI bus number (SPI0)
-#define BMP280_CS          0       // Chip select 0
+#define BMP280_SPEED_HZ    1000000 // SPI clock for devices created from the devices parameter
 
 /* ---------- SPI Operation Macros ---------- */
 #define BMP280_SPI_READ    0x80    // MSB=1 for read operation
@@ -32,6 +73,9 @@
 
 /* ---------- BMP280 Register Addresses ---------- */
 #define BMP280_REG_CHIP_ID      0xD0
+#define BMP280_CHIP_ID_VAL      0x58
+#define BMP280_REG_RESET        0xE0   // write 0xB6 for a soft reset, reads 0
+#define BMP280_REG_STATUS       0xF3
 #define BMP280_REG_CTRL_MEAS    0xF4
 #define BMP280_REG_CONFIG       0xF5
 #define BMP280_REG_PRESS_MSB    0xF7   // Pressure MSB
@@ -42,170 +86,1848 @@
 #define BMP280_REG_TEMP_XLSB    0xFC
 
 /* ---------- Example Configuration Macros ---------- */
-#define BMP280_CONFIG_VAL       0x40   // CONFIG register value: standby=0.5ms, filter off
+#define BMP280_CONFIG_VAL       0x40   // CONFIG register value: standby=125ms, filter off
 #define BMP280_CTRL_MEAS_VAL    0x27   // CTRL_MEAS: temp x1, press x1, normal mode
 
-/* ---------- Global SPI device pointer ---------- */
-static struct spi_device *bmp280_device;
+/* ---------- CONFIG Register Fields ---------- */
+#define BMP280_CONFIG_T_SB_SHIFT  5      // bits 7:5 standby time between conversions in normal mode
+#define BMP280_CONFIG_T_SB_MASK   0xE0
+#define BMP280_CONFIG_FILTER_SHIFT 2
+#define BMP280_CONFIG_FILTER_MASK 0x1C   // bits 4:2 IIR filter coefficient
+
+/* ---------- CTRL_MEAS / STATUS Register Fields ---------- */
+#define BMP280_OSRS_T_SHIFT       5      // bits 7:5 temperature oversampling
+#define BMP280_OSRS_T_MASK        0xE0
+#define BMP280_OSRS_P_SHIFT       2      // bits 4:2 pressure oversampling
+#define BMP280_OSRS_P_MASK        0x1C
+#define BMP280_MODE_MASK          0x03   // bits 1:0 power mode
+#define BMP280_MODE_SLEEP         0x00
+#define BMP280_MODE_FORCED        0x01   // one conversion, then back to sleep
+#define BMP280_MODE_NORMAL        0x03
+#define BMP280_STATUS_MEASURING   0x08   // set while a conversion is running
+
+/* ---------- Forced Mode Polling ---------- */
+#define BMP280_POLL_MIN_US        50     // first pause between STATUS polls
+#define BMP280_POLL_MAX_US        2000   // pauses double up to this
+
+/* ---------- Continuous Sampling ---------- */
+#define BMP280_MAX_RATE_HZ      2000     // above the sensor's ODR this only yields repeated samples
+
+static unsigned int sample_rate_hz = 100;
+module_param(sample_rate_hz, uint, 0644);
+MODULE_PARM_DESC(sample_rate_hz, "Samples per second pushed to /dev/bmp280 (1-2000, may be changed at runtime)");
+
+static unsigned int ring_entries = 1024;
+module_param(ring_entries, uint, 0444);
+MODULE_PARM_DESC(ring_entries, "Samples buffered for /dev/bmp280, shared by all sensors (rounded up to a power of 2)");
+
+/*
+ * Sensors without a device tree node are created at load time from this
+ * list of bus:chipselect pairs, e.g. devices=0:0,0:1,1:0. Pass an empty
+ * string when all sensors come from the device tree.
+ */
+static char *devices = "0:0";
+module_param(devices, charp, 0444);
+MODULE_PARM_DESC(devices, "Comma-separated bus:cs list of sensors to create (default 0:0)");
+
+static bool spi_autotune;
+module_param(spi_autotune, bool, 0444);
+MODULE_PARM_DESC(spi_autotune, "Find the fastest reliable SPI clock (up to 10 MHz) for each sensor at probe");
+
+/*
+ * Standby times selectable in CONFIG[7:5], in microseconds.
+ * In normal mode the sensor converts once per (t_measure + t_standby), so the
+ * sampler picks the longest standby that still refreshes the data registers
+ * at least once per sampling period.
+ */
+static const unsigned int bmp280_t_sb_us[] = {
+    500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000,
+};
+
+/* ---------- SPI Transactions ---------- */
+/*
+ * A transaction packs several register operations into one spi_message,
+ * one spi_transfer per operation:
+ * - read:  control byte + len dummy bytes; the data lands in rx right
+ *          after the control byte
+ * - write: control byte + value
+ * cs_change on every transfer but the last toggles chip select between
+ * operations, which ends a register sequence on the BMP280. Each operation
+ * therefore behaves exactly like a separate transfer, but the controller
+ * gets the whole list at once: one queueing, one wakeup and one completion
+ * instead of one round trip per register access.
+ *
+ * tx and rx live inside the kmalloc'd transaction and each start on an
+ * ARCH_DMA_MINALIGN boundary, so controllers can DMA straight into them
+ * without the bounce buffer spi_write_then_read needs.
+ */
+#define BMP280_XACT_MAX_OPS     8
+#define BMP280_XACT_BUF_LEN     64
+
+struct bmp280_xact {
+    struct spi_message msg;
+    struct spi_transfer xfer[BMP280_XACT_MAX_OPS];
+    unsigned int nr_ops;
+    unsigned int len;               // bytes of tx/rx used so far
+    bool overflow;                  // an operation did not fit, submit refuses
+    void (*complete)(struct bmp280_xact *xact);
+    void *context;
+    struct completion done;         // complete whenever no message is in flight
+    u8 tx[BMP280_XACT_BUF_LEN] __aligned(ARCH_DMA_MINALIGN);
+    u8 rx[BMP280_XACT_BUF_LEN] __aligned(ARCH_DMA_MINALIGN);
+};
+
+static struct bmp280_xact *bmp280_xact_alloc(void)
+{
+    struct bmp280_xact *xact = kzalloc(sizeof(*xact), GFP_KERNEL);
+
+    if (!xact)
+        return NULL;
+    init_completion(&xact->done);
+    complete_all(&xact->done);      // idle
+    return xact;
+}
+
+static void bmp280_xact_reset(struct bmp280_xact *xact)
+{
+    spi_message_init(&xact->msg);
+    xact->nr_ops = 0;
+    xact->len = 0;
+    xact->overflow = false;
+}
+
+static struct spi_transfer *bmp280_xact_add(struct bmp280_xact *xact, unsigned int len)
+{
+    struct spi_transfer *t;
+
+    if (xact->nr_ops == BMP280_XACT_MAX_OPS || xact->len + len > BMP280_XACT_BUF_LEN) {
+        WARN_ONCE(1, DRIVER_NAME ": transaction too large\n");
+        xact->overflow = true;
+        return NULL;
+    }
+
+    if (xact->nr_ops)
+        xact->xfer[xact->nr_ops - 1].cs_change = 1;
+    t = &xact->xfer[xact->nr_ops++];
+    memset(t, 0, sizeof(*t));
+    t->tx_buf = &xact->tx[xact->len];
+    t->len = len;
+    spi_message_add_tail(t, &xact->msg);
+    xact->len += len;
+    return t;
+}
+
+/* Queues a burst read of len registers; the returned pointer is valid after completion */
+static u8 *bmp280_xact_read(struct bmp280_xact *xact, u8 reg, unsigned int len)
+{
+    struct spi_transfer *t = bmp280_xact_add(xact, len + 1);
+    u8 *tx;
+
+    if (!t)
+        return NULL;
+    tx = (u8 *)t->tx_buf;
+    tx[0] = reg | BMP280_SPI_READ;
+    memset(tx + 1, 0, len);
+    t->rx_buf = &xact->rx[tx - xact->tx];
+    return (u8 *)t->rx_buf + 1;
+}
+
+static void bmp280_xact_write(struct bmp280_xact *xact, u8 reg, u8 val)
+{
+    struct spi_transfer *t = bmp280_xact_add(xact, 2);
+    u8 *tx;
+
+    if (!t)
+        return;
+    tx = (u8 *)t->tx_buf;
+    tx[0] = reg & BMP280_SPI_WRITE;
+    tx[1] = val;
+}
+
+/* Runs in the controller's completion context: must not sleep */
+static void bmp280_xact_done(void *context)
+{
+    struct bmp280_xact *xact = context;
+
+    if (xact->complete)
+        xact->complete(xact);
+    complete_all(&xact->done);
+}
+
+/*
+ * bmp280_xact_submit
+ * ----------------
+ * Hands the message to the controller with spi_async and returns at once.
+ * complete(xact) is called when the transfers are done; msg.status holds
+ * the result. A transaction may be resubmitted as is once it completed,
+ * so fixed sequences are built only once.
+ */
+static int bmp280_xact_submit(struct spi_device *spi, struct bmp280_xact *xact,
+                              void (*complete)(struct bmp280_xact *xact), void *context)
+{
+    int ret;
+
+    if (xact->overflow || !xact->nr_ops)
+        return -EINVAL;
+
+    xact->complete = complete;
+    xact->context = context;
+    xact->msg.complete = bmp280_xact_done;
+    xact->msg.context = xact;
+    reinit_completion(&xact->done);
+
+    ret = spi_async(spi, &xact->msg);
+    if (ret)
+        complete_all(&xact->done);
+    return ret;
+}
+
+/* Submits and waits, for callers that need the result before going on */
+static int bmp280_xact_sync(struct spi_device *spi, struct bmp280_xact *xact)
+{
+    int ret;
+
+    ret = bmp280_xact_submit(spi, xact, NULL, NULL);
+    if (ret)
+        return ret;
+    wait_for_completion(&xact->done);
+    return xact->msg.status;
+}
+
+/* ---------- Driver State ---------- */
+/*
+ * Per-sensor state, allocated in probe:
+ * - spi:    the SPI device this instance is bound to
+ * - index:  slot in bmp280_stream.sensors, reported as sample.sensor
+ * - regmap: cached register map for all control-path access
+ * - ctl:    transaction the regmap bus moves its bytes through
+ * - sample: prebuilt data-register burst, submitted asynchronously once per
+ *           period by this sensor's sampler thread
+ */
+struct bmp280_forced_stats {
+    u64 reads;                  // completed forced conversions
+    u64 polls;                  // STATUS reads while waiting for them
+    u64 timeouts;
+    u64 last_latency_ns;        // trigger to data, last read
+};
+
+struct bmp280_regstats {
+    atomic64_t reads;           // registers requested through the map
+    atomic64_t miss_regs;       // cacheable registers that had to be read from the bus
+    atomic64_t volatile_regs;   // volatile registers read from the bus
+    atomic64_t bus_reads;
+    atomic64_t bus_writes;
+};
+
+struct bmp280_data {
+    struct spi_device *spi;
+    unsigned int index;
+    struct task_struct *sampler;
+    struct regmap *regmap;
+    struct bmp280_regstats regstats;
+    struct dentry *debugfs;
+    struct bmp280_xact *ctl;
+    struct bmp280_xact *sample;
+    const u8 *sample_rx;        // data registers inside sample->rx
+    u64 sample_ts;              // timestamp of the sample in flight
+    u32 seq;
+    u64 dropped;
+    u64 errors;
+    u64 overruns;               // periods skipped because the last read was still running
+    int t_sb;                   // standby code last written to CONFIG, -1 = unknown
+    struct mutex meas_lock;     // one forced conversion or mode change at a time
+    bool forced;                // forced mode instead of normal mode
+    bool reconfig;              // oversampling changed, sampler recomputes standby
+    u64 conv_ewma_ns;           // running estimate of the conversion time
+    struct bmp280_forced_stats forced_stats;
+    u32 tune_max_ok_hz;         // fastest clean clock found at probe, 0 = not tuned
+    u32 tune_checks;
+    u32 tune_errors;
+    struct iio_dev *indio_dev;
+    u8 calib_raw[BMP280_CALIB_LEN];
+    struct bmp280_calib calib;  // trim parameters, constant for the life of the chip
+};
+
+/*
+ * The merged output stream, shared by every sensor:
+ * - fifo:     ring of timestamped samples. Each sensor's completion
+ *             callback is a producer and those run concurrently on
+ *             different buses, so pushes take fifo_lock; read() holds
+ *             read_lock, the consumer side needs nothing more
+ * - wait:     readers sleep here until a sample is pushed
+ * - sensors:  probed sensors by index (allocated from bmp280_ida), for
+ *             the ioctls; guarded by sensors_lock
+ */
+struct bmp280_stream {
+    DECLARE_KFIFO_PTR(fifo, struct bmp280_sample);
+    spinlock_t fifo_lock;
+    wait_queue_head_t wait;
+    struct mutex read_lock;
+    struct bmp280_data *sensors[BMP280_MAX_SENSORS];
+    struct mutex sensors_lock;
+};
+
+static struct bmp280_stream bmp280_stream;
+
+/* ---------- Character Device ---------- */
+static int major;
+static struct class *bmp280_class;
+static struct device *bmp280_chardev;
+
+/* ---------- SPI devices created from the devices parameter ---------- */
+static struct spi_device *bmp280_param_devs[BMP280_MAX_SENSORS];
+
+/* ---------- Register Map (regmap) ---------- */
+/*
+ * Control-path register access goes through regmap with an rbtree cache:
+ * - non-volatile registers (CHIP_ID, CTRL_MEAS, CONFIG) are read from the
+ *   bus once; later reads, including the read half of regmap_update_bits(),
+ *   come from the cache, and update_bits skips the write when nothing
+ *   changes. A write updates the cache, so no readback is needed
+ * - volatile registers (STATUS, the data block, RESET) always go to the bus;
+ *   the data block is read with one regmap_bulk_read() burst
+ * - the trim block is read once at probe, past the cache, and kept parsed
+ *   in data->calib, so regmap would only hold a second copy of it
+ * The sampler's data burst stays a prebuilt async transaction: regmap has
+ * no asynchronous reads, and the data registers are volatile, so reading
+ * them past the map cannot leave the cache stale.
+ *
+ * The regmap bus below moves bytes through the ctl transaction, so register
+ * writes use DMA-safe buffers too. The regmap's own lock serialises it.
+ */
+static const struct regmap_range bmp280_readable_ranges[] = {
+    regmap_reg_range(BMP280_REG_CALIB, BMP280_REG_CALIB + BMP280_CALIB_LEN - 1),
+    regmap_reg_range(BMP280_REG_CHIP_ID, BMP280_REG_CHIP_ID),
+    regmap_reg_range(BMP280_REG_STATUS, BMP280_REG_TEMP_XLSB),
+};
+
+static const struct regmap_range bmp280_writeable_ranges[] = {
+    regmap_reg_range(BMP280_REG_RESET, BMP280_REG_RESET),
+    regmap_reg_range(BMP280_REG_CTRL_MEAS, BMP280_REG_CONFIG),
+};
+
+static const struct regmap_range bmp280_volatile_ranges[] = {
+    regmap_reg_range(BMP280_REG_RESET, BMP280_REG_RESET),
+    regmap_reg_range(BMP280_REG_STATUS, BMP280_REG_STATUS),
+    regmap_reg_range(BMP280_REG_PRESS_MSB, BMP280_REG_TEMP_XLSB),
+};
+
+static const struct regmap_access_table bmp280_readable_table = {
+    .yes_ranges = bmp280_readable_ranges,
+    .n_yes_ranges = ARRAY_SIZE(bmp280_readable_ranges),
+};
+
+static const struct regmap_access_table bmp280_writeable_table = {
+    .yes_ranges = bmp280_writeable_ranges,
+    .n_yes_ranges = ARRAY_SIZE(bmp280_writeable_ranges),
+};
+
+static const struct regmap_access_table bmp280_volatile_table = {
+    .yes_ranges = bmp280_volatile_ranges,
+    .n_yes_ranges = ARRAY_SIZE(bmp280_volatile_ranges),
+};
+
+static const struct regmap_config bmp280_regmap_config = {
+    .reg_bits = 8,
+    .val_bits = 8,
+    .read_flag_mask = BMP280_SPI_READ,
+    .max_register = BMP280_REG_TEMP_XLSB,
+    .rd_table = &bmp280_readable_table,
+    .wr_table = &bmp280_writeable_table,
+    .volatile_table = &bmp280_volatile_table,
+    .cache_type = REGCACHE_RBTREE,
+    .use_single_write = true,       // the BMP280 has no auto-increment on writes
+};
+
+/*
+ * Bus side of the map. Every register that reaches these callbacks missed
+ * the cache, or is volatile; counting them per register gives the cache
+ * statistics in debugfs (see bmp280_regstats_show).
+ */
+static int bmp280_regmap_read(void *context, const void *reg, size_t reg_size,
+                              void *val, size_t val_size)
+{
+    struct bmp280_data *data = context;
+    u8 addr = *(const u8 *)reg;
+    const u8 *rx;
+    int ret;
+
+    bmp280_xact_reset(data->ctl);
+    rx = bmp280_xact_read(data->ctl, addr, val_size);
+    ret = bmp280_xact_sync(data->spi, data->ctl);
+    if (ret)
+        return ret;
+    memcpy(val, rx, val_size);
+
+    atomic64_inc(&data->regstats.bus_reads);
+    if (regmap_check_range_table(data->regmap, addr, &bmp280_volatile_table))
+        atomic64_add(val_size, &data->regstats.volatile_regs);
+    else
+        atomic64_add(val_size, &data->regstats.miss_regs);
+    return 0;
+}
+
+/* count bytes: register, then one value per consecutive register */
+static int bmp280_regmap_write(void *context, const void *buf, size_t count)
+{
+    struct bmp280_data *data = context;
+    const u8 *tx = buf;
+    size_t i;
+
+    bmp280_xact_reset(data->ctl);
+    for (i = 1; i < count; i++)
+        bmp280_xact_write(data->ctl, tx[0] + i - 1, tx[i]);
+    atomic64_inc(&data->regstats.bus_writes);
+    return bmp280_xact_sync(data->spi, data->ctl);
+}
+
+static const struct regmap_bus bmp280_regmap_bus = {
+    .read = bmp280_regmap_read,
+    .write = bmp280_regmap_write,
+    .max_raw_read = BMP280_XACT_BUF_LEN - 1,    // control byte + data must fit the transaction
+    .reg_format_endian_default = REGMAP_ENDIAN_BIG,
+    .val_format_endian_default = REGMAP_ENDIAN_BIG,
+};
+
+/* Reads through the map, counting every register requested */
+static int bmp280_reg_read(struct bmp280_data *data, unsigned int reg, unsigned int *val)
+{
+    atomic64_inc(&data->regstats.reads);
+    return regmap_read(data->regmap, reg, val);
+}
+
+static int bmp280_reg_bulk_read(struct bmp280_data *data, unsigned int reg, void *buf, size_t count)
+{
+    atomic64_add(count, &data->regstats.reads);
+    return regmap_bulk_read(data->regmap, reg, buf, count);
+}
+
+static int bmp280_reg_update(struct bmp280_data *data, unsigned int reg,
+                             unsigned int mask, unsigned int val)
+{
+    atomic64_inc(&data->regstats.reads);
+    return regmap_update_bits(data->regmap, reg, mask, val);
+}
+
+/* ---------- debugfs ---------- */
+/*
+ * /sys/kernel/debug/spi_bmp280/sensor<N>/regcache
+ *   reads           registers read through the map
+ *   cache_hits      ... served from the cache
+ *   cache_misses    ... of cacheable registers that went to the bus
+ *   volatile_reads  ... of volatile registers (always the bus)
+ *   bus_reads       read transactions on the bus
+ *   bus_writes      write transactions on the bus
+ * The sampler's own data bursts are not included.
+ */
+static struct dentry *bmp280_debugfs;
+
+static int bmp280_regstats_show(struct seq_file *m, void *v)
+{
+    struct bmp280_data *data = m->private;
+    struct bmp280_regstats *st = &data->regstats;
+    s64 reads = atomic64_read(&st->reads);
+    s64 misses = atomic64_read(&st->miss_regs);
+    s64 vol = atomic64_read(&st->volatile_regs);
+
+    seq_printf(m, "reads:          %lld\n", reads);
+    seq_printf(m, "cache_hits:     %lld\n", max_t(s64, reads - misses - vol, 0));
+    seq_printf(m, "cache_misses:   %lld\n", misses);
+    seq_printf(m, "volatile_reads: %lld\n", vol);
+    seq_printf(m, "bus_reads:      %lld\n", atomic64_read(&st->bus_reads));
+    seq_printf(m, "bus_writes:     %lld\n", atomic64_read(&st->bus_writes));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bmp280_regstats);
+
+/*
+ * /sys/kernel/debug/spi_bmp280/sensor<N>/forced
+ *   reads             forced conversions read
+ *   polls             STATUS reads spent waiting for them
+ *   timeouts          conversions that never finished
+ *   conv_estimate_ns  current estimate of the conversion time
+ *   last_latency_ns   trigger to data, last read
+ */
+static int bmp280_forced_show(struct seq_file *m, void *v)
+{
+    struct bmp280_data *data = m->private;
+    struct bmp280_forced_stats *fs = &data->forced_stats;
+
+    mutex_lock(&data->meas_lock);
+    seq_printf(m, "reads:            %llu\n", fs->reads);
+    seq_printf(m, "polls:            %llu\n", fs->polls);
+    seq_printf(m, "timeouts:         %llu\n", fs->timeouts);
+    seq_printf(m, "conv_estimate_ns: %llu\n", data->conv_ewma_ns);
+    seq_printf(m, "last_latency_ns:  %llu\n", fs->last_latency_ns);
+    mutex_unlock(&data->meas_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bmp280_forced);
+
+/* ---------- Sampling Helpers ---------- */
+/* Splits the six data registers (0xF7-0xFC) into the two 20-bit values */
+static void bmp280_parse_raw(const u8 *rx, u32 *raw_press, u32 *raw_temp)
+{
+    *raw_press = ((u32)rx[0] << 12) | ((u32)rx[1] << 4) | ((rx[2] >> 4) & 0x0F);
+    *raw_temp  = ((u32)rx[3] << 12) | ((u32)rx[4] << 4) | ((rx[5] >> 4) & 0x0F);
+}
+
+/*
+ * bmp280_read_raw
+ * ----------------
+ * Burst-reads the six data registers (0xF7-0xFC) in one transfer so that
+ * pressure and temperature always come from the same conversion.
+ * Used for on-demand reads; the sampler uses its own prebuilt transaction.
+ */
+static int bmp280_read_raw(struct bmp280_data *data, u32 *raw_press, u32 *raw_temp)
+{
+    u8 rx[6];
+    int ret;
+
+    ret = bmp280_reg_bulk_read(data, BMP280_REG_PRESS_MSB, rx, sizeof(rx));
+    if (!ret)
+        bmp280_parse_raw(rx, raw_press, raw_temp);
+    return ret;
+}
+
+/*
+ * bmp280_compensate
+ * ----------------
+ * Datasheet integer compensation: temperature first, because its t_fine
+ * term feeds the pressure formula.
+ */
+static void bmp280_compensate(struct bmp280_data *data, u32 raw_press, u32 raw_temp,
+                              s32 *temp_cdeg, u32 *press_q8)
+{
+    s32 t_fine;
+
+    *temp_cdeg = bmp280_compensate_temp(&data->calib, raw_temp, &t_fine);
+    *press_q8 = bmp280_compensate_press(&data->calib, raw_press, t_fine);
+}
+
+/*
+ * bmp280_t_meas_us
+ * ----------------
+ * Conversion time for the oversampling settings in CTRL_MEAS (datasheet
+ * section 9.1): typical or maximum. A skipped pressure measurement
+ * (osrs_p = 0) also skips its fixed overhead.
+ */
+static unsigned int bmp280_t_meas_us(unsigned int ctrl_meas, bool max)
+{
+    static const u8 os_mult[8] = { 0, 1, 2, 4, 8, 16, 16, 16 };
+    unsigned int t = os_mult[(ctrl_meas & BMP280_OSRS_T_MASK) >> BMP280_OSRS_T_SHIFT];
+    unsigned int p = os_mult[(ctrl_meas & BMP280_OSRS_P_MASK) >> BMP280_OSRS_P_SHIFT];
+
+    if (max)
+        return 1250 + 2300 * t + (p ? 2300 * p + 575 : 0);
+    return 1000 + 2000 * t + (p ? 2000 * p + 500 : 0);
+}
+
+/* Called after an oversampling change: new conversion time, new standby */
+static void bmp280_timing_changed(struct bmp280_data *data, unsigned int ctrl_meas)
+{
+    mutex_lock(&data->meas_lock);
+    data->conv_ewma_ns = (u64)bmp280_t_meas_us(ctrl_meas, false) * NSEC_PER_USEC;
+    mutex_unlock(&data->meas_lock);
+    WRITE_ONCE(data->reconfig, true);
+}
+
+/*
+ * bmp280_forced_read
+ * ----------------
+ * One conversion on request: write forced mode to CTRL_MEAS, wait for
+ * STATUS.measuring (0xF3 bit 3) to clear, then burst-read the result.
+ *
+ * The wait adapts to the sensor:
+ * - first sleep for 15/16 of conv_ewma_ns, the running estimate of the
+ *   conversion time, without touching the bus
+ * - then poll STATUS, doubling the pause between polls from
+ *   BMP280_POLL_MIN_US up to BMP280_POLL_MAX_US
+ * - the time at which the conversion was seen done updates the estimate
+ *   (EWMA, weight 1/8). A first poll that already finds it done pulls the
+ *   estimate down, extra polls push it up, so it settles just around the
+ *   real conversion time of this chip at this oversampling
+ *
+ * The chip drops back to sleep mode by itself, which the register cache
+ * cannot know, so the trigger is a forced write (regmap_write_bits) rather
+ * than an update that the cache might consider a no-op.
+ */
+static int bmp280_forced_read(struct bmp280_data *data, u32 *raw_press, u32 *raw_temp)
+{
+    struct bmp280_forced_stats *fs = &data->forced_stats;
+    unsigned int ctrl_meas, status, step_us = BMP280_POLL_MIN_US;
+    u64 start, now, deadline;
+    int ret;
+
+    mutex_lock(&data->meas_lock);
+
+    ret = bmp280_reg_read(data, BMP280_REG_CTRL_MEAS, &ctrl_meas);
+    if (ret)
+        goto out;
+    // give up after twice the datasheet maximum
+    deadline = 2ULL * bmp280_t_meas_us(ctrl_meas, true) * NSEC_PER_USEC;
+
+    start = ktime_get_ns();
+    deadline += start;
+    ret = regmap_write_bits(data->regmap, BMP280_REG_CTRL_MEAS,
+                            BMP280_MODE_MASK, BMP280_MODE_FORCED);
+    if (ret)
+        goto out;
+
+    fsleep(div_u64(data->conv_ewma_ns - data->conv_ewma_ns / 16, NSEC_PER_USEC));
+
+    for (;;) {
+        ret = bmp280_reg_read(data, BMP280_REG_STATUS, &status);
+        if (ret)
+            goto out;
+        fs->polls++;
+        now = ktime_get_ns();
+        if (!(status & BMP280_STATUS_MEASURING))
+            break;
+        if (now > deadline) {
+            fs->timeouts++;
+            ret = -ETIMEDOUT;
+            goto out;
+        }
+        fsleep(step_us);
+        step_us = min(step_us * 2, (unsigned int)BMP280_POLL_MAX_US);
+    }
+
+    data->conv_ewma_ns += ((s64)(now - start) - (s64)data->conv_ewma_ns) / 8;
+
+    ret = bmp280_read_raw(data, raw_press, raw_temp);
+    if (!ret) {
+        fs->reads++;
+        fs->last_latency_ns = ktime_get_ns() - start;
+    }
+out:
+    mutex_unlock(&data->meas_lock);
+    return ret;
+}
+
+/* A fresh conversion in forced mode, the latest normal-mode result otherwise */
+static int bmp280_measure(struct bmp280_data *data, u32 *raw_press, u32 *raw_temp)
+{
+    if (READ_ONCE(data->forced))
+        return bmp280_forced_read(data, raw_press, raw_temp);
+    return bmp280_read_raw(data, raw_press, raw_temp);
+}
+
+/*
+ * bmp280_set_mode
+ * ----------------
+ * normal: the sensor converts continuously, the sampler just reads.
+ * forced: the sensor sleeps between samples; the sampler and on-demand
+ * reads each trigger their own conversion. Oversampling bits are kept.
+ */
+static int bmp280_set_mode(struct bmp280_data *data, bool forced)
+{
+    int ret;
+
+    mutex_lock(&data->meas_lock);
+    ret = regmap_write_bits(data->regmap, BMP280_REG_CTRL_MEAS, BMP280_MODE_MASK,
+                            forced ? BMP280_MODE_SLEEP : BMP280_MODE_NORMAL);
+    if (!ret)
+        WRITE_ONCE(data->forced, forced);
+    mutex_unlock(&data->meas_lock);
+    return ret;
+}
+
+/*
+ * bmp280_set_standby
+ * ----------------
+ * Programs CONFIG[7:5] so that normal mode refreshes the data registers at
+ * least once per sampling period. The IIR filter bits are kept as they are.
+ * The read-modify-write reads CONFIG from the register cache, so only the
+ * write reaches the bus.
+ */
+static int bmp280_set_standby(struct bmp280_data *data, u64 period_ns)
+{
+    unsigned int ctrl_meas, t_meas_us;
+    int t_sb = 0, i, ret;
+
+    ret = bmp280_reg_read(data, BMP280_REG_CTRL_MEAS, &ctrl_meas);
+    if (ret)
+        return ret;
+    t_meas_us = bmp280_t_meas_us(ctrl_meas, true);
+
+    for (i = ARRAY_SIZE(bmp280_t_sb_us) - 1; i > 0; i--) {
+        if ((u64)(bmp280_t_sb_us[i] + t_meas_us) * NSEC_PER_USEC <= period_ns) {
+            t_sb = i;
+            break;
+        }
+    }
+    if (t_sb == data->t_sb)
+        return 0;
+
+    ret = bmp280_reg_update(data, BMP280_REG_CONFIG, BMP280_CONFIG_T_SB_MASK,
+                            t_sb << BMP280_CONFIG_T_SB_SHIFT);
+    if (ret)
+        return ret;
+
+    data->t_sb = t_sb;
+    pr_info(DRIVER_NAME ": sensor %u: standby set to %u us\n", data->index, bmp280_t_sb_us[t_sb]);
+    return 0;
+}
+
+/*
+ * bmp280_sample_complete
+ * ----------------
+ * Completion of the sampler's data burst, called from the SPI controller's
+ * completion context. Compensation is a handful of integer operations, so
+ * the sample is finished and pushed right here and the sampler thread never
+ * waits for the bus. Only one burst per sensor is in flight at a time, so
+ * seq needs no locking; the shared ring does.
+ */
+static void bmp280_push_sample(struct bmp280_data *data, u64 timestamp_ns,
+                               u32 raw_press, u32 raw_temp)
+{
+    struct bmp280_stream *stream = &bmp280_stream;
+    struct bmp280_sample sample = {
+        .timestamp_ns = timestamp_ns,
+        .raw_press = raw_press,
+        .raw_temp = raw_temp,
+        .seq = data->seq++,
+        .sensor = data->index,
+    };
+
+    bmp280_compensate(data, raw_press, raw_temp, &sample.temp_cdeg, &sample.press_q8);
+    if (kfifo_in_spinlocked(&stream->fifo, &sample, 1, &stream->fifo_lock))
+        wake_up_interruptible_poll(&stream->wait, EPOLLIN | EPOLLRDNORM);
+    else
+        data->dropped++;
+}
+
+static void bmp280_sample_complete(struct bmp280_xact *xact)
+{
+    struct bmp280_data *data = xact->context;
+    u32 raw_press, raw_temp;
+
+    if (xact->msg.status) {
+        data->errors++;
+        return;
+    }
+
+    bmp280_parse_raw(data->sample_rx, &raw_press, &raw_temp);
+    bmp280_push_sample(data, data->sample_ts, raw_press, raw_temp);
+}
+
+/*
+ * bmp280_sampler
+ * ----------------
+ * Kernel thread, one per sensor, that starts one sample per period;
+ * bmp280_sample_complete pushes it into the ring when the transfer is done.
+ * Sensors on different buses therefore transfer in parallel, each on its
+ * own controller, and sensors sharing a bus queue on that controller.
+ * Wakeups use absolute hrtimer deadlines (next += period), so the rate does
+ * not drift with the time spent on the SPI transfer. If the thread falls
+ * behind it resynchronises instead of bursting to catch up.
+ * If the previous burst has not completed when the next period starts, the
+ * period is skipped and counted as an overrun.
+ * In forced mode the thread instead triggers a conversion, waits for it and
+ * pushes the result itself; the sensor sleeps for the rest of the period.
+ * A full ring drops the new sample; the gap shows up in the seq numbers.
+ */
+static int bmp280_sampler(void *arg)
+{
+    struct bmp280_data *data = arg;
+    ktime_t next = ktime_get();
+    unsigned int rate = 0;
+    u64 period_ns = 0;
+
+    while (!kthread_should_stop()) {
+        unsigned int hz = clamp(READ_ONCE(sample_rate_hz), 1U, (unsigned int)BMP280_MAX_RATE_HZ);
+
+        if (hz != rate || READ_ONCE(data->reconfig)) {
+            rate = hz;
+            period_ns = NSEC_PER_SEC / rate;
+            WRITE_ONCE(data->reconfig, false);
+            if (bmp280_set_standby(data, period_ns))
+                pr_warn(DRIVER_NAME ": failed to update standby time\n");
+        }
+
+        if (READ_ONCE(data->forced)) {
+            u64 ts = ktime_get_ns();
+            u32 raw_press, raw_temp;
+
+            wait_for_completion(&data->sample->done);  // no async burst may push concurrently
+            if (bmp280_forced_read(data, &raw_press, &raw_temp))
+                data->errors++;
+            else
+                bmp280_push_sample(data, ts, raw_press, raw_temp);
+        } else if (!completion_done(&data->sample->done)) {
+            data->overruns++;
+        } else {
+            data->sample_ts = ktime_get_ns();
+            if (bmp280_xact_submit(data->spi, data->sample, bmp280_sample_complete, data))
+                data->errors++;
+        }
+
+        next = ktime_add_ns(next, period_ns);
+        if (ktime_before(next, ktime_get()))
+            next = ktime_get();
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop()) {
+            __set_current_state(TASK_RUNNING);
+            break;
+        }
+        schedule_hrtimeout_range(&next, period_ns >> 4, HRTIMER_MODE_ABS);
+    }
+    return 0;
+}
+
+/* ---------- File Operations for /dev/bmp280 ---------- */
+/*
+ * bmp280_read
+ * ----------------
+ * Returns as many whole struct bmp280_sample records as fit in the buffer.
+ * Blocks until at least one sample is available unless O_NONBLOCK is set.
+ */
+static ssize_t bmp280_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+{
+    struct bmp280_stream *data = &bmp280_stream;
+    unsigned int copied;
+    int ret;
+
+    if (len < sizeof(struct bmp280_sample))
+        return -EINVAL;
+    len = rounddown(len, sizeof(struct bmp280_sample));
+
+    if (mutex_lock_interruptible(&data->read_lock))
+        return -ERESTARTSYS;
+
+    while (kfifo_is_empty(&data->fifo)) {
+        mutex_unlock(&data->read_lock);
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        if (wait_event_interruptible(data->wait, !kfifo_is_empty(&data->fifo)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&data->read_lock))
+            return -ERESTARTSYS;
+    }
+
+    ret = kfifo_to_user(&data->fifo, buf, len, &copied);
+    mutex_unlock(&data->read_lock);
+
+    return ret ? ret : copied;
+}
+
+static __poll_t bmp280_poll(struct file *file, poll_table *wait)
+{
+    struct bmp280_stream *data = &bmp280_stream;
+
+    poll_wait(file, &data->wait, wait);
+    if (!kfifo_is_empty(&data->fifo))
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+static int bmp280_open(struct inode *inode, struct file *file)
+{
+    return stream_open(inode, file);
+}
+
+/* Copies the trim block of sensor index, or of the first sensor if index < 0 */
+static int bmp280_get_calib(int index, u8 *raw)
+{
+    struct bmp280_stream *stream = &bmp280_stream;
+    int i, ret = -ENODEV;
+
+    mutex_lock(&stream->sensors_lock);
+    for (i = 0; i < BMP280_MAX_SENSORS; i++) {
+        struct bmp280_data *data = stream->sensors[i];
+
+        if (data && (index < 0 || index == i)) {
+            memcpy(raw, data->calib_raw, BMP280_CALIB_LEN);
+            ret = 0;
+            break;
+        }
+    }
+    mutex_unlock(&stream->sensors_lock);
+    return ret;
+}
+
+/*
+ * BMP280_IOC_GET_CALIB / BMP280_IOC_GET_SENSOR_CALIB hand out the raw trim
+ * block, so tools can store it next to a raw capture and compensate the
+ * capture offline.
+ */
+static long bmp280_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct bmp280_sensor_calib sc;
+    u8 raw[BMP280_CALIB_LEN];
+    int ret;
+
+    BUILD_BUG_ON(sizeof(struct bmp280_calib_raw) != BMP280_CALIB_LEN);
+    BUILD_BUG_ON(sizeof(sc.data) != BMP280_CALIB_LEN);
+
+    switch (cmd) {
+    case BMP280_IOC_GET_CALIB:
+        ret = bmp280_get_calib(-1, raw);
+        if (ret)
+            return ret;
+        if (copy_to_user((void __user *)arg, raw, BMP280_CALIB_LEN))
+            return -EFAULT;
+        return 0;
+    case BMP280_IOC_GET_SENSOR_CALIB:
+        if (copy_from_user(&sc, (void __user *)arg, sizeof(sc)))
+            return -EFAULT;
+        if (sc.sensor >= BMP280_MAX_SENSORS)
+            return -ENODEV;
+        ret = bmp280_get_calib(sc.sensor, sc.data);
+        if (ret)
+            return ret;
+        if (copy_to_user((void __user *)arg, &sc, sizeof(sc)))
+            return -EFAULT;
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static const struct file_operations bmp280_fops = {
+    .owner = THIS_MODULE,
+    .open = bmp280_open,
+    .read = bmp280_read,
+    .poll = bmp280_poll,
+    .unlocked_ioctl = bmp280_ioctl,
+};
+
+/*
+ * bmp280_stream_create / bmp280_stream_destroy
+ * ----------------
+ * Allocate the shared ring and expose /dev/bmp280. Done once at module
+ * load, before any sensor is probed; the device node goes away before the
+ * ring is freed.
+ */
+static int bmp280_stream_create(struct bmp280_stream *stream)
+{
+    int ret;
+
+    ret = kfifo_alloc(&stream->fifo, roundup_pow_of_two(max(ring_entries, 2U)), GFP_KERNEL);
+    if (ret)
+        return ret;
+    spin_lock_init(&stream->fifo_lock);
+    init_waitqueue_head(&stream->wait);
+    mutex_init(&stream->read_lock);
+    mutex_init(&stream->sensors_lock);
+
+    major = register_chrdev(0, BMP280_DEVICE_NAME, &bmp280_fops);
+    if (major < 0) {
+        ret = major;
+        goto err_fifo;
+    }
+
+    bmp280_class = class_create(BMP280_DEVICE_NAME);
+    if (IS_ERR(bmp280_class)) {
+        ret = PTR_ERR(bmp280_class);
+        goto err_chrdev;
+    }
+
+    bmp280_chardev = device_create(bmp280_class, NULL, MKDEV(major, 0), NULL, BMP280_DEVICE_NAME);
+    if (IS_ERR(bmp280_chardev)) {
+        ret = PTR_ERR(bmp280_chardev);
+        goto err_class;
+    }
+    return 0;
+
+err_class:
+    class_destroy(bmp280_class);
+err_chrdev:
+    unregister_chrdev(major, BMP280_DEVICE_NAME);
+err_fifo:
+    kfifo_free(&stream->fifo);
+    return ret;
+}
+
+static void bmp280_stream_destroy(struct bmp280_stream *stream)
+{
+    device_destroy(bmp280_class, MKDEV(major, 0));
+    class_destroy(bmp280_class);
+    unregister_chrdev(major, BMP280_DEVICE_NAME);
+    kfifo_free(&stream->fifo);
+}
+
+/*
+ * bmp280_sampler_start / bmp280_sampler_stop
+ * ----------------
+ * Build the sensor's data burst and start its sampler thread. Stopping
+ * waits for a burst still on the bus, since its completion writes to the
+ * shared ring and to data.
+ */
+static int bmp280_sampler_start(struct bmp280_data *data)
+{
+    data->sample = bmp280_xact_alloc();
+    if (!data->sample)
+        return -ENOMEM;
+    bmp280_xact_reset(data->sample);
+    data->sample_rx = bmp280_xact_read(data->sample, BMP280_REG_PRESS_MSB, 6);
+    data->t_sb = -1;
+
+    data->sampler = kthread_run(bmp280_sampler, data, "bmp280_sampler/%u", data->index);
+    if (IS_ERR(data->sampler)) {
+        kfree(data->sample);
+        return PTR_ERR(data->sampler);
+    }
+    return 0;
+}
+
+static void bmp280_sampler_stop(struct bmp280_data *data)
+{
+    kthread_stop(data->sampler);
+    wait_for_completion(&data->sample->done);   // last burst may still be on the bus
+    pr_info(DRIVER_NAME ": sensor %u: %u samples taken, %llu dropped, %llu read errors, %llu overruns\n",
+            data->index, data->seq, data->dropped, data->errors, data->overruns);
+    kfree(data->sample);
+}
+
+/* ---------- IIO Interface ---------- */
+/*
+ * The sensor is also registered as an IIO device, so standard consumers
+ * (iio_readdev, libiio, iio_generic_buffer) can use it:
+ * - in_pressure_raw / in_temp_raw read one sample on demand
+ * - the triggered buffer captures one scan per trigger (hrtimer or sysfs
+ *   trigger) and the IIO core stamps every scan with the trigger time
+ *
+ * Scan layout, identical for every scan so consumers can read it in bulk:
+ *   u32 raw_press | u32 raw_temp | s64 timestamp
+ *
+ * in_*_input return compensated values in IIO units:
+ * pressure in kPa, temperature in milli degC.
+ *
+ * Runtime settings, each applied with one register write:
+ *   in_*_oversampling_ratio          1, 2, 4, 8, 16 (CTRL_MEAS osrs_t / osrs_p)
+ *   filter_iir_coefficient           0 (off), 2, 4, 8, 16 (CONFIG[4:2])
+ *   measurement_mode                 normal or forced
+ */
+enum bmp280_scan_index {
+    BMP280_SCAN_PRESS,
+    BMP280_SCAN_TEMP,
+    BMP280_SCAN_TIMESTAMP,
+};
+
+#define BMP280_RAW_CHANNEL(_type, _index) {                     \
+    .type = (_type),                                            \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) |              \
+                          BIT(IIO_CHAN_INFO_PROCESSED) |        \
+                          BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO), \
+    .info_mask_separate_available =                             \
+                          BIT(IIO_CHAN_INFO_OVERSAMPLING_RATIO), \
+    .scan_index = (_index),                                     \
+    .scan_type = {                                              \
+        .sign = 'u',                                            \
+        .realbits = 20,                                         \
+        .storagebits = 32,                                      \
+        .endianness = IIO_CPU,                                  \
+    },                                                          \
+}
+
+static const struct iio_chan_spec bmp280_channels[] = {
+    BMP280_RAW_CHANNEL(IIO_PRESSURE, BMP280_SCAN_PRESS),
+    BMP280_RAW_CHANNEL(IIO_TEMP, BMP280_SCAN_TEMP),
+    IIO_CHAN_SOFT_TIMESTAMP(BMP280_SCAN_TIMESTAMP),
+};
+
+/*
+ * One burst read always yields both values, so the hardware scan is fixed
+ * to both channels; the IIO core demuxes it for consumers that enabled one.
+ */
+static const unsigned long bmp280_scan_masks[] = {
+    BIT(BMP280_SCAN_PRESS) | BIT(BMP280_SCAN_TEMP),
+    0
+};
+
+struct bmp280_iio {
+    struct bmp280_data *data;
+    struct {
+        u32 chan[2];
+        s64 timestamp __aligned(8);
+    } scan;
+};
+
+/* Oversampling codes 1-5 of osrs_t / osrs_p; code 0 skips the measurement */
+static const int bmp280_os_ratios[] = { 1, 2, 4, 8, 16 };
+
+/* IIR filter coefficients of CONFIG[4:2] codes 0-4 */
+static const int bmp280_iir_coefs[] = { 0, 2, 4, 8, 16 };
+
+static int bmp280_osrs_shift(const struct iio_chan_spec *chan)
+{
+    return chan->type == IIO_PRESSURE ? BMP280_OSRS_P_SHIFT : BMP280_OSRS_T_SHIFT;
+}
+
+static int bmp280_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                               int *val, int *val2, long mask)
+{
+    struct bmp280_iio *st = iio_priv(indio_dev);
+    u32 raw_press, raw_temp, press_q8;
+    unsigned int ctrl_meas, code;
+    s32 temp_cdeg;
+    int ret;
+
+    if (mask == IIO_CHAN_INFO_OVERSAMPLING_RATIO) {
+        ret = bmp280_reg_read(st->data, BMP280_REG_CTRL_MEAS, &ctrl_meas);
+        if (ret)
+            return ret;
+        code = (ctrl_meas >> bmp280_osrs_shift(chan)) & 0x7;
+        *val = code ? bmp280_os_ratios[min(code, 5U) - 1] : 0;
+        return IIO_VAL_INT;
+    }
+    if (mask != IIO_CHAN_INFO_RAW && mask != IIO_CHAN_INFO_PROCESSED)
+        return -EINVAL;
+
+    ret = iio_device_claim_direct_mode(indio_dev);
+    if (ret)
+        return ret;
+    ret = bmp280_measure(st->data, &raw_press, &raw_temp);
+    iio_device_release_direct_mode(indio_dev);
+    if (ret)
+        return ret;
+
+    if (mask == IIO_CHAN_INFO_RAW) {
+        *val = chan->type == IIO_PRESSURE ? raw_press : raw_temp;
+        return IIO_VAL_INT;
+    }
+
+    bmp280_compensate(st->data, raw_press, raw_temp, &temp_cdeg, &press_q8);
+    if (chan->type == IIO_PRESSURE) {
+        *val = press_q8;            // Pa * 256 -> kPa
+        *val2 = 256 * 1000;
+        return IIO_VAL_FRACTIONAL;
+    }
+    *val = temp_cdeg * 10;          // 0.01 degC -> milli degC
+    return IIO_VAL_INT;
+}
 
-/* ---------- Module Initialization Function ---------- */
 /*
- * bmp280_init
+ * Changing the oversampling changes the conversion time, so the forced-mode
+ * estimate restarts from the datasheet value and the sampler recomputes the
+ * normal-mode standby time. The mode bits are written along with it: the
+ * cached CTRL_MEAS may still say "forced" after the chip went back to sleep.
+ */
+static int bmp280_iio_write_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                                int val, int val2, long mask)
+{
+    struct bmp280_data *data = ((struct bmp280_iio *)iio_priv(indio_dev))->data;
+    unsigned int shift = bmp280_osrs_shift(chan), ctrl_meas;
+    int i, ret;
+
+    if (mask != IIO_CHAN_INFO_OVERSAMPLING_RATIO || val2)
+        return -EINVAL;
+    for (i = 0; i < ARRAY_SIZE(bmp280_os_ratios); i++)
+        if (bmp280_os_ratios[i] == val)
+            break;
+    if (i == ARRAY_SIZE(bmp280_os_ratios))
+        return -EINVAL;
+
+    mutex_lock(&data->meas_lock);
+    ret = regmap_write_bits(data->regmap, BMP280_REG_CTRL_MEAS,
+                            (0x7 << shift) | BMP280_MODE_MASK,
+                            ((i + 1) << shift) |
+                            (data->forced ? BMP280_MODE_SLEEP : BMP280_MODE_NORMAL));
+    if (!ret)
+        ret = bmp280_reg_read(data, BMP280_REG_CTRL_MEAS, &ctrl_meas);
+    mutex_unlock(&data->meas_lock);
+    if (ret)
+        return ret;
+
+    bmp280_timing_changed(data, ctrl_meas);
+    return 0;
+}
+
+static int bmp280_iio_read_avail(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                                 const int **vals, int *type, int *length, long mask)
+{
+    if (mask != IIO_CHAN_INFO_OVERSAMPLING_RATIO)
+        return -EINVAL;
+    *vals = bmp280_os_ratios;
+    *type = IIO_VAL_INT;
+    *length = ARRAY_SIZE(bmp280_os_ratios);
+    return IIO_AVAIL_LIST;
+}
+
+static ssize_t filter_iir_coefficient_show(struct device *dev, struct device_attribute *attr,
+                                           char *buf)
+{
+    struct bmp280_iio *st = iio_priv(dev_to_iio_dev(dev));
+    unsigned int config, code;
+    int ret;
+
+    ret = bmp280_reg_read(st->data, BMP280_REG_CONFIG, &config);
+    if (ret)
+        return ret;
+    code = (config & BMP280_CONFIG_FILTER_MASK) >> BMP280_CONFIG_FILTER_SHIFT;
+    return sysfs_emit(buf, "%d\n", bmp280_iir_coefs[min(code, 4U)]);
+}
+
+static ssize_t filter_iir_coefficient_store(struct device *dev, struct device_attribute *attr,
+                                            const char *buf, size_t len)
+{
+    struct bmp280_iio *st = iio_priv(dev_to_iio_dev(dev));
+    int coef, i, ret;
+
+    ret = kstrtoint(buf, 0, &coef);
+    if (ret)
+        return ret;
+    for (i = 0; i < ARRAY_SIZE(bmp280_iir_coefs); i++)
+        if (bmp280_iir_coefs[i] == coef)
+            break;
+    if (i == ARRAY_SIZE(bmp280_iir_coefs))
+        return -EINVAL;
+
+    ret = bmp280_reg_update(st->data, BMP280_REG_CONFIG, BMP280_CONFIG_FILTER_MASK,
+                            i << BMP280_CONFIG_FILTER_SHIFT);
+    return ret ? ret : len;
+}
+
+static ssize_t measurement_mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct bmp280_iio *st = iio_priv(dev_to_iio_dev(dev));
+
+    return sysfs_emit(buf, "%s\n", READ_ONCE(st->data->forced) ? "forced" : "normal");
+}
+
+static ssize_t measurement_mode_store(struct device *dev, struct device_attribute *attr,
+                                      const char *buf, size_t len)
+{
+    struct bmp280_iio *st = iio_priv(dev_to_iio_dev(dev));
+    int ret;
+
+    if (sysfs_streq(buf, "forced"))
+        ret = bmp280_set_mode(st->data, true);
+    else if (sysfs_streq(buf, "normal"))
+        ret = bmp280_set_mode(st->data, false);
+    else
+        return -EINVAL;
+    return ret ? ret : len;
+}
+
+static IIO_DEVICE_ATTR_RW(filter_iir_coefficient, 0);
+static IIO_CONST_ATTR(filter_iir_coefficient_available, "0 2 4 8 16");
+static IIO_DEVICE_ATTR_RW(measurement_mode, 0);
+static IIO_CONST_ATTR(measurement_mode_available, "normal forced");
+
+static struct attribute *bmp280_iio_attrs[] = {
+    &iio_dev_attr_filter_iir_coefficient.dev_attr.attr,
+    &iio_const_attr_filter_iir_coefficient_available.dev_attr.attr,
+    &iio_dev_attr_measurement_mode.dev_attr.attr,
+    &iio_const_attr_measurement_mode_available.dev_attr.attr,
+    NULL
+};
+
+static const struct attribute_group bmp280_iio_attr_group = {
+    .attrs = bmp280_iio_attrs,
+};
+
+static const struct iio_info bmp280_iio_info = {
+    .read_raw = bmp280_iio_read_raw,
+    .write_raw = bmp280_iio_write_raw,
+    .read_avail = bmp280_iio_read_avail,
+    .attrs = &bmp280_iio_attr_group,
+};
+
+/*
+ * bmp280_trigger_handler
  * ----------------
- * This function is called when the kernel module is loaded.
- * Its responsibilities:
- * 1. Locate the SPI master controller that will manage communication with the sensor.
- * 2. Create and register the BMP280 SPI device with the kernel.
- * 3. Configure the SPI device (mode, speed, bits per word).
- * 4. Perform example read/write operations for CHIP_ID, CONFIG, CTRL_MEAS registers.
- * 5. Read raw pressure and temperature data from the sensor.
- *
- * Returns:
- * 0 on success, negative error code on failure.
+ * Threaded half of the poll function: runs once per trigger, may sleep on
+ * the SPI transfer. The top half (iio_pollfunc_store_time) already stored
+ * the trigger timestamp in pf->timestamp.
  */
-static int __init bmp280_init(void)
+static irqreturn_t bmp280_trigger_handler(int irq, void *p)
 {
-    struct spi_master *master;
-    struct spi_board_info spi_device_info = {
-        .modalias = DRIVER_NAME,
-        .max_speed_hz = 1000000,
-        .bus_num = BMP280_BUS_NUM,
-        .chip_select = BMP280_CS,
-        .mode = SPI_MODE_3,
-    };
+    struct iio_poll_func *pf = p;
+    struct iio_dev *indio_dev = pf->indio_dev;
+    struct bmp280_iio *st = iio_priv(indio_dev);
 
-    u8 tx[2], rx[6];
+    if (!bmp280_measure(st->data, &st->scan.chan[BMP280_SCAN_PRESS],
+                        &st->scan.chan[BMP280_SCAN_TEMP]))
+        iio_push_to_buffers_with_timestamp(indio_dev, &st->scan, pf->timestamp);
+
+    iio_trigger_notify_done(indio_dev->trig);
+    return IRQ_HANDLED;
+}
+
+static int bmp280_iio_register(struct bmp280_data *data)
+{
+    struct iio_dev *indio_dev;
+    struct bmp280_iio *st;
     int ret;
-    u8 chip_id, reg_val;
-    u32 raw_press, raw_temp;
 
-    pr_info(DRIVER_NAME ": init\n");
+    indio_dev = iio_device_alloc(&data->spi->dev, sizeof(*st));
+    if (!indio_dev)
+        return -ENOMEM;
 
-    /* ---------- 1. Get SPI Master ---------- */
-    /*
-     * spi_busnum_to_master(bus_num)
-     * - Finds the SPI master controller registered for the given bus.
-     * - Necessary to know which hardware SPI controller will act as master.
-     * - Returns pointer to spi_master structure, or NULL if not found.
-     */
-    master = spi_busnum_to_master(BMP280_BUS_NUM);
-    if (!master) {
-        pr_err(DRIVER_NAME ": SPI bus %d not found\n", BMP280_BUS_NUM);
-        return -ENODEV;
+    st = iio_priv(indio_dev);
+    st->data = data;
+    indio_dev->name = BMP280_DEVICE_NAME;
+    indio_dev->info = &bmp280_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->channels = bmp280_channels;
+    indio_dev->num_channels = ARRAY_SIZE(bmp280_channels);
+    indio_dev->available_scan_masks = bmp280_scan_masks;
+
+    ret = iio_triggered_buffer_setup(indio_dev, iio_pollfunc_store_time,
+                                     bmp280_trigger_handler, NULL);
+    if (ret)
+        goto err_free;
+
+    ret = iio_device_register(indio_dev);
+    if (ret)
+        goto err_buffer;
+
+    data->indio_dev = indio_dev;
+    return 0;
+
+err_buffer:
+    iio_triggered_buffer_cleanup(indio_dev);
+err_free:
+    iio_device_free(indio_dev);
+    return ret;
+}
+
+static void bmp280_iio_unregister(struct bmp280_data *data)
+{
+    iio_device_unregister(data->indio_dev);
+    iio_triggered_buffer_cleanup(data->indio_dev);
+    iio_device_free(data->indio_dev);
+    data->indio_dev = NULL;
+}
+
+/* ---------- SPI Clock Tuning ---------- */
+/*
+ * The BMP280 accepts SPI clocks up to 10 MHz, but what a board can really
+ * carry depends on its wiring. With spi_autotune=1 probe steps the clock
+ * up through bmp280_tune_hz and checks every step:
+ * - BMP280_TUNE_ROUNDS times, read CHIP_ID and the 24-byte trim block past
+ *   the register cache and compare them with the values read at the
+ *   conservative starting clock; any difference or failed transfer is an
+ *   error
+ * - the first step with an error ends the search
+ * The sensor then runs at BMP280_TUNE_MARGIN_PCT percent of the fastest
+ * clean step (never below the starting clock), so a board that only just
+ * passed is not left at its limit.
+ */
+#define BMP280_TUNE_ROUNDS        32
+#define BMP280_TUNE_MARGIN_PCT    80
+
+static const u32 bmp280_tune_hz[] = { 2000000, 4000000, 5000000, 8000000, 10000000 };
+
+static int bmp280_spi_set_speed(struct spi_device *spi, u32 hz)
+{
+    spi->max_speed_hz = hz;
+    return spi_setup(spi);      // the core clamps to the controller's limit
+}
+
+/* Returns the number of rounds that failed at the current clock */
+static unsigned int bmp280_spi_check(struct bmp280_data *data, unsigned int chip_id)
+{
+    u8 calib[BMP280_CALIB_LEN];
+    unsigned int id, i, errors = 0;
+
+    regcache_cache_bypass(data->regmap, true);
+    for (i = 0; i < BMP280_TUNE_ROUNDS; i++) {
+        if (bmp280_reg_read(data, BMP280_REG_CHIP_ID, &id) || id != chip_id ||
+            bmp280_reg_bulk_read(data, BMP280_REG_CALIB, calib, sizeof(calib)) ||
+            memcmp(calib, data->calib_raw, sizeof(calib)))
+            errors++;
     }
+    regcache_cache_bypass(data->regmap, false);
+    return errors;
+}
 
-    /* ---------- 2. Create SPI Device ---------- */
-    /*
-     * spi_new_device(master, &spi_device_info)
-     * - Registers a new SPI slave device (BMP280) with the SPI master.
-     * - Returns a pointer to the SPI device structure.
-     * put_device(&master->dev) decrements the reference count on master after creating device.
-     * This is necessary to avoid memory leaks.
-     */
-    bmp280_device = spi_new_device(master, &spi_device_info);
-    put_device(&master->dev);
-    if (!bmp280_device) {
-        pr_err(DRIVER_NAME ": failed to create SPI device\n");
-        return -ENODEV;
+static int bmp280_spi_autotune(struct bmp280_data *data, unsigned int chip_id)
+{
+    struct spi_device *spi = data->spi;
+    u32 base = spi->max_speed_hz, ok = base, hz;
+    unsigned int errors;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(bmp280_tune_hz); i++) {
+        if (bmp280_tune_hz[i] <= ok)
+            continue;
+        if (bmp280_spi_set_speed(spi, bmp280_tune_hz[i]))
+            break;
+        hz = spi->max_speed_hz;
+        if (hz <= ok)
+            break;              // controller cannot go faster
+
+        errors = bmp280_spi_check(data, chip_id);
+        data->tune_checks += BMP280_TUNE_ROUNDS;
+        data->tune_errors += errors;
+        pr_info(DRIVER_NAME ": sensor %u: %u Hz: %u of %u checks failed\n",
+                data->index, hz, errors, BMP280_TUNE_ROUNDS);
+        if (errors)
+            break;
+        ok = hz;
     }
 
-    /* ---------- 3. Configure SPI Device ---------- */
+    data->tune_max_ok_hz = ok;
+    hz = ok > base ? max_t(u32, base, div_u64((u64)ok * BMP280_TUNE_MARGIN_PCT, 100)) : base;
+    pr_info(DRIVER_NAME ": sensor %u: SPI clock %u Hz (fastest clean %u Hz)\n",
+            data->index, hz, ok);
+    return bmp280_spi_set_speed(spi, hz);
+}
+
+/*
+ * /sys/bus/spi/devices/spi<B>.<CS>/
+ *   spi_clock_hz          clock the sensor runs at
+ *   spi_clock_max_ok_hz   fastest clock that passed every check (0 = not tuned)
+ *   spi_clock_checks      CHIP_ID + trim readbacks done while tuning
+ *   spi_clock_errors      ... that came back wrong
+ */
+static ssize_t spi_clock_hz_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%u\n", to_spi_device(dev)->max_speed_hz);
+}
+static DEVICE_ATTR_RO(spi_clock_hz);
+
+static ssize_t spi_clock_max_ok_hz_show(struct device *dev, struct device_attribute *attr,
+                                        char *buf)
+{
+    struct bmp280_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", data->tune_max_ok_hz);
+}
+static DEVICE_ATTR_RO(spi_clock_max_ok_hz);
+
+static ssize_t spi_clock_checks_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct bmp280_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", data->tune_checks);
+}
+static DEVICE_ATTR_RO(spi_clock_checks);
+
+static ssize_t spi_clock_errors_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct bmp280_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", data->tune_errors);
+}
+static DEVICE_ATTR_RO(spi_clock_errors);
+
+static struct attribute *bmp280_attrs[] = {
+    &dev_attr_spi_clock_hz.attr,
+    &dev_attr_spi_clock_max_ok_hz.attr,
+    &dev_attr_spi_clock_checks.attr,
+    &dev_attr_spi_clock_errors.attr,
+    NULL
+};
+ATTRIBUTE_GROUPS(bmp280);
+
+/* ---------- SPI Driver: Probe / Remove ---------- */
+static DEFINE_IDA(bmp280_ida);
+
+/*
+ * bmp280_probe
+ * ----------------
+ * Called by the SPI core for every device bound to this driver, whether it
+ * comes from a device tree node (compatible "bosch,bmp280") or from the
+ * devices module parameter. Its responsibilities:
+ * 1. Configure the SPI device (bits per word).
+ * 2. Allocate per-sensor state and a sensor index.
+ * 3. Set up the register map, then perform example read/write operations
+ *    for CHIP_ID, CONFIG, CTRL_MEAS registers.
+ *    With spi_autotune=1, find the fastest reliable SPI clock first.
+ * 4. Read the trim registers and raw pressure and temperature data.
+ * 5. Start this sensor's sampler, feeding the shared /dev/bmp280 stream.
+ * 6. Register the sensor's IIO device.
+ *
+ * Returns:
+ * 0 on success, negative error code on failure.
+ */
+static int bmp280_probe(struct spi_device *spi)
+{
+    struct bmp280_stream *stream = &bmp280_stream;
+    struct bmp280_data *data;
+    unsigned int chip_id, config, ctrl_meas;
+    char name[16];
+    int ret;
+    u32 raw_press, raw_temp;
+    s32 temp_cdeg;
+    u32 press_q8;
+
+    /* ---------- 1. Configure SPI Device ---------- */
     /*
      * Sets bits per word and calls spi_setup() to configure the SPI hardware.
      * spi_setup() ensures SPI mode, speed, and word length are applied.
      * Necessary before any SPI communication occurs.
      */
-    bmp280_device->bits_per_word = 8;
-    ret = spi_setup(bmp280_device);
+    spi->bits_per_word = 8;
+    ret = spi_setup(spi);
     if (ret) {
         pr_err(DRIVER_NAME ": spi_setup failed\n");
-        spi_unregister_device(bmp280_device);
         return ret;
     }
 
-    /* ---------- 4. Read CHIP_ID ---------- */
+    /* ---------- 2. Per-Sensor State ---------- */
+    /*
+     * devm_kzalloc() memory is freed by the driver core once the device is
+     * unbound. The index identifies the sensor in the shared stream.
+     */
+    data = devm_kzalloc(&spi->dev, sizeof(*data), GFP_KERNEL);
+    if (!data)
+        return -ENOMEM;
+    data->spi = spi;
+    mutex_init(&data->meas_lock);
+    spi_set_drvdata(spi, data);
+
+    ret = ida_alloc_max(&bmp280_ida, BMP280_MAX_SENSORS - 1, GFP_KERNEL);
+    if (ret < 0) {
+        pr_err(DRIVER_NAME ": more than %d sensors\n", BMP280_MAX_SENSORS);
+        return ret;
+    }
+    data->index = ret;
+
+    data->ctl = bmp280_xact_alloc();
+    if (!data->ctl) {
+        ret = -ENOMEM;
+        goto err_ida;
+    }
+
+    /* ---------- 3. Register Map ---------- */
+    /*
+     * devm_regmap_init() builds the cached register map on top of
+     * bmp280_regmap_bus; every control-path access below goes through it.
+     */
+    data->regmap = devm_regmap_init(&spi->dev, &bmp280_regmap_bus, data, &bmp280_regmap_config);
+    if (IS_ERR(data->regmap)) {
+        ret = PTR_ERR(data->regmap);
+        goto err_xact;
+    }
+
+    /* ---------- 3a. Read CHIP_ID ---------- */
     /*
      * Reads BMP280 chip ID (0xD0). MSB=1 indicates a read operation.
      * Necessary to verify sensor presence and correct communication.
+     * The ID never changes, so the value stays in the cache.
      */
-    tx[0] = BMP280_REG_CHIP_ID | BMP280_SPI_READ;
-    ret = spi_write_then_read(bmp280_device, tx, 1, &chip_id, 1);
-    if (ret) {
-        pr_err(DRIVER_NAME ": failed to read CHIP_ID\n");
-    } else {
-        pr_info(DRIVER_NAME ": CHIP_ID = 0x%X (should be 0x58)\n", chip_id);
+    ret = bmp280_reg_read(data, BMP280_REG_CHIP_ID, &chip_id);
+
+    /* ---------- 3b. Read Calibration (Trim) Registers ---------- */
+    /*
+     * Reads dig_T1..dig_P9 (0x88-0x9F) once and caches them.
+     * Necessary to turn raw ADC values into degC and Pa.
+     * The values are fused at the factory, so the parsed copy serves every
+     * later compensation without bus traffic. Bypassing the register cache
+     * turns the read into one 24-byte burst instead of one read per register.
+     */
+    if (!ret) {
+        regcache_cache_bypass(data->regmap, true);
+        ret = bmp280_reg_bulk_read(data, BMP280_REG_CALIB, data->calib_raw, BMP280_CALIB_LEN);
+        regcache_cache_bypass(data->regmap, false);
     }
 
-    /* ---------- 5. Write CONFIG Register ---------- */
+    /* ---------- 3c. Tune the SPI Clock (optional) ---------- */
+    /*
+     * CHIP_ID and the trim block were just read at the conservative clock.
+     * With spi_autotune=1 they serve as the reference while faster clocks
+     * are tried (see bmp280_spi_autotune). Only a sensor that answered with
+     * the right ID is tuned.
+     */
+    if (!ret && spi_autotune && chip_id == BMP280_CHIP_ID_VAL)
+        ret = bmp280_spi_autotune(data, chip_id);
+
+    /* ---------- 3d. Write CONFIG Register ---------- */
     /*
      * Writes example configuration value to CONFIG register.
      * MSB=0 indicates a write operation.
      * Necessary to setup standby time and filter options.
      */
-    tx[0] = BMP280_REG_CONFIG & BMP280_SPI_WRITE;
-    tx[1] = BMP280_CONFIG_VAL;
-    ret = spi_write(bmp280_device, tx, 2);
+    if (!ret)
+        ret = regmap_write(data->regmap, BMP280_REG_CONFIG, BMP280_CONFIG_VAL);
+
+    /* ---------- 3e. Read CONFIG Register Back ---------- */
+    /*
+     * The write above already put the value into the register cache, so
+     * this readback costs no bus transfer.
+     */
+    if (!ret)
+        ret = bmp280_reg_read(data, BMP280_REG_CONFIG, &config);
+
+    /* ---------- 3f. Write CTRL_MEASUREMENT Register ---------- */
+    /*
+     * Writes CTRL_MEAS register to configure oversampling and normal mode.
+     * Necessary to start sensor measurements for temperature and pressure.
+     */
+    if (!ret)
+        ret = regmap_write(data->regmap, BMP280_REG_CTRL_MEAS, BMP280_CTRL_MEAS_VAL);
+
+    /* ---------- 3g. Read CTRL_MEAS Register Back ---------- */
+    /*
+     * Served from the register cache as well.
+     */
+    if (!ret)
+        ret = bmp280_reg_read(data, BMP280_REG_CTRL_MEAS, &ctrl_meas);
+
+    /* ---------- 3h. Read Raw Pressure and Temperature (6 bytes F7–FC) ---------- */
+    /*
+     * Reads 6 bytes of raw data:
+     *   - Pressure MSB, LSB, XLSB (20-bit)
+     *   - Temperature MSB, LSB, XLSB (20-bit)
+     * Necessary to retrieve measurement data from the sensor.
+     * The data block is volatile, so this always reaches the bus.
+     */
+    if (!ret)
+        ret = bmp280_read_raw(data, &raw_press, &raw_temp);
+
     if (ret) {
-        pr_err(DRIVER_NAME ": failed to write CONFIG register\n");
+        pr_err(DRIVER_NAME ": sensor %u: register access failed (%d)\n", data->index, ret);
+        goto err_xact;
     }
 
-    /* ---------- 6. Read CONFIG Register Back ---------- */
+    /* ---------- 4. Report What the Sensor Returned ---------- */
+    pr_info(DRIVER_NAME ": sensor %u on spi%d.%d: CHIP_ID = 0x%X (should be 0x58)\n",
+            data->index, spi->controller->bus_num, spi_get_chipselect(spi, 0), chip_id);
+
+    bmp280_parse_calib(data->calib_raw, &data->calib);
+    pr_info(DRIVER_NAME ": sensor %u: dig_T1 = %u, dig_P1 = %u\n",
+            data->index, data->calib.dig_T1, data->calib.dig_P1);
+
+    pr_info(DRIVER_NAME ": sensor %u: CONFIG register = 0x%X, CTRL_MEAS register = 0x%X\n",
+            data->index, config, ctrl_meas);
+    data->conv_ewma_ns = (u64)bmp280_t_meas_us(ctrl_meas, false) * NSEC_PER_USEC;
+
+    bmp280_compensate(data, raw_press, raw_temp, &temp_cdeg, &press_q8);
+    pr_info(DRIVER_NAME ": sensor %u: Raw Pressure = %u, Raw Temperature = %u (20-bit)\n",
+            data->index, raw_press, raw_temp);
+    pr_info(DRIVER_NAME ": sensor %u: Temperature = %d.%02d degC, Pressure = %u Pa\n",
+            data->index, temp_cdeg / 100, abs(temp_cdeg % 100), press_q8 >> 8);
+
+    snprintf(name, sizeof(name), "sensor%u", data->index);
+    data->debugfs = debugfs_create_dir(name, bmp280_debugfs);
+    debugfs_create_file("regcache", 0444, data->debugfs, data, &bmp280_regstats_fops);
+    debugfs_create_file("forced", 0444, data->debugfs, data, &bmp280_forced_fops);
+
+    /* ---------- 5. Start Continuous Sampling ---------- */
     /*
-     * Verifies that CONFIG register was correctly written.
-     * Optional, but useful for debugging.
+     * From here on a kernel thread samples this sensor at sample_rate_hz
+     * and its records appear in /dev/bmp280 tagged with data->index.
+     * Publishing the sensor makes its trim block available to the ioctls.
      */
-    tx[0] = BMP280_REG_CONFIG | BMP280_SPI_READ;
-    ret = spi_write_then_read(bmp280_device, tx, 1, &reg_val, 1);
+    ret = bmp280_sampler_start(data);
     if (ret) {
-        pr_err(DRIVER_NAME ": failed to read CONFIG register\n");
-    } else {
-        pr_info(DRIVER_NAME ": CONFIG register = 0x%X\n", reg_val);
+        pr_err(DRIVER_NAME ": sensor %u: failed to start sampling (%d)\n", data->index, ret);
+        goto err_xact;
     }
 
-    /* ---------- 7. Write CTRL_MEASUREMENT Register ---------- */
+    mutex_lock(&stream->sensors_lock);
+    stream->sensors[data->index] = data;
+    mutex_unlock(&stream->sensors_lock);
+
+    /* ---------- 6. Register IIO Device ---------- */
     /*
-     * Writes CTRL_MEAS register to configure oversampling and normal mode.
-     * Necessary to start sensor measurements for temperature and pressure.
+     * Gives standard IIO tools access to the sensor, including buffered
+     * capture driven by any IIO trigger.
      */
-    tx[0] = BMP280_REG_CTRL_MEAS & BMP280_SPI_WRITE;
-    tx[1] = BMP280_CTRL_MEAS_VAL;
-    ret = spi_write(bmp280_device, tx, 2);
+    ret = bmp280_iio_register(data);
     if (ret) {
-        pr_err(DRIVER_NAME ": failed to write CTRL_MEAS register\n");
+        pr_err(DRIVER_NAME ": sensor %u: failed to register IIO device (%d)\n", data->index, ret);
+        goto err_sampler;
     }
 
-    /* ---------- 8. Read CTRL_MEAS Register Back ---------- */
+    pr_info(DRIVER_NAME ": sensor %u: streaming %u samples/s on /dev/%s\n",
+            data->index, sample_rate_hz, BMP280_DEVICE_NAME);
+    return 0;
+
+err_sampler:
+    mutex_lock(&stream->sensors_lock);
+    stream->sensors[data->index] = NULL;
+    mutex_unlock(&stream->sensors_lock);
+    bmp280_sampler_stop(data);
+err_xact:
+    debugfs_remove_recursive(data->debugfs);
+    kfree(data->ctl);
+err_ida:
+    ida_free(&bmp280_ida, data->index);
+    return ret;
+}
+
+/*
+ * bmp280_remove
+ * ----------------
+ * Called when the device goes away or the driver is unregistered.
+ * Undoes probe in reverse order. Samples the sensor already pushed stay in
+ * the shared ring until read.
+ */
+static void bmp280_remove(struct spi_device *spi)
+{
+    struct bmp280_stream *stream = &bmp280_stream;
+    struct bmp280_data *data = spi_get_drvdata(spi);
+
+    bmp280_iio_unregister(data);
+
+    mutex_lock(&stream->sensors_lock);
+    stream->sensors[data->index] = NULL;
+    mutex_unlock(&stream->sensors_lock);
+
+    bmp280_sampler_stop(data);
+    debugfs_remove_recursive(data->debugfs);
+    kfree(data->ctl);
+    ida_free(&bmp280_ida, data->index);
+}
+
+/*
+ * Device tree nodes bind through the compatible string; devices created
+ * by bmp280_new_device() bind through their modalias (DRIVER_NAME).
+ */
+static const struct of_device_id bmp280_of_match[] = {
+    { .compatible = "bosch,bmp280" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, bmp280_of_match);
+
+static const struct spi_device_id bmp280_id[] = {
+    { DRIVER_NAME, 0 },
+    { "bmp280", 0 },
+    { }
+};
+MODULE_DEVICE_TABLE(spi, bmp280_id);
+
+static struct spi_driver bmp280_driver = {
+    .driver = {
+        .name = DRIVER_NAME,
+        .of_match_table = bmp280_of_match,
+        .dev_groups = bmp280_groups,
+    },
+    .probe = bmp280_probe,
+    .remove = bmp280_remove,
+    .id_table = bmp280_id,
+};
+
+/* ---------- Devices From Module Parameters ---------- */
+/*
+ * bmp280_new_device
+ * ----------------
+ * Creates an SPI device for a sensor that has no device tree node.
+ * The SPI core binds it to bmp280_driver right away, so probe has run
+ * (successfully or not) when this returns.
+ */
+static struct spi_device *bmp280_new_device(unsigned int bus, unsigned int cs)
+{
+    struct spi_master *master;
+    struct spi_device *spi;
+    struct spi_board_info spi_device_info = {
+        .modalias = DRIVER_NAME,
+        .max_speed_hz = BMP280_SPEED_HZ,
+        .bus_num = bus,
+        .chip_select = cs,
+        .mode = SPI_MODE_3,
+    };
+
     /*
-     * Verifies that CTRL_MEAS register was correctly written.
-     * Optional, but ensures communication integrity.
+     * spi_busnum_to_master(bus_num)
+     * - Finds the SPI master controller registered for the given bus.
+     * - Necessary to know which hardware SPI controller will act as master.
+     * - Returns pointer to spi_master structure, or NULL if not found.
      */
-    tx[0] = BMP280_REG_CTRL_MEAS | BMP280_SPI_READ;
-    ret = spi_write_then_read(bmp280_device, tx, 1, &reg_val, 1);
-    if (ret) {
-        pr_err(DRIVER_NAME ": failed to read CTRL_MEAS register\n");
-    } else {
-        pr_info(DRIVER_NAME ": CTRL_MEAS register = 0x%X\n", reg_val);
+    master = spi_busnum_to_master(bus);
+    if (!master) {
+        pr_err(DRIVER_NAME ": SPI bus %u not found\n", bus);
+        return NULL;
     }
 
-    /* ---------- 9. Read Raw Pressure and Temperature (6 bytes F7–FC) ---------- */
     /*
-     * Reads 6 bytes of raw data:
-     *   - Pressure MSB, LSB, XLSB (20-bit)
-     *   - Temperature MSB, LSB, XLSB (20-bit)
-     * Necessary to retrieve measurement data from the sensor.
+     * spi_new_device(master, &spi_device_info)
+     * - Registers a new SPI slave device (BMP280) with the SPI master.
+     * - Returns a pointer to the SPI device structure.
+     * put_device(&master->dev) decrements the reference count on master after creating device.
+     * This is necessary to avoid memory leaks.
      */
-    tx[0] = BMP280_REG_PRESS_MSB | BMP280_SPI_READ;
-    ret = spi_write_then_read(bmp280_device, tx, 1, rx, 6);
+    spi = spi_new_device(master, &spi_device_info);
+    put_device(&master->dev);
+    if (!spi)
+        pr_err(DRIVER_NAME ": failed to create SPI device %u:%u\n", bus, cs);
+    return spi;
+}
+
+/* Parses the devices parameter ("bus:cs,bus:cs,...") and creates each sensor */
+static void bmp280_create_devices(void)
+{
+    char *list, *cur, *entry;
+    unsigned int n = 0;
+
+    if (!devices || !*devices)
+        return;
+
+    list = kstrdup(devices, GFP_KERNEL);
+    if (!list)
+        return;
+
+    cur = list;
+    while ((entry = strsep(&cur, ",")) != NULL) {
+        unsigned int bus, cs;
+
+        if (!*entry)
+            continue;
+        if (sscanf(entry, "%u:%u", &bus, &cs) != 2) {
+            pr_err(DRIVER_NAME ": bad devices entry \"%s\", expected bus:cs\n", entry);
+            continue;
+        }
+        if (n == ARRAY_SIZE(bmp280_param_devs)) {
+            pr_err(DRIVER_NAME ": more than %d devices listed\n", BMP280_MAX_SENSORS);
+            break;
+        }
+        bmp280_param_devs[n] = bmp280_new_device(bus, cs);
+        if (bmp280_param_devs[n])
+            n++;
+    }
+    kfree(list);
+}
+
+static void bmp280_destroy_devices(void)
+{
+    int i;
+
+    for (i = ARRAY_SIZE(bmp280_param_devs) - 1; i >= 0; i--) {
+        if (bmp280_param_devs[i]) {
+            spi_unregister_device(bmp280_param_devs[i]);
+            bmp280_param_devs[i] = NULL;
+        }
+    }
+}
+
+/* ---------- Module Initialization Function ---------- */
+/*
+ * bmp280_init
+ * ----------------
+ * This function is called when the kernel module is loaded.
+ * Its responsibilities:
+ * 1. Create the shared sample stream, /dev/bmp280.
+ * 2. Register the SPI driver; device tree sensors are probed right away.
+ * 3. Create the sensors listed in the devices parameter.
+ *
+ * Returns:
+ * 0 on success, negative error code on failure.
+ */
+static int __init bmp280_init(void)
+{
+    int ret;
+
+    pr_info(DRIVER_NAME ": init\n");
+
+    /* ---------- 1. Shared Sample Stream ---------- */
+    ret = bmp280_stream_create(&bmp280_stream);
     if (ret) {
-        pr_err(DRIVER_NAME ": failed to read pressure/temperature registers\n");
-    } else {
-        raw_press = ((u32)rx[0] << 12) | ((u32)rx[1] << 4) | ((rx[2] >> 4) & 0x0F);
-        raw_temp  = ((u32)rx[3] << 12) | ((u32)rx[4] << 4) | ((rx[5] >> 4) & 0x0F);
+        pr_err(DRIVER_NAME ": failed to create /dev/%s (%d)\n", BMP280_DEVICE_NAME, ret);
+        return ret;
+    }
 
-        pr_info(DRIVER_NAME ": Raw Pressure = %u (20-bit)\n", raw_press);
-        pr_info(DRIVER_NAME ": Raw Temperature = %u (20-bit)\n", raw_temp);
+    /* ---------- 2. Register SPI Driver ---------- */
+    /* Each probed sensor adds its directory below this one */
+    bmp280_debugfs = debugfs_create_dir(DRIVER_NAME, NULL);
+
+    ret = spi_register_driver(&bmp280_driver);
+    if (ret) {
+        pr_err(DRIVER_NAME ": failed to register SPI driver (%d)\n", ret);
+        debugfs_remove_recursive(bmp280_debugfs);
+        bmp280_stream_destroy(&bmp280_stream);
+        return ret;
     }
 
+    /* ---------- 3. Sensors Without Device Tree Nodes ---------- */
+    bmp280_create_devices();
     return 0;
 }
 
@@ -214,18 +1936,25 @@ static int __init bmp280_init(void)
  * bmp280_exit
  * ----------------
  * Called when the kernel module is removed.
- * Unregisters the SPI device to release resources.
+ * Removes the sensors created from the devices parameter, unregisters the
+ * driver (which removes any remaining sensor) and removes /dev/bmp280.
  * Necessary to avoid memory leaks and maintain kernel stability.
  */
 static void __exit bmp280_exit(void)
 {
-    if (bmp280_device) {
-        spi_unregister_device(bmp280_device);
-        bmp280_device = NULL;
-        pr_info(DRIVER_NAME ": SPI device unregistered\n");
-    }
+    bmp280_destroy_devices();
+    spi_unregister_driver(&bmp280_driver);
+    debugfs_remove_recursive(bmp280_debugfs);
+    bmp280_stream_destroy(&bmp280_stream);
     pr_info(DRIVER_NAME ": exit\n");
 }
 
 /* ---------- Module Macros ---------- */
 module_init(bmp280_init);
+module_exit(bmp280_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Muhammad Ali Hussnain");
+MODULE_DESCRIPTION("SPI driver for the BMP280 pressure/temperature sensor");
+MODULE_VERSION("1.6");
+
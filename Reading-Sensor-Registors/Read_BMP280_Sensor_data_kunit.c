@@ -0,0 +1,196 @@
+/*
+ * KUnit suites of the BMP280 driver: compensation, timing and the sample
+ * stream (see ../common/ktest.h). Load with devices= so no sensor is
+ * probed; the tests drive a bmp280_data of their own.
+ */
+#include "Read_BMP280_Sensor_data.c"
+#include "../common/ktest.h"
+
+/* Trim block and raw sample of the datasheet's compensation example (section 3.12) */
+static const u8 test_calib_raw[BMP280_CALIB_LEN] = {
+    0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC,     // dig_T1 27504, dig_T2 26435, dig_T3 -1000
+    0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B,     // dig_P1 36477, dig_P2 -10685, dig_P3 3024
+    0x27, 0x0B, 0x8C, 0x00, 0xF9, 0xFF,     // dig_P4 2855, dig_P5 140, dig_P6 -7
+    0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17,     // dig_P7 15500, dig_P8 -14600, dig_P9 6000
+};
+static const u8 test_data_rx[6] = { 0x65, 0x5A, 0xC0, 0x7E, 0xED, 0x00 };
+
+#define TEST_RAW_PRESS  415148
+#define TEST_RAW_TEMP   519888
+#define TEST_TEMP_CDEG  2508        // 25.08 degC
+#define TEST_PRESS_Q8   25767233    // 100653.3 Pa
+
+static struct bmp280_data *test_sensor(struct kunit *test)
+{
+    struct bmp280_data *data = kunit_kzalloc(test, sizeof(*data), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, data);
+    data->index = 3;
+    bmp280_parse_calib(test_calib_raw, &data->calib);
+    return data;
+}
+
+/* The stream is shared with the rest of the module: empty it after each test */
+static void stream_test_exit(struct kunit *test)
+{
+    mutex_lock(&bmp280_stream.read_lock);
+    kfifo_reset_out(&bmp280_stream.fifo);
+    mutex_unlock(&bmp280_stream.read_lock);
+}
+
+static void calib_test(struct kunit *test)
+{
+    struct bmp280_calib c;
+
+    bmp280_parse_calib(test_calib_raw, &c);
+    KUNIT_EXPECT_EQ(test, c.dig_T1, 27504);
+    KUNIT_EXPECT_EQ(test, c.dig_T3, -1000);
+    KUNIT_EXPECT_EQ(test, c.dig_P1, 36477);
+    KUNIT_EXPECT_EQ(test, c.dig_P2, -10685);
+    KUNIT_EXPECT_EQ(test, c.dig_P6, -7);
+    KUNIT_EXPECT_EQ(test, c.dig_P9, 6000);
+}
+
+static void compensate_test(struct kunit *test)
+{
+    struct bmp280_data *data = test_sensor(test);
+    u32 raw_press, raw_temp, press_q8;
+    s32 temp_cdeg, t_fine;
+
+    bmp280_parse_raw(test_data_rx, &raw_press, &raw_temp);
+    KUNIT_EXPECT_EQ(test, raw_press, TEST_RAW_PRESS);
+    KUNIT_EXPECT_EQ(test, raw_temp, TEST_RAW_TEMP);
+
+    bmp280_compensate(data, raw_press, raw_temp, &temp_cdeg, &press_q8);
+    KUNIT_EXPECT_EQ(test, temp_cdeg, TEST_TEMP_CDEG);
+    KUNIT_EXPECT_EQ(test, press_q8, TEST_PRESS_Q8);
+    KUNIT_EXPECT_EQ(test, bmp280_compensate_temp(&data->calib, raw_temp, &t_fine), TEST_TEMP_CDEG);
+    KUNIT_EXPECT_EQ(test, t_fine, 128422);
+
+    /* A trim block of zeros would divide by zero */
+    memset(&data->calib, 0, sizeof(data->calib));
+    KUNIT_EXPECT_EQ(test, bmp280_compensate_press(&data->calib, raw_press, t_fine), 0);
+}
+
+/* Datasheet section 9.1: x1 temperature and pressure, then pressure skipped */
+static void t_meas_test(struct kunit *test)
+{
+    KUNIT_EXPECT_EQ(test, bmp280_t_meas_us(BMP280_CTRL_MEAS_VAL, false), 5500);
+    KUNIT_EXPECT_EQ(test, bmp280_t_meas_us(BMP280_CTRL_MEAS_VAL, true), 6425);
+    KUNIT_EXPECT_EQ(test, bmp280_t_meas_us(0x20 | BMP280_MODE_NORMAL, false), 3000);
+    KUNIT_EXPECT_EQ(test, bmp280_t_meas_us(0x20 | BMP280_MODE_NORMAL, true), 3550);
+    KUNIT_EXPECT_EQ(test, bmp280_t_meas_us(0xFF, true), 1250 + 16 * 2300 + 16 * 2300 + 575);
+}
+
+/* Pushed samples come back from read() compensated, in order, as whole records */
+static void stream_read_test(struct kunit *test)
+{
+    struct bmp280_data *data = test_sensor(test);
+    struct file *file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+    struct bmp280_sample __user *ubuf = ktest_user_buf(test, 4 * sizeof(struct bmp280_sample));
+    struct bmp280_sample rec[2];
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    file->f_flags = O_NONBLOCK;
+    KUNIT_EXPECT_EQ(test, bmp280_read(file, (char __user *)ubuf, sizeof(rec[0]) - 1, NULL), -EINVAL);
+    KUNIT_EXPECT_EQ(test, bmp280_read(file, (char __user *)ubuf, sizeof(rec[0]), NULL), -EAGAIN);
+    KUNIT_EXPECT_EQ(test, bmp280_poll(file, NULL), 0);
+
+    bmp280_push_sample(data, 1000, TEST_RAW_PRESS, TEST_RAW_TEMP);
+    bmp280_push_sample(data, 2000, TEST_RAW_PRESS, TEST_RAW_TEMP);
+    KUNIT_EXPECT_EQ(test, bmp280_poll(file, NULL), EPOLLIN | EPOLLRDNORM);
+
+    /* Room for one and a half records: one is returned */
+    KUNIT_EXPECT_EQ(test, bmp280_read(file, (char __user *)ubuf, sizeof(rec[0]) * 3 / 2, NULL),
+                    sizeof(rec[0]));
+    KUNIT_EXPECT_EQ(test, bmp280_read(file, (char __user *)&ubuf[1], 3 * sizeof(rec[0]), NULL),
+                    sizeof(rec[0]));
+    KUNIT_ASSERT_EQ(test, copy_from_user(rec, ubuf, sizeof(rec)), 0);
+    for (i = 0; i < ARRAY_SIZE(rec); i++) {
+        KUNIT_EXPECT_EQ(test, rec[i].timestamp_ns, 1000 * (i + 1));
+        KUNIT_EXPECT_EQ(test, rec[i].seq, i);
+        KUNIT_EXPECT_EQ(test, rec[i].sensor, 3);
+        KUNIT_EXPECT_EQ(test, rec[i].raw_press, TEST_RAW_PRESS);
+        KUNIT_EXPECT_EQ(test, rec[i].temp_cdeg, TEST_TEMP_CDEG);
+        KUNIT_EXPECT_EQ(test, rec[i].press_q8, TEST_PRESS_Q8);
+    }
+}
+
+/* A full ring drops the newest sample and leaves a gap in seq */
+static void stream_full_test(struct kunit *test)
+{
+    struct bmp280_data *data = test_sensor(test);
+    unsigned int i, size = kfifo_size(&bmp280_stream.fifo);
+    struct bmp280_sample s;
+
+    for (i = 0; i <= size; i++)
+        bmp280_push_sample(data, i, TEST_RAW_PRESS, TEST_RAW_TEMP);
+    KUNIT_EXPECT_EQ(test, data->dropped, 1);
+    KUNIT_EXPECT_EQ(test, data->seq, size + 1);
+
+    mutex_lock(&bmp280_stream.read_lock);
+    KUNIT_EXPECT_EQ(test, kfifo_len(&bmp280_stream.fifo), size);
+    for (i = 0; i < size - 1; i++)
+        KUNIT_ASSERT_TRUE(test, kfifo_get(&bmp280_stream.fifo, &s));
+    KUNIT_ASSERT_TRUE(test, kfifo_get(&bmp280_stream.fifo, &s));
+    mutex_unlock(&bmp280_stream.read_lock);
+    KUNIT_EXPECT_EQ(test, s.seq, size - 1);
+
+    bmp280_push_sample(data, 0, TEST_RAW_PRESS, TEST_RAW_TEMP);
+    KUNIT_EXPECT_EQ(test, kfifo_peek(&bmp280_stream.fifo, &s), 1);
+    KUNIT_EXPECT_EQ(test, s.seq, size + 1);
+}
+
+static struct kunit_case bmp280_cases[] = {
+    KUNIT_CASE(calib_test),
+    KUNIT_CASE(compensate_test),
+    KUNIT_CASE(t_meas_test),
+    KUNIT_CASE(stream_read_test),
+    KUNIT_CASE(stream_full_test),
+    {}
+};
+
+static struct kunit_suite bmp280_suite = {
+    .name = "bmp280",
+    .exit = stream_test_exit,
+    .test_cases = bmp280_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+/* What the completion callback does per sample, and what a reader pays to take it */
+static void bmp280_sample_bench(struct kunit *test)
+{
+    struct bmp280_data *data = test_sensor(test);
+    struct file *file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+    char __user *ubuf = ktest_user_buf(test, 64 * sizeof(struct bmp280_sample));
+    s32 temp_cdeg;
+    u32 press_q8;
+    int i;
+
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    file->f_flags = O_NONBLOCK;
+    ktest_bench(test, "compensate",
+                bmp280_compensate(data, TEST_RAW_PRESS, TEST_RAW_TEMP, &temp_cdeg, &press_q8));
+    ktest_bench(test, "push + read",
+                bmp280_push_sample(data, 0, TEST_RAW_PRESS, TEST_RAW_TEMP);
+                bmp280_read(file, ubuf, sizeof(struct bmp280_sample), NULL));
+    ktest_bench_n(test, "64 pushes + one read", bench_iters >> 6,
+                  for (i = 0; i < 64; i++)
+                      bmp280_push_sample(data, 0, TEST_RAW_PRESS, TEST_RAW_TEMP);
+                  bmp280_read(file, ubuf, 64 * sizeof(struct bmp280_sample), NULL));
+}
+
+static struct kunit_case bmp280_bench_cases[] = {
+    KUNIT_CASE_SLOW(bmp280_sample_bench),
+    {}
+};
+
+static struct kunit_suite bmp280_bench_suite = {
+    .name = "bmp280_bench",
+    .exit = stream_test_exit,
+    .test_cases = bmp280_bench_cases,
+};
+
+kunit_test_suites(&bmp280_suite, &bmp280_bench_suite);
@@ -0,0 +1,63 @@
+#ifndef BMP280_H
+#define BMP280_H
+
+/*
+ * Definitions shared between the BMP280 SPI driver and user-space readers
+ * of its sample stream (/dev/bmp280).
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#else
+#include <stdint.h>
+#include <sys/ioctl.h>
+typedef uint8_t  __u8;
+typedef int32_t  __s32;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+#endif
+
+#define BMP280_DEVICE_NAME "bmp280"
+
+/*
+ * One record per sample, returned by read() on /dev/bmp280.
+ * raw_press / raw_temp are the 20-bit ADC values from registers 0xF7-0xFC.
+ * seq increments by one per sample taken, so a gap means the ring
+ * overflowed and samples were dropped before user space read them.
+ * temp_cdeg / press_q8 are compensated with the sensor's trim parameters
+ * (see bmp280_comp.h): 0.01 degC and Pa in unsigned Q24.8.
+ *
+ * All sensors driven by the module share one stream. sensor tells them
+ * apart, and seq counts per sensor. Records appear in the order their
+ * bus transfers completed, so timestamps of different sensors may
+ * interleave slightly out of order.
+ */
+struct bmp280_sample {
+    __u64 timestamp_ns;    /* CLOCK_MONOTONIC, taken when the burst read started */
+    __u32 raw_press;
+    __u32 raw_temp;
+    __u32 seq;
+    __s32 temp_cdeg;
+    __u32 press_q8;
+    __u32 sensor;          /* index of the sensor, 0..BMP280_MAX_SENSORS-1 */
+};
+
+#define BMP280_MAX_SENSORS     16
+
+/* Raw trim block (registers 0x88-0x9F), for offline compensation of raw logs */
+struct bmp280_calib_raw {
+    __u8 data[24];
+};
+
+/* Trim block of one sensor: set sensor, get data (ENODEV if no such sensor) */
+struct bmp280_sensor_calib {
+    __u32 sensor;
+    __u8 data[24];
+};
+
+#define BMP280_IOCTL_MAGIC              'B'
+#define BMP280_IOC_GET_CALIB            _IOR(BMP280_IOCTL_MAGIC, 0, struct bmp280_calib_raw)   /* sensor 0 */
+#define BMP280_IOC_GET_SENSOR_CALIB     _IOWR(BMP280_IOCTL_MAGIC, 1, struct bmp280_sensor_calib)
+
+#endif // BMP280_H
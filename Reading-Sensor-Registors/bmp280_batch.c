@@ -0,0 +1,350 @@
+/*
+ * bmp280_batch.c
+ *
+ * User-space batch compensation for recorded BMP280 raw samples.
+ * See bmp280_batch.h for the API.
+ *
+ * Integer path: the temperature formula is all 32-bit multiplies and
+ * arithmetic shifts, so it vectorises exactly (8 lanes on AVX2, 4 on NEON)
+ * and produces t_fine for a whole block. The 64-bit pressure formula ends in
+ * a 64-bit division, which no SIMD unit has; it stays scalar per sample but
+ * runs over the precomputed t_fine block.
+ *
+ * Double path: every step vectorises (4 lanes on AVX2, 2 on NEON). The
+ * vector and scalar versions perform the same operations in the same order
+ * (divisions by powers of two are written as exact reciprocal multiplies),
+ * so both give identical results. Build with -ffp-contract=off to keep the
+ * compiler from fusing them into FMAs.
+ */
+
+#include "bmp280_batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMP280_HAVE_AVX2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BMP280_HAVE_NEON 1
+#endif
+
+#define BLOCK 256   // samples per t_fine block, keeps the scratch buffer on the stack
+
+/* ---------- Portable C ---------- */
+
+static void temp_block_scalar(const struct bmp280_calib *c, const uint32_t *raw_temp,
+                              int32_t *temp_cdeg, int32_t *t_fine, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        temp_cdeg[i] = bmp280_compensate_temp(c, (int32_t)raw_temp[i], &t_fine[i]);
+}
+
+static void f64_scalar(const struct bmp280_calib *c, const uint32_t *raw_press,
+                       const uint32_t *raw_temp, double *temp_c, double *press_pa, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        double adc_T = raw_temp[i], adc_P = raw_press[i];
+        double var1, var2, t_fine, p, a, b;
+
+        a = adc_T * (1.0 / 16384.0) - (double)c->dig_T1 * (1.0 / 1024.0);
+        var1 = a * (double)c->dig_T2;
+        b = adc_T * (1.0 / 131072.0) - (double)c->dig_T1 * (1.0 / 8192.0);
+        var2 = (b * b) * (double)c->dig_T3;
+        t_fine = (double)(int32_t)(var1 + var2);
+        temp_c[i] = (var1 + var2) / 5120.0;
+
+        var1 = t_fine * 0.5 - 64000.0;
+        var2 = ((var1 * var1) * (double)c->dig_P6) * (1.0 / 32768.0);
+        var2 = var2 + (var1 * (double)c->dig_P5) * 2.0;
+        var2 = var2 * 0.25 + (double)c->dig_P4 * 65536.0;
+        var1 = ((((double)c->dig_P3 * var1) * var1) * (1.0 / 524288.0) +
+                (double)c->dig_P2 * var1) * (1.0 / 524288.0);
+        var1 = (1.0 + var1 * (1.0 / 32768.0)) * (double)c->dig_P1;
+        if (var1 == 0.0) {
+            press_pa[i] = 0.0;   // avoid division by zero
+            continue;
+        }
+        p = 1048576.0 - adc_P;
+        p = ((p - var2 * (1.0 / 4096.0)) * 6250.0) / var1;
+        var1 = (((double)c->dig_P9 * p) * p) * (1.0 / 2147483648.0);
+        var2 = (p * (double)c->dig_P8) * (1.0 / 32768.0);
+        press_pa[i] = p + ((var1 + var2) + (double)c->dig_P7) * (1.0 / 16.0);
+    }
+}
+
+/* ---------- AVX2 ---------- */
+#ifdef BMP280_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void temp_block_avx2(const struct bmp280_calib *c, const uint32_t *raw_temp,
+                            int32_t *temp_cdeg, int32_t *t_fine, size_t n)
+{
+    const __m256i t1 = _mm256_set1_epi32(c->dig_T1);
+    const __m256i t1x2 = _mm256_set1_epi32((int32_t)c->dig_T1 << 1);
+    const __m256i t2 = _mm256_set1_epi32(c->dig_T2);
+    const __m256i t3 = _mm256_set1_epi32(c->dig_T3);
+    const __m256i five = _mm256_set1_epi32(5);
+    const __m256i round = _mm256_set1_epi32(128);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i adc = _mm256_loadu_si256((const __m256i *)&raw_temp[i]);
+        __m256i v1, v2, d, tf;
+
+        v1 = _mm256_sub_epi32(_mm256_srai_epi32(adc, 3), t1x2);
+        v1 = _mm256_srai_epi32(_mm256_mullo_epi32(v1, t2), 11);
+        d = _mm256_sub_epi32(_mm256_srai_epi32(adc, 4), t1);
+        v2 = _mm256_srai_epi32(_mm256_mullo_epi32(d, d), 12);
+        v2 = _mm256_srai_epi32(_mm256_mullo_epi32(v2, t3), 14);
+        tf = _mm256_add_epi32(v1, v2);
+
+        _mm256_storeu_si256((__m256i *)&t_fine[i], tf);
+        _mm256_storeu_si256((__m256i *)&temp_cdeg[i],
+                            _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(tf, five), round), 8));
+    }
+    temp_block_scalar(c, raw_temp + i, temp_cdeg + i, t_fine + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void f64_avx2(const struct bmp280_calib *c, const uint32_t *raw_press,
+                     const uint32_t *raw_temp, double *temp_c, double *press_pa, size_t n)
+{
+    const __m256d T1_1024 = _mm256_set1_pd((double)c->dig_T1 * (1.0 / 1024.0));
+    const __m256d T1_8192 = _mm256_set1_pd((double)c->dig_T1 * (1.0 / 8192.0));
+    const __m256d T2 = _mm256_set1_pd(c->dig_T2), T3 = _mm256_set1_pd(c->dig_T3);
+    const __m256d P1 = _mm256_set1_pd(c->dig_P1), P2 = _mm256_set1_pd(c->dig_P2);
+    const __m256d P3 = _mm256_set1_pd(c->dig_P3), P4x = _mm256_set1_pd((double)c->dig_P4 * 65536.0);
+    const __m256d P5 = _mm256_set1_pd(c->dig_P5), P6 = _mm256_set1_pd(c->dig_P6);
+    const __m256d P7 = _mm256_set1_pd(c->dig_P7), P8 = _mm256_set1_pd(c->dig_P8);
+    const __m256d P9 = _mm256_set1_pd(c->dig_P9);
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+    size_t i;
+
+#define K(x) _mm256_set1_pd(x)
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d adc_T = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&raw_temp[i]));
+        __m256d adc_P = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)&raw_press[i]));
+        __m256d var1, var2, sum, t_fine, p, a, b, valid;
+
+        a = _mm256_sub_pd(_mm256_mul_pd(adc_T, K(1.0 / 16384.0)), T1_1024);
+        var1 = _mm256_mul_pd(a, T2);
+        b = _mm256_sub_pd(_mm256_mul_pd(adc_T, K(1.0 / 131072.0)), T1_8192);
+        var2 = _mm256_mul_pd(_mm256_mul_pd(b, b), T3);
+        sum = _mm256_add_pd(var1, var2);
+        t_fine = _mm256_round_pd(sum, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        _mm256_storeu_pd(&temp_c[i], _mm256_div_pd(sum, K(5120.0)));
+
+        var1 = _mm256_sub_pd(_mm256_mul_pd(t_fine, K(0.5)), K(64000.0));
+        var2 = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(var1, var1), P6), K(1.0 / 32768.0));
+        var2 = _mm256_add_pd(var2, _mm256_mul_pd(_mm256_mul_pd(var1, P5), K(2.0)));
+        var2 = _mm256_add_pd(_mm256_mul_pd(var2, K(0.25)), P4x);
+        a = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(P3, var1), var1), K(1.0 / 524288.0));
+        var1 = _mm256_mul_pd(_mm256_add_pd(a, _mm256_mul_pd(P2, var1)), K(1.0 / 524288.0));
+        var1 = _mm256_mul_pd(_mm256_add_pd(one, _mm256_mul_pd(var1, K(1.0 / 32768.0))), P1);
+        valid = _mm256_cmp_pd(var1, zero, _CMP_NEQ_OQ);
+        var1 = _mm256_blendv_pd(one, var1, valid);      // keep the division finite
+
+        p = _mm256_sub_pd(K(1048576.0), adc_P);
+        p = _mm256_sub_pd(p, _mm256_mul_pd(var2, K(1.0 / 4096.0)));
+        p = _mm256_div_pd(_mm256_mul_pd(p, K(6250.0)), var1);
+        var1 = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(P9, p), p), K(1.0 / 2147483648.0));
+        var2 = _mm256_mul_pd(_mm256_mul_pd(p, P8), K(1.0 / 32768.0));
+        p = _mm256_add_pd(p, _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(var1, var2), P7), K(1.0 / 16.0)));
+        _mm256_storeu_pd(&press_pa[i], _mm256_and_pd(p, valid));
+    }
+#undef K
+    f64_scalar(c, raw_press + i, raw_temp + i, temp_c + i, press_pa + i, n - i);
+}
+
+#endif /* BMP280_HAVE_AVX2 */
+
+/* ---------- NEON ---------- */
+#ifdef BMP280_HAVE_NEON
+
+static void temp_block_neon(const struct bmp280_calib *c, const uint32_t *raw_temp,
+                            int32_t *temp_cdeg, int32_t *t_fine, size_t n)
+{
+    const int32x4_t t1 = vdupq_n_s32(c->dig_T1);
+    const int32x4_t t1x2 = vdupq_n_s32((int32_t)c->dig_T1 << 1);
+    const int32x4_t t2 = vdupq_n_s32(c->dig_T2);
+    const int32x4_t t3 = vdupq_n_s32(c->dig_T3);
+    const int32x4_t round = vdupq_n_s32(128);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        int32x4_t adc = vreinterpretq_s32_u32(vld1q_u32(&raw_temp[i]));
+        int32x4_t v1, v2, d, tf;
+
+        v1 = vsubq_s32(vshrq_n_s32(adc, 3), t1x2);
+        v1 = vshrq_n_s32(vmulq_s32(v1, t2), 11);
+        d = vsubq_s32(vshrq_n_s32(adc, 4), t1);
+        v2 = vshrq_n_s32(vmulq_s32(d, d), 12);
+        v2 = vshrq_n_s32(vmulq_s32(v2, t3), 14);
+        tf = vaddq_s32(v1, v2);
+
+        vst1q_s32(&t_fine[i], tf);
+        vst1q_s32(&temp_cdeg[i], vshrq_n_s32(vaddq_s32(vmulq_n_s32(tf, 5), round), 8));
+    }
+    temp_block_scalar(c, raw_temp + i, temp_cdeg + i, t_fine + i, n - i);
+}
+
+static void f64_neon(const struct bmp280_calib *c, const uint32_t *raw_press,
+                     const uint32_t *raw_temp, double *temp_c, double *press_pa, size_t n)
+{
+    const float64x2_t T1_1024 = vdupq_n_f64((double)c->dig_T1 * (1.0 / 1024.0));
+    const float64x2_t T1_8192 = vdupq_n_f64((double)c->dig_T1 * (1.0 / 8192.0));
+    const float64x2_t T2 = vdupq_n_f64(c->dig_T2), T3 = vdupq_n_f64(c->dig_T3);
+    const float64x2_t P1 = vdupq_n_f64(c->dig_P1), P2 = vdupq_n_f64(c->dig_P2);
+    const float64x2_t P3 = vdupq_n_f64(c->dig_P3), P4x = vdupq_n_f64((double)c->dig_P4 * 65536.0);
+    const float64x2_t P5 = vdupq_n_f64(c->dig_P5), P6 = vdupq_n_f64(c->dig_P6);
+    const float64x2_t P7 = vdupq_n_f64(c->dig_P7), P8 = vdupq_n_f64(c->dig_P8);
+    const float64x2_t P9 = vdupq_n_f64(c->dig_P9);
+    const float64x2_t one = vdupq_n_f64(1.0);
+    size_t i;
+
+#define K(x) vdupq_n_f64(x)
+    for (i = 0; i + 2 <= n; i += 2) {
+        float64x2_t adc_T = vcvtq_f64_u64(vmovl_u32(vld1_u32(&raw_temp[i])));
+        float64x2_t adc_P = vcvtq_f64_u64(vmovl_u32(vld1_u32(&raw_press[i])));
+        float64x2_t var1, var2, sum, t_fine, p, a, b;
+        uint64x2_t valid;
+
+        a = vsubq_f64(vmulq_f64(adc_T, K(1.0 / 16384.0)), T1_1024);
+        var1 = vmulq_f64(a, T2);
+        b = vsubq_f64(vmulq_f64(adc_T, K(1.0 / 131072.0)), T1_8192);
+        var2 = vmulq_f64(vmulq_f64(b, b), T3);
+        sum = vaddq_f64(var1, var2);
+        t_fine = vrndq_f64(sum);                         // truncate toward zero
+        vst1q_f64(&temp_c[i], vdivq_f64(sum, K(5120.0)));
+
+        var1 = vsubq_f64(vmulq_f64(t_fine, K(0.5)), K(64000.0));
+        var2 = vmulq_f64(vmulq_f64(vmulq_f64(var1, var1), P6), K(1.0 / 32768.0));
+        var2 = vaddq_f64(var2, vmulq_f64(vmulq_f64(var1, P5), K(2.0)));
+        var2 = vaddq_f64(vmulq_f64(var2, K(0.25)), P4x);
+        a = vmulq_f64(vmulq_f64(vmulq_f64(P3, var1), var1), K(1.0 / 524288.0));
+        var1 = vmulq_f64(vaddq_f64(a, vmulq_f64(P2, var1)), K(1.0 / 524288.0));
+        var1 = vmulq_f64(vaddq_f64(one, vmulq_f64(var1, K(1.0 / 32768.0))), P1);
+        valid = vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(vceqzq_f64(var1))));
+        var1 = vbslq_f64(valid, var1, one);              // keep the division finite
+
+        p = vsubq_f64(K(1048576.0), adc_P);
+        p = vsubq_f64(p, vmulq_f64(var2, K(1.0 / 4096.0)));
+        p = vdivq_f64(vmulq_f64(p, K(6250.0)), var1);
+        var1 = vmulq_f64(vmulq_f64(vmulq_f64(P9, p), p), K(1.0 / 2147483648.0));
+        var2 = vmulq_f64(vmulq_f64(p, P8), K(1.0 / 32768.0));
+        p = vaddq_f64(p, vmulq_f64(vaddq_f64(vaddq_f64(var1, var2), P7), K(1.0 / 16.0)));
+        vst1q_f64(&press_pa[i], vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(p), valid)));
+    }
+#undef K
+    f64_scalar(c, raw_press + i, raw_temp + i, temp_c + i, press_pa + i, n - i);
+}
+
+#endif /* BMP280_HAVE_NEON */
+
+/* ---------- Dispatch ---------- */
+
+typedef void (*temp_block_fn)(const struct bmp280_calib *, const uint32_t *,
+                              int32_t *, int32_t *, size_t);
+typedef void (*f64_fn)(const struct bmp280_calib *, const uint32_t *, const uint32_t *,
+                       double *, double *, size_t);
+
+static struct {
+    int ready;
+    int force_scalar;
+    const char *name;
+    temp_block_fn temp_block;
+    f64_fn f64;
+} impl;
+
+static void impl_select(void)
+{
+    impl.name = "scalar";
+    impl.temp_block = temp_block_scalar;
+    impl.f64 = f64_scalar;
+
+    if (!impl.force_scalar) {
+#ifdef BMP280_HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            impl.name = "avx2";
+            impl.temp_block = temp_block_avx2;
+            impl.f64 = f64_avx2;
+        }
+#elif defined(BMP280_HAVE_NEON)
+        impl.name = "neon";
+        impl.temp_block = temp_block_neon;
+        impl.f64 = f64_neon;
+#endif
+    }
+    impl.ready = 1;
+}
+
+static inline void impl_get(void)
+{
+    if (!impl.ready)
+        impl_select();
+}
+
+const char *bmp280_batch_impl(void)
+{
+    impl_get();
+    return impl.name;
+}
+
+void bmp280_batch_force_scalar(int on)
+{
+    impl.force_scalar = on;
+    impl_select();
+}
+
+void bmp280_batch_compensate(const struct bmp280_calib *c,
+                             const uint32_t *raw_press, const uint32_t *raw_temp,
+                             int32_t *temp_cdeg, uint32_t *press_q8, size_t n)
+{
+    int32_t t_fine[BLOCK];
+    size_t i, j, len;
+
+    impl_get();
+    for (i = 0; i < n; i += len) {
+        len = n - i < BLOCK ? n - i : BLOCK;
+        impl.temp_block(c, raw_temp + i, temp_cdeg + i, t_fine, len);
+        for (j = 0; j < len; j++)
+            press_q8[i + j] = bmp280_compensate_press(c, (int32_t)raw_press[i + j], t_fine[j]);
+    }
+}
+
+void bmp280_batch_compensate_f64(const struct bmp280_calib *c,
+                                 const uint32_t *raw_press, const uint32_t *raw_temp,
+                                 double *temp_c, double *press_pa, size_t n)
+{
+    impl_get();
+    impl.f64(c, raw_press, raw_temp, temp_c, press_pa, n);
+}
+
+/*
+ * Records from /dev/bmp280 are array-of-structs; gather one block into
+ * struct-of-arrays scratch so the vector loads stay contiguous.
+ */
+void bmp280_batch_compensate_samples(const struct bmp280_calib *c,
+                                     struct bmp280_sample *samples, size_t n)
+{
+    uint32_t press[BLOCK], temp[BLOCK], press_q8[BLOCK];
+    int32_t temp_cdeg[BLOCK];
+    size_t i, j, len;
+
+    for (i = 0; i < n; i += len) {
+        len = n - i < BLOCK ? n - i : BLOCK;
+        for (j = 0; j < len; j++) {
+            press[j] = samples[i + j].raw_press;
+            temp[j] = samples[i + j].raw_temp;
+        }
+        bmp280_batch_compensate(c, press, temp, temp_cdeg, press_q8, len);
+        for (j = 0; j < len; j++) {
+            samples[i + j].temp_cdeg = temp_cdeg[j];
+            samples[i + j].press_q8 = press_q8[j];
+        }
+    }
+}
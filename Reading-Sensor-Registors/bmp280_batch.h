@@ -0,0 +1,53 @@
+#ifndef BMP280_BATCH_H
+#define BMP280_BATCH_H
+
+/*
+ * libbmp280_batch: offline compensation of recorded BMP280 raw samples.
+ *
+ * Two flavours:
+ * - bmp280_batch_compensate():     datasheet integer formulas, bit-identical
+ *                                  to the kernel driver (bmp280_comp.h)
+ * - bmp280_batch_compensate_f64(): datasheet double-precision formulas,
+ *                                  fully vectorised
+ *
+ * Both pick the widest SIMD unit available at run time: AVX2 on x86-64
+ * (checked with cpuid), NEON on AArch64, plain C elsewhere.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp280.h"
+#include "bmp280_comp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * raw_press/raw_temp: 20-bit ADC values.
+ * temp_cdeg: 0.01 degC, press_q8: Pa in unsigned Q24.8, as in the driver.
+ */
+void bmp280_batch_compensate(const struct bmp280_calib *c,
+                             const uint32_t *raw_press, const uint32_t *raw_temp,
+                             int32_t *temp_cdeg, uint32_t *press_q8, size_t n);
+
+/* temp_c in degC, press_pa in Pa */
+void bmp280_batch_compensate_f64(const struct bmp280_calib *c,
+                                 const uint32_t *raw_press, const uint32_t *raw_temp,
+                                 double *temp_c, double *press_pa, size_t n);
+
+/* Fills temp_cdeg/press_q8 of records read from /dev/bmp280 */
+void bmp280_batch_compensate_samples(const struct bmp280_calib *c,
+                                     struct bmp280_sample *samples, size_t n);
+
+/* Name of the implementation picked at run time: "avx2", "neon" or "scalar" */
+const char *bmp280_batch_impl(void);
+
+/* Force the portable C path, e.g. to compare results or speed */
+void bmp280_batch_force_scalar(int on);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BMP280_BATCH_H
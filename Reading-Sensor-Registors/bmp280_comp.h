@@ -0,0 +1,109 @@
+#ifndef BMP280_COMP_H
+#define BMP280_COMP_H
+
+/*
+ * BMP280 calibration data and integer compensation (datasheet section 3.11).
+ *
+ * Shared by the kernel driver, which compensates live readings, and by the
+ * user-space batch library, whose integer path must give bit-identical
+ * results. Everything here is static inline and uses only fixed-width types
+ * that exist in both environments.
+ *
+ * The datasheet formulas rely on two's complement wrap-around in a few
+ * 32-bit products; the kernel builds with -fno-strict-overflow and the
+ * library with -fwrapv to get exactly that behaviour.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/math64.h>
+#define bmp280_div_s64(a, b)    div64_s64((a), (b))
+#else
+#include <stdint.h>
+#define bmp280_div_s64(a, b)    ((a) / (b))
+#endif
+
+#define BMP280_REG_CALIB        0x88    // dig_T1 LSB, start of the trim block
+#define BMP280_CALIB_LEN        24      // 0x88-0x9F: dig_T1..dig_T3, dig_P1..dig_P9
+
+/* Trim parameters, little endian in registers 0x88-0x9F */
+struct bmp280_calib {
+    uint16_t dig_T1;
+    int16_t  dig_T2;
+    int16_t  dig_T3;
+    uint16_t dig_P1;
+    int16_t  dig_P2;
+    int16_t  dig_P3;
+    int16_t  dig_P4;
+    int16_t  dig_P5;
+    int16_t  dig_P6;
+    int16_t  dig_P7;
+    int16_t  dig_P8;
+    int16_t  dig_P9;
+};
+
+static inline uint16_t bmp280_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void bmp280_parse_calib(const uint8_t raw[BMP280_CALIB_LEN], struct bmp280_calib *c)
+{
+    c->dig_T1 = bmp280_le16(&raw[0]);
+    c->dig_T2 = (int16_t)bmp280_le16(&raw[2]);
+    c->dig_T3 = (int16_t)bmp280_le16(&raw[4]);
+    c->dig_P1 = bmp280_le16(&raw[6]);
+    c->dig_P2 = (int16_t)bmp280_le16(&raw[8]);
+    c->dig_P3 = (int16_t)bmp280_le16(&raw[10]);
+    c->dig_P4 = (int16_t)bmp280_le16(&raw[12]);
+    c->dig_P5 = (int16_t)bmp280_le16(&raw[14]);
+    c->dig_P6 = (int16_t)bmp280_le16(&raw[16]);
+    c->dig_P7 = (int16_t)bmp280_le16(&raw[18]);
+    c->dig_P8 = (int16_t)bmp280_le16(&raw[20]);
+    c->dig_P9 = (int16_t)bmp280_le16(&raw[22]);
+}
+
+/*
+ * Temperature in 0.01 degC (5123 = 51.23 degC).
+ * t_fine carries the fine temperature into the pressure formula.
+ */
+static inline int32_t bmp280_compensate_temp(const struct bmp280_calib *c, int32_t adc_T,
+                                             int32_t *t_fine)
+{
+    int32_t var1, var2;
+
+    var1 = ((((adc_T >> 3) - ((int32_t)c->dig_T1 << 1))) * ((int32_t)c->dig_T2)) >> 11;
+    var2 = (((((adc_T >> 4) - ((int32_t)c->dig_T1)) *
+              ((adc_T >> 4) - ((int32_t)c->dig_T1))) >> 12) *
+            ((int32_t)c->dig_T3)) >> 14;
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+/*
+ * Pressure in Pa as unsigned Q24.8 (24674867 = 24674867/256 = 96386.2 Pa).
+ * Returns 0 if the calibration would make the formula divide by zero.
+ */
+static inline uint32_t bmp280_compensate_press(const struct bmp280_calib *c, int32_t adc_P,
+                                               int32_t t_fine)
+{
+    int64_t var1, var2, p;
+
+    var1 = ((int64_t)t_fine) - 128000;
+    var2 = var1 * var1 * (int64_t)c->dig_P6;
+    var2 = var2 + ((var1 * (int64_t)c->dig_P5) * 131072);
+    var2 = var2 + (((int64_t)c->dig_P4) * 34359738368LL);
+    var1 = ((var1 * var1 * (int64_t)c->dig_P3) >> 8) + ((var1 * (int64_t)c->dig_P2) * 4096);
+    var1 = ((((int64_t)1) << 47) + var1) * ((int64_t)c->dig_P1) >> 33;
+    if (var1 == 0)
+        return 0;
+
+    p = 1048576 - adc_P;
+    p = bmp280_div_s64((((p << 31) - var2) * 3125), var1);
+    var1 = (((int64_t)c->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)c->dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)c->dig_P7) << 4);
+    return (uint32_t)p;
+}
+
+#endif // BMP280_COMP_H
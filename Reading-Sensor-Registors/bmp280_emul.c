@@ -0,0 +1,545 @@
+/*
+ * bmp280_emul.c
+ *
+ * Software BMP280 behind a virtual SPI controller.
+ *
+ * Registers SPI controllers whose transfers are answered by a model of
+ * the BMP280 register map instead of real hardware. Load it before the
+ * BMP280 driver and the buses named in its devices parameter exist,
+ * so the driver, its /dev/bmp280 stream and its IIO device can be
+ * exercised on any machine, and their bus usage measured.
+ *
+ * SPI protocol implemented (BMP280 datasheet, section 5.3):
+ * - the first byte after chip select is a control byte: bit 7 = 1 for read,
+ *   bits 6:0 = register address with bit 7 dropped
+ * - reads return consecutive registers while chip select stays asserted
+ * - writes are pairs of (control byte, data byte)
+ * - deasserting chip select ends the sequence
+ *
+ * Measurement model:
+ * - sleep, forced and normal mode from CTRL_MEAS[1:0]
+ * - conversion time from the oversampling settings (datasheet max values),
+ *   normal mode cycle = conversion time + CONFIG standby time
+ * - STATUS.measuring (bit 3) is set while a conversion runs
+ * - conversion number n produces a raw value that only depends on n, the
+ *   chip select and the waveform parameters, so runs are reproducible
+ *
+ * Signal integrity model: above max_reliable_hz, one transfer in four
+ * returns a flipped bit, like marginal wiring at too fast a clock.
+ *
+ * License: GPL
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/platform_device.h>
+#include <linux/spi/spi.h>
+#include <linux/err.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+
+#define DRIVER_NAME        "bmp280_emul"
+#define EMUL_MAX_CS        4
+#define EMUL_MAX_BUSES     4
+
+/* ---------- BMP280 Register Map ---------- */
+#define BMP280_REG_CALIB        0x88    // 0x88-0x9F trim parameters
+#define BMP280_REG_CHIP_ID      0xD0
+#define BMP280_REG_RESET        0xE0
+#define BMP280_REG_STATUS       0xF3
+#define BMP280_REG_CTRL_MEAS    0xF4
+#define BMP280_REG_CONFIG       0xF5
+#define BMP280_REG_PRESS_MSB    0xF7
+#define BMP280_REG_TEMP_MSB     0xFA
+
+#define BMP280_CHIP_ID          0x58
+#define BMP280_RESET_CMD        0xB6
+#define BMP280_SPI_READ         0x80
+#define BMP280_STATUS_MEASURING 0x08
+
+#define BMP280_MODE_MASK        0x03
+#define BMP280_MODE_SLEEP       0x00
+#define BMP280_MODE_NORMAL      0x03
+
+/* Raw sample and trim values from the datasheet's compensation example (section 3.12) */
+#define EMUL_RAW_PRESS          415148
+#define EMUL_RAW_TEMP           519888
+
+static const s16 emul_trim[12] = {
+    27504, 26435, -1000,                                    // dig_T1..T3 (T1 unsigned)
+    (s16)36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000, // dig_P1..P9 (P1 unsigned)
+};
+
+/* Standby times selectable in CONFIG[7:5], in microseconds */
+static const unsigned int emul_t_sb_us[] = {
+    500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000,
+};
+
+/* ---------- Module Parameters ---------- */
+static int bus_num;
+module_param(bus_num, int, 0444);
+MODULE_PARM_DESC(bus_num, "SPI bus number of the first virtual controller (default 0)");
+
+static unsigned int num_buses = 1;
+module_param(num_buses, uint, 0444);
+MODULE_PARM_DESC(num_buses, "Virtual controllers, numbered from bus_num upwards (1-4)");
+
+static unsigned int num_cs = 1;
+module_param(num_cs, uint, 0444);
+MODULE_PARM_DESC(num_cs, "Emulated sensors per bus, one per chip select (1-4)");
+
+static unsigned int xfer_latency_us;
+module_param(xfer_latency_us, uint, 0644);
+MODULE_PARM_DESC(xfer_latency_us, "Fixed latency added to every spi_transfer");
+
+static bool model_clock = true;
+module_param(model_clock, bool, 0644);
+MODULE_PARM_DESC(model_clock, "Also delay each transfer by len * 8 / speed_hz, like a real bus");
+
+static unsigned int max_reliable_hz;
+module_param(max_reliable_hz, uint, 0644);
+MODULE_PARM_DESC(max_reliable_hz, "Corrupt received bits on transfers clocked faster than this (0 = never)");
+
+enum emul_waveform {
+    EMUL_WAVE_CONST,
+    EMUL_WAVE_TRIANGLE,
+    EMUL_WAVE_SQUARE,
+    EMUL_WAVE_SAWTOOTH,
+};
+
+static unsigned int waveform = EMUL_WAVE_TRIANGLE;
+module_param(waveform, uint, 0644);
+MODULE_PARM_DESC(waveform, "0=constant 1=triangle 2=square 3=sawtooth");
+
+static unsigned int wave_period = 1000;
+module_param(wave_period, uint, 0644);
+MODULE_PARM_DESC(wave_period, "Waveform period in conversions");
+
+static unsigned int press_amplitude = 20000;
+module_param(press_amplitude, uint, 0644);
+MODULE_PARM_DESC(press_amplitude, "Peak deviation of the raw pressure value");
+
+static unsigned int temp_amplitude = 10000;
+module_param(temp_amplitude, uint, 0644);
+MODULE_PARM_DESC(temp_amplitude, "Peak deviation of the raw temperature value");
+
+/* ---------- Emulated Device State ---------- */
+enum emul_phase {
+    EMUL_CONTROL,               // next byte is a control byte
+    EMUL_READ,                  // clocking out registers from addr upwards
+    EMUL_WRITE,                 // next byte is the data for addr
+};
+
+struct bmp280_emul_chip {
+    u8 regs[256];
+    enum emul_phase phase;
+    u8 addr;
+    unsigned int id;            // bus index * EMUL_MAX_CS + chip select, sets the wave phase
+    u64 conversions;            // index of the next conversion to complete
+    u64 meas_start_ns;          // forced: conversion start, normal: cycle origin
+    u64 meas_end_ns;            // forced mode: when the running conversion ends
+};
+
+/*
+ * Bus statistics. transfer_one and set_cs are serialised by the SPI core's
+ * message pump, so plain counters are enough.
+ */
+struct bmp280_emul_stats {
+    u64 cs_cycles;              // chip select assertions = bus transactions
+    u64 transfers;
+    u64 bytes;
+    u64 data_reads;             // read bursts that started in the data block
+    u64 conversions;
+    u64 busy_ns;                // time spent inside transfer_one
+    u64 corrupted;              // transfers answered with a flipped bit
+};
+
+struct bmp280_emul {
+    struct bmp280_emul_chip chip[EMUL_MAX_CS];
+    struct bmp280_emul_stats stats;
+};
+
+static struct platform_device *emul_pdev;
+static struct spi_controller *emul_ctlr[EMUL_MAX_BUSES];
+static struct dentry *emul_debugfs;
+
+/* ---------- Waveforms ---------- */
+/*
+ * Deviation in [-amp, amp] for conversion n. Every emulated sensor is phase
+ * shifted by another eighth of a period so parallel sensors do not report
+ * identical data.
+ */
+static s32 emul_wave(u64 n, unsigned int id, unsigned int amp)
+{
+    u32 period = max(wave_period, 2U);
+    u32 pos = do_div(n, period);     // n %= period, returns the remainder
+    s64 a = amp;
+
+    pos = (pos + (u64)id * period / 8) % period;
+
+    switch (waveform) {
+    case EMUL_WAVE_TRIANGLE:
+        // -amp at pos 0, +amp at period/2, back to -amp
+        if (pos < period / 2)
+            return -a + div_s64(4 * a * pos, period);
+        return 3 * a - div_s64(4 * a * pos, period);
+    case EMUL_WAVE_SQUARE:
+        return pos < period / 2 ? amp : -amp;
+    case EMUL_WAVE_SAWTOOTH:
+        return -a + div_s64(2 * a * pos, period);
+    default:
+        return 0;
+    }
+}
+
+/* ---------- Register Model ---------- */
+static void emul_store_raw(u8 *regs, u32 raw)
+{
+    raw &= 0xFFFFF;
+    regs[0] = raw >> 12;
+    regs[1] = raw >> 4;
+    regs[2] = (raw & 0x0F) << 4;
+}
+
+/* Conversion time for the current oversampling, datasheet "max" column */
+static u64 emul_t_meas_ns(struct bmp280_emul_chip *chip)
+{
+    static const u8 os_mult[8] = { 0, 1, 2, 4, 8, 16, 16, 16 };
+    u8 ctrl = chip->regs[BMP280_REG_CTRL_MEAS];
+    unsigned int osrs_t = os_mult[ctrl >> 5];
+    unsigned int osrs_p = os_mult[(ctrl >> 2) & 0x07];
+    u64 us = 1250 + 2300 * osrs_t;
+
+    if (osrs_p)
+        us += 2300 * osrs_p + 575;
+    return us * NSEC_PER_USEC;
+}
+
+/* Latch the result of one conversion into the data registers */
+static void emul_convert(struct bmp280_emul *emul, struct bmp280_emul_chip *chip)
+{
+    u64 n = chip->conversions++;
+
+    emul_store_raw(&chip->regs[BMP280_REG_PRESS_MSB],
+                   EMUL_RAW_PRESS + emul_wave(n, chip->id, press_amplitude));
+    emul_store_raw(&chip->regs[BMP280_REG_TEMP_MSB],
+                   EMUL_RAW_TEMP + emul_wave(n, chip->id, temp_amplitude));
+    emul->stats.conversions++;
+}
+
+/*
+ * Bring the model up to "now": finish a forced conversion that has run its
+ * time, or complete every normal-mode cycle that has elapsed. Only the last
+ * completed cycle matters for the registers, but each one counts for n.
+ */
+static void emul_advance(struct bmp280_emul *emul, struct bmp280_emul_chip *chip)
+{
+    u8 *ctrl = &chip->regs[BMP280_REG_CTRL_MEAS];
+    u64 now = ktime_get_ns();
+
+    if (chip->meas_end_ns) {
+        if (now < chip->meas_end_ns)
+            return;
+        chip->meas_end_ns = 0;
+        emul_convert(emul, chip);
+        *ctrl &= ~BMP280_MODE_MASK;     // forced mode falls back to sleep
+        chip->regs[BMP280_REG_STATUS] &= ~BMP280_STATUS_MEASURING;
+        return;
+    }
+
+    if ((*ctrl & BMP280_MODE_MASK) == BMP280_MODE_NORMAL) {
+        u64 cycle = emul_t_meas_ns(chip) +
+                    (u64)emul_t_sb_us[chip->regs[BMP280_REG_CONFIG] >> 5] * NSEC_PER_USEC;
+        u64 done = div64_u64(now - chip->meas_start_ns, cycle);
+
+        if (done) {
+            chip->conversions += done - 1;
+            emul_convert(emul, chip);
+            chip->meas_start_ns += done * cycle;
+        }
+        // measuring during the first t_meas of every cycle
+        if (now - chip->meas_start_ns < emul_t_meas_ns(chip))
+            chip->regs[BMP280_REG_STATUS] |= BMP280_STATUS_MEASURING;
+        else
+            chip->regs[BMP280_REG_STATUS] &= ~BMP280_STATUS_MEASURING;
+    }
+}
+
+static void emul_reset(struct bmp280_emul_chip *chip)
+{
+    unsigned int i;
+
+    memset(chip->regs, 0, sizeof(chip->regs));
+    chip->regs[BMP280_REG_CHIP_ID] = BMP280_CHIP_ID;
+    for (i = 0; i < ARRAY_SIZE(emul_trim); i++) {
+        chip->regs[BMP280_REG_CALIB + 2 * i] = (u16)emul_trim[i] & 0xFF;
+        chip->regs[BMP280_REG_CALIB + 2 * i + 1] = (u16)emul_trim[i] >> 8;
+    }
+    // the real chip reports 0x80000 until the first conversion
+    emul_store_raw(&chip->regs[BMP280_REG_PRESS_MSB], 0x80000);
+    emul_store_raw(&chip->regs[BMP280_REG_TEMP_MSB], 0x80000);
+    chip->phase = EMUL_CONTROL;
+    chip->conversions = 0;
+    chip->meas_end_ns = 0;
+}
+
+static void emul_write_reg(struct bmp280_emul_chip *chip, u8 reg, u8 val)
+{
+    switch (reg) {
+    case BMP280_REG_RESET:
+        if (val == BMP280_RESET_CMD)
+            emul_reset(chip);
+        break;
+    case BMP280_REG_CTRL_MEAS:
+        chip->regs[reg] = val;
+        chip->meas_start_ns = ktime_get_ns();
+        switch (val & BMP280_MODE_MASK) {
+        case BMP280_MODE_SLEEP:
+            chip->meas_end_ns = 0;
+            chip->regs[BMP280_REG_STATUS] &= ~BMP280_STATUS_MEASURING;
+            break;
+        case BMP280_MODE_NORMAL:
+            chip->meas_end_ns = 0;
+            break;
+        default:
+            // forced: one conversion, then back to sleep
+            chip->meas_end_ns = chip->meas_start_ns + emul_t_meas_ns(chip);
+            chip->regs[BMP280_REG_STATUS] |= BMP280_STATUS_MEASURING;
+            break;
+        }
+        break;
+    case BMP280_REG_CONFIG:
+        chip->regs[reg] = val & ~0x02;  // bit 1 is reserved
+        break;
+    default:
+        // read-only or reserved: ignored like on the real chip
+        break;
+    }
+}
+
+/* Clock one byte through the model; returns the byte seen on MISO */
+static u8 emul_xfer_byte(struct bmp280_emul *emul, struct bmp280_emul_chip *chip, u8 in)
+{
+    u8 out = 0xFF;
+
+    switch (chip->phase) {
+    case EMUL_CONTROL:
+        chip->addr = in | BMP280_SPI_READ;
+        chip->phase = (in & BMP280_SPI_READ) ? EMUL_READ : EMUL_WRITE;
+        if (chip->phase == EMUL_READ) {
+            // a read burst sees one consistent snapshot of the registers
+            emul_advance(emul, chip);
+            if (chip->addr >= BMP280_REG_PRESS_MSB)
+                emul->stats.data_reads++;
+        }
+        break;
+    case EMUL_READ:
+        out = chip->regs[chip->addr++];
+        break;
+    case EMUL_WRITE:
+        emul_advance(emul, chip);
+        emul_write_reg(chip, chip->addr, in);
+        chip->phase = EMUL_CONTROL;
+        break;
+    }
+    return out;
+}
+
+/* ---------- SPI Controller Callbacks ---------- */
+/*
+ * Any change of the chip select line ends the current register sequence,
+ * so both assert and deassert put the model back to expecting a control byte.
+ * The core passes the line level: low means asserted.
+ */
+static void emul_set_cs(struct spi_device *spi, bool level)
+{
+    struct bmp280_emul *emul = spi_controller_get_devdata(spi->controller);
+
+    emul->chip[spi_get_chipselect(spi, 0)].phase = EMUL_CONTROL;
+    if (!level)
+        emul->stats.cs_cycles++;
+}
+
+static int emul_transfer_one(struct spi_controller *ctlr, struct spi_device *spi,
+                             struct spi_transfer *xfer)
+{
+    struct bmp280_emul *emul = spi_controller_get_devdata(ctlr);
+    struct bmp280_emul_chip *chip = &emul->chip[spi_get_chipselect(spi, 0)];
+    const u8 *tx = xfer->tx_buf;
+    u8 *rx = xfer->rx_buf;
+    u64 start = ktime_get_ns(), delay_ns;
+    unsigned int i;
+
+    for (i = 0; i < xfer->len; i++) {
+        u8 out = emul_xfer_byte(emul, chip, tx ? tx[i] : 0xFF);
+
+        if (rx)
+            rx[i] = out;
+    }
+
+    /*
+     * Too fast for the "wiring": a deterministic one in four transfers gets
+     * a flipped bit, at a byte and bit position that vary per transfer.
+     */
+    if (max_reliable_hz && xfer->speed_hz > max_reliable_hz && rx && xfer->len) {
+        u32 h = hash_64(emul->stats.transfers, 32);
+
+        if (!(h & 3)) {
+            rx[(h >> 8) % xfer->len] ^= 1 << ((h >> 2) & 7);
+            emul->stats.corrupted++;
+        }
+    }
+
+    /* Emulated wire time: fixed latency plus, optionally, the clocked bits */
+    delay_ns = (u64)xfer_latency_us * NSEC_PER_USEC;
+    if (model_clock && xfer->speed_hz)
+        delay_ns += div_u64((u64)xfer->len * 8 * NSEC_PER_SEC, xfer->speed_hz);
+    if (delay_ns >= 10 * NSEC_PER_USEC)
+        usleep_range(div_u64(delay_ns, NSEC_PER_USEC), div_u64(delay_ns, NSEC_PER_USEC) + 5);
+    else if (delay_ns)
+        ndelay(delay_ns);
+
+    emul->stats.transfers++;
+    emul->stats.bytes += xfer->len;
+    emul->stats.busy_ns += ktime_get_ns() - start;
+    return 0;   // finished synchronously
+}
+
+/* ---------- debugfs ---------- */
+/*
+ * /sys/kernel/debug/bmp280_emul/spi<bus>/
+ *   cs_cycles transfers bytes data_reads conversions busy_ns
+ *   corrupted                                                  (read-only)
+ *   reset                                                      (write anything)
+ * bytes / data_reads and cs_cycles / data_reads show how much bus traffic
+ * each sample costs the driver.
+ */
+static int emul_reset_stats(void *data, u64 val)
+{
+    struct bmp280_emul *emul = data;
+
+    memset(&emul->stats, 0, sizeof(emul->stats));
+    return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(emul_reset_fops, NULL, emul_reset_stats, "%llu\n");
+
+static void emul_debugfs_add(struct bmp280_emul *emul, int bus)
+{
+    char name[16];
+    struct dentry *dir;
+
+    snprintf(name, sizeof(name), "spi%d", bus);
+    dir = debugfs_create_dir(name, emul_debugfs);
+    debugfs_create_u64("cs_cycles", 0444, dir, &emul->stats.cs_cycles);
+    debugfs_create_u64("transfers", 0444, dir, &emul->stats.transfers);
+    debugfs_create_u64("bytes", 0444, dir, &emul->stats.bytes);
+    debugfs_create_u64("data_reads", 0444, dir, &emul->stats.data_reads);
+    debugfs_create_u64("conversions", 0444, dir, &emul->stats.conversions);
+    debugfs_create_u64("busy_ns", 0444, dir, &emul->stats.busy_ns);
+    debugfs_create_u64("corrupted", 0444, dir, &emul->stats.corrupted);
+    debugfs_create_file_unsafe("reset", 0200, dir, emul, &emul_reset_fops);
+}
+
+/* ---------- Module Init / Exit ---------- */
+/*
+ * Every controller has its own message pump, so sensors on different
+ * virtual buses are served in parallel, like on separate hardware buses.
+ */
+static int emul_add_bus(unsigned int index)
+{
+    struct spi_controller *ctlr;
+    struct bmp280_emul *emul;
+    unsigned int cs;
+    int ret;
+
+    ctlr = spi_alloc_master(&emul_pdev->dev, sizeof(*emul));
+    if (!ctlr)
+        return -ENOMEM;
+
+    emul = spi_controller_get_devdata(ctlr);
+    for (cs = 0; cs < EMUL_MAX_CS; cs++) {
+        emul->chip[cs].id = index * EMUL_MAX_CS + cs;
+        emul_reset(&emul->chip[cs]);
+    }
+
+    ctlr->bus_num = bus_num + index;
+    ctlr->num_chipselect = num_cs;
+    ctlr->mode_bits = SPI_CPOL | SPI_CPHA;
+    ctlr->bits_per_word_mask = SPI_BPW_MASK(8);
+    ctlr->max_speed_hz = 10000000;     // BMP280 limit
+    ctlr->set_cs = emul_set_cs;
+    ctlr->transfer_one = emul_transfer_one;
+
+    ret = spi_register_controller(ctlr);
+    if (ret) {
+        spi_controller_put(ctlr);
+        return ret;
+    }
+
+    emul_ctlr[index] = ctlr;
+    emul_debugfs_add(emul, ctlr->bus_num);
+    return 0;
+}
+
+static void emul_remove_buses(void)
+{
+    int i;
+
+    for (i = EMUL_MAX_BUSES - 1; i >= 0; i--) {
+        if (emul_ctlr[i]) {
+            spi_unregister_controller(emul_ctlr[i]);
+            emul_ctlr[i] = NULL;
+        }
+    }
+}
+
+static int __init bmp280_emul_init(void)
+{
+    unsigned int i;
+    int ret;
+
+    num_cs = clamp(num_cs, 1U, (unsigned int)EMUL_MAX_CS);
+    num_buses = clamp(num_buses, 1U, (unsigned int)EMUL_MAX_BUSES);
+
+    /* The controllers need a parent device; a bare platform device will do */
+    emul_pdev = platform_device_register_simple(DRIVER_NAME, -1, NULL, 0);
+    if (IS_ERR(emul_pdev))
+        return PTR_ERR(emul_pdev);
+
+    emul_debugfs = debugfs_create_dir(DRIVER_NAME, NULL);
+    for (i = 0; i < num_buses; i++) {
+        ret = emul_add_bus(i);
+        if (ret)
+            goto err_buses;
+    }
+
+    pr_info(DRIVER_NAME ": %u virtual BMP280(s) on each of SPI buses %d-%d\n",
+            num_cs, bus_num, bus_num + num_buses - 1);
+    return 0;
+
+err_buses:
+    debugfs_remove_recursive(emul_debugfs);
+    emul_remove_buses();
+    platform_device_unregister(emul_pdev);
+    return ret;
+}
+
+static void __exit bmp280_emul_exit(void)
+{
+    debugfs_remove_recursive(emul_debugfs);
+    emul_remove_buses();
+    platform_device_unregister(emul_pdev);
+    pr_info(DRIVER_NAME ": exit\n");
+}
+
+module_init(bmp280_emul_init);
+module_exit(bmp280_emul_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Muhammad Ali Hussnain");
+MODULE_DESCRIPTION("Virtual SPI controller emulating a BMP280 for hardware-free testing");
+MODULE_VERSION("1.3");
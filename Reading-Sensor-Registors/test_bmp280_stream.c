@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include "bmp280.h"
+
+#define DEVICE "/dev/" BMP280_DEVICE_NAME
+#define BATCH  256
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Usage: ./test_bmp280_stream [seconds]
+ * Reads the sample stream, prints the latest raw values once per second
+ * and reports the achieved rate and any gaps in the sequence numbers.
+ * Sequence numbers count per sensor, so gaps are tracked per sensor.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned long seconds = argc > 1 ? strtoul(argv[1], NULL, 0) : 5;
+    static struct bmp280_sample samples[BATCH];
+    uint64_t start, next_print, total = 0, lost = 0;
+    uint64_t per_sensor[BMP280_MAX_SENSORS] = { 0 };
+    uint32_t expect[BMP280_MAX_SENSORS];
+    int have_seq[BMP280_MAX_SENSORS] = { 0 };
+    struct pollfd pfd;
+    int fd, i;
+
+    fd = open(DEVICE, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    start = now_ns();
+    next_print = start + 1000000000ull;
+
+    while (now_ns() - start < seconds * 1000000000ull) {
+        ssize_t len;
+        size_t i, n;
+
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+
+        len = read(fd, samples, sizeof(samples));
+        if (len < 0) {
+            perror("read failed");
+            break;
+        }
+
+        n = len / sizeof(samples[0]);
+        for (i = 0; i < n; i++) {
+            uint32_t s = samples[i].sensor;
+
+            if (s >= BMP280_MAX_SENSORS)
+                continue;
+            if (have_seq[s] && samples[i].seq != expect[s])
+                lost += samples[i].seq - expect[s];
+            expect[s] = samples[i].seq + 1;
+            have_seq[s] = 1;
+            per_sensor[s]++;
+        }
+        total += n;
+
+        if (n && now_ns() >= next_print) {
+            printf("t=%llu ns sensor=%u press=%u temp=%u\n",
+                   (unsigned long long)samples[n - 1].timestamp_ns, samples[n - 1].sensor,
+                   samples[n - 1].raw_press, samples[n - 1].raw_temp);
+            next_print += 1000000000ull;
+        }
+    }
+
+    printf("%llu samples in %lu s (%.1f/s), %llu lost\n",
+           (unsigned long long)total, seconds, (double)total / seconds,
+           (unsigned long long)lost);
+    for (i = 0; i < BMP280_MAX_SENSORS; i++)
+        if (per_sensor[i])
+            printf("  sensor %d: %llu samples (%.1f/s)\n", i,
+                   (unsigned long long)per_sensor[i], (double)per_sensor[i] / seconds);
+
+    close(fd);
+    return EXIT_SUCCESS;
+}
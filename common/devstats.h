@@ -0,0 +1,234 @@
+#ifndef DEVSTATS_H
+#define DEVSTATS_H
+
+/*
+ * Per-CPU operation counters of a character device, shared with user space
+ * through a read-only mapping of /dev/devstats/<name>.
+ *
+ * Layout of the mapping (all offsets from its start):
+ *
+ *   struct devstats_header                       at 0
+ *   slot of CPU c                                at slots_offset + c * slot_size
+ *     struct devstats_counters[nr_channels]
+ *
+ * A channel is one kind of operation of the device (read, write, ioctl,
+ * irq, ...), named in the header. Each CPU only ever writes its own slot,
+ * and slots are padded to whole cachelines, so counting never bounces a
+ * cacheline between CPUs and needs no lock. A reader sums the slots; each
+ * counter is a single 64-bit word, so it is never torn, but the counters of
+ * one channel may be read at slightly different moments.
+ *
+ * Reading needs no system call once the mapping exists:
+ *
+ *     int fd = open("/dev/devstats/hello_cdev", O_RDONLY);
+ *     const void *map = devstats_map(fd, &len);
+ *     struct devstats_counters sum;
+ *     devstats_sum(map, 0, &sum);         // channel 0, all CPUs
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+#endif
+
+#define DEVSTATS_MAGIC          0x54535644  /* "DVST" */
+#define DEVSTATS_VERSION        1
+#define DEVSTATS_MAX_CHANNELS   4
+#define DEVSTATS_CACHELINE      64
+
+struct devstats_counters {
+    __u64 ops;
+    __u64 bytes;
+    __u64 errors;
+    __u64 latency_ns;      /* summed over all ops */
+};
+
+struct devstats_header {
+    __u32 magic;
+    __u16 version;
+    __u16 nr_channels;
+    __u32 nr_slots;        /* possible CPU ids */
+    __u32 slot_size;       /* bytes, a multiple of DEVSTATS_CACHELINE */
+    __u32 slots_offset;
+    __u32 map_size;        /* bytes to map to see every slot */
+    char name[32];
+    char channel[DEVSTATS_MAX_CHANNELS][16];
+};
+
+#ifdef __KERNEL__
+#include <linux/miscdevice.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/smp.h>
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <asm/local64.h>
+
+struct devstats {
+    struct devstats_header *hdr;    /* start of the vmalloc_user() area */
+    struct miscdevice misc;
+    char nodename[48];
+};
+
+static inline struct devstats_counters *devstats_slot(struct devstats *ds, int cpu)
+{
+    return (void *)ds->hdr + ds->hdr->slots_offset + cpu * ds->hdr->slot_size;
+}
+
+/*
+ * Counts one operation on channel ch of the calling CPU. Safe from any
+ * context, interrupt handlers included: local64 updates are atomic against
+ * the local CPU, and nobody else writes this slot.
+ */
+static inline void devstats_add(struct devstats *ds, unsigned int ch, u64 bytes,
+                                bool error, u64 latency_ns)
+{
+    struct devstats_counters *c = devstats_slot(ds, get_cpu()) + ch;
+
+    local64_inc((local64_t *)&c->ops);
+    if (bytes)
+        local64_add(bytes, (local64_t *)&c->bytes);
+    if (error)
+        local64_inc((local64_t *)&c->errors);
+    local64_add(latency_ns, (local64_t *)&c->latency_ns);
+    put_cpu();
+}
+
+/* t0 = ktime_get_ns() when the operation started */
+static inline void devstats_end(struct devstats *ds, unsigned int ch, u64 t0, ssize_t ret)
+{
+    devstats_add(ds, ch, ret > 0 ? ret : 0, ret < 0, ktime_get_ns() - t0);
+}
+
+static inline int devstats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct devstats *ds = container_of(file->private_data, struct devstats, misc);
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    // Forbid a later mprotect(PROT_WRITE) as well
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_vmalloc_range(vma, ds->hdr, vma->vm_pgoff);
+}
+
+static const struct file_operations devstats_fops = {
+    .owner = THIS_MODULE,
+    .mmap = devstats_mmap,
+};
+
+/*
+ * devstats_register
+ * ----------------
+ * Allocates the zeroed counter area and creates /dev/devstats/<name>.
+ * The device pins the module while it is open or mapped, so
+ * devstats_unregister() in module exit never frees a mapped area.
+ */
+static inline int devstats_register(struct devstats *ds, const char *name,
+                                    const char *const *channels, unsigned int nr_channels)
+{
+    u32 slot_size, offset, size;
+    unsigned int i;
+    int ret;
+
+    BUILD_BUG_ON(sizeof(local64_t) != sizeof(__u64));
+    BUILD_BUG_ON(sizeof(struct devstats_header) > DEVSTATS_CACHELINE * 2);
+    if (!nr_channels || nr_channels > DEVSTATS_MAX_CHANNELS)
+        return -EINVAL;
+
+    slot_size = ALIGN(nr_channels * sizeof(struct devstats_counters), DEVSTATS_CACHELINE);
+    offset = ALIGN(sizeof(struct devstats_header), DEVSTATS_CACHELINE);
+    size = PAGE_ALIGN(offset + nr_cpu_ids * slot_size);
+
+    ds->hdr = vmalloc_user(size);
+    if (!ds->hdr)
+        return -ENOMEM;
+    ds->hdr->magic = DEVSTATS_MAGIC;
+    ds->hdr->version = DEVSTATS_VERSION;
+    ds->hdr->nr_channels = nr_channels;
+    ds->hdr->nr_slots = nr_cpu_ids;
+    ds->hdr->slot_size = slot_size;
+    ds->hdr->slots_offset = offset;
+    ds->hdr->map_size = size;
+    strscpy(ds->hdr->name, name, sizeof(ds->hdr->name));
+    for (i = 0; i < nr_channels; i++)
+        strscpy(ds->hdr->channel[i], channels[i], sizeof(ds->hdr->channel[i]));
+
+    snprintf(ds->nodename, sizeof(ds->nodename), "devstats/%s", name);
+    ds->misc.minor = MISC_DYNAMIC_MINOR;
+    ds->misc.name = ds->nodename + strlen("devstats/");
+    ds->misc.nodename = ds->nodename;
+    ds->misc.fops = &devstats_fops;
+    ds->misc.mode = 0444;
+    ret = misc_register(&ds->misc);
+    if (ret) {
+        vfree(ds->hdr);
+        ds->hdr = NULL;
+    }
+    return ret;
+}
+
+static inline void devstats_unregister(struct devstats *ds)
+{
+    if (!ds->hdr)
+        return;
+    misc_deregister(&ds->misc);
+    vfree(ds->hdr);
+    ds->hdr = NULL;
+}
+
+#else /* user space */
+#include <sys/mman.h>
+
+/* Maps every slot; returns NULL on failure. munmap(map, *len) when done. */
+static inline const void *devstats_map(int fd, size_t *len)
+{
+    const struct devstats_header *hdr;
+    size_t size;
+
+    hdr = mmap(NULL, 4096, PROT_READ, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+        return NULL;
+    if (hdr->magic != DEVSTATS_MAGIC || hdr->version != DEVSTATS_VERSION) {
+        munmap((void *)hdr, 4096);
+        return NULL;
+    }
+    size = hdr->map_size;
+    munmap((void *)hdr, 4096);
+
+    hdr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+        return NULL;
+    *len = size;
+    return hdr;
+}
+
+static inline const struct devstats_header *devstats_header(const void *map)
+{
+    return (const struct devstats_header *)map;
+}
+
+/* Sums channel ch over all CPU slots, without entering the kernel */
+static inline void devstats_sum(const void *map, unsigned int ch, struct devstats_counters *sum)
+{
+    const struct devstats_header *hdr = devstats_header(map);
+    const struct devstats_counters *c;
+    __u32 cpu;
+
+    sum->ops = sum->bytes = sum->errors = sum->latency_ns = 0;
+    for (cpu = 0; cpu < hdr->nr_slots; cpu++) {
+        c = (const struct devstats_counters *)((const char *)map + hdr->slots_offset +
+                                               cpu * hdr->slot_size) + ch;
+        sum->ops        += __atomic_load_n(&c->ops, __ATOMIC_RELAXED);
+        sum->bytes      += __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+        sum->errors     += __atomic_load_n(&c->errors, __ATOMIC_RELAXED);
+        sum->latency_ns += __atomic_load_n(&c->latency_ns, __ATOMIC_RELAXED);
+    }
+}
+#endif
+
+#endif // DEVSTATS_H
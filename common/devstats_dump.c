@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "devstats.h"
+
+#define DEVSTATS_DIR "/dev/devstats"
+#define MAX_DEVICES  1024
+
+/*
+ * Usage: ./devstats_dump [interval_s] [count]
+ * Maps every /dev/devstats/<name> once, then prints the counters of every
+ * channel each interval (default 1 s, count 0 = forever). Apart from
+ * sleeping and printing, a scrape makes no system calls.
+ */
+
+struct mapped {
+    const void *map;
+    size_t len;
+    struct devstats_counters last[DEVSTATS_MAX_CHANNELS];
+};
+
+int main(int argc, char *argv[])
+{
+    int interval = argc > 1 ? atoi(argv[1]) : 1;
+    int count = argc > 2 ? atoi(argv[2]) : 0;
+    static struct mapped dev[MAX_DEVICES];
+    char path[512];
+    struct dirent *de;
+    int ndev = 0, i, n, fd;
+    unsigned int ch;
+    DIR *dir;
+
+    dir = opendir(DEVSTATS_DIR);
+    if (!dir) {
+        perror(DEVSTATS_DIR);
+        return EXIT_FAILURE;
+    }
+    while ((de = readdir(dir)) && ndev < MAX_DEVICES) {
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), DEVSTATS_DIR "/%s", de->d_name);
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            continue;
+        }
+        dev[ndev].map = devstats_map(fd, &dev[ndev].len);
+        close(fd);   // the mapping stays valid
+        if (dev[ndev].map)
+            ndev++;
+        else
+            fprintf(stderr, "%s: not a devstats device\n", path);
+    }
+    closedir(dir);
+
+    for (n = 0; !count || n < count; n++) {
+        if (n)
+            sleep(interval);
+        printf("%-16s %-8s %14s %16s %10s %12s %12s\n",
+               "device", "channel", "ops", "bytes", "errors", "avg_ns", "ops/s");
+        for (i = 0; i < ndev; i++) {
+            const struct devstats_header *hdr = devstats_header(dev[i].map);
+
+            for (ch = 0; ch < hdr->nr_channels; ch++) {
+                struct devstats_counters s;
+
+                devstats_sum(dev[i].map, ch, &s);
+                printf("%-16.16s %-8.8s %14llu %16llu %10llu %12.0f %12.0f\n",
+                       hdr->name, hdr->channel[ch],
+                       (unsigned long long)s.ops, (unsigned long long)s.bytes,
+                       (unsigned long long)s.errors,
+                       s.ops ? (double)s.latency_ns / s.ops : 0.0,
+                       n ? (double)(s.ops - dev[i].last[ch].ops) / interval : 0.0);
+                dev[i].last[ch] = s;
+            }
+        }
+        fflush(stdout);
+    }
+
+    for (i = 0; i < ndev; i++)
+        munmap((void *)dev[i].map, dev[i].len);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#ifndef KTEST_H
+#define KTEST_H
+
+/*
+ * Helpers for the KUnit suites of the modules, one <module>_kunit.c per
+ * directory.
+ *
+ * A suite file #includes its module's source, so the tests call the
+ * static functions and see the static state directly, and is built as a
+ * test module of its own (<module>_kunit.ko) when the kernel has
+ * CONFIG_KUNIT. Loading it initialises the module as usual, then runs the
+ * suites; unloading it tears the module down. It registers the same
+ * devices as the module, so the two cannot be loaded together.
+ * kunit/run-qemu.sh boots a guest and loads every test module in turn.
+ *
+ * User memory: file operations and ioctls take __user pointers, and a
+ * kernel buffer is not one. ktest_user_buf() maps anonymous memory into
+ * the test thread with kunit_vm_mmap() (Linux 6.10 and later); it is
+ * unmapped when the test ends.
+ *
+ * Benchmarks: ktest_bench() runs a statement bench_iters times (a module
+ * parameter of every test module), KTEST_BENCH_ROUNDS rounds in a row,
+ * and reports the fastest round as
+ *
+ *     # <test case>: <ns>.<ps> ns/op <label>
+ *
+ * in the suite's results. The fastest round is the one interrupts and
+ * preemption disturbed least; the others only add noise. Benchmark cases
+ * are marked KUNIT_CASE_SLOW and live in a <suite>_bench suite of their
+ * own, so kunit.filter=speed>slow leaves them out. Statements that move
+ * megabytes use ktest_bench_n() with a fraction of bench_iters.
+ */
+
+#include <kunit/test.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/mman.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+#include <linux/sched.h>
+#include <linux/moduleparam.h>
+
+static unsigned long bench_iters = 1000000;
+module_param(bench_iters, ulong, 0444);
+MODULE_PARM_DESC(bench_iters, "Iterations of each benchmark round (default 1000000)");
+
+#define KTEST_BENCH_ROUNDS  5
+
+#define ktest_bench_n(test, label, iters, body)                                     \
+do {                                                                                \
+    unsigned long __n = max_t(unsigned long, (iters), 1);                           \
+    u64 __best = U64_MAX, __t0, __ps;                                               \
+    unsigned long __i;                                                              \
+    int __r;                                                                        \
+                                                                                    \
+    for (__r = 0; __r < KTEST_BENCH_ROUNDS; __r++) {                                \
+        __t0 = ktime_get_ns();                                                      \
+        for (__i = 0; __i < __n; __i++) {                                           \
+            body;                                                                   \
+            if (!(__i & 4095))                                                      \
+                cond_resched();                                                     \
+        }                                                                           \
+        __best = min(__best, ktime_get_ns() - __t0);                                \
+    }                                                                               \
+    __ps = div64_u64(__best * 1000, __n);                                           \
+    kunit_info(test, "%llu.%03llu ns/op %s\n", __ps / 1000, __ps % 1000, label);    \
+} while (0)
+
+#define ktest_bench(test, label, body)  ktest_bench_n(test, label, bench_iters, body)
+
+/* len bytes of zeroed, writable user memory in the test thread */
+static inline void __user *ktest_user_buf(struct kunit *test, size_t len)
+{
+    unsigned long addr;
+
+    addr = kunit_vm_mmap(test, NULL, 0, len, PROT_READ | PROT_WRITE,
+                         MAP_ANONYMOUS | MAP_PRIVATE, 0);
+    KUNIT_ASSERT_NE_MSG(test, addr, 0, "cannot map %zu bytes of user memory", len);
+    return (void __user *)addr;
+}
+
+static inline void ktest_filp_close(void *file)
+{
+    filp_close(file, NULL);
+}
+
+/*
+ * Opens a device node, closed again when the test ends. A missing node
+ * (no devtmpfs) skips the test rather than failing it.
+ */
+static inline struct file *ktest_open(struct kunit *test, const char *path, int flags)
+{
+    struct file *file = filp_open(path, flags, 0);
+
+    if (IS_ERR(file))
+        kunit_skip(test, "cannot open %s: %ld", path, PTR_ERR(file));
+    KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, ktest_filp_close, file), 0);
+    return file;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define DEVICE_PATH "/dev/hello_cdev"
+#define MIN_SIZE    (4u << 10)
+#define MAX_SIZE    (16u << 20)
+#define PIPE_SIZE   (1u << 20)
+
+/*
+ * Usage: ./bench_source [total_MiB] [device]
+ * Moves total_MiB out of the data source with each transfer method, at
+ * request sizes from 4 KiB to 16 MiB, and prints the throughput in GB/s.
+ * The stream comes from the module's mode parameter.
+ */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static volatile uint64_t sink;      // keeps the mmap loop from being optimised away
+
+static int do_read(int fd, char *buf, size_t size)
+{
+    return read(fd, buf, size) == (ssize_t)size ? 0 : -1;
+}
+
+/* Two halves, so the call really goes through .read_iter */
+static int do_readv(int fd, char *buf, size_t size)
+{
+    struct iovec iov[2] = {
+        { buf, size / 2 },
+        { buf + size / 2, size - size / 2 },
+    };
+
+    return readv(fd, iov, 2) == (ssize_t)size ? 0 : -1;
+}
+
+/* Fault the mapping in and read one word per cache line */
+static int do_mmap(int fd, char *buf, size_t size)
+{
+    const uint64_t *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    uint64_t sum = 0;
+    size_t i;
+
+    (void)buf;
+    if (p == MAP_FAILED)
+        return -1;
+    for (i = 0; i < size / 8; i += 8)
+        sum += p[i];
+    sink += sum;
+    munmap((void *)p, size);
+    return 0;
+}
+
+/* Device -> pipe -> /dev/null; only the first hop is the source's cost */
+static int pipefd[2] = { -1, -1 }, nullfd = -1;
+
+static int do_splice(int fd, char *buf, size_t size)
+{
+    ssize_t n, m;
+
+    (void)buf;
+    while (size) {
+        n = splice(fd, NULL, pipefd[1], NULL, size < PIPE_SIZE ? size : PIPE_SIZE, 0);
+        if (n <= 0)
+            return -1;
+        size -= n;
+        while (n) {
+            m = splice(pipefd[0], NULL, nullfd, NULL, n, 0);
+            if (m <= 0)
+                return -1;
+            n -= m;
+        }
+    }
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(int fd, char *buf, size_t size);
+} methods[] = {
+    { "read", do_read },
+    { "readv", do_readv },
+    { "mmap", do_mmap },
+    { "splice", do_splice },
+};
+
+int main(int argc, char *argv[])
+{
+    uint64_t total = (argc > 1 ? strtoull(argv[1], NULL, 0) : 1024) << 20;
+    const char *dev = argc > 2 ? argv[2] : DEVICE_PATH;
+    char *buf = malloc(MAX_SIZE);
+    size_t size, m;
+    int fd;
+
+    fd = open(dev, O_RDONLY);
+    if (fd < 0 || !buf) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+    memset(buf, 0, MAX_SIZE);       // fault the buffer in before timing
+
+    nullfd = open("/dev/null", O_WRONLY);
+    if (nullfd < 0 || pipe(pipefd)) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+    fcntl(pipefd[1], F_SETPIPE_SZ, PIPE_SIZE);
+
+    printf("%10s", "size");
+    for (m = 0; m < sizeof(methods) / sizeof(methods[0]); m++)
+        printf(" %10s", methods[m].name);
+    printf("   (GB/s)\n");
+
+    for (size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+        printf("%9zuK", size >> 10);
+        for (m = 0; m < sizeof(methods) / sizeof(methods[0]); m++) {
+            uint64_t done = 0, t0 = now_ns();
+
+            while (done < total) {
+                if (methods[m].run(fd, buf, size)) {
+                    perror(methods[m].name);
+                    return EXIT_FAILURE;
+                }
+                done += size;
+            }
+            printf(" %10.2f", (double)done / (now_ns() - t0));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    close(fd);
+    return EXIT_SUCCESS;
+}
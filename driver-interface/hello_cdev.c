@@ -1,34 +1,427 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/sched/signal.h>
+#include <linux/uaccess.h>
+#include <linux/sizes.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>     // moved to linux/unaligned.h in 6.12
+#endif
+
+#define DEVICE_NAME "hello_cdev"
+
+/*
+hello_cdev is a synthetic data source, a reference for the cost of moving
+data from the kernel to user space. It never ends, like /dev/zero, and
+produces one of four streams (module parameter mode, sampled at open):
+
+  0 zero     all zero bytes; read() is clear_user(), no source memory at all
+  1 pattern  every 8-byte aligned word holds its own file offset
+             (little endian), so any range can be checked with pread()
+  2 prng     xorshift64* output, one generator per open file
+  3 page     one page of random bytes made at load time, repeated: byte at
+             offset o is page[o % PAGE_SIZE]
+
+Every mode can be read four ways, so each transfer path can be timed on
+its own at any request size:
+  read()      .read,        copy_to_user() / clear_user()
+  readv()     .read_iter,   copy_to_iter() / iov_iter_zero()
+  mmap()      .mmap,        a page fault per page, no copy afterwards
+  splice()    .splice_read, zero and page hand out references to one shared
+              page (no copy); pattern and prng are generated into fresh
+              pipe pages through .read_iter
+Generated modes (pattern, prng) first fill a per-open scratch page and copy
+from there, so their cost includes the generation.
+*/
+enum src_mode {
+    SRC_ZERO,
+    SRC_PATTERN,
+    SRC_PRNG,
+    SRC_PAGE,
+    SRC_NR_MODES,
+};
+
+static unsigned int mode = SRC_ZERO;
+module_param(mode, uint, 0644);
+MODULE_PARM_DESC(mode, "0=zero 1=pattern 2=prng 3=page (applies to files opened afterwards)");
+
+static ulong seed = 0x9E3779B97F4A7C15UL;
+module_param(seed, ulong, 0444);
+MODULE_PARM_DESC(seed, "Seed of the page mode's page and of every prng stream");
 
 static int major;
+static struct class *src_class;
+static struct device *src_device;
+
+/* Shared, read-only source pages; mmap and splice hand out references to them */
+static struct page *zero_src, *page_src;
+
+/* Per open file */
+struct src_file {
+    enum src_mode mode;
+    struct mutex lock;          // scratch and rng, generated modes only
+    u64 rng;
+    u8 *scratch;                // one page
+};
+
+/* ---------- Generators ---------- */
+
+static u64 src_rng_next(u64 *s)
+{
+    u64 x = *s;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void src_fill_prng(u64 *s, u8 *buf, size_t len)
+{
+    u64 v;
+
+    for (; len >= 8; buf += 8, len -= 8)
+        put_unaligned_le64(src_rng_next(s), buf);
+    if (len) {
+        v = cpu_to_le64(src_rng_next(s));
+        memcpy(buf, &v, len);
+    }
+}
+
+/* Bytes [pos, pos + len) of the offset pattern */
+static void src_fill_pattern(u8 *buf, loff_t pos, size_t len)
+{
+    u64 w = pos & ~7ULL, v;
+    size_t skip = pos & 7, n;
+
+    if (skip) {
+        v = cpu_to_le64(w);
+        n = min(len, 8 - skip);
+        memcpy(buf, (u8 *)&v + skip, n);
+        buf += n;
+        len -= n;
+        w += 8;
+    }
+    for (; len >= 8; buf += 8, len -= 8, w += 8)
+        put_unaligned_le64(w, buf);
+    if (len) {
+        v = cpu_to_le64(w);
+        memcpy(buf, &v, len);
+    }
+}
+
+/*
+Returns n bytes of the stream starting at pos, n <= PAGE_SIZE - pos % PAGE_SIZE.
+Generated modes write them into the scratch page; the caller holds sf->lock.
+*/
+static const u8 *src_chunk(struct src_file *sf, loff_t pos, size_t n)
+{
+    size_t off = offset_in_page(pos);
+
+    switch (sf->mode) {
+    case SRC_PATTERN:
+        src_fill_pattern(sf->scratch, pos, n);
+        return sf->scratch;
+    case SRC_PRNG:
+        src_fill_prng(&sf->rng, sf->scratch, n);
+        return sf->scratch;
+    case SRC_PAGE:
+        return (const u8 *)page_address(page_src) + off;
+    default:
+        return (const u8 *)page_address(zero_src) + off;
+    }
+}
+
+/* Large reads stop at a fatal signal and give the CPU away between chunks */
+static bool src_should_stop(void)
+{
+    if (fatal_signal_pending(current))
+        return true;
+    cond_resched();
+    return false;
+}
+
+/* ---------- read / read_iter ---------- */
 
 static ssize_t my_read(struct file *f, char __user *u, size_t l, loff_t *o)
 {
-    printk("hello_cdev - Read is called\n");
+    struct src_file *sf = f->private_data;
+    size_t done = 0, n;
+    loff_t pos = *o;
+
+    if (sf->mode == SRC_ZERO) {
+        // no source buffer at all: the floor for any copy to user space
+        while (done < l) {
+            n = min_t(size_t, l - done, SZ_1M);
+            n -= clear_user(u + done, n);
+            done += n;
+            if (!n || src_should_stop())
+                break;
+        }
+    } else {
+        mutex_lock(&sf->lock);
+        while (done < l) {
+            n = min_t(size_t, l - done, PAGE_SIZE - offset_in_page(pos + done));
+            n -= copy_to_user(u + done, src_chunk(sf, pos + done, n), n);
+            done += n;
+            if (!n || src_should_stop())
+                break;
+        }
+        mutex_unlock(&sf->lock);
+    }
+
+    if (!done && l)
+        return -EFAULT;
+    *o = pos + done;
+    return done;
+}
+
+static ssize_t my_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct src_file *sf = iocb->ki_filp->private_data;
+    size_t done = 0, n, want;
+    loff_t pos = iocb->ki_pos;
+
+    if (sf->mode == SRC_ZERO) {
+        while (iov_iter_count(to)) {
+            want = min_t(size_t, iov_iter_count(to), SZ_1M);
+            n = iov_iter_zero(want, to);
+            done += n;
+            if (n != want || src_should_stop())
+                break;
+        }
+    } else {
+        mutex_lock(&sf->lock);
+        while (iov_iter_count(to)) {
+            want = min_t(size_t, iov_iter_count(to), PAGE_SIZE - offset_in_page(pos + done));
+            n = copy_to_iter(src_chunk(sf, pos + done, want), want, to);
+            done += n;
+            if (n != want || src_should_stop())
+                break;
+        }
+        mutex_unlock(&sf->lock);
+    }
+
+    if (!done && iov_iter_count(to))
+        return -EFAULT;
+    iocb->ki_pos = pos + done;
+    return done;
+}
+
+/* ---------- splice_read ---------- */
+
+static void src_spd_release(struct splice_pipe_desc *spd, unsigned int i)
+{
+    put_page(spd->pages[i]);
+}
+
+/*
+zero and page modes splice the shared source page itself, so moving data
+into a pipe copies nothing. Generated modes have no page to share and go
+through copy_splice_read(), i.e. my_read_iter() into new pipe pages.
+*/
+static ssize_t my_splice_read(struct file *in, loff_t *ppos, struct pipe_inode_info *pipe,
+                              size_t len, unsigned int flags)
+{
+    struct src_file *sf = in->private_data;
+    struct page *pages[PIPE_DEF_BUFFERS];
+    struct partial_page partial[PIPE_DEF_BUFFERS];
+    struct splice_pipe_desc spd = {
+        .pages = pages,
+        .partial = partial,
+        .nr_pages_max = PIPE_DEF_BUFFERS,
+        .ops = &nosteal_pipe_buf_ops,     // shared pages must not be stolen
+        .spd_release = src_spd_release,
+    };
+    struct page *page;
+    loff_t pos = *ppos;
+    ssize_t ret;
+
+    if (sf->mode == SRC_PATTERN || sf->mode == SRC_PRNG)
+        return copy_splice_read(in, ppos, pipe, len, flags);
+
+    page = sf->mode == SRC_PAGE ? page_src : zero_src;
+    while (len && spd.nr_pages < PIPE_DEF_BUFFERS) {
+        unsigned int off = offset_in_page(pos);
+        unsigned int n = min_t(size_t, len, PAGE_SIZE - off);
+
+        get_page(page);
+        pages[spd.nr_pages] = page;
+        partial[spd.nr_pages].offset = off;
+        partial[spd.nr_pages].len = n;
+        spd.nr_pages++;
+        pos += n;
+        len -= n;
+    }
+
+    ret = splice_to_pipe(pipe, &spd);
+    if (ret > 0)
+        *ppos += ret;
+    return ret;
+}
+
+/* ---------- mmap ---------- */
+
+/*
+Mappings are read-only. zero and page modes map the shared source page at
+every page of the mapping; generated modes get a new page per fault, filled
+for its file offset (pattern) or from the file's generator (prng). Such a
+page is freed when it is unmapped, and a later fault generates it again.
+*/
+static vm_fault_t src_vm_fault(struct vm_fault *vmf)
+{
+    struct src_file *sf = vmf->vma->vm_file->private_data;
+    struct page *page;
+
+    switch (sf->mode) {
+    case SRC_PATTERN:
+    case SRC_PRNG:
+        page = alloc_page(GFP_USER);
+        if (!page)
+            return VM_FAULT_OOM;
+        mutex_lock(&sf->lock);
+        memcpy(page_address(page), src_chunk(sf, (loff_t)vmf->pgoff << PAGE_SHIFT, PAGE_SIZE),
+               PAGE_SIZE);
+        mutex_unlock(&sf->lock);
+        break;
+    default:
+        page = sf->mode == SRC_PAGE ? page_src : zero_src;
+        get_page(page);
+        break;
+    }
+    vmf->page = page;
+    return 0;
+}
+
+static const struct vm_operations_struct src_vm_ops = {
+    .fault = src_vm_fault,
+};
+
+static int my_mmap(struct file *f, struct vm_area_struct *vma)
+{
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    // Forbid a later mprotect(PROT_WRITE) as well
+    vm_flags_clear(vma, VM_MAYWRITE);
+    vma->vm_ops = &src_vm_ops;
+    return 0;
+}
+
+/* ---------- open / release ---------- */
+
+static int my_open(struct inode *inode, struct file *f)
+{
+    static atomic64_t opens = ATOMIC64_INIT(0);
+    struct src_file *sf;
+
+    sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+    if (!sf)
+        return -ENOMEM;
+
+    sf->mode = min_t(unsigned int, READ_ONCE(mode), SRC_NR_MODES - 1);
+    if (sf->mode == SRC_PATTERN || sf->mode == SRC_PRNG) {
+        sf->scratch = (u8 *)__get_free_page(GFP_KERNEL);
+        if (!sf->scratch) {
+            kfree(sf);
+            return -ENOMEM;
+        }
+    }
+    mutex_init(&sf->lock);
+    // distinct, reproducible stream per open; xorshift must not start at 0
+    sf->rng = (seed ^ (atomic64_inc_return(&opens) * 0xD1B54A32D192ED03ULL)) | 1;
+
+    f->private_data = sf;
+    return 0;
+}
+
+static int my_release(struct inode *inode, struct file *f)
+{
+    struct src_file *sf = f->private_data;
+
+    free_page((unsigned long)sf->scratch);
+    kfree(sf);
     return 0;
 }
 
 static struct file_operations fops = {
+    .owner = THIS_MODULE,
+    .open = my_open,
+    .release = my_release,
     .read = my_read,
+    .read_iter = my_read_iter,
+    .splice_read = my_splice_read,
+    .mmap = my_mmap,
+    .llseek = default_llseek,
 };
 
 static int __init my_init(void)
 {
-    major = register_chrdev(0, "hello_cdev", &fops);
+    u64 s = seed | 1;
+    int ret;
+
+    zero_src = alloc_page(GFP_KERNEL | __GFP_ZERO);
+    page_src = alloc_page(GFP_KERNEL);
+    if (!zero_src || !page_src) {
+        ret = -ENOMEM;
+        goto err_pages;
+    }
+    src_fill_prng(&s, page_address(page_src), PAGE_SIZE);
+
+    major = register_chrdev(0, DEVICE_NAME, &fops);
     if (major < 0) {
         printk("hello_cdev - Error registering chrdev\n");
-        return major;
+        ret = major;
+        goto err_pages;
     }
 
-    printk("hello_cdev - Major Device Number: %d\n", major);
+    src_class = class_create(DEVICE_NAME);
+    if (IS_ERR(src_class)) {
+        ret = PTR_ERR(src_class);
+        goto err_chrdev;
+    }
+
+    src_device = device_create(src_class, NULL, MKDEV(major, 0), NULL, DEVICE_NAME);
+    if (IS_ERR(src_device)) {
+        ret = PTR_ERR(src_device);
+        goto err_class;
+    }
+
+    printk("hello_cdev - Major Device Number: %d, data source on /dev/%s\n", major, DEVICE_NAME);
     return 0;
+
+err_class:
+    class_destroy(src_class);
+err_chrdev:
+    unregister_chrdev(major, DEVICE_NAME);
+err_pages:
+    if (page_src)
+        __free_page(page_src);
+    if (zero_src)
+        __free_page(zero_src);
+    return ret;
 }
 
 static void __exit my_exit(void)
 {
-    unregister_chrdev(major, "hello_cdev");
+    device_destroy(src_class, MKDEV(major, 0));
+    class_destroy(src_class);
+    unregister_chrdev(major, DEVICE_NAME);
+    // pipes may still hold references; the last one frees the page
+    put_page(page_src);
+    put_page(zero_src);
 }
 
 module_init(my_init);
@@ -0,0 +1,210 @@
+// KUnit suites of hello_cdev, the synthetic data source (see ../common/ktest.h)
+#include "hello_cdev.c"
+#include "../common/ktest.h"
+
+#define TEST_LEN    (3 * PAGE_SIZE + 17)
+
+static struct file *source_open(struct kunit *test, enum src_mode m)
+{
+    mode = m;
+    return ktest_open(test, "/dev/" DEVICE_NAME, O_RDONLY);
+}
+
+// Byte at offset o of the pattern stream
+static u8 pattern_byte(loff_t o)
+{
+    return (u64)(o & ~7ULL) >> (8 * (o & 7));
+}
+
+static void source_pattern_test(struct kunit *test)
+{
+    u8 buf[100];
+    loff_t pos;
+    int i;
+
+    // Unaligned at both ends
+    for (pos = 0; pos < 16; pos += 5) {
+        src_fill_pattern(buf, pos + 0x123456789, sizeof(buf));
+        for (i = 0; i < sizeof(buf); i++)
+            KUNIT_ASSERT_EQ_MSG(test, buf[i], pattern_byte(pos + 0x123456789 + i),
+                                "pos %lld byte %d", pos, i);
+    }
+}
+
+static void source_prng_test(struct kunit *test)
+{
+    u64 a = 42, b = 42, w0, w1;
+    u8 buf[13];
+
+    KUNIT_EXPECT_EQ(test, src_rng_next(&a), src_rng_next(&b));
+    KUNIT_EXPECT_NE(test, src_rng_next(&a), src_rng_next(&a));
+
+    // A tail shorter than a word takes the low bytes of the next output
+    a = b = 7;
+    src_fill_prng(&a, buf, sizeof(buf));
+    w0 = cpu_to_le64(src_rng_next(&b));
+    w1 = cpu_to_le64(src_rng_next(&b));
+    KUNIT_EXPECT_MEMEQ(test, buf, &w0, 8);
+    KUNIT_EXPECT_MEMEQ(test, buf + 8, &w1, 5);
+    KUNIT_EXPECT_EQ(test, a, b);
+}
+
+// read_iter through kernel_read(), in every mode, from an unaligned offset
+static void source_read_iter_test(struct kunit *test)
+{
+    u8 *buf = kunit_kmalloc(test, TEST_LEN, GFP_KERNEL);
+    const u8 *page;
+    struct file *f;
+    loff_t pos;
+    size_t i;
+
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+
+    f = source_open(test, SRC_ZERO);
+    pos = 5;
+    memset(buf, 0xff, TEST_LEN);
+    KUNIT_ASSERT_EQ(test, kernel_read(f, buf, TEST_LEN, &pos), (ssize_t)TEST_LEN);
+    KUNIT_EXPECT_EQ(test, pos, 5 + TEST_LEN);
+    KUNIT_EXPECT_NULL(test, memchr_inv(buf, 0, TEST_LEN));
+
+    f = source_open(test, SRC_PATTERN);
+    pos = 5;
+    KUNIT_ASSERT_EQ(test, kernel_read(f, buf, TEST_LEN, &pos), (ssize_t)TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++)
+        KUNIT_ASSERT_EQ_MSG(test, buf[i], pattern_byte(5 + i), "byte %zu", i);
+
+    f = source_open(test, SRC_PAGE);
+    page = page_address(page_src);
+    pos = 5;
+    KUNIT_ASSERT_EQ(test, kernel_read(f, buf, TEST_LEN, &pos), (ssize_t)TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++)
+        KUNIT_ASSERT_EQ_MSG(test, buf[i], page[(5 + i) % PAGE_SIZE], "byte %zu", i);
+}
+
+// Page-sized reads of a prng file continue one generator
+static void source_prng_stream_test(struct kunit *test)
+{
+    u8 *buf = kunit_kmalloc(test, 2 * PAGE_SIZE, GFP_KERNEL);
+    u8 *want = kunit_kmalloc(test, 2 * PAGE_SIZE, GFP_KERNEL);
+    struct src_file *sf;
+    struct file *f;
+    loff_t pos = 0;
+    u64 s;
+
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+    KUNIT_ASSERT_NOT_NULL(test, want);
+    f = source_open(test, SRC_PRNG);
+    sf = f->private_data;
+    s = sf->rng;
+    KUNIT_EXPECT_NE(test, s, 0);
+    src_fill_prng(&s, want, 2 * PAGE_SIZE);
+
+    KUNIT_ASSERT_EQ(test, kernel_read(f, buf, PAGE_SIZE, &pos), (ssize_t)PAGE_SIZE);
+    KUNIT_ASSERT_EQ(test, kernel_read(f, buf + PAGE_SIZE, PAGE_SIZE, &pos), (ssize_t)PAGE_SIZE);
+    KUNIT_EXPECT_MEMEQ(test, buf, want, 2 * PAGE_SIZE);
+
+    // Every open starts a different stream
+    f = source_open(test, SRC_PRNG);
+    KUNIT_EXPECT_NE(test, ((struct src_file *)f->private_data)->rng, sf->rng);
+}
+
+// .read into user memory, across a page boundary
+static void source_read_user_test(struct kunit *test)
+{
+    char __user *ubuf = ktest_user_buf(test, PAGE_SIZE);
+    struct file *f = source_open(test, SRC_PATTERN);
+    loff_t pos = PAGE_SIZE - 3;
+    u8 buf[11];
+    int i;
+
+    KUNIT_ASSERT_EQ(test, f->f_op->read(f, ubuf, sizeof(buf), &pos), (ssize_t)sizeof(buf));
+    KUNIT_EXPECT_EQ(test, pos, PAGE_SIZE - 3 + sizeof(buf));
+    KUNIT_ASSERT_EQ(test, copy_from_user(buf, ubuf, sizeof(buf)), 0);
+    for (i = 0; i < sizeof(buf); i++)
+        KUNIT_EXPECT_EQ(test, buf[i], pattern_byte(PAGE_SIZE - 3 + i));
+
+    // Nothing copied at all is -EFAULT
+    KUNIT_EXPECT_EQ(test, f->f_op->read(f, (char __user *)NULL + 16, 8, &pos), -EFAULT);
+}
+
+// Mappings fault in generated pages and refuse to become writable
+static void source_mmap_test(struct kunit *test)
+{
+    struct file *f = source_open(test, SRC_PATTERN);
+    unsigned long addr;
+    u8 buf[16];
+    int i;
+
+    addr = kunit_vm_mmap(test, f, 0, 2 * PAGE_SIZE, PROT_READ, MAP_SHARED, 0);
+    KUNIT_ASSERT_NE(test, addr, 0);
+    KUNIT_ASSERT_EQ(test, copy_from_user(buf, (void __user *)addr + PAGE_SIZE + 8, sizeof(buf)), 0);
+    for (i = 0; i < sizeof(buf); i++)
+        KUNIT_EXPECT_EQ(test, buf[i], pattern_byte(PAGE_SIZE + 8 + i));
+
+    KUNIT_EXPECT_EQ(test, kunit_vm_mmap(test, f, 0, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED, 0), 0);
+}
+
+static void source_exit(struct kunit *test)
+{
+    mode = SRC_ZERO;
+}
+
+static struct kunit_case source_cases[] = {
+    KUNIT_CASE(source_pattern_test),
+    KUNIT_CASE(source_prng_test),
+    KUNIT_CASE(source_read_iter_test),
+    KUNIT_CASE(source_prng_stream_test),
+    KUNIT_CASE(source_read_user_test),
+    KUNIT_CASE(source_mmap_test),
+    {}
+};
+
+static struct kunit_suite source_suite = {
+    .name = "hello_source",
+    .exit = source_exit,
+    .test_cases = source_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+// One page per read() into user memory, for each mode
+static void source_read_bench(struct kunit *test)
+{
+    static const char *const names[SRC_NR_MODES] = { "zero", "pattern", "prng", "page" };
+    char __user *ubuf = ktest_user_buf(test, PAGE_SIZE);
+    struct file *f;
+    loff_t pos;
+    int m;
+
+    for (m = 0; m < SRC_NR_MODES; m++) {
+        f = source_open(test, m);
+        pos = 0;
+        ktest_bench(test, names[m], f->f_op->read(f, ubuf, PAGE_SIZE, &pos));
+    }
+}
+
+static void source_open_bench(struct kunit *test)
+{
+    struct inode *inode = kunit_kzalloc(test, sizeof(*inode), GFP_KERNEL);
+    struct file *file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, inode);
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    mode = SRC_PATTERN;     // the costly open: a scratch page
+    ktest_bench(test, "pattern", my_open(inode, file); my_release(inode, file));
+}
+
+static struct kunit_case source_bench_cases[] = {
+    KUNIT_CASE_SLOW(source_read_bench),
+    KUNIT_CASE_SLOW(source_open_bench),
+    {}
+};
+
+static struct kunit_suite source_bench_suite = {
+    .name = "hello_source_bench",
+    .exit = source_exit,
+    .test_cases = source_bench_cases,
+};
+
+kunit_test_suites(&source_suite, &source_bench_suite);
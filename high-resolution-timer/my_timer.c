@@ -3,26 +3,684 @@
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
 #include <linux/jiffies.h>
+#include <linux/fs.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/timerqueue.h>
+#include <linux/xarray.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include "timer_service.h"
+#include "timer_page.h"
 
 static struct hrtimer my_hrtimer;
 u64 start_t;
 
+static unsigned int period_ms;
+module_param(period_ms, uint, 0444);
+MODULE_PARM_DESC(period_ms, "Re-arm my_hrtimer every period_ms (0 = fire once after 100 ms)");
+
+/*
+my_hrtimer's status lives in one zeroed page that user space maps read-only
+through /dev/timerstat (see timer_page.h). The handler is the only writer,
+so the seq counter alone is enough: no lock, and readers never enter the kernel.
+*/
+static struct timer_page *timer_page;
+
+/* ---------- Timer service tunables ---------- */
+static unsigned int ring_entries = 4096;
+module_param(ring_entries, uint, 0444);
+MODULE_PARM_DESC(ring_entries, "Expiry records buffered per open file (rounded up to a power of 2)");
+
+static unsigned long max_timers = 1 << 20;
+module_param(max_timers, ulong, 0644);
+MODULE_PARM_DESC(max_timers, "Maximum number of timers per open file");
+
+static unsigned long default_slack_ns;
+module_param(default_slack_ns, ulong, 0644);
+MODULE_PARM_DESC(default_slack_ns, "Slack applied to timers armed with slack_ns = 0");
+
+static unsigned long min_period_ns = 10000;
+module_param(min_period_ns, ulong, 0644);
+MODULE_PARM_DESC(min_period_ns, "Shortest period accepted for periodic timers");
+
+static unsigned int expire_batch = 4096;
+
+// 0 would let no timer expire and re-arm the hrtimer every microsecond
+static int expire_batch_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned int n;
+    int ret = kstrtouint(val, 0, &n);
+
+    if (ret)
+        return ret;
+    if (!n)
+        return -EINVAL;
+    return param_set_uint(val, kp);
+}
+
+static const struct kernel_param_ops expire_batch_ops = {
+    .set = expire_batch_set,
+    .get = param_get_uint,
+};
+module_param_cb(expire_batch, &expire_batch_ops, &expire_batch, 0644);
+MODULE_PARM_DESC(expire_batch, "Maximum expiries handled per hrtimer interrupt, at least 1");
+
+/*
+How the service is built:
+Every CPU owns one hrtimer and one ordered timer queue (struct timerqueue_head,
+an rbtree sorted by expiry that caches its leftmost node). A client timer is
+just a timerqueue_node linked into the queue of the CPU that armed it, so
+100k client timers still cost exactly one hrtimer per CPU. The per-CPU
+hrtimer is always programmed for the earliest entry of its queue; when it
+fires, the handler pops every due entry, queues an expiry record for the
+owning file and re-inserts periodic timers.
+
+Slack: a timer may fire anywhere in [expires, expires + slack]. The hrtimer
+is armed with that range for the whole queue, so due entries are collected
+into as few interrupts as possible and the hrtimer core is free to merge
+the interrupt with other timers on the CPU.
+*/
+#define TS_DEADLINE_SCAN   64              // queue entries examined when computing the hard deadline
+#define TS_RESCHED_NS      NSEC_PER_USEC   // back-off when one interrupt hit expire_batch
+#define TS_MAX_NS          (KTIME_MAX / 2) // keeps expires + slack / period from overflowing
+
+struct ts_cpu_base {
+    spinlock_t lock;                 // protects queue and deadline
+    struct timerqueue_head queue;
+    struct hrtimer timer;
+    ktime_t deadline;                // hard expiry the hrtimer is programmed for
+};
+
+static DEFINE_PER_CPU(struct ts_cpu_base, ts_bases);
+
+struct ts_ctx;
+
+struct ts_timer {
+    struct timerqueue_node node;     // node.expires is the next due time
+    struct ts_ctx *ctx;
+    u64 id;
+    u64 period_ns;
+    u64 slack_ns;
+    int cpu;                         // base the node lives on, -1 if never armed
+};
+
+/* One per open file of /dev/timersvc */
+struct ts_ctx {
+    struct mutex lock;               // serialises commands on this file
+    struct xarray timers;            // id -> struct ts_timer
+    unsigned long ntimers;
+    atomic_long_t armed;
+
+    struct mutex read_lock;          // kfifo allows a single reader at a time
+    spinlock_t fifo_lock;            // and a single writer: CPUs take turns
+    DECLARE_KFIFO_PTR(fifo, struct ts_expiry);
+    wait_queue_head_t wait;
+    u64 delivered;
+    u64 dropped;
+};
+
+static struct kmem_cache *ts_timer_cache;
+static int major;
+static struct class *ts_class;
+static struct device *ts_device;
+static struct device *tstat_device;
+
+/* Publish a new status record; readers retry while seq is odd */
+static void timer_page_update(u64 last_ns, u64 next_ns, u64 overruns)
+{
+    struct timer_page *page = timer_page;
+
+    WRITE_ONCE(page->seq, page->seq + 1);
+    smp_wmb();
+    WRITE_ONCE(page->expiry_count, page->expiry_count + 1);
+    WRITE_ONCE(page->last_expiry_ns, last_ns);
+    WRITE_ONCE(page->next_expiry_ns, next_ns);
+    WRITE_ONCE(page->overrun_count, page->overrun_count + overruns);
+    smp_wmb();
+    WRITE_ONCE(page->seq, page->seq + 1);
+}
+
 /* Timer handler */
 static enum hrtimer_restart test_hrtimer_handler(struct hrtimer *timer)
 {
     u64 now_t = jiffies;
-    printk(KERN_INFO "High-res timer fired! Elapsed = %u ms\n",
-           jiffies_to_msecs(now_t - start_t));
+    ktime_t now = hrtimer_cb_get_time(timer);
+    u64 overruns = 0;
+
+    if (!timer_page->expiry_count)
+        printk(KERN_INFO "High-res timer fired! Elapsed = %u ms\n",
+               jiffies_to_msecs(now_t - start_t));
+
+    if (!period_ms) {
+        // Do not restart timer (one-shot)
+        timer_page_update(ktime_to_ns(now), 0, 0);
+        return HRTIMER_NORESTART;
+    }
+
+    // hrtimer_forward_now() returns how many periods were consumed: more than one means we ran late
+    overruns = hrtimer_forward_now(timer, ms_to_ktime(period_ms)) - 1;
+    timer_page_update(ktime_to_ns(now), ktime_to_ns(hrtimer_get_expires(timer)), overruns);
+    return HRTIMER_RESTART;
+}
+
+/* ---------- Per-CPU queue handling ---------- */
+
+/*
+ * Latest moment the hrtimer may fire without making any queued timer
+ * later than expires + slack. The queue is sorted by expires, so the scan
+ * can stop at the first entry that is not due before the current bound.
+ */
+static ktime_t ts_base_deadline(struct timerqueue_node *head)
+{
+    struct rb_node *rb = &head->node;
+    ktime_t hard = KTIME_MAX;
+    int scan = TS_DEADLINE_SCAN;
+
+    while (rb) {
+        struct ts_timer *t = rb_entry(rb, struct ts_timer, node.node);
+
+        if (t->node.expires >= hard)
+            return hard;
+        if (!scan--)
+            return t->node.expires;  // unscanned entries: assume no slack
+        hard = min(hard, ktime_add_ns(t->node.expires, t->slack_ns));
+        rb = rb_next(rb);
+    }
+    return hard;
+}
+
+/* Called with base->lock held, on the CPU that owns the base */
+static void ts_base_program(struct ts_cpu_base *base)
+{
+    struct timerqueue_node *head = timerqueue_getnext(&base->queue);
+
+    if (!head) {
+        base->deadline = KTIME_MAX;  // a stale expiry finds an empty queue
+        return;
+    }
+    base->deadline = ts_base_deadline(head);
+    hrtimer_start_range_ns(&base->timer, head->expires,
+                           ktime_to_ns(ktime_sub(base->deadline, head->expires)),
+                           HRTIMER_MODE_ABS_PINNED);
+}
+
+/* Queue an expiry record for the timer's owner. Called with base->lock held. */
+static void ts_deliver(struct ts_timer *t, ktime_t now, u32 overruns)
+{
+    struct ts_ctx *ctx = t->ctx;
+    struct ts_expiry rec = {
+        .id = t->id,
+        .expires_ns = ktime_to_ns(t->node.expires),
+        .fired_ns = ktime_to_ns(now),
+        .overruns = overruns,
+    };
+
+    spin_lock(&ctx->fifo_lock);
+    if (kfifo_put(&ctx->fifo, rec))
+        ctx->delivered++;
+    else
+        ctx->dropped++;
+    spin_unlock(&ctx->fifo_lock);
+
+    /*
+     * A woken reader is removed from the waitqueue right away, so a burst
+     * of expiries for the same file costs one wakeup, not one per record.
+     */
+    if (wq_has_sleeper(&ctx->wait))
+        wake_up_interruptible_poll(&ctx->wait, EPOLLIN | EPOLLRDNORM);
+}
+
+static enum hrtimer_restart ts_base_expire(struct hrtimer *hrt)
+{
+    struct ts_cpu_base *base = container_of(hrt, struct ts_cpu_base, timer);
+    struct timerqueue_node *next;
+    ktime_t now = hrtimer_cb_get_time(hrt);
+    unsigned int budget = expire_batch;
+    enum hrtimer_restart ret = HRTIMER_NORESTART;
+    unsigned long flags;
+
+    spin_lock_irqsave(&base->lock, flags);
+    while ((next = timerqueue_getnext(&base->queue)) && next->expires <= now) {
+        struct ts_timer *t = container_of(next, struct ts_timer, node);
+        u32 overruns = 0;
+
+        if (!budget--) {
+            // Let the CPU breathe, then carry on with the backlog
+            base->deadline = ktime_add_ns(now, TS_RESCHED_NS);
+            hrtimer_set_expires(hrt, base->deadline);
+            spin_unlock_irqrestore(&base->lock, flags);
+            return HRTIMER_RESTART;
+        }
+
+        timerqueue_del(&base->queue, next);
+        if (t->period_ns) {
+            u64 late = ktime_to_ns(ktime_sub(now, next->expires));
+
+            overruns = div64_u64(late, t->period_ns);
+            ts_deliver(t, now, overruns);
+            next->expires = ktime_add_ns(next->expires,
+                                         (u64)(overruns + 1) * t->period_ns);
+            timerqueue_add(&base->queue, next);
+        } else {
+            ts_deliver(t, now, 0);
+            atomic_long_dec(&t->ctx->armed);
+        }
+    }
+
+    if (next) {
+        base->deadline = ts_base_deadline(next);
+        hrtimer_set_expires_range(hrt, next->expires,
+                                  ktime_sub(base->deadline, next->expires));
+        ret = HRTIMER_RESTART;
+    } else {
+        base->deadline = KTIME_MAX;
+    }
+    spin_unlock_irqrestore(&base->lock, flags);
+    return ret;
+}
+
+/* ---------- Timer commands ---------- */
+
+/*
+ * Take the timer off whatever queue it is on. The caller must own the
+ * timer exclusively: ctx->lock held, or ts_release() where no other user
+ * of the file is left.
+ */
+static void ts_disarm(struct ts_timer *t)
+{
+    struct ts_cpu_base *base;
+    unsigned long flags;
+
+    if (t->cpu < 0)
+        return;
+
+    /*
+     * Always take the lock, even if the node looks idle: once we hold it
+     * the expiry handler is done with this timer and its owner.
+     * A removed head is not worth reprogramming for, the next expiry
+     * simply finds nothing due and re-arms for the new head.
+     */
+    base = per_cpu_ptr(&ts_bases, t->cpu);
+    spin_lock_irqsave(&base->lock, flags);
+    if (timerqueue_node_queued(&t->node)) {
+        timerqueue_del(&base->queue, &t->node);
+        atomic_long_dec(&t->ctx->armed);
+    }
+    spin_unlock_irqrestore(&base->lock, flags);
+}
+
+static int ts_arm(struct ts_ctx *ctx, const struct ts_cmd *cmd)
+{
+    struct ts_cpu_base *base;
+    struct ts_timer *t;
+    unsigned long flags;
+    u64 expires;
+    int cpu, ret;
+
+    if (cmd->expires_ns > TS_MAX_NS || cmd->period_ns > TS_MAX_NS ||
+        cmd->slack_ns > TS_MAX_NS)
+        return -EINVAL;
+    if (cmd->period_ns && cmd->period_ns < min_period_ns)
+        return -EINVAL;
+
+    expires = cmd->expires_ns;
+    if (!(cmd->flags & TS_ARM_ABS))
+        expires += ktime_get_ns();
+    if (expires > TS_MAX_NS)
+        return -EINVAL;
+
+    t = xa_load(&ctx->timers, cmd->id);
+    if (t) {
+        ts_disarm(t);
+    } else {
+        if (ctx->ntimers >= max_timers)
+            return -ENOSPC;
+
+        t = kmem_cache_zalloc(ts_timer_cache, GFP_KERNEL);
+        if (!t)
+            return -ENOMEM;
+        timerqueue_init(&t->node);
+        t->ctx = ctx;
+        t->id = cmd->id;
+        t->cpu = -1;
+
+        ret = xa_err(xa_store(&ctx->timers, cmd->id, t, GFP_KERNEL));
+        if (ret) {
+            kmem_cache_free(ts_timer_cache, t);
+            return ret;
+        }
+        ctx->ntimers++;
+    }
+
+    t->period_ns = cmd->period_ns;
+    t->slack_ns = cmd->slack_ns ? cmd->slack_ns : default_slack_ns;
+    t->node.expires = ns_to_ktime(expires);
+
+    /* Queue on the local CPU, so the pinned hrtimer stays where it is */
+    cpu = get_cpu();
+    base = per_cpu_ptr(&ts_bases, cpu);
+    spin_lock_irqsave(&base->lock, flags);
+    t->cpu = cpu;
+    atomic_long_inc(&ctx->armed);
+    if (timerqueue_add(&base->queue, &t->node) ||
+        ktime_add_ns(t->node.expires, t->slack_ns) < base->deadline)
+        ts_base_program(base);
+    spin_unlock_irqrestore(&base->lock, flags);
+    put_cpu();
+
+    return 0;
+}
+
+static int ts_do_cmd(struct ts_ctx *ctx, const struct ts_cmd *cmd)
+{
+    struct ts_timer *t;
+
+    if (!cmd->id || cmd->id > ULONG_MAX)
+        return -EINVAL;
 
-    // Do not restart timer (one-shot)
-    return HRTIMER_NORESTART;
+    switch (cmd->op) {
+    case TS_OP_ARM:
+        return ts_arm(ctx, cmd);
+
+    case TS_OP_CANCEL:
+        t = xa_load(&ctx->timers, cmd->id);
+        if (!t)
+            return -ENOENT;
+        ts_disarm(t);
+        return 0;
+
+    case TS_OP_DELETE:
+        t = xa_erase(&ctx->timers, cmd->id);
+        if (!t)
+            return -ENOENT;
+        ts_disarm(t);
+        kmem_cache_free(ts_timer_cache, t);
+        ctx->ntimers--;
+        return 0;
+
+    default:
+        return -EINVAL;
+    }
+}
+
+/* ---------- File operations ---------- */
+
+static int ts_open(struct inode *inode, struct file *file)
+{
+    struct ts_ctx *ctx;
+    int ret;
+
+    ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+    if (!ctx)
+        return -ENOMEM;
+
+    ret = kfifo_alloc(&ctx->fifo, ring_entries, GFP_KERNEL);
+    if (ret) {
+        kfree(ctx);
+        return ret;
+    }
+
+    mutex_init(&ctx->lock);
+    mutex_init(&ctx->read_lock);
+    spin_lock_init(&ctx->fifo_lock);
+    xa_init(&ctx->timers);
+    atomic_long_set(&ctx->armed, 0);
+    init_waitqueue_head(&ctx->wait);
+
+    file->private_data = ctx;
+    return stream_open(inode, file);
+}
+
+static int ts_release(struct inode *inode, struct file *file)
+{
+    struct ts_ctx *ctx = file->private_data;
+    struct ts_timer *t;
+    unsigned long id;
+
+    /* After every timer is off its queue no expiry handler can see ctx */
+    xa_for_each(&ctx->timers, id, t) {
+        ts_disarm(t);
+        kmem_cache_free(ts_timer_cache, t);
+    }
+    xa_destroy(&ctx->timers);
+    kfifo_free(&ctx->fifo);
+    kfree(ctx);
+    return 0;
+}
+
+/*
+ * write() takes an array of struct ts_cmd. Commands run in order and the
+ * call stops at the first failure: the return value is then the number of
+ * bytes consumed so far, or the error if the very first command failed.
+ */
+static ssize_t ts_write(struct file *file, const char __user *buf, size_t len, loff_t *offset)
+{
+    struct ts_ctx *ctx = file->private_data;
+    size_t done = 0;
+    struct ts_cmd cmd;
+    int ret = 0;
+
+    if (len < sizeof(cmd))
+        return -EINVAL;
+
+    mutex_lock(&ctx->lock);
+    while (len - done >= sizeof(cmd)) {
+        if (copy_from_user(&cmd, buf + done, sizeof(cmd))) {
+            ret = -EFAULT;
+            break;
+        }
+        ret = ts_do_cmd(ctx, &cmd);
+        if (ret)
+            break;
+        done += sizeof(cmd);
+        cond_resched();
+    }
+    mutex_unlock(&ctx->lock);
+
+    return done ? done : ret;
+}
+
+static ssize_t ts_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+{
+    struct ts_ctx *ctx = file->private_data;
+    unsigned int copied;
+    int ret;
+
+    if (len < sizeof(struct ts_expiry))
+        return -EINVAL;
+    len = rounddown(len, sizeof(struct ts_expiry));
+
+    if (mutex_lock_interruptible(&ctx->read_lock))
+        return -ERESTARTSYS;
+
+    while (kfifo_is_empty(&ctx->fifo)) {
+        mutex_unlock(&ctx->read_lock);
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        if (wait_event_interruptible(ctx->wait, !kfifo_is_empty(&ctx->fifo)))
+            return -ERESTARTSYS;
+        if (mutex_lock_interruptible(&ctx->read_lock))
+            return -ERESTARTSYS;
+    }
+
+    ret = kfifo_to_user(&ctx->fifo, buf, len, &copied);
+    mutex_unlock(&ctx->read_lock);
+
+    return ret ? ret : copied;
+}
+
+static __poll_t ts_poll(struct file *file, poll_table *wait)
+{
+    struct ts_ctx *ctx = file->private_data;
+
+    poll_wait(file, &ctx->wait, wait);
+    if (!kfifo_is_empty(&ctx->fifo))
+        return EPOLLIN | EPOLLRDNORM;
+    return EPOLLOUT | EPOLLWRNORM;
+}
+
+static long ts_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct ts_ctx *ctx = file->private_data;
+    struct ts_stats stats;
+    struct ts_cmd tc;
+    int ret;
+
+    switch (cmd) {
+    case TS_IOC_CMD:
+        if (copy_from_user(&tc, (void __user *)arg, sizeof(tc)))
+            return -EFAULT;
+        mutex_lock(&ctx->lock);
+        ret = ts_do_cmd(ctx, &tc);
+        mutex_unlock(&ctx->lock);
+        return ret;
+
+    case TS_IOC_GET_STATS:
+        mutex_lock(&ctx->lock);
+        stats.timers = ctx->ntimers;
+        mutex_unlock(&ctx->lock);
+        stats.armed = atomic_long_read(&ctx->armed);
+        spin_lock_irq(&ctx->fifo_lock);
+        stats.delivered = ctx->delivered;
+        stats.dropped = ctx->dropped;
+        spin_unlock_irq(&ctx->fifo_lock);
+        if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+            return -EFAULT;
+        return 0;
+
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* ---------- /dev/timerstat ---------- */
+
+static int tstat_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    // Forbid a later mprotect(PROT_WRITE) as well
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_pfn_range(vma, vma->vm_start, virt_to_phys(timer_page) >> PAGE_SHIFT,
+                           PAGE_SIZE, vma->vm_page_prot);
+}
+
+static int tstat_open(struct inode *inode, struct file *file)
+{
+    if (file->f_mode & FMODE_WRITE)
+        return -EPERM;
+    return 0;
+}
+
+static const struct file_operations tstat_fops = {
+    .owner = THIS_MODULE,
+    .open = tstat_open,
+    .mmap = tstat_mmap,
+};
+
+/*
+ * Minor 0 is the timer service, minor 1 the status page. replace_fops()
+ * drops the module reference of the old fops, so the new ones need their
+ * own, as misc_open() does: it keeps the module pinned while the status
+ * page is open or mapped.
+ */
+static int my_timer_open(struct inode *inode, struct file *file)
+{
+    if (iminor(inode) == 1) {
+        replace_fops(file, fops_get(&tstat_fops));
+        return tstat_open(inode, file);
+    }
+    return ts_open(inode, file);
+}
+
+static struct file_operations fops = {
+    .owner = THIS_MODULE,
+    .open = my_timer_open,
+    .release = ts_release,
+    .read = ts_read,
+    .write = ts_write,
+    .poll = ts_poll,
+    .unlocked_ioctl = ts_ioctl,
+};
+
+static void ts_bases_init(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct ts_cpu_base *base = per_cpu_ptr(&ts_bases, cpu);
+
+        spin_lock_init(&base->lock);
+        timerqueue_init_head(&base->queue);
+        hrtimer_init(&base->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_PINNED);
+        base->timer.function = ts_base_expire;
+        base->deadline = KTIME_MAX;
+    }
+}
+
+static void ts_bases_exit(void)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        hrtimer_cancel(&per_cpu_ptr(&ts_bases, cpu)->timer);
 }
 
 /* Init function (called when module is loaded) */
 static int __init ModuleInit(void)
 {
+    int ret;
+
     printk(KERN_INFO "Hello, Kernel! Starting high-res timer...\n");
 
+    /* Set up the timer service before the device node becomes visible */
+    ring_entries = roundup_pow_of_two(max(ring_entries, 2U));
+    ts_timer_cache = KMEM_CACHE(ts_timer, 0);
+    if (!ts_timer_cache)
+        return -ENOMEM;
+    ts_bases_init();
+
+    major = register_chrdev(0, TIMERSVC_DEVICE_NAME, &fops);
+    if (major < 0) {
+        printk(KERN_ALERT "my_timer: Failed to register device\n");
+        ret = major;
+        goto err_cache;
+    }
+
+    ts_class = class_create(TIMERSVC_DEVICE_NAME);
+    if (IS_ERR(ts_class)) {
+        ret = PTR_ERR(ts_class);
+        goto err_chrdev;
+    }
+
+    ts_device = device_create(ts_class, NULL, MKDEV(major, 0), NULL, TIMERSVC_DEVICE_NAME);
+    if (IS_ERR(ts_device)) {
+        ret = PTR_ERR(ts_device);
+        goto err_class;
+    }
+
+    timer_page = (struct timer_page *)get_zeroed_page(GFP_KERNEL);
+    if (!timer_page) {
+        ret = -ENOMEM;
+        goto err_device;
+    }
+    timer_page->period_ms = period_ms;
+
+    tstat_device = device_create(ts_class, NULL, MKDEV(major, 1), NULL, TIMERSTAT_DEVICE_NAME);
+    if (IS_ERR(tstat_device)) {
+        ret = PTR_ERR(tstat_device);
+        goto err_page;
+    }
+
     /* Init high-resolution timer */
     hrtimer_init(&my_hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
     my_hrtimer.function = &test_hrtimer_handler;
@@ -30,16 +688,41 @@ static int __init ModuleInit(void)
     /* Save start time */
     start_t = jiffies;
 
-    /* Start timer: 100 ms */
+    /* Start timer: 100 ms, then every period_ms if set */
+    timer_page->next_expiry_ns = ktime_get_ns() + 100 * NSEC_PER_MSEC;
     hrtimer_start(&my_hrtimer, ms_to_ktime(100), HRTIMER_MODE_REL);
 
+    printk(KERN_INFO "my_timer: timer service ready on /dev/%s, status page on /dev/%s (major=%d)\n",
+           TIMERSVC_DEVICE_NAME, TIMERSTAT_DEVICE_NAME, major);
     return 0;
+
+err_page:
+    free_page((unsigned long)timer_page);
+err_device:
+    device_destroy(ts_class, MKDEV(major, 0));
+err_class:
+    class_destroy(ts_class);
+err_chrdev:
+    unregister_chrdev(major, TIMERSVC_DEVICE_NAME);
+err_cache:
+    kmem_cache_destroy(ts_timer_cache);
+    return ret;
 }
 
 /* Exit function (called when module is removed) */
 static void __exit ModuleExit(void)
 {
     hrtimer_cancel(&my_hrtimer);
+
+    /* No file can be open or mapped any more, so every queue is already empty */
+    device_destroy(ts_class, MKDEV(major, 1));
+    free_page((unsigned long)timer_page);
+    device_destroy(ts_class, MKDEV(major, 0));
+    class_destroy(ts_class);
+    unregister_chrdev(major, TIMERSVC_DEVICE_NAME);
+    ts_bases_exit();
+    kmem_cache_destroy(ts_timer_cache);
+
     printk(KERN_INFO "Goodbye, Kernel! High-res timer canceled.\n");
 }
 
@@ -48,5 +731,5 @@ module_exit(ModuleExit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Muhammad Ali Hussnain");
-MODULE_DESCRIPTION("A simple Linux kernel module using high-resolution timers");
-MODULE_VERSION("1.0");
+MODULE_DESCRIPTION("High-resolution timers and a multiplexed timer service device");
+MODULE_VERSION("1.1");
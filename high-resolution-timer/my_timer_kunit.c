@@ -0,0 +1,201 @@
+// KUnit suites of the timer service (see ../common/ktest.h)
+#include "my_timer.c"
+#include "../common/ktest.h"
+
+static void ts_test_close(void *file)
+{
+    ts_release(NULL, file);
+}
+
+// An open file of /dev/timersvc, released when the test ends with whatever it still has armed
+static struct file *ts_test_open(struct kunit *test, unsigned int f_flags)
+{
+    struct file *file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    file->f_flags = f_flags;
+    KUNIT_ASSERT_EQ(test, ts_open(NULL, file), 0);
+    KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, ts_test_close, file), 0);
+    return file;
+}
+
+// One command, as TS_IOC_CMD runs it
+static int ts_test_cmd(struct file *file, u32 op, u64 id, u64 expires_ns, u64 period_ns)
+{
+    struct ts_ctx *ctx = file->private_data;
+    struct ts_cmd cmd = {
+        .op = op, .id = id, .expires_ns = expires_ns, .period_ns = period_ns,
+    };
+    int ret;
+
+    mutex_lock(&ctx->lock);
+    ret = ts_do_cmd(ctx, &cmd);
+    mutex_unlock(&ctx->lock);
+    return ret;
+}
+
+// Blocking read of exactly nr records
+static void ts_test_read(struct kunit *test, struct file *file, struct ts_expiry *rec, int nr)
+{
+    struct ts_expiry __user *ubuf = ktest_user_buf(test, nr * sizeof(*rec));
+    ssize_t got = 0, n;
+
+    while (got < nr * sizeof(*rec)) {
+        n = ts_read(file, (char __user *)ubuf + got, nr * sizeof(*rec) - got, NULL);
+        KUNIT_ASSERT_GT(test, n, 0);
+        got += n;
+    }
+    KUNIT_ASSERT_EQ(test, copy_from_user(rec, ubuf, nr * sizeof(*rec)), 0);
+}
+
+static void ts_cmd_test(struct kunit *test)
+{
+    struct file *f = ts_test_open(test, O_NONBLOCK);
+    struct ts_ctx *ctx = f->private_data;
+
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 0, NSEC_PER_SEC, 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, 9, 1, NSEC_PER_SEC, 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 1, TS_MAX_NS + 1, 0), -EINVAL);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 1, NSEC_PER_SEC, min_period_ns - 1), -EINVAL);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_CANCEL, 1, 0, 0), -ENOENT);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_DELETE, 1, 0, 0), -ENOENT);
+
+    // Re-arming an id moves the one timer; cancel keeps it, delete forgets it
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 1, 10 * NSEC_PER_SEC, 0), 0);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 1, 20 * NSEC_PER_SEC, 0), 0);
+    KUNIT_EXPECT_EQ(test, ctx->ntimers, 1);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&ctx->armed), 1);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_CANCEL, 1, 0, 0), 0);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&ctx->armed), 0);
+    KUNIT_EXPECT_EQ(test, ctx->ntimers, 1);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_DELETE, 1, 0, 0), 0);
+    KUNIT_EXPECT_EQ(test, ctx->ntimers, 0);
+
+    // Armed timers are left for release to clean up
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 2, 10 * NSEC_PER_SEC, 0), 0);
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 3, 10 * NSEC_PER_SEC, NSEC_PER_SEC), 0);
+}
+
+static void ts_read_test(struct kunit *test)
+{
+    struct file *f = ts_test_open(test, O_NONBLOCK);
+    char __user *ubuf = ktest_user_buf(test, sizeof(struct ts_expiry));
+
+    KUNIT_EXPECT_EQ(test, ts_read(f, ubuf, sizeof(struct ts_expiry) - 1, NULL), -EINVAL);
+    KUNIT_EXPECT_EQ(test, ts_read(f, ubuf, sizeof(struct ts_expiry), NULL), -EAGAIN);
+    KUNIT_EXPECT_EQ(test, ts_poll(f, NULL), EPOLLOUT | EPOLLWRNORM);
+}
+
+// One-shots fire once each, in expiry order, never early
+static void ts_oneshot_test(struct kunit *test)
+{
+    struct file *f = ts_test_open(test, 0);
+    struct ts_ctx *ctx = f->private_data;
+    struct ts_expiry rec[4];
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(rec); i++)
+        KUNIT_ASSERT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 10 + i,
+                                          (ARRAY_SIZE(rec) - i) * 10 * NSEC_PER_MSEC, 0), 0);
+    ts_test_read(test, f, rec, ARRAY_SIZE(rec));
+    for (i = 0; i < ARRAY_SIZE(rec); i++) {
+        KUNIT_EXPECT_EQ(test, rec[i].id, 10 + ARRAY_SIZE(rec) - 1 - i);
+        KUNIT_EXPECT_GE(test, rec[i].fired_ns, rec[i].expires_ns);
+        KUNIT_EXPECT_EQ(test, rec[i].overruns, 0);
+    }
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&ctx->armed), 0);
+    KUNIT_EXPECT_EQ(test, ctx->delivered, ARRAY_SIZE(rec));
+}
+
+// A periodic timer keeps its phase: each record is whole periods after the last
+static void ts_periodic_test(struct kunit *test)
+{
+    struct file *f = ts_test_open(test, 0);
+    struct ts_expiry rec[3];
+    u64 period = 2 * NSEC_PER_MSEC;
+    int i;
+
+    KUNIT_ASSERT_EQ(test, ts_test_cmd(f, TS_OP_ARM, 7, period, period), 0);
+    ts_test_read(test, f, rec, ARRAY_SIZE(rec));
+    KUNIT_EXPECT_EQ(test, ts_test_cmd(f, TS_OP_DELETE, 7, 0, 0), 0);
+    for (i = 1; i < ARRAY_SIZE(rec); i++)
+        KUNIT_EXPECT_EQ(test, rec[i].expires_ns - rec[i - 1].expires_ns,
+                        (u64)(rec[i].overruns + 1) * period);
+}
+
+// The hrtimer may wait for the tightest expires + slack among the entries due first
+static void ts_deadline_test(struct kunit *test)
+{
+    static const u64 expires[] = { 100, 200, 300, 400 };
+    static const u64 slack[] = { 500, 50, 0, 0 };
+    struct timerqueue_head q;
+    struct ts_timer *t;
+    int i;
+
+    t = kunit_kcalloc(test, ARRAY_SIZE(expires), sizeof(*t), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, t);
+    timerqueue_init_head(&q);
+    for (i = 0; i < ARRAY_SIZE(expires); i++) {
+        timerqueue_init(&t[i].node);
+        t[i].node.expires = expires[i];
+        t[i].slack_ns = slack[i];
+        timerqueue_add(&q, &t[i].node);
+    }
+    KUNIT_EXPECT_EQ(test, ts_base_deadline(timerqueue_getnext(&q)), 250);
+
+    // No slack anywhere: the head's expiry
+    t[0].slack_ns = 0;
+    KUNIT_EXPECT_EQ(test, ts_base_deadline(timerqueue_getnext(&q)), 100);
+}
+
+static struct kunit_case ts_cases[] = {
+    KUNIT_CASE(ts_cmd_test),
+    KUNIT_CASE(ts_read_test),
+    KUNIT_CASE(ts_oneshot_test),
+    KUNIT_CASE(ts_periodic_test),
+    KUNIT_CASE(ts_deadline_test),
+    {}
+};
+
+static struct kunit_suite ts_suite = {
+    .name = "timersvc",
+    .test_cases = ts_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+/*
+Re-arming one timer far in the future, with an empty queue and behind
+10000 others: the rbtree insert and, for a new head, the hrtimer
+reprogram. Timers on other CPUs are not in the way, so the queue is
+filled from this CPU.
+*/
+static void ts_arm_bench(struct kunit *test)
+{
+    struct file *f = ts_test_open(test, 0);
+    u64 far = 1000 * NSEC_PER_SEC;
+    int i;
+
+    ktest_bench(test, "re-arm", ts_test_cmd(f, TS_OP_ARM, 1, far, 0));
+    ktest_bench(test, "arm + cancel", ts_test_cmd(f, TS_OP_ARM, 1, far, 0);
+                                      ts_test_cmd(f, TS_OP_CANCEL, 1, 0, 0));
+
+    migrate_disable();
+    for (i = 0; i < 10000; i++)
+        ts_test_cmd(f, TS_OP_ARM, 100 + i, far + i * NSEC_PER_USEC, 0);
+    ktest_bench(test, "re-arm, 10000 queued",
+                ts_test_cmd(f, TS_OP_ARM, 1, far + 5000 * NSEC_PER_USEC, 0));
+    migrate_enable();
+}
+
+static struct kunit_case ts_bench_cases[] = {
+    KUNIT_CASE_SLOW(ts_arm_bench),
+    {}
+};
+
+static struct kunit_suite ts_bench_suite = {
+    .name = "timersvc_bench",
+    .test_cases = ts_bench_cases,
+};
+
+kunit_test_suites(&ts_suite, &ts_bench_suite);
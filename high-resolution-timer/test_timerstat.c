@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "timer_page.h"
+
+#define DEVICE "/dev/" TIMERSTAT_DEVICE_NAME
+
+/*
+ * Usage: ./test_timerstat [samples] [interval_us]
+ * Maps the status page of my_hrtimer once and then samples it without any
+ * further system calls apart from the usleep() between prints.
+ */
+int main(int argc, char *argv[])
+{
+    int samples = argc > 1 ? atoi(argv[1]) : 10;
+    int interval = argc > 2 ? atoi(argv[2]) : 100000;
+    const struct timer_page *page;
+    struct timer_page snap;
+    int fd, i;
+
+    fd = open(DEVICE, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        perror("mmap failed");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    close(fd);   // the mapping keeps the page alive
+
+    for (i = 0; i < samples; i++) {
+        timer_page_read(page, &snap);
+        printf("seq=%u period=%u ms expiries=%llu last=%llu next=%llu overruns=%llu\n",
+               snap.seq, snap.period_ms,
+               (unsigned long long)snap.expiry_count,
+               (unsigned long long)snap.last_expiry_ns,
+               (unsigned long long)snap.next_expiry_ns,
+               (unsigned long long)snap.overrun_count);
+        usleep(interval);
+    }
+
+    munmap((void *)page, sizeof(*page));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "timer_service.h"
+
+#define DEVICE "/dev/" TIMERSVC_DEVICE_NAME
+#define BATCH  1024   // records per read() and commands per write()
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Usage: ./test_timersvc [timers] [period_ms] [slack_us] [seconds]
+ * Arms <timers> periodic timers with one write() per BATCH commands and
+ * then drains the expiry stream, reporting records per read() and lateness.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned long timers  = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+    unsigned long period  = argc > 2 ? strtoul(argv[2], NULL, 0) : 100;
+    unsigned long slack   = argc > 3 ? strtoul(argv[3], NULL, 0) : 1000;
+    unsigned long seconds = argc > 4 ? strtoul(argv[4], NULL, 0) : 5;
+    static struct ts_cmd cmds[BATCH];
+    static struct ts_expiry recs[BATCH];
+    uint64_t records = 0, reads = 0, late_sum = 0, late_max = 0, end;
+    struct ts_stats stats;
+    struct pollfd pfd;
+    unsigned long i;
+    int fd;
+
+    fd = open(DEVICE, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    // Arm all timers, spreading the first expiry over one period
+    for (i = 0; i < timers; ) {
+        unsigned long n = 0;
+
+        for (; n < BATCH && i < timers; n++, i++) {
+            memset(&cmds[n], 0, sizeof(cmds[n]));
+            cmds[n].op = TS_OP_ARM;
+            cmds[n].id = i + 1;
+            cmds[n].expires_ns = period * 1000000ull * (i + 1) / timers;
+            cmds[n].period_ns = period * 1000000ull;
+            cmds[n].slack_ns = slack * 1000ull;
+        }
+        if (write(fd, cmds, n * sizeof(cmds[0])) != (ssize_t)(n * sizeof(cmds[0]))) {
+            perror("write failed");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("Armed %lu timers (period %lu ms, slack %lu us)\n", timers, period, slack);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    end = now_ns() + seconds * 1000000000ull;
+
+    while (now_ns() < end) {
+        ssize_t len;
+
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+
+        len = read(fd, recs, sizeof(recs));
+        if (len < 0) {
+            perror("read failed");
+            break;
+        }
+
+        reads++;
+        for (i = 0; i < (unsigned long)len / sizeof(recs[0]); i++) {
+            uint64_t late = recs[i].fired_ns - recs[i].expires_ns;
+
+            late_sum += late;
+            if (late > late_max)
+                late_max = late;
+            records++;
+        }
+    }
+
+    if (ioctl(fd, TS_IOC_GET_STATS, &stats) == 0)
+        printf("Kernel: timers=%llu armed=%llu delivered=%llu dropped=%llu\n",
+               (unsigned long long)stats.timers, (unsigned long long)stats.armed,
+               (unsigned long long)stats.delivered, (unsigned long long)stats.dropped);
+
+    printf("%llu expiries in %llu reads (%.1f per read)\n",
+           (unsigned long long)records, (unsigned long long)reads,
+           reads ? (double)records / reads : 0.0);
+    if (records)
+        printf("Lateness: avg %.1f us, max %.1f us\n",
+               late_sum / 1000.0 / records, late_max / 1000.0);
+
+    close(fd);   // releases every timer owned by this file
+    return EXIT_SUCCESS;
+}
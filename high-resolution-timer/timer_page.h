@@ -0,0 +1,68 @@
+#ifndef TIMER_PAGE_H
+#define TIMER_PAGE_H
+
+/*
+ * Read-only status page of my_hrtimer, exported by the my_timer module
+ * through mmap() of /dev/timerstat.
+ *
+ * The timer handler is the only writer. It bumps seq to an odd value,
+ * updates the fields and bumps seq back to even, so a reader that sees the
+ * same even seq before and after copying the fields has a consistent
+ * snapshot. Times are CLOCK_MONOTONIC nanoseconds.
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+#endif
+
+#define TIMERSTAT_DEVICE_NAME "timerstat"
+
+struct timer_page {
+    __u32 seq;
+    __u32 period_ms;       /* 0 = one-shot                              */
+    __u64 expiry_count;
+    __u64 last_expiry_ns;
+    __u64 next_expiry_ns;  /* 0 = not armed                             */
+    __u64 overrun_count;   /* periods missed because the handler was late */
+};
+
+#ifndef __KERNEL__
+/*
+ * Lockless snapshot, no syscall involved:
+ *
+ *     int fd = open("/dev/timerstat", O_RDONLY);
+ *     const struct timer_page *page =
+ *         mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+ *     struct timer_page snap;
+ *     timer_page_read(page, &snap);
+ */
+static inline void timer_page_read(const struct timer_page *page, struct timer_page *snap)
+{
+    __u32 seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            /* update in progress, it only takes a few stores */
+            continue;
+        }
+
+        snap->period_ms      = __atomic_load_n(&page->period_ms, __ATOMIC_RELAXED);
+        snap->expiry_count   = __atomic_load_n(&page->expiry_count, __ATOMIC_RELAXED);
+        snap->last_expiry_ns = __atomic_load_n(&page->last_expiry_ns, __ATOMIC_RELAXED);
+        snap->next_expiry_ns = __atomic_load_n(&page->next_expiry_ns, __ATOMIC_RELAXED);
+        snap->overrun_count  = __atomic_load_n(&page->overrun_count, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+            break;
+    }
+    snap->seq = seq;
+}
+#endif
+
+#endif // TIMER_PAGE_H
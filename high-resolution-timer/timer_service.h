@@ -0,0 +1,66 @@
+#ifndef TIMER_SERVICE_H
+#define TIMER_SERVICE_H
+
+/*
+ * Shared between the my_timer kernel module and user-space clients.
+ *
+ * A client opens /dev/timersvc and drives any number of timers by
+ * submitting struct ts_cmd records, either one at a time through
+ * TS_IOC_CMD or in batches through write().  Timer ids are chosen by the
+ * client (any non-zero value), so a batch never needs a reply channel.
+ * Expirations come back as struct ts_expiry records through read()/poll().
+ *
+ * All times are CLOCK_MONOTONIC nanoseconds, the same clock user space
+ * gets from clock_gettime(CLOCK_MONOTONIC, ...).
+ */
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#else
+#include <stdint.h>
+#include <sys/ioctl.h>
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+#endif
+
+#define TIMERSVC_DEVICE_NAME "timersvc"
+#define TIMERSVC_IOCTL_MAGIC 'T'
+
+/* ts_cmd.op */
+#define TS_OP_ARM     1   /* create the timer if needed, then (re)arm it */
+#define TS_OP_CANCEL  2   /* disarm, keep the id for a later TS_OP_ARM  */
+#define TS_OP_DELETE  3   /* disarm and forget the id                    */
+
+/* ts_cmd.flags */
+#define TS_ARM_ABS    0x1 /* expires_ns is absolute, otherwise relative  */
+
+struct ts_cmd {
+    __u32 op;
+    __u32 flags;
+    __u64 id;          /* client chosen, must be non-zero               */
+    __u64 expires_ns;  /* first expiry                                  */
+    __u64 period_ns;   /* 0 = one-shot                                  */
+    __u64 slack_ns;    /* allowed lateness, 0 = module default          */
+};
+
+/* One record per expiry, returned by read() */
+struct ts_expiry {
+    __u64 id;
+    __u64 expires_ns;  /* when the timer was due                        */
+    __u64 fired_ns;    /* when the service actually ran it              */
+    __u32 overruns;    /* periods skipped since the previous record     */
+    __u32 reserved;
+};
+
+struct ts_stats {
+    __u64 timers;      /* timers owned by this file                     */
+    __u64 armed;       /* of which currently queued                     */
+    __u64 delivered;   /* records queued for read()                     */
+    __u64 dropped;     /* records lost because the ring was full        */
+};
+
+#define TS_IOC_CMD       _IOW(TIMERSVC_IOCTL_MAGIC, 0, struct ts_cmd)
+#define TS_IOC_GET_STATS _IOR(TIMERSVC_IOCTL_MAGIC, 1, struct ts_stats)
+
+#endif // TIMER_SERVICE_H
@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/mount.h>
+#include <sys/reboot.h>
+#include <sys/syscall.h>
+
+#define KUNIT_DIR   "/sys/kernel/debug/kunit"
+#define MAX_SUITES  256
+
+/*
+ * Usage: built statically as /init of the guest's initramfs (run-qemu.sh)
+ * Loads each test module listed in /modules/list, one line
+ *
+ *     <path of the .ko> [module parameters]
+ *
+ * at a time. The suites run while the module loads; their results are
+ * then read from debugfs, and the module is unloaded before the next one
+ * is loaded, since several of them register the same devices. All results
+ * are printed at the end as one KTAP document, which kunit.py parse reads
+ * from the serial console. Then the guest powers off.
+ */
+
+static char *suites[MAX_SUITES];
+static int nr_suites;
+static int nr_builtin;          // suites of the kernel itself, not reported
+
+static int known_suite(const char *name)
+{
+    int i;
+
+    for (i = 0; i < nr_suites; i++)
+        if (!strcmp(suites[i], name))
+            return 1;
+    return 0;
+}
+
+/*
+ * Appends the results file of every suite not seen before to out. Each
+ * file ends in "ok 1 <suite>" or "not ok 1 <suite>"; the 1 becomes the
+ * suite's number in the whole run.
+ */
+static void collect(FILE *out)
+{
+    char path[512], line[1024];
+    struct dirent *de;
+    DIR *dir;
+    FILE *f;
+    int nr;
+
+    dir = opendir(KUNIT_DIR);
+    if (!dir) {
+        perror("opendir " KUNIT_DIR);
+        return;
+    }
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] == '.' || known_suite(de->d_name) || nr_suites == MAX_SUITES)
+            continue;
+        suites[nr_suites++] = strdup(de->d_name);
+        nr = nr_suites - nr_builtin;
+
+        snprintf(path, sizeof(path), KUNIT_DIR "/%s/results", de->d_name);
+        f = fopen(path, "r");
+        if (!f) {
+            fprintf(out, "not ok %d %s # cannot read results\n", nr, de->d_name);
+            continue;
+        }
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, "ok 1 ", 5))
+                fprintf(out, "ok %d %s", nr, line + 5);
+            else if (!strncmp(line, "not ok 1 ", 9))
+                fprintf(out, "not ok %d %s", nr, line + 9);
+            else
+                fputs(line, out);
+        }
+        fclose(f);
+    }
+    closedir(dir);
+}
+
+/* Module name from its path: basename without .ko, dashes as underscores */
+static void module_name(const char *path, char *name, size_t len)
+{
+    const char *base = strrchr(path, '/');
+    char *p;
+
+    snprintf(name, len, "%s", base ? base + 1 : path);
+    p = strstr(name, ".ko");
+    if (p)
+        *p = '\0';
+    for (p = name; *p; p++)
+        if (*p == '-')
+            *p = '_';
+}
+
+static void run_module(char *line, FILE *out)
+{
+    char *path = line, *params, name[1024];
+    int fd;
+
+    line[strcspn(line, "\n")] = '\0';
+    if (!*line || *line == '#')
+        return;
+    params = strchr(line, ' ');
+    if (params)
+        *params++ = '\0';
+    else
+        params = "";
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || syscall(SYS_finit_module, fd, params, 0)) {
+        fprintf(out, "# %s: cannot load: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    close(fd);
+
+    collect(out);
+
+    module_name(path, name, sizeof(name));
+    if (syscall(SYS_delete_module, name, O_NONBLOCK))
+        fprintf(out, "# %s: cannot unload: %s\n", name, strerror(errno));
+}
+
+int main(void)
+{
+    char line[1024], *results;
+    size_t results_len;
+    FILE *list, *out;
+
+    mount("devtmpfs", "/dev", "devtmpfs", 0, NULL);
+    mount("proc", "/proc", "proc", 0, NULL);
+    mount("sysfs", "/sys", "sysfs", 0, NULL);
+    mount("debugfs", "/sys/kernel/debug", "debugfs", 0, NULL);
+
+    /* Suites built into the kernel are not ours */
+    out = open_memstream(&results, &results_len);
+    collect(out);
+    fclose(out);
+    free(results);
+    nr_builtin = nr_suites;
+
+    out = open_memstream(&results, &results_len);
+    list = fopen("/modules/list", "r");
+    if (!list) {
+        perror("/modules/list");
+    } else {
+        while (fgets(line, sizeof(line), list))
+            run_module(line, out);
+        fclose(list);
+    }
+    fclose(out);
+
+    printf("KTAP version 1\n1..%d\n%s", nr_suites - nr_builtin, results);
+    fflush(stdout);
+    sync();
+    reboot(RB_POWER_OFF);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Usage: kunit/run-qemu.sh <guest kernel build dir> [extra qemu arguments]
+#
+# Boots the guest kernel (built by "make kunit-kernel") with an initramfs
+# holding the test modules listed in kunit/modules and a static init
+# (kunit/init.c) that loads them one by one. The KTAP results go through
+# kunit.py parse; the benchmark lines (ns/op) are kept in bench.txt.
+#
+# Environment:
+#   KUNIT_PY         kunit.py (default: the one in the kernel source of the build dir)
+#   BENCH_ITERS      bench_iters of every test module (default: the modules' own)
+#   BENCH_BASELINE   ns/op of an earlier run; created if missing, else compared with
+#   BENCH_TOLERANCE  percent a benchmark may be slower than the baseline (default 20)
+#   QEMU_MEM, QEMU_SMP  guest memory and CPUs (default 2G, 4)
+#   OUT              where console.log and bench.txt go (default: a temporary directory)
+
+set -e
+
+[ $# -ge 1 ] || { sed -n '3p' "$0"; exit 2; }
+KBUILD=$(cd "$1" && pwd)
+shift
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+KUNIT_PY=${KUNIT_PY:-$KBUILD/source/tools/testing/kunit/kunit.py}
+OUT=${OUT:-$(mktemp -d)}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# ---------- initramfs ----------
+${CC:-gcc} -O2 -Wall -static -o "$WORK/init" "$REPO/kunit/init.c"
+
+cat > "$WORK/cpio.list" <<CPIO
+dir /dev 0755 0 0
+nod /dev/console 0600 0 0 c 5 1
+dir /proc 0755 0 0
+dir /sys 0755 0 0
+dir /modules 0755 0 0
+file /init $WORK/init 0755 0 0
+file /modules/list $WORK/list 0644 0 0
+CPIO
+
+# Modules of different directories may share a name: one directory each
+n=0
+: > "$WORK/list"
+grep -v '^#' "$REPO/kunit/modules" | while read -r ko params; do
+    [ -n "$ko" ] || continue
+    n=$((n + 1))
+    [ -f "$REPO/$ko" ] || { echo "$ko not built (make kunit)" >&2; exit 1; }
+    echo "dir /modules/$n 0755 0 0" >> "$WORK/cpio.list"
+    echo "file /modules/$n/$(basename "$ko") $REPO/$ko 0644 0 0" >> "$WORK/cpio.list"
+    echo "/modules/$n/$(basename "$ko") $params${BENCH_ITERS:+ bench_iters=$BENCH_ITERS}" >> "$WORK/list"
+done
+
+"$KBUILD/usr/gen_init_cpio" "$WORK/cpio.list" > "$WORK/initramfs.cpio"
+
+# ---------- run ----------
+ACCEL=
+[ -w /dev/kvm ] && ACCEL="-accel kvm -cpu host"
+
+# shellcheck disable=SC2086
+qemu-system-x86_64 -nographic -no-reboot $ACCEL \
+    -m "${QEMU_MEM:-2G}" -smp "${QEMU_SMP:-4}" \
+    -kernel "$KBUILD/arch/x86/boot/bzImage" -initrd "$WORK/initramfs.cpio" \
+    -append "console=ttyS0 loglevel=1 panic=-1 rdinit=/init" \
+    "$@" < /dev/null > "$OUT/console.log"
+
+status=0
+python3 "$KUNIT_PY" parse "$OUT/console.log" || status=1
+
+# ---------- benchmarks ----------
+# "# hello_rw_bench: 12.345 ns/op write" -> "hello_rw_bench: 12.345 ns/op write"
+sed -n 's/^.*# \([A-Za-z0-9_]*: [0-9.]* ns\/op.*\)$/\1/p' "$OUT/console.log" | tr -d '\r' > "$OUT/bench.txt"
+echo "benchmarks: $OUT/bench.txt"
+cat "$OUT/bench.txt"
+
+if [ -n "$BENCH_BASELINE" ]; then
+    if [ ! -s "$BENCH_BASELINE" ]; then
+        cp "$OUT/bench.txt" "$BENCH_BASELINE"
+        echo "baseline saved to $BENCH_BASELINE"
+    else
+        awk -v tol="${BENCH_TOLERANCE:-20}" '
+            { key = $1; for (i = 4; i <= NF; i++) key = key " " $i }
+            NR == FNR { base[key] = $2; next }
+            (key in base) && $2 > base[key] * (1 + tol / 100) {
+                printf "slower than baseline: %s %s -> %s ns/op\n", key, base[key], $2
+                bad = 1
+            }
+            END { exit bad }' "$BENCH_BASELINE" "$OUT/bench.txt" || status=1
+    fi
+fi
+
+exit $status
@@ -2,21 +2,60 @@
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
 
 
 
 static int major;
 
+/*
+Per-open session, stored in file->private_data.
+Sessions come from their own kmem_cache: open and close run at very high
+rates from many threads, and a dedicated cache keeps the objects
+cacheline-aligned and recycled per CPU instead of going through kmalloc.
+Every field is set at open and only read afterwards, so a session needs
+neither a lock nor a constructor.
+*/
+struct hello_session {
+    unsigned int minor;
+    unsigned int f_flags;
+    fmode_t f_mode;
+    u64 opened_ns;
+};
+
+static struct kmem_cache *hello_session_cache;
+
+/*
+Nothing is logged on open or release. The counters are per CPU, so a storm
+of opens on many cores never bounces a shared cacheline; they are summed
+once, at unload.
+*/
+static DEFINE_PER_CPU(unsigned long, hello_opens);
+static DEFINE_PER_CPU(unsigned long, hello_releases);
+
 static int hello_open(struct inode *inode, struct file *file) {
-    printk(KERN_INFO "hello_cdev: Device opened   with major %d and minor  %d\n",imajor(inode), iminor(inode));
-    printk(KERN_INFO "file position is %s",file->f_pos==0?"at the beginning":"not at the beginning");
-    printk(KERN_INFO "file flags are %d\n",file->f_flags);
-    printk(KERN_INFO "file mode is %d\n",file->f_mode);
+    struct hello_session *s;
+
+    s = kmem_cache_alloc(hello_session_cache, GFP_KERNEL);
+    if (!s)
+        return -ENOMEM;
+
+    s->minor = iminor(inode);
+    s->f_flags = file->f_flags;
+    s->f_mode = file->f_mode;
+    s->opened_ns = ktime_get_ns();
+    file->private_data = s;
+
+    this_cpu_inc(hello_opens);
     return 0;
 }
 
 static int hello_release(struct inode *inode, struct file *file) {
-    printk(KERN_INFO "hello_cdev: Device closed with major %d and minor %d\n ", imajor(inode), iminor(inode) );
+    kmem_cache_free(hello_session_cache, file->private_data);
+
+    this_cpu_inc(hello_releases);
     return 0;
 }
 
@@ -28,9 +67,15 @@ struct file_operations fops = {
 
 
 static int __init hello_init(void) {
+    hello_session_cache = kmem_cache_create("hello_session", sizeof(struct hello_session), 0,
+                                            SLAB_HWCACHE_ALIGN, NULL);
+    if (!hello_session_cache)
+        return -ENOMEM;
+
     major = register_chrdev(0, "hello_cdev", &fops);
     if (major < 0) {
         printk(KERN_ALERT "hello_cdev: Registering char device failed with %d\n", major);
+        kmem_cache_destroy(hello_session_cache);
         return major;
     }
     printk(KERN_INFO "hello_cdev: Registered char device with major number %d\n", major);
@@ -38,7 +83,18 @@ static int __init hello_init(void) {
 }
 
 static void __exit hello_exit(void) {
+    unsigned long opens = 0, releases = 0;
+    int cpu;
+
     unregister_chrdev(major, "hello_cdev");
+
+    // every file is closed by now (the module was pinned while any was open)
+    kmem_cache_destroy(hello_session_cache);
+    for_each_possible_cpu(cpu) {
+        opens += per_cpu(hello_opens, cpu);
+        releases += per_cpu(hello_releases, cpu);
+    }
+    printk(KERN_INFO "hello_cdev: %lu opens, %lu releases\n", opens, releases);
     printk(KERN_INFO "hello_cdev: Unregistered char device with major number %d\n", major);
 }
 
@@ -46,4 +102,4 @@ module_init(hello_init);
 module_exit(hello_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Muhammad Ali Hussnain");
-MODULE_DESCRIPTION("A simple Hello World character device");
\ No newline at end of file
+MODULE_DESCRIPTION("A simple Hello World character device");
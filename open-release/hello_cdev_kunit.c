@@ -0,0 +1,112 @@
+// KUnit suites of the open/release sessions (see ../common/ktest.h)
+#include "hello_cdev.c"
+#include "../common/ktest.h"
+
+/*
+The driver makes no device node, so the tests hand open and release an
+inode and a file of their own: all the driver looks at is the minor
+number, the flags and private_data.
+*/
+struct session_fixture {
+    struct inode inode;
+    struct file file;
+};
+
+static int session_init(struct kunit *test)
+{
+    struct session_fixture *fx = kunit_kzalloc(test, sizeof(*fx), GFP_KERNEL);
+
+    if (!fx)
+        return -ENOMEM;
+    fx->inode.i_rdev = MKDEV(major, 3);
+    fx->file.f_flags = O_RDWR | O_NONBLOCK;
+    fx->file.f_mode = FMODE_READ | FMODE_WRITE;
+    test->priv = fx;
+    return 0;
+}
+
+static unsigned long session_sum(unsigned long __percpu *counter)
+{
+    unsigned long sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        sum += *per_cpu_ptr(counter, cpu);
+    return sum;
+}
+
+static void session_open_test(struct kunit *test)
+{
+    struct session_fixture *fx = test->priv;
+    unsigned long opens = session_sum(&hello_opens);
+    unsigned long releases = session_sum(&hello_releases);
+    struct hello_session *s;
+    u64 t0 = ktime_get_ns();
+
+    KUNIT_ASSERT_EQ(test, hello_open(&fx->inode, &fx->file), 0);
+    s = fx->file.private_data;
+    KUNIT_ASSERT_NOT_NULL(test, s);
+    KUNIT_EXPECT_EQ(test, s->minor, 3);
+    KUNIT_EXPECT_EQ(test, s->f_flags, O_RDWR | O_NONBLOCK);
+    KUNIT_EXPECT_EQ(test, s->f_mode, FMODE_READ | FMODE_WRITE);
+    KUNIT_EXPECT_GE(test, s->opened_ns, t0);
+    KUNIT_EXPECT_LE(test, s->opened_ns, ktime_get_ns());
+    KUNIT_EXPECT_EQ(test, session_sum(&hello_opens), opens + 1);
+
+    KUNIT_EXPECT_EQ(test, hello_release(&fx->inode, &fx->file), 0);
+    KUNIT_EXPECT_EQ(test, session_sum(&hello_releases), releases + 1);
+}
+
+// Sessions of files open at the same time are distinct
+static void session_many_test(struct kunit *test)
+{
+    struct session_fixture *fx = test->priv;
+    struct file *files;
+    int i, j;
+
+    files = kunit_kcalloc(test, 64, sizeof(*files), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, files);
+    for (i = 0; i < 64; i++)
+        KUNIT_ASSERT_EQ(test, hello_open(&fx->inode, &files[i]), 0);
+    for (i = 0; i < 64; i++)
+        for (j = 0; j < i; j++)
+            KUNIT_EXPECT_PTR_NE(test, files[i].private_data, files[j].private_data);
+    for (i = 0; i < 64; i++)
+        hello_release(&fx->inode, &files[i]);
+}
+
+static struct kunit_case session_cases[] = {
+    KUNIT_CASE(session_open_test),
+    KUNIT_CASE(session_many_test),
+    {}
+};
+
+static struct kunit_suite session_suite = {
+    .name = "hello_session",
+    .init = session_init,
+    .test_cases = session_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+// One open/release pair, without the VFS around it
+static void session_open_release_bench(struct kunit *test)
+{
+    struct session_fixture *fx = test->priv;
+
+    ktest_bench(test, "pair", hello_open(&fx->inode, &fx->file);
+                              hello_release(&fx->inode, &fx->file));
+}
+
+static struct kunit_case session_bench_cases[] = {
+    KUNIT_CASE_SLOW(session_open_release_bench),
+    {}
+};
+
+static struct kunit_suite session_bench_suite = {
+    .name = "hello_session_bench",
+    .init = session_init,
+    .test_cases = session_bench_cases,
+};
+
+kunit_test_suites(&session_suite, &session_bench_suite);
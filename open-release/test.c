@@ -1,17 +1,107 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+/*
+ * Usage: ./test <device> [threads] [seconds]
+ * Without threads, opens and closes the device once.
+ * With threads, runs an open/close storm: one thread per CPU slot, thread i
+ * pinned to CPU i % online CPUs, each opening and closing the device in a
+ * loop for the given time (default 5 s). Prints opens per second for
+ * every CPU used and in total.
+ */
+
+struct worker {
+    pthread_t tid;
+    const char *dev;
+    int cpu;
+    unsigned long opens;
+    int failed;
+};
+
+static volatile int stop;
+
+static void *storm(void *arg)
+{
+    struct worker *w = arg;
+    cpu_set_t set;
+    int fd;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    while (!stop) {
+        fd = open(w->dev, O_RDONLY);
+        if (fd < 0) {
+            w->failed = 1;
+            break;
+        }
+        close(fd);
+        w->opens++;
+    }
+    return NULL;
+}
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        printf("Usage: %s <device>\n", argv[0]);
+        printf("Usage: %s <device> [threads] [seconds]\n", argv[0]);
         return 1;
     }
-    int fd = open(argv[1], O_RDONLY);
-    if (fd < 0) {
-        perror("open");
+
+    if (argc < 3) {
+        int fd = open(argv[1], O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            return 1;
+        }
+        close(fd);
+        return 0;
+    }
+
+    int nthreads = atoi(argv[2]);
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    struct worker *w = calloc(nthreads > 0 ? nthreads : 1, sizeof(*w));
+    unsigned long total = 0, per_cpu;
+    struct timespec t0, t1;
+    double elapsed;
+    int i, cpu, failed = 0;
+
+    if (nthreads < 1 || !w) {
+        printf("threads must be at least 1\n");
         return 1;
     }
-    close(fd);
-    return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < nthreads; i++) {
+        w[i].dev = argv[1];
+        w[i].cpu = i % ncpu;
+        pthread_create(&w[i].tid, NULL, storm, &w[i]);
+    }
+    sleep(seconds);
+    stop = 1;
+    for (i = 0; i < nthreads; i++)
+        pthread_join(w[i].tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    for (cpu = 0; cpu < ncpu && cpu < nthreads; cpu++) {
+        per_cpu = 0;
+        for (i = cpu; i < nthreads; i += ncpu) {
+            per_cpu += w[i].opens;
+            failed |= w[i].failed;
+        }
+        printf("cpu %3d: %12.0f opens/s\n", cpu, per_cpu / elapsed);
+        total += per_cpu;
+    }
+    printf("total: %.0f opens/s, %d threads on %ld CPUs\n", total / elapsed, nthreads, ncpu);
+    if (failed)
+        printf("some opens failed, the numbers are incomplete\n");
+    return failed;
 }
@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "hello_cdev_ioctl.h"
+
+#define DEVICE_PATH "/dev/hello_cdev"
+#define CHUNK       (1 << 20)       // bytes per pwrite
+
+/*
+ * Usage: ./bench_crc [device] [MiB]
+ * Needs the module loaded with sparse=1 crc_workers=N.
+ * Streams MiB (default 1024) of random data into the store in 1 MiB
+ * writes, then asks for every block's checksum with HELLO_GET_CRC and
+ * prints the write rate, the rate once all checksums are ready, and the
+ * memcpy rate of the same data for reference. Every checksum is verified
+ * against a software CRC32C.
+ */
+
+static uint32_t crc_table[256];
+
+static void crc32c_init(void)
+{
+    uint32_t c;
+    int i, k;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32c(const unsigned char *p, size_t len)
+{
+    uint32_t c = ~0u;
+
+    while (len--)
+        c = crc_table[(c ^ *p++) & 0xff] ^ (c >> 8);
+    return ~c;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev = argc > 1 ? argv[1] : DEVICE_PATH;
+    size_t total = (size_t)(argc > 2 ? atol(argv[2]) : 1024) << 20;
+    struct hello_crc req = { 0 };
+    struct hello_range all;
+    unsigned char *data, *copy;
+    uint32_t *crcs;
+    size_t off, block, bad = 0, i;
+    double t0, t1, t2;
+    int fd;
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        perror(dev);
+        return EXIT_FAILURE;
+    }
+    data = malloc(total);
+    copy = malloc(total);
+    if (!data || !copy || !total) {
+        fprintf(stderr, "cannot allocate %zu bytes\n", total);
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for (off = 0; off < total; off++)
+        data[off] = rand();
+
+    t0 = now();
+    memcpy(copy, data, total);
+    t1 = now();
+    printf("memcpy:       %8.2f GB/s\n", total / (t1 - t0) / 1e9);
+
+    t0 = now();
+    for (off = 0; off < total; off += CHUNK) {
+        size_t n = total - off < CHUNK ? total - off : CHUNK;
+
+        if (pwrite(fd, data + off, n, off) != (ssize_t)n) {
+            perror("pwrite");
+            return EXIT_FAILURE;
+        }
+    }
+    t1 = now();
+
+    // The first call tells us the block size; it also waits for those blocks
+    req.offset = 0;
+    req.nr = 1;
+    req.crcs = (uintptr_t)&bad;
+    if (ioctl(fd, HELLO_GET_CRC, &req) < 0) {
+        perror("HELLO_GET_CRC (loaded with crc_workers?)");
+        return EXIT_FAILURE;
+    }
+    block = req.block_size;
+    crcs = malloc(total / block * sizeof(*crcs));
+    req.nr = total / block;
+    req.crcs = (uintptr_t)crcs;
+    if (!crcs || ioctl(fd, HELLO_GET_CRC, &req) < 0) {
+        perror("HELLO_GET_CRC");
+        return EXIT_FAILURE;
+    }
+    t2 = now();
+
+    printf("write:        %8.2f GB/s\n", total / (t1 - t0) / 1e9);
+    printf("write + crc:  %8.2f GB/s (%zu blocks of %zu bytes)\n",
+           total / (t2 - t0) / 1e9, total / block, block);
+
+    crc32c_init();
+    bad = 0;
+    for (i = 0; i < total / block; i++)
+        bad += crcs[i] != crc32c(data + i * block, block);
+    printf("verified:     %zu of %zu checksums %s\n",
+           bad ? bad : total / block, total / block, bad ? "WRONG" : "match");
+
+    all.offset = 0;
+    all.len = total;
+    ioctl(fd, HELLO_DISCARD, &all);
+    close(fd);
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
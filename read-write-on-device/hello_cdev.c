@@ -2,6 +2,18 @@
 #include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/uaccess.h> // for copy_to_user, copy_from_user
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/xarray.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/kthread.h>
+#include <linux/crc32c.h>
+#include <linux/math64.h>
+#include "../common/devstats.h"
+#include "hello_cdev_ioctl.h"
 
 #define DEVICE_NAME "hello_cdev"
 #define BUFFER_SIZE 64
@@ -9,8 +21,62 @@
 static char device_buffer[BUFFER_SIZE];
 static int major;
 
+// Per-CPU counters of every read and write, mapped by /dev/devstats/hello_cdev
+enum { STAT_READ, STAT_WRITE, STAT_CRC };
+static const char *const stat_channels[] = { "read", "write", "crc" };
+static struct devstats stats;
+
+/*
+With sparse=1 the device is a RAM-backed scratch store of store_mb MiB
+instead of the 64-byte buffer. Pages are allocated on first write and
+indexed by page number in an xarray, so memory use follows what has been
+written, not the size of the device. Never-written ranges (holes) read as
+zeros, and lseek(SEEK_DATA / SEEK_HOLE) finds them. HELLO_DISCARD frees a
+range again.
+
+Each page is guarded by its own page lock, so readers and writers of
+different pages never wait for each other; the xarray lookup itself is
+lockless.
+*/
+static bool sparse;
+module_param(sparse, bool, 0444);
+MODULE_PARM_DESC(sparse, "Use the sparse page store instead of the 64-byte buffer");
+
+static ulong store_mb = 16384;
+module_param(store_mb, ulong, 0444);
+MODULE_PARM_DESC(store_mb, "Size of the sparse store in MiB (default 16 GiB)");
+
+static loff_t store_size;
+static DEFINE_XARRAY(store);
+static atomic_long_t store_pages = ATOMIC_LONG_INIT(0);
+
+/*
+With crc_workers > 0 every page written to the store is also checksummed.
+store_write marks the page and hands runs of pages to a pool of kthreads,
+which compute the CRC32C of each whole page with crc32c() (the CPU's crc32
+instruction where there is one) and keep it with the page. The write
+returns as soon as the data is copied, so checksumming overlaps the next
+write instead of adding a pass to it. HELLO_GET_CRC waits for a range to
+settle and returns its checksums.
+*/
+static uint crc_workers;
+module_param(crc_workers, uint, 0444);
+MODULE_PARM_DESC(crc_workers, "Kthreads computing CRC32C of written pages, 0 = off (sparse store only)");
+
+#define CRC_PENDING     XA_MARK_1   // store mark: page changed since its checksum was taken
+#define CRC_JOB_PAGES   16          // longest run handed to one worker
+#define CRC_MAX_JOBS    64          // queued jobs per worker before writers wait
+
+// A run of consecutive pages written by one call, queued as one job
+struct crc_batch {
+    pgoff_t first;
+    unsigned int nr;
+};
+static void crc_batch_add(struct crc_batch *b, pgoff_t index);
+static void crc_batch_flush(struct crc_batch *b);
+
 // -------------------- READ --------------------
-static ssize_t hello_read(struct file *file, char __user *buf, size_t len, loff_t *offset) {
+static ssize_t hello_do_read(struct file *file, char __user *buf, size_t len, loff_t *offset) {
     printk(KERN_INFO "hello_cdev: read requested (len=%zu, offset=%lld)\n", len, *offset);
 
     if (*offset >= BUFFER_SIZE) {
@@ -33,7 +99,7 @@ static ssize_t hello_read(struct file *file, char __user *buf, size_t len, loff_
 }
 
 // -------------------- WRITE --------------------
-static ssize_t hello_write(struct file *file, const char __user *buf, size_t len, loff_t *offset) {
+static ssize_t hello_do_write(struct file *file, const char __user *buf, size_t len, loff_t *offset) {
     printk(KERN_INFO "hello_cdev: write requested (len=%zu, offset=%lld)\n", len, *offset);
 
     if (*offset >= BUFFER_SIZE) {
@@ -55,8 +121,660 @@ static ssize_t hello_write(struct file *file, const char __user *buf, size_t len
     return len;
 }
 
+// -------------------- SPARSE STORE --------------------
+/*
+store_get_page
+--------------
+Returns the page at index locked and with a reference held, or NULL for a
+hole when create is false. As in the page cache, the reference is taken
+speculatively under RCU and checked against the xarray again, because a
+discard may have freed the page in between.
+*/
+static struct page *store_get_page(pgoff_t index, bool create) {
+    struct page *page, *new = NULL, *old;
+
+repeat:
+    rcu_read_lock();
+    page = xa_load(&store, index);
+    if (page && !get_page_unless_zero(page)) {
+        rcu_read_unlock();
+        goto repeat;
+    }
+    rcu_read_unlock();
+
+    if (page) {
+        if (unlikely(xa_load(&store, index) != page)) {
+            put_page(page);
+            goto repeat;
+        }
+        if (new)
+            __free_page(new);
+        lock_page(page);
+        return page;
+    }
+    if (!create)
+        return NULL;
+
+    if (!new) {
+        new = alloc_page(GFP_KERNEL | __GFP_ZERO);
+        if (!new)
+            return ERR_PTR(-ENOMEM);
+    }
+    // Our reference is taken before the page becomes visible to a discard
+    get_page(new);
+    old = xa_cmpxchg(&store, index, NULL, new, GFP_KERNEL);
+    if (old) {
+        put_page(new);
+        if (xa_is_err(old)) {
+            __free_page(new);
+            return ERR_PTR(xa_err(old));
+        }
+        goto repeat;    // another writer got there first; keep new for a retry
+    }
+    atomic_long_inc(&store_pages);
+    lock_page(new);
+    return new;
+}
+
+static void store_put_page(struct page *page) {
+    unlock_page(page);
+    put_page(page);
+}
+
+static ssize_t store_read(char __user *buf, size_t len, loff_t *offset) {
+    loff_t pos = *offset;
+    size_t done = 0, n, left;
+    struct page *page;
+
+    if (pos < 0)
+        return -EINVAL;
+    if (pos >= store_size || !len)
+        return 0; // EOF
+    len = min_t(loff_t, len, store_size - pos);
+
+    while (done < len) {
+        n = min_t(size_t, len - done, PAGE_SIZE - offset_in_page(pos));
+        page = store_get_page(pos >> PAGE_SHIFT, false);
+        if (page) {
+            left = copy_to_user(buf + done, page_address(page) + offset_in_page(pos), n);
+            store_put_page(page);
+        } else {
+            left = clear_user(buf + done, n); // hole
+        }
+        done += n - left;
+        pos += n - left;
+        if (left)
+            break;
+        cond_resched();
+    }
+
+    *offset = pos;
+    return done ? done : -EFAULT;
+}
+
+static ssize_t store_write(const char __user *buf, size_t len, loff_t *offset) {
+    loff_t pos = *offset;
+    size_t done = 0, n, left;
+    struct crc_batch batch = { 0 };
+    struct page *page;
+
+    if (pos < 0)
+        return -EINVAL;
+    if (pos >= store_size)
+        return -ENOSPC;
+    if (!len)
+        return 0;
+    len = min_t(loff_t, len, store_size - pos);
+
+    while (done < len) {
+        n = min_t(size_t, len - done, PAGE_SIZE - offset_in_page(pos));
+        page = store_get_page(pos >> PAGE_SHIFT, true);
+        if (IS_ERR(page)) {
+            if (done)
+                break;
+            return PTR_ERR(page);
+        }
+        left = copy_from_user(page_address(page) + offset_in_page(pos), buf + done, n);
+        if (crc_workers) {
+            // Marked before the page is unlocked, so a worker never misses the new data
+            xa_set_mark(&store, pos >> PAGE_SHIFT, CRC_PENDING);
+            store_put_page(page);
+            crc_batch_add(&batch, pos >> PAGE_SHIFT);
+        } else {
+            store_put_page(page);
+        }
+        done += n - left;
+        pos += n - left;
+        if (left)
+            break;
+        cond_resched();
+    }
+    crc_batch_flush(&batch);
+
+    *offset = pos;
+    return done ? done : -EFAULT;
+}
+
+// Zeroes n bytes inside one page; nothing to do in a hole
+static void store_zero(loff_t pos, size_t n) {
+    struct page *page;
+
+    if (!n)
+        return;
+    page = store_get_page(pos >> PAGE_SHIFT, false);
+    if (!page)
+        return;
+    memset(page_address(page) + offset_in_page(pos), 0, n);
+    if (crc_workers) {
+        struct crc_batch batch = { pos >> PAGE_SHIFT, 1 };
+
+        xa_set_mark(&store, pos >> PAGE_SHIFT, CRC_PENDING);
+        store_put_page(page);
+        crc_batch_flush(&batch);
+        return;
+    }
+    store_put_page(page);
+}
+
+/*
+Frees every page that lies wholly inside the range. A page only partly
+covered keeps its other bytes, so the covered part is zeroed instead;
+either way the range reads back as zeros, like a punched hole in a file.
+*/
+static long store_discard(struct hello_range __user *arg) {
+    struct hello_range r;
+    loff_t start, end, head, tail;
+    unsigned long index;
+    struct page *page;
+
+    if (copy_from_user(&r, arg, sizeof(r)))
+        return -EFAULT;
+    if (r.offset >= store_size)
+        return -EINVAL;
+    start = r.offset;
+    end = r.len > store_size - start ? store_size : start + r.len;
+
+    head = min_t(loff_t, end, round_up(start, PAGE_SIZE));
+    store_zero(start, head - start);
+    if (head >= end)
+        return 0;
+    tail = max_t(loff_t, round_down(end, PAGE_SIZE), head);
+    store_zero(tail, end - tail);
+    if (head == tail)
+        return 0;
+
+    xa_for_each_range(&store, index, page, head >> PAGE_SHIFT, (tail >> PAGE_SHIFT) - 1) {
+        // Readers and writers still holding the page keep it alive until they drop it
+        page = xa_erase(&store, index);
+        if (page) {
+            put_page(page);
+            atomic_long_dec(&store_pages);
+        }
+        cond_resched();
+    }
+    return 0;
+}
+
+// First index at or after index that has no page, walking the xarray once under RCU
+static unsigned long store_next_hole(unsigned long index, unsigned long last) {
+    XA_STATE(xas, &store, index);
+    void *entry;
+
+    rcu_read_lock();
+    for (;;) {
+        entry = xas_next(&xas);
+        if (xas_retry(&xas, entry))
+            continue;
+        if (!entry)
+            break;
+        if (xas.xa_index == last) {
+            xas.xa_index = last + 1; // end of the device counts as a hole
+            break;
+        }
+    }
+    rcu_read_unlock();
+    return xas.xa_index;
+}
+
+static loff_t store_llseek(struct file *file, loff_t offset, int whence) {
+    unsigned long index, last = (store_size - 1) >> PAGE_SHIFT;
+
+    if (whence != SEEK_DATA && whence != SEEK_HOLE)
+        return fixed_size_llseek(file, offset, whence, store_size);
+
+    if (offset < 0 || offset >= store_size)
+        return -ENXIO;
+    index = offset >> PAGE_SHIFT;
+    if (whence == SEEK_DATA) {
+        if (!xa_find(&store, &index, last, XA_PRESENT))
+            return -ENXIO;
+    } else {
+        index = store_next_hole(index, last);
+    }
+    offset = max_t(loff_t, offset, (loff_t)index << PAGE_SHIFT);
+    return vfs_setpos(file, min(offset, store_size), store_size);
+}
+
+static void store_free(void) {
+    unsigned long index;
+    struct page *page;
+
+    xa_for_each(&store, index, page)
+        put_page(page);
+    xa_destroy(&store);
+}
+
+// -------------------- CRC32C PIPELINE --------------------
+struct crc_job {
+    struct list_head list;
+    pgoff_t first;
+    unsigned int nr;
+};
+
+static LIST_HEAD(crc_jobs);
+static DEFINE_SPINLOCK(crc_lock);
+static unsigned int crc_queued;
+static DECLARE_WAIT_QUEUE_HEAD(crc_work_wq);    // idle workers
+static DECLARE_WAIT_QUEUE_HEAD(crc_done_wq);    // writers waiting for room, HELLO_GET_CRC
+static struct task_struct **crc_threads;
+static u32 crc_zero;                            // checksum of a hole
+
+/*
+The checksum lives in page->private: the store's pages are ours, not page
+cache pages. Both it and the CRC_PENDING mark change only under the page
+lock, which a writer holds from the copy until the page is marked again,
+so a checksum always covers the page as some write left it. Returns
+whether there was anything to do.
+*/
+static bool crc_page(struct page *page, pgoff_t index) {
+    if (!xa_get_mark(&store, index, CRC_PENDING))
+        return false;
+    set_page_private(page, ~crc32c(~0u, page_address(page), PAGE_SIZE));
+    xa_clear_mark(&store, index, CRC_PENDING);
+    return true;
+}
+
+static void crc_run(pgoff_t first, unsigned int nr) {
+    u64 t0 = ktime_get_ns();
+    size_t bytes = 0;
+    struct page *page;
+    pgoff_t index;
+
+    for (index = first; index < first + nr; index++) {
+        // Unlocked peek: done by an earlier job, or discarded since
+        if (!xa_get_mark(&store, index, CRC_PENDING))
+            continue;
+        page = store_get_page(index, false);
+        if (!page)
+            continue;
+        if (crc_page(page, index))
+            bytes += PAGE_SIZE;
+        store_put_page(page);
+    }
+    devstats_end(&stats, STAT_CRC, t0, bytes);
+}
+
+static int crc_worker(void *unused) {
+    struct crc_job *job;
+
+    while (!kthread_should_stop()) {
+        // Exclusive: each queued job wakes one worker, not the whole pool
+        wait_event_idle_exclusive(crc_work_wq,
+                                  !list_empty_careful(&crc_jobs) || kthread_should_stop());
+
+        spin_lock(&crc_lock);
+        job = list_first_entry_or_null(&crc_jobs, struct crc_job, list);
+        if (job) {
+            list_del(&job->list);
+            crc_queued--;
+        }
+        spin_unlock(&crc_lock);
+        if (!job)
+            continue;
+
+        crc_run(job->first, job->nr);
+        kfree(job);
+        wake_up_all(&crc_done_wq);
+        cond_resched();
+    }
+    return 0;
+}
+
+static void crc_batch_flush(struct crc_batch *b) {
+    struct crc_job *job;
+
+    if (!b->nr)
+        return;
+    job = kmalloc(sizeof(*job), GFP_KERNEL);
+    if (!job) {
+        crc_run(b->first, b->nr);   // no job to queue: the writer checksums it itself
+        b->nr = 0;
+        wake_up_all(&crc_done_wq);  // as a worker would: HELLO_GET_CRC may wait on these pages
+        return;
+    }
+    job->first = b->first;
+    job->nr = b->nr;
+    b->nr = 0;
+
+    // A writer that outruns the workers waits for them instead of growing the queue
+    wait_event(crc_done_wq, READ_ONCE(crc_queued) < crc_workers * CRC_MAX_JOBS);
+    spin_lock(&crc_lock);
+    list_add_tail(&job->list, &crc_jobs);
+    crc_queued++;
+    spin_unlock(&crc_lock);
+    wake_up(&crc_work_wq);
+}
+
+static void crc_batch_add(struct crc_batch *b, pgoff_t index) {
+    if (b->nr && (index != b->first + b->nr || b->nr == CRC_JOB_PAGES))
+        crc_batch_flush(b);
+    if (!b->nr)
+        b->first = index;
+    b->nr++;
+}
+
+static bool crc_settled(pgoff_t first, pgoff_t last) {
+    unsigned long index = first;
+
+    return !xa_find(&store, &index, last, CRC_PENDING);
+}
+
+// HELLO_GET_CRC: waits until no page of the range is pending, then copies the checksums out
+static long crc_get(struct hello_crc __user *arg) {
+    u32 __user *out;
+    struct hello_crc req;
+    pgoff_t first, index;
+    struct page *page;
+    u32 crc;
+    int ret;
+
+    if (!crc_workers)
+        return -ENOTTY;
+    if (copy_from_user(&req, arg, sizeof(req)))
+        return -EFAULT;
+    if (!req.nr || offset_in_page(req.offset) || req.offset >= store_size ||
+        req.nr > (store_size - req.offset) >> PAGE_SHIFT)
+        return -EINVAL;
+    first = req.offset >> PAGE_SHIFT;
+    out = u64_to_user_ptr(req.crcs);
+
+    ret = wait_event_interruptible(crc_done_wq, crc_settled(first, first + req.nr - 1));
+    if (ret)
+        return ret;
+
+    for (index = first; index < first + req.nr; index++) {
+        crc = crc_zero;
+        page = store_get_page(index, false);
+        if (page) {
+            crc_page(page, index);  // rewritten since the wait: cheaper than waiting again
+            crc = page_private(page);
+            store_put_page(page);
+        }
+        if (put_user(crc, out + (index - first)))
+            return -EFAULT;
+        cond_resched();
+    }
+
+    req.block_size = PAGE_SIZE;
+    if (copy_to_user(arg, &req, sizeof(req)))
+        return -EFAULT;
+    return 0;
+}
+
+static int crc_start(void) {
+    unsigned int i;
+
+    crc_zero = ~crc32c(~0u, page_address(ZERO_PAGE(0)), PAGE_SIZE);
+    crc_threads = kcalloc(crc_workers, sizeof(*crc_threads), GFP_KERNEL);
+    if (!crc_threads)
+        return -ENOMEM;
+    for (i = 0; i < crc_workers; i++) {
+        crc_threads[i] = kthread_run(crc_worker, NULL, "hello_crc/%u", i);
+        if (IS_ERR(crc_threads[i])) {
+            int ret = PTR_ERR(crc_threads[i]);
+
+            while (i--)
+                kthread_stop(crc_threads[i]);
+            kfree(crc_threads);
+            return ret;
+        }
+    }
+    printk(KERN_INFO "hello_cdev: %u CRC32C workers\n", crc_workers);
+    return 0;
+}
+
+static void crc_stop(void) {
+    struct crc_job *job, *tmp;
+    unsigned int i;
+
+    for (i = 0; i < crc_workers; i++)
+        kthread_stop(crc_threads[i]);
+    kfree(crc_threads);
+    // Nobody is left to run them, and the store goes away with the module
+    list_for_each_entry_safe(job, tmp, &crc_jobs, list)
+        kfree(job);
+}
+
+// -------------------- PER-OPEN LIMITS --------------------
+/*
+Every open file can be limited to a rate of bytes and a rate of calls
+(HELLO_SET_LIMIT), shared by its reads and writes, so one busy opener
+cannot starve the others. Each limit is a token bucket: it fills at the
+rate up to its burst, and a call takes one op token and one byte token
+per byte. Buckets are refilled lazily from the clock when a call looks
+at them, so an idle or unlimited file costs no timer and no work.
+
+A call that finds a bucket short sleeps exactly until it will be full
+enough, or fails with -EAGAIN on an O_NONBLOCK file. Its length is cut
+to the byte burst first, so no call waits for more than one bucketful;
+like any read or write it may then transfer less than asked.
+*/
+struct hello_bucket {
+    u64 rate;       // tokens per second, 0 = unlimited
+    u64 burst;      // bucket size
+    u64 tokens;
+    u64 last_ns;    // time the tokens were last brought up to date
+};
+
+struct hello_client {
+    spinlock_t lock;
+    struct hello_bucket bytes, ops;
+    unsigned int gen;               // bumped by HELLO_SET_LIMIT to wake sleepers
+    wait_queue_head_t wait;
+    struct hello_throttle tstats;
+};
+
+static void tb_refill(struct hello_bucket *b, u64 now) {
+    u64 credit;
+
+    if (b->tokens >= b->burst) {
+        b->last_ns = now;
+        return;
+    }
+    credit = mul_u64_u64_div_u64(now - b->last_ns, b->rate, NSEC_PER_SEC);
+    if (credit >= b->burst - b->tokens) {
+        b->tokens = b->burst;
+        b->last_ns = now;
+        return;
+    }
+    // Advance only by the time those whole tokens took; the fraction counts next time
+    b->tokens += credit;
+    b->last_ns += mul_u64_u64_div_u64(credit, NSEC_PER_SEC, b->rate);
+}
+
+// Nanoseconds until b holds n tokens, 0 if it does now
+static u64 tb_wait(struct hello_bucket *b, u64 n, u64 now) {
+    if (!b->rate)
+        return 0;
+    tb_refill(b, now);
+    if (b->tokens >= n)
+        return 0;
+    return mul_u64_u64_div_u64(n - b->tokens, NSEC_PER_SEC, b->rate) + 1;
+}
+
+static void tb_set(struct hello_bucket *b, u64 rate, u64 burst, u64 min_burst, u64 now) {
+    b->rate = rate;
+    b->burst = burst ? burst : max(rate / 10, min_burst);  // default: 100 ms worth
+    b->tokens = b->burst;
+    b->last_ns = now;
+}
+
+// Takes the tokens for one call of up to *len bytes, cutting *len to the byte burst
+static int tb_acquire(struct file *file, size_t *len) {
+    struct hello_client *c = file->private_data;
+    u64 now, wait_ns, t0 = 0;
+    unsigned int gen;
+    int ret;
+
+    for (;;) {
+        spin_lock(&c->lock);
+        if (!c->bytes.rate && !c->ops.rate) {
+            c->tstats.calls++;
+            spin_unlock(&c->lock);
+            return 0;
+        }
+        now = ktime_get_ns();
+        if (c->bytes.rate)
+            *len = min_t(u64, *len, c->bytes.burst);
+        wait_ns = max(tb_wait(&c->bytes, *len, now), tb_wait(&c->ops, 1, now));
+        if (!wait_ns) {
+            if (c->bytes.rate)
+                c->bytes.tokens -= *len;
+            if (c->ops.rate)
+                c->ops.tokens--;
+            c->tstats.calls++;
+            if (t0) {
+                c->tstats.wait_ns += now - t0;
+                c->tstats.max_wait_ns = max(c->tstats.max_wait_ns, now - t0);
+            }
+            spin_unlock(&c->lock);
+            return 0;
+        }
+        if (file->f_flags & O_NONBLOCK) {
+            c->tstats.rejected++;
+            spin_unlock(&c->lock);
+            return -EAGAIN;
+        }
+        if (!t0) {
+            c->tstats.throttled++;
+            t0 = now;
+        }
+        gen = c->gen;
+        spin_unlock(&c->lock);
+
+        ret = wait_event_interruptible_hrtimeout(c->wait, READ_ONCE(c->gen) != gen,
+                                                 ns_to_ktime(wait_ns));
+        if (ret == -ERESTARTSYS)
+            return ret;
+    }
+}
+
+// Gives back the byte tokens of a call that moved less than it was charged for
+static void tb_refund(struct file *file, size_t len, ssize_t moved) {
+    struct hello_client *c = file->private_data;
+
+    if (moved < 0)
+        moved = 0;
+    if (!READ_ONCE(c->bytes.rate) || moved >= len)
+        return;
+    spin_lock(&c->lock);
+    if (c->bytes.rate)
+        c->bytes.tokens = min(c->bytes.tokens + (len - moved), c->bytes.burst);
+    spin_unlock(&c->lock);
+}
+
+static long hello_set_limit(struct file *file, struct hello_limit __user *arg) {
+    struct hello_client *c = file->private_data;
+    struct hello_limit lim;
+    u64 now = ktime_get_ns();
+
+    if (copy_from_user(&lim, arg, sizeof(lim)))
+        return -EFAULT;
+
+    spin_lock(&c->lock);
+    tb_set(&c->bytes, lim.bytes_per_sec, lim.bytes_burst, PAGE_SIZE, now);
+    tb_set(&c->ops, lim.ops_per_sec, lim.ops_burst, 1, now);
+    c->gen++;
+    spin_unlock(&c->lock);
+    wake_up_all(&c->wait);  // sleepers re-check against the new limits
+    return 0;
+}
+
+static long hello_get_throttle(struct file *file, struct hello_throttle __user *arg) {
+    struct hello_client *c = file->private_data;
+    struct hello_throttle t;
+
+    spin_lock(&c->lock);
+    t = c->tstats;
+    spin_unlock(&c->lock);
+    return copy_to_user(arg, &t, sizeof(t)) ? -EFAULT : 0;
+}
+
+// Timed wrappers: bytes moved, errors and latency go to the stats page.
+// The latency includes time spent waiting for the file's limits.
+static ssize_t hello_read(struct file *file, char __user *buf, size_t len, loff_t *offset) {
+    u64 t0 = ktime_get_ns();
+    ssize_t ret = tb_acquire(file, &len);
+
+    if (!ret) {
+        ret = sparse ? store_read(buf, len, offset) : hello_do_read(file, buf, len, offset);
+        tb_refund(file, len, ret);
+    }
+    devstats_end(&stats, STAT_READ, t0, ret);
+    return ret;
+}
+
+static ssize_t hello_write(struct file *file, const char __user *buf, size_t len, loff_t *offset) {
+    u64 t0 = ktime_get_ns();
+    ssize_t ret = tb_acquire(file, &len);
+
+    if (!ret) {
+        ret = sparse ? store_write(buf, len, offset) : hello_do_write(file, buf, len, offset);
+        tb_refund(file, len, ret);
+    }
+    devstats_end(&stats, STAT_WRITE, t0, ret);
+    return ret;
+}
+
+// -------------------- LLSEEK / IOCTL --------------------
+// The 64-byte buffer is a stream, as before; only the store can seek
+static loff_t hello_llseek(struct file *file, loff_t offset, int whence) {
+    if (!sparse)
+        return -ESPIPE;
+    return store_llseek(file, offset, whence);
+}
+
+static long hello_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    // Limits apply in both modes
+    switch (cmd) {
+    case HELLO_SET_LIMIT:
+        return hello_set_limit(file, (struct hello_limit __user *)arg);
+    case HELLO_GET_THROTTLE:
+        return hello_get_throttle(file, (struct hello_throttle __user *)arg);
+    }
+    if (!sparse)
+        return -ENOTTY;
+
+    switch (cmd) {
+    case HELLO_DISCARD:
+        return store_discard((struct hello_range __user *)arg);
+    case HELLO_GET_CRC:
+        return crc_get((struct hello_crc __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
 // -------------------- OPEN --------------------
 static int my_open(struct inode *inode, struct file *file) {
+    struct hello_client *c = kzalloc(sizeof(*c), GFP_KERNEL);
+
+    if (!c)
+        return -ENOMEM;
+    spin_lock_init(&c->lock);
+    init_waitqueue_head(&c->wait);
+    file->private_data = c;     // unlimited until HELLO_SET_LIMIT
+
     printk(KERN_INFO "hello_cdev: device opened (major=%d, minor=%d)\n",
            imajor(inode), iminor(inode));
     return 0;
@@ -64,6 +782,7 @@ static int my_open(struct inode *inode, struct file *file) {
 
 // -------------------- RELEASE --------------------
 static int my_release(struct inode *inode, struct file *file) {
+    kfree(file->private_data);
     printk(KERN_INFO "hello_cdev: device closed (major=%d, minor=%d)\n",
            imajor(inode), iminor(inode));
     return 0;
@@ -76,13 +795,43 @@ static struct file_operations fops = {
     .release = my_release,
     .read = hello_read,
     .write = hello_write,
+    .llseek = hello_llseek,
+    .unlocked_ioctl = hello_ioctl,
 };
 
 // -------------------- INIT --------------------
 static int __init hello_init(void) {
+    int ret;
+
+    if (sparse) {
+        if (!store_mb || store_mb > (MAX_LFS_FILESIZE >> 20))
+            return -EINVAL;
+        store_size = (loff_t)store_mb << 20;
+        printk(KERN_INFO "hello_cdev: sparse store of %lu MiB\n", store_mb);
+    }
+    if (crc_workers && (!sparse || crc_workers > 256)) {
+        printk(KERN_ERR "hello_cdev: crc_workers needs sparse=1 and at most 256 workers\n");
+        return -EINVAL;
+    }
+
+    ret = devstats_register(&stats, DEVICE_NAME, stat_channels, ARRAY_SIZE(stat_channels));
+    if (ret)
+        return ret;
+
+    if (crc_workers) {
+        ret = crc_start();
+        if (ret) {
+            devstats_unregister(&stats);
+            return ret;
+        }
+    }
+
     major = register_chrdev(0, DEVICE_NAME, &fops);
     if (major < 0) {
         printk(KERN_ALERT "hello_cdev: failed to register character device\n");
+        if (crc_workers)
+            crc_stop();
+        devstats_unregister(&stats);
         return major;
     }
     printk(KERN_INFO "hello_cdev: registered successfully with major number %d\n", major);
@@ -92,6 +841,13 @@ static int __init hello_init(void) {
 // -------------------- EXIT --------------------
 static void __exit hello_exit(void) {
     unregister_chrdev(major, DEVICE_NAME);
+    if (crc_workers)
+        crc_stop();
+    devstats_unregister(&stats);
+    if (sparse) {
+        printk(KERN_INFO "hello_cdev: freeing %ld store pages\n", atomic_long_read(&store_pages));
+        store_free();
+    }
     printk(KERN_INFO "hello_cdev: unregistered character device\n");
 }
 
@@ -101,4 +857,4 @@ module_exit(hello_exit);
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Muhammad Ali Hussnain");
 MODULE_DESCRIPTION("A simple character device driver with logging");
-MODULE_VERSION("1.0");
+MODULE_VERSION("1.4");
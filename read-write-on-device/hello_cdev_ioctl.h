@@ -0,0 +1,51 @@
+#ifndef HELLO_CDEV_IOCTL_H
+#define HELLO_CDEV_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// A byte range of the sparse store: [offset, offset + len)
+struct hello_range {
+    __u64 offset;
+    __u64 len;
+};
+
+// Checksums of nr consecutive blocks of the store, starting at a block boundary
+struct hello_crc {
+    __u64 offset;       // in: first byte of the first block
+    __u64 crcs;         // in: user pointer to nr __u32 CRC32C values
+    __u32 nr;           // in: number of blocks
+    __u32 block_size;   // out: bytes per block (the page size)
+};
+
+#define HELLO_IOCTL_MAGIC 'h'
+
+// Frees the pages inside the range; partial pages at its ends are zeroed
+#define HELLO_DISCARD _IOW(HELLO_IOCTL_MAGIC, 0, struct hello_range)
+
+// Waits for the checksum workers to finish the range, then fills crcs;
+// a block never written has the CRC32C of a block of zeros
+#define HELLO_GET_CRC _IOWR(HELLO_IOCTL_MAGIC, 1, struct hello_crc)
+
+// Token-bucket limits of one open file, shared by its reads and writes
+struct hello_limit {
+    __u64 bytes_per_sec;    // 0 = unlimited
+    __u64 ops_per_sec;      // 0 = unlimited
+    __u64 bytes_burst;      // bucket size; 0 = 100 ms worth, at least a page
+    __u64 ops_burst;        // bucket size; 0 = 100 ms worth, at least 1
+};
+
+// What the limits did to this file's calls so far
+struct hello_throttle {
+    __u64 calls;            // reads and writes let through
+    __u64 throttled;        // of those, how many had to wait
+    __u64 rejected;         // -EAGAIN on an O_NONBLOCK file
+    __u64 wait_ns;          // total time spent waiting
+    __u64 max_wait_ns;
+};
+
+// Both work in either mode; setting limits refills the buckets
+#define HELLO_SET_LIMIT    _IOW(HELLO_IOCTL_MAGIC, 2, struct hello_limit)
+#define HELLO_GET_THROTTLE _IOR(HELLO_IOCTL_MAGIC, 3, struct hello_throttle)
+
+#endif
@@ -0,0 +1,426 @@
+// KUnit suites of hello_cdev: the buffer, the sparse store, checksums and limits (see ../common/ktest.h)
+#include "hello_cdev.c"
+#include "../common/ktest.h"
+
+#define TEST_LEN    (3 * PAGE_SIZE + 100)
+
+/*
+The store tests need the module loaded with sparse=1 (and crc_workers > 0
+for the checksum test); kunit/run-qemu.sh does that. Each test works in
+its own GiB of the store and discards it again at the end.
+*/
+static void store_require(struct kunit *test)
+{
+    if (!sparse || store_size < (8LL << 30))
+        kunit_skip(test, "needs sparse=1 and store_mb >= 8192");
+}
+
+static void store_punch(struct kunit *test, loff_t start, u64 len)
+{
+    struct hello_range __user *ur = ktest_user_buf(test, sizeof(*ur));
+    struct hello_range r = { .offset = start, .len = len };
+
+    KUNIT_ASSERT_EQ(test, copy_to_user(ur, &r, sizeof(r)), 0);
+    KUNIT_ASSERT_EQ(test, store_discard(ur), 0);
+}
+
+// An opened file as the VFS would hand it over, for the calls that use private_data
+static struct file *client_open(struct kunit *test, unsigned int f_flags)
+{
+    struct inode *inode = kunit_kzalloc(test, sizeof(*inode), GFP_KERNEL);
+    struct file *file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, inode);
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    file->f_flags = f_flags;
+    file->f_inode = inode;
+    KUNIT_ASSERT_EQ(test, my_open(inode, file), 0);
+    return file;
+}
+
+static void client_close(struct file *file)
+{
+    my_release(file->f_inode, file);
+}
+
+/* ---------- 64-byte buffer ---------- */
+
+static void buffer_test(struct kunit *test)
+{
+    char __user *ubuf = ktest_user_buf(test, 128);
+    char data[100], back[100];
+    loff_t pos = 0;
+    int i;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = 'a' + i % 26;
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, data, sizeof(data)), 0);
+
+    // Cut to the buffer, then full
+    KUNIT_EXPECT_EQ(test, hello_do_write(NULL, ubuf, sizeof(data), &pos), BUFFER_SIZE);
+    KUNIT_EXPECT_EQ(test, pos, BUFFER_SIZE);
+    KUNIT_EXPECT_EQ(test, hello_do_write(NULL, ubuf, 1, &pos), -ENOSPC);
+
+    pos = 10;
+    KUNIT_ASSERT_EQ(test, clear_user(ubuf, 128), 0);
+    KUNIT_EXPECT_EQ(test, hello_do_read(NULL, ubuf, sizeof(back), &pos), BUFFER_SIZE - 10);
+    KUNIT_ASSERT_EQ(test, copy_from_user(back, ubuf, BUFFER_SIZE - 10), 0);
+    KUNIT_EXPECT_MEMEQ(test, back, data + 10, BUFFER_SIZE - 10);
+    KUNIT_EXPECT_EQ(test, hello_do_read(NULL, ubuf, sizeof(back), &pos), 0);
+
+    pos = 0;
+    KUNIT_EXPECT_EQ(test, hello_do_read(NULL, (char __user *)NULL + 16, 8, &pos), -EFAULT);
+    KUNIT_EXPECT_EQ(test, pos, 0);
+}
+
+/* ---------- sparse store ---------- */
+
+// Unaligned across four pages, reading back through holes on either side
+static void store_rw_test(struct kunit *test)
+{
+    loff_t base = 1LL << 30, pos;
+    char __user *ubuf;
+    long pages;
+    u8 *data, *back;
+    int i;
+
+    store_require(test);
+    ubuf = ktest_user_buf(test, TEST_LEN + 2 * PAGE_SIZE);
+    data = kunit_kmalloc(test, TEST_LEN, GFP_KERNEL);
+    back = kunit_kmalloc(test, TEST_LEN + 2 * PAGE_SIZE, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, data);
+    KUNIT_ASSERT_NOT_NULL(test, back);
+    for (i = 0; i < TEST_LEN; i++)
+        data[i] = i * 7 + 1;
+
+    pages = atomic_long_read(&store_pages);
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, data, TEST_LEN), 0);
+    pos = base + PAGE_SIZE + 123;
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, TEST_LEN, &pos), (ssize_t)TEST_LEN);
+    KUNIT_EXPECT_EQ(test, pos, base + PAGE_SIZE + 123 + TEST_LEN);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&store_pages), pages + 4);
+
+    // Holes read as zeros even over a dirty user buffer
+    memset(back, 0xff, TEST_LEN + 2 * PAGE_SIZE);
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, back, TEST_LEN + 2 * PAGE_SIZE), 0);
+    pos = base;
+    KUNIT_ASSERT_EQ(test, store_read(ubuf, TEST_LEN + 2 * PAGE_SIZE, &pos),
+                    (ssize_t)(TEST_LEN + 2 * PAGE_SIZE));
+    KUNIT_ASSERT_EQ(test, copy_from_user(back, ubuf, TEST_LEN + 2 * PAGE_SIZE), 0);
+    KUNIT_EXPECT_NULL(test, memchr_inv(back, 0, PAGE_SIZE + 123));
+    KUNIT_EXPECT_MEMEQ(test, back + PAGE_SIZE + 123, data, TEST_LEN);
+    KUNIT_EXPECT_NULL(test, memchr_inv(back + PAGE_SIZE + 123 + TEST_LEN, 0, PAGE_SIZE - 123));
+
+    store_punch(test, base, 8 * PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&store_pages), pages);
+}
+
+static void store_bounds_test(struct kunit *test)
+{
+    char __user *ubuf;
+    loff_t pos;
+
+    store_require(test);
+    ubuf = ktest_user_buf(test, PAGE_SIZE);
+
+    pos = store_size;
+    KUNIT_EXPECT_EQ(test, store_read(ubuf, PAGE_SIZE, &pos), 0);
+    KUNIT_EXPECT_EQ(test, store_write(ubuf, PAGE_SIZE, &pos), -ENOSPC);
+    pos = -1;
+    KUNIT_EXPECT_EQ(test, store_read(ubuf, PAGE_SIZE, &pos), -EINVAL);
+    KUNIT_EXPECT_EQ(test, store_write(ubuf, PAGE_SIZE, &pos), -EINVAL);
+
+    // Cut at the end of the device
+    pos = store_size - 10;
+    KUNIT_EXPECT_EQ(test, store_write(ubuf, PAGE_SIZE, &pos), 10);
+    KUNIT_EXPECT_EQ(test, pos, store_size);
+    store_punch(test, store_size - PAGE_SIZE, PAGE_SIZE);
+}
+
+// A partly covered page keeps the bytes outside the range
+static void store_discard_test(struct kunit *test)
+{
+    struct hello_range past = { .offset = store_size, .len = 1 };
+    loff_t base = 2LL << 30, pos;
+    char __user *ubuf;
+    long pages;
+    u8 *back;
+
+    store_require(test);
+    ubuf = ktest_user_buf(test, 3 * PAGE_SIZE);
+    back = kunit_kmalloc(test, 3 * PAGE_SIZE, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, back);
+
+    pages = atomic_long_read(&store_pages);
+    memset(back, 0xaa, 3 * PAGE_SIZE);
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, back, 3 * PAGE_SIZE), 0);
+    pos = base;
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, 3 * PAGE_SIZE, &pos), (ssize_t)(3 * PAGE_SIZE));
+
+    store_punch(test, base + 100, 2 * PAGE_SIZE - 50);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&store_pages), pages + 2);
+
+    pos = base;
+    KUNIT_ASSERT_EQ(test, store_read(ubuf, 3 * PAGE_SIZE, &pos), (ssize_t)(3 * PAGE_SIZE));
+    KUNIT_ASSERT_EQ(test, copy_from_user(back, ubuf, 3 * PAGE_SIZE), 0);
+    KUNIT_EXPECT_NULL(test, memchr_inv(back, 0xaa, 100));
+    KUNIT_EXPECT_NULL(test, memchr_inv(back + 100, 0, 2 * PAGE_SIZE - 50));
+    KUNIT_EXPECT_NULL(test, memchr_inv(back + 2 * PAGE_SIZE + 50, 0xaa, PAGE_SIZE - 50));
+
+    store_punch(test, base, 3 * PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, atomic_long_read(&store_pages), pages);
+
+    // Past the end is refused; a length past it is cut
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, &past, sizeof(past)), 0);
+    KUNIT_EXPECT_EQ(test, store_discard((struct hello_range __user *)ubuf), -EINVAL);
+    store_punch(test, store_size - 1, U64_MAX);
+}
+
+static void store_seek_test(struct kunit *test)
+{
+    loff_t base = 3LL << 30, pos;
+    struct file *file;
+    char __user *ubuf;
+
+    store_require(test);
+    ubuf = ktest_user_buf(test, 1);
+    file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, file);
+
+    // Data in pages 1 and 3 of base, and in the device's last page
+    pos = base + PAGE_SIZE + 5;
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, 1, &pos), 1);
+    pos = base + 3 * PAGE_SIZE;
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, 1, &pos), 1);
+    pos = store_size - 1;
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, 1, &pos), 1);
+
+    KUNIT_EXPECT_EQ(test, store_llseek(file, base, SEEK_DATA), base + PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, file->f_pos, base + PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, store_llseek(file, base + PAGE_SIZE + 9, SEEK_DATA),
+                    base + PAGE_SIZE + 9);
+    KUNIT_EXPECT_EQ(test, store_llseek(file, base + PAGE_SIZE + 9, SEEK_HOLE),
+                    base + 2 * PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, store_llseek(file, base + 2 * PAGE_SIZE, SEEK_DATA),
+                    base + 3 * PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, store_llseek(file, base, SEEK_HOLE), base);
+
+    // The end of the device counts as a hole
+    KUNIT_EXPECT_EQ(test, store_llseek(file, store_size - 1, SEEK_HOLE), store_size);
+    KUNIT_EXPECT_EQ(test, store_llseek(file, store_size, SEEK_DATA), -ENXIO);
+    KUNIT_EXPECT_EQ(test, store_llseek(file, -1, SEEK_HOLE), -ENXIO);
+
+    store_punch(test, base, 4 * PAGE_SIZE);
+    store_punch(test, store_size - PAGE_SIZE, PAGE_SIZE);
+}
+
+// HELLO_GET_CRC waits for the workers and matches crc32c() page by page, holes included
+static void store_crc_test(struct kunit *test)
+{
+    loff_t base = 4LL << 30, pos;
+    struct hello_crc __user *ureq;
+    struct hello_crc req;
+    char __user *ubuf;
+    u32 __user *ucrcs;
+    u32 crcs[3];
+    u8 *data;
+    int i;
+
+    store_require(test);
+    if (!crc_workers)
+        kunit_skip(test, "needs crc_workers > 0");
+    ubuf = ktest_user_buf(test, 2 * PAGE_SIZE);
+    ureq = ktest_user_buf(test, sizeof(*ureq) + sizeof(crcs));
+    ucrcs = (u32 __user *)(ureq + 1);
+    data = kunit_kmalloc(test, 2 * PAGE_SIZE, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, data);
+    for (i = 0; i < 2 * PAGE_SIZE; i++)
+        data[i] = i ^ (i >> 8);
+
+    KUNIT_ASSERT_EQ(test, copy_to_user(ubuf, data, 2 * PAGE_SIZE), 0);
+    pos = base;
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, 2 * PAGE_SIZE, &pos), (ssize_t)(2 * PAGE_SIZE));
+
+    req = (struct hello_crc){ .offset = base, .crcs = (unsigned long)ucrcs, .nr = 3 };
+    KUNIT_ASSERT_EQ(test, copy_to_user(ureq, &req, sizeof(req)), 0);
+    KUNIT_ASSERT_EQ(test, crc_get(ureq), 0);
+    KUNIT_ASSERT_EQ(test, copy_from_user(&req, ureq, sizeof(req)), 0);
+    KUNIT_ASSERT_EQ(test, copy_from_user(crcs, ucrcs, sizeof(crcs)), 0);
+    KUNIT_EXPECT_EQ(test, req.block_size, PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, crcs[0], ~crc32c(~0u, data, PAGE_SIZE));
+    KUNIT_EXPECT_EQ(test, crcs[1], ~crc32c(~0u, data + PAGE_SIZE, PAGE_SIZE));
+    KUNIT_EXPECT_EQ(test, crcs[2], ~crc32c(~0u, page_address(ZERO_PAGE(0)), PAGE_SIZE));
+
+    // Unaligned or empty ranges
+    req.offset = base + 1;
+    KUNIT_ASSERT_EQ(test, copy_to_user(ureq, &req, sizeof(req)), 0);
+    KUNIT_EXPECT_EQ(test, crc_get(ureq), -EINVAL);
+    req = (struct hello_crc){ .offset = base, .crcs = (unsigned long)ucrcs, .nr = 0 };
+    KUNIT_ASSERT_EQ(test, copy_to_user(ureq, &req, sizeof(req)), 0);
+    KUNIT_EXPECT_EQ(test, crc_get(ureq), -EINVAL);
+
+    store_punch(test, base, 2 * PAGE_SIZE);
+}
+
+/* ---------- per-open limits ---------- */
+
+static void tb_refill_test(struct kunit *test)
+{
+    struct hello_bucket b;
+
+    // 1000 tokens/s: the default burst is 100 ms worth
+    tb_set(&b, 1000, 0, 1, 0);
+    KUNIT_EXPECT_EQ(test, b.burst, 100);
+    KUNIT_EXPECT_EQ(test, tb_wait(&b, 100, 0), 0);
+    b.tokens = 0;
+    KUNIT_EXPECT_EQ(test, tb_wait(&b, 1, 0), NSEC_PER_MSEC + 1);
+
+    // A fraction of a token is carried over, not lost
+    tb_refill(&b, 1500 * NSEC_PER_USEC);
+    KUNIT_EXPECT_EQ(test, b.tokens, 1);
+    KUNIT_EXPECT_EQ(test, b.last_ns, NSEC_PER_MSEC);
+    tb_refill(&b, 2 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, b.tokens, 2);
+
+    // Never past the burst, however long idle
+    tb_refill(&b, 100 * NSEC_PER_SEC);
+    KUNIT_EXPECT_EQ(test, b.tokens, 100);
+    KUNIT_EXPECT_EQ(test, b.last_ns, 100 * NSEC_PER_SEC);
+
+    // The minimum burst, and unlimited
+    tb_set(&b, 10, 0, PAGE_SIZE, 0);
+    KUNIT_EXPECT_EQ(test, b.burst, PAGE_SIZE);
+    tb_set(&b, 0, 0, 1, 0);
+    KUNIT_EXPECT_EQ(test, tb_wait(&b, U64_MAX, 0), 0);
+}
+
+// O_NONBLOCK: a short bucket fails the call instead of sleeping
+static void tb_acquire_test(struct kunit *test)
+{
+    struct file *file = client_open(test, O_NONBLOCK);
+    struct hello_client *c = file->private_data;
+    size_t len;
+
+    len = 1000;
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    KUNIT_EXPECT_EQ(test, len, 1000);      // unlimited
+
+    tb_set(&c->bytes, 1, 100, PAGE_SIZE, ktime_get_ns());
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    KUNIT_EXPECT_EQ(test, len, 100);       // cut to the burst
+    len = 1;
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), -EAGAIN);
+
+    // A call that moved 40 of its 100 bytes gets 60 back
+    tb_refund(file, 100, 40);
+    KUNIT_EXPECT_EQ(test, c->bytes.tokens, 60);
+    len = 60;
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    KUNIT_EXPECT_EQ(test, c->bytes.tokens, 0);
+
+    tb_set(&c->bytes, 0, 0, PAGE_SIZE, 0);
+    tb_set(&c->ops, 1, 2, 1, ktime_get_ns());
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), -EAGAIN);
+
+    KUNIT_EXPECT_EQ(test, c->tstats.calls, 5);
+    KUNIT_EXPECT_EQ(test, c->tstats.rejected, 2);
+    KUNIT_EXPECT_EQ(test, c->tstats.throttled, 0);
+    client_close(file);
+}
+
+// A blocking call sleeps until the bucket has refilled
+static void tb_sleep_test(struct kunit *test)
+{
+    struct file *file = client_open(test, 0);
+    struct hello_client *c = file->private_data;
+    size_t len = 1;
+    u64 t0;
+
+    tb_set(&c->ops, 100, 1, 1, ktime_get_ns());
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    t0 = ktime_get_ns();
+    KUNIT_EXPECT_EQ(test, tb_acquire(file, &len), 0);
+    KUNIT_EXPECT_GE(test, ktime_get_ns() - t0, 5 * NSEC_PER_MSEC);
+    KUNIT_EXPECT_EQ(test, c->tstats.throttled, 1);
+    KUNIT_EXPECT_GT(test, c->tstats.max_wait_ns, 0);
+    client_close(file);
+}
+
+static struct kunit_case hello_cases[] = {
+    KUNIT_CASE(buffer_test),
+    KUNIT_CASE(store_rw_test),
+    KUNIT_CASE(store_bounds_test),
+    KUNIT_CASE(store_discard_test),
+    KUNIT_CASE(store_seek_test),
+    KUNIT_CASE(store_crc_test),
+    KUNIT_CASE(tb_refill_test),
+    KUNIT_CASE(tb_acquire_test),
+    KUNIT_CASE(tb_sleep_test),
+    {}
+};
+
+static struct kunit_suite hello_suite = {
+    .name = "hello_cdev",
+    .test_cases = hello_cases,
+};
+
+/* ---------- benchmarks ---------- */
+
+/*
+One page per call through the timed wrappers, as read(2) and write(2) run
+them. Store only: the 64-byte buffer logs every call, so timing it would
+time printk.
+*/
+static void hello_rw_bench(struct kunit *test)
+{
+    loff_t base = 5LL << 30, pos;
+    struct hello_client *c;
+    struct file *file;
+    char __user *ubuf;
+
+    store_require(test);
+    ubuf = ktest_user_buf(test, PAGE_SIZE);
+    file = client_open(test, 0);
+    c = file->private_data;
+
+    ktest_bench(test, "write", pos = base; hello_write(file, ubuf, PAGE_SIZE, &pos));
+    ktest_bench(test, "read", pos = base; hello_read(file, ubuf, PAGE_SIZE, &pos));
+
+    // A limit too high to ever wait: what the bucket arithmetic costs
+    tb_set(&c->bytes, 1ULL << 50, 0, PAGE_SIZE, ktime_get_ns());
+    ktest_bench(test, "read limited", pos = base; hello_read(file, ubuf, PAGE_SIZE, &pos));
+
+    store_punch(test, base, PAGE_SIZE);
+    client_close(file);
+}
+
+// SEEK_HOLE across 256 written pages: one walk of the xarray under RCU
+static void store_seek_bench(struct kunit *test)
+{
+    loff_t base = 6LL << 30, pos = base;
+    struct file *file;
+    char __user *ubuf;
+
+    store_require(test);
+    file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_NULL(test, file);
+    ubuf = ktest_user_buf(test, SZ_1M);
+    KUNIT_ASSERT_EQ(test, store_write(ubuf, SZ_1M, &pos), (ssize_t)SZ_1M);
+    ktest_bench(test, "SEEK_HOLE 1M", store_llseek(file, base, SEEK_HOLE));
+    store_punch(test, base, SZ_1M);
+}
+
+static struct kunit_case hello_bench_cases[] = {
+    KUNIT_CASE_SLOW(hello_rw_bench),
+    KUNIT_CASE_SLOW(store_seek_bench),
+    {}
+};
+
+static struct kunit_suite hello_bench_suite = {
+    .name = "hello_cdev_bench",
+    .test_cases = hello_bench_cases,
+};
+
+kunit_test_suites(&hello_suite, &hello_bench_suite);
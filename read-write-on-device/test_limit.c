@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "hello_cdev_ioctl.h"
+
+#define DEVICE_PATH "/dev/hello_cdev"
+#define NOISY_IO    (64 << 10)
+#define PRIO_IO     4096
+#define MAX_SAMPLES 1000000
+
+/*
+ * Usage: ./test_limit [device] [noisy_MiB_per_s] [seconds]
+ * Needs the module loaded with sparse=1.
+ * Checks that an O_NONBLOCK file over its ops limit gets EAGAIN, then runs
+ * a "noisy" opener writing 64 KiB blocks as fast as it can under a byte
+ * limit (default 200 MiB/s; 0 = unlimited) next to a "priority" opener
+ * doing one 4 KiB write per millisecond without limits. Prints the noisy
+ * rate, its throttle counters and the priority writes' latency percentiles.
+ * Run with 0 and with a limit to compare the priority tail.
+ */
+
+static const char *dev;
+static int seconds;
+static volatile int stop;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int open_dev(int flags)
+{
+    int fd = open(dev, O_RDWR | flags);
+
+    if (fd < 0) {
+        perror(dev);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+struct noisy {
+    uint64_t limit;         // bytes per second
+    uint64_t bytes;
+    struct hello_throttle t;
+};
+
+static void *noisy_thread(void *arg)
+{
+    struct noisy *n = arg;
+    struct hello_limit lim = { .bytes_per_sec = n->limit };
+    static char buf[NOISY_IO];
+    off_t off = 0;
+    ssize_t r;
+    int fd = open_dev(0);
+
+    if (ioctl(fd, HELLO_SET_LIMIT, &lim) < 0)
+        perror("HELLO_SET_LIMIT");
+    memset(buf, 0xa5, sizeof(buf));
+    while (!stop) {
+        r = pwrite(fd, buf, sizeof(buf), off);
+        if (r <= 0)
+            break;
+        n->bytes += r;
+        off = (off + r) % (256 << 20);  // the first 256 MiB of the store
+    }
+    ioctl(fd, HELLO_GET_THROTTLE, &n->t);
+    close(fd);
+    return NULL;
+}
+
+static int check_nonblock(void)
+{
+    struct hello_limit lim = { .ops_per_sec = 1, .ops_burst = 1 };
+    struct hello_throttle t;
+    char c = 0;
+    int fd = open_dev(O_NONBLOCK), ok;
+
+    if (ioctl(fd, HELLO_SET_LIMIT, &lim) < 0) {
+        perror("HELLO_SET_LIMIT");
+        return 0;
+    }
+    ok = pwrite(fd, &c, 1, 1u << 30) == 1;
+    ok &= pwrite(fd, &c, 1, 1u << 30) < 0 && errno == EAGAIN;
+    ok &= !ioctl(fd, HELLO_GET_THROTTLE, &t) && t.calls == 1 && t.rejected == 1;
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint64_t lat[MAX_SAMPLES];
+    static char buf[PRIO_IO];
+    struct noisy noisy = { 0 };
+    uint64_t t0, start, end;
+    const char *limit;
+    size_t n = 0;
+    pthread_t th;
+    int fd;
+
+    dev = argc > 1 ? argv[1] : DEVICE_PATH;
+    limit = argc > 2 ? argv[2] : "200";
+    noisy.limit = (uint64_t)(atof(limit) * (1 << 20));
+    seconds = argc > 3 ? atoi(argv[3]) : 5;
+
+    printf("non-blocking over the limit gets EAGAIN: %s\n", check_nonblock() ? "yes" : "NO");
+
+    fd = open_dev(0);
+    pthread_create(&th, NULL, noisy_thread, &noisy);
+    start = now_ns();
+    end = start + (uint64_t)seconds * 1000000000ull;
+    while ((t0 = now_ns()) < end && n < MAX_SAMPLES) {
+        if (pwrite(fd, buf, sizeof(buf), 512u << 20) != sizeof(buf)) {
+            perror("pwrite");
+            break;
+        }
+        lat[n++] = now_ns() - t0;
+        usleep(1000);
+    }
+    stop = 1;
+    pthread_join(th, NULL);
+    close(fd);
+
+    printf("noisy: %.1f MiB/s (limit %s MiB/s), %llu of %llu writes waited, %.3f ms max\n",
+           noisy.bytes / ((now_ns() - start) / 1e9) / (1 << 20),
+           noisy.limit ? limit : "none",
+           (unsigned long long)noisy.t.throttled, (unsigned long long)noisy.t.calls,
+           noisy.t.max_wait_ns / 1e6);
+    if (!n)
+        return EXIT_FAILURE;
+    qsort(lat, n, sizeof(lat[0]), cmp_u64);
+    printf("priority: %zu writes, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", n,
+           lat[n / 2] / 1e3, lat[n * 99 / 100] / 1e3, lat[n * 999 / 1000] / 1e3,
+           lat[n - 1] / 1e3);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "hello_cdev_ioctl.h"
+
+#define DEVICE_PATH "/dev/hello_cdev"
+#define FAR         (1ll << 30)     // 1 GiB into the store
+#define BLOCK       4096
+
+/*
+ * Usage: ./test_store [device] [threads] [seconds]
+ * Needs the module loaded with sparse=1 (store_mb >= 2048).
+ * Checks holes, SEEK_DATA/SEEK_HOLE and HELLO_DISCARD, then runs one
+ * pwrite+pread loop per thread, each on its own pages, and prints the rate.
+ */
+
+static const char *dev;
+static int seconds;
+static volatile int stop;
+
+static void print_extents(int fd)
+{
+    off_t data = 0, hole;
+
+    printf("extents:");
+    while ((data = lseek(fd, data, SEEK_DATA)) >= 0) {
+        hole = lseek(fd, data, SEEK_HOLE);
+        printf(" [%lld, %lld)", (long long)data, (long long)hole);
+        data = hole;
+    }
+    printf("%s\n", errno == ENXIO ? "" : " (lseek failed)");
+}
+
+static int is_zero(const char *buf, size_t len)
+{
+    while (len--)
+        if (*buf++)
+            return 0;
+    return 1;
+}
+
+static void *worker(void *arg)
+{
+    long id = (long)arg, ops = 0;
+    char buf[BLOCK];
+    off_t pos;
+    int fd = open(dev, O_RDWR);
+
+    if (fd < 0)
+        return (void *)-1l;
+    memset(buf, id + 1, sizeof(buf));
+    while (!stop) {
+        // 256 pages of its own per thread, so no two threads share a page lock
+        pos = (off_t)(id * 256 + ops % 256) * BLOCK;
+        if (pwrite(fd, buf, BLOCK, pos) != BLOCK || pread(fd, buf, BLOCK, pos) != BLOCK)
+            break;
+        ops++;
+    }
+    close(fd);
+    return (void *)ops;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    struct hello_range range;
+    char buf[64];
+    pthread_t *tid;
+    long total = 0;
+    void *ret;
+    int fd, i;
+
+    dev = argc > 1 ? argv[1] : DEVICE_PATH;
+    seconds = argc > 3 ? atoi(argv[3]) : 2;
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return 1;
+    }
+
+    if (pwrite(fd, "hello", 5, 0) != 5 || pwrite(fd, "far away", 8, FAR + 100) != 8) {
+        perror("pwrite");
+        return 1;
+    }
+    print_extents(fd);
+
+    pread(fd, buf, 8, FAR + 100);
+    printf("at 1 GiB + 100: %.8s\n", buf);
+    pread(fd, buf, sizeof(buf), FAR / 2);
+    printf("hole reads as zeros: %s\n", is_zero(buf, sizeof(buf)) ? "yes" : "NO");
+
+    range.offset = FAR;
+    range.len = BLOCK;
+    if (ioctl(fd, HELLO_DISCARD, &range)) {
+        perror("HELLO_DISCARD");
+        return 1;
+    }
+    pread(fd, buf, 8, FAR + 100);
+    printf("after discard: %s\n", is_zero(buf, 8) ? "zeros" : "STILL DATA");
+    print_extents(fd);
+
+    tid = calloc(threads, sizeof(*tid));
+    for (i = 0; i < threads; i++)
+        pthread_create(&tid[i], NULL, worker, (void *)(long)i);
+    sleep(seconds);
+    stop = 1;
+    for (i = 0; i < threads; i++) {
+        pthread_join(tid[i], &ret);
+        total += (long)ret;
+    }
+    printf("%d threads: %.0f pwrite+pread pairs/s\n", threads, (double)total / seconds);
+
+    range.offset = 0;
+    range.len = (uint64_t)threads * 256 * BLOCK;
+    ioctl(fd, HELLO_DISCARD, &range);
+    close(fd);
+    return 0;
+}